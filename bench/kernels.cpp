@@ -0,0 +1,1039 @@
+//
+//  kernels.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+//  Micro-benchmarks for the llcv_* kernels and the generated models, at the sizes
+//  the pipeline actually uses. Each kernel is timed once per backend available in
+//  this build (scalar, OpenCV, SIMD), and every backend's output is checked against
+//  the first backend's, in the spirit of the TEST_*_NEON blocks.
+//  Output is CSV, one row per kernel/size/backend, for regression tracking.
+//  Build with `fab bench`; see bench/README.md.
+//
+
+// The whole dmz is one translation unit (see dmz_all.cpp), which also gives the
+// benchmark access to the DMZ_INTERNAL kernels and their per-backend variants.
+// DMZ_BENCH compiles in the reference kernels that only the checks here use.
+#define DMZ_BENCH 1
+#include "dmz_all.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#define kBenchSamples 7
+#define kBenchExact 0.0
+#define kBenchInformational -1.0 // report differences, but don't fail on them
+
+
+#pragma mark harness
+
+typedef void (*bench_fn)(void *context);
+
+typedef struct {
+  double min_sample_ms;
+  const char *filter;
+  int n_failures;
+} bench_options;
+
+static bench_options options;
+static volatile float bench_sink; // keeps scalar results alive
+
+static uint64_t bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool bench_selected(const char *kernel) {
+  return options.filter == NULL || strstr(kernel, options.filter) != NULL;
+}
+
+// Picks a call count that makes each sample last at least min_sample_ms,
+// then reports the median and fastest time per call across kBenchSamples samples.
+static void bench_time(bench_fn fn, void *context, uint32_t *calls, double *median_ns, double *min_ns) {
+  uint32_t n_calls = 1;
+  for(;;) {
+    uint64_t start = bench_now_ns();
+    for(uint32_t call = 0; call < n_calls; call++) {
+      fn(context);
+    }
+    double elapsed_ms = (bench_now_ns() - start) / 1e6;
+    if(elapsed_ms >= options.min_sample_ms || n_calls >= (1u << 24)) {
+      break;
+    }
+    n_calls = elapsed_ms <= 0.0 ? n_calls * 16 : MAX(n_calls * 2, (uint32_t)(n_calls * 1.2 * options.min_sample_ms / elapsed_ms));
+  }
+
+  double samples[kBenchSamples];
+  for(int sample = 0; sample < kBenchSamples; sample++) {
+    uint64_t start = bench_now_ns();
+    for(uint32_t call = 0; call < n_calls; call++) {
+      fn(context);
+    }
+    samples[sample] = (double)(bench_now_ns() - start) / n_calls;
+  }
+  std::sort(samples, samples + kBenchSamples);
+  *calls = n_calls;
+  *median_ns = samples[kBenchSamples / 2];
+  *min_ns = samples[0];
+}
+
+static double bench_pixel(const IplImage *image, int row, int col, int channel) {
+  const char *row_data = image->imageData + row * image->widthStep;
+  int index = col * image->nChannels + channel;
+  if(image->depth == (int)IPL_DEPTH_16S) {
+    return ((const int16_t *)row_data)[index];
+  } else if(image->depth == IPL_DEPTH_32F) {
+    return ((const float *)row_data)[index];
+  }
+  assert(image->depth == IPL_DEPTH_8U);
+  return ((const uint8_t *)row_data)[index];
+}
+
+// Largest absolute difference, and the number of pixels that differ at all.
+static void bench_compare(const IplImage *a, const IplImage *b, double *max_abs_diff, int *n_mismatches) {
+  assert(a->width == b->width && a->height == b->height);
+  assert(a->depth == b->depth && a->nChannels == b->nChannels);
+  *max_abs_diff = 0.0;
+  *n_mismatches = 0;
+  for(int row = 0; row < a->height; row++) {
+    for(int col = 0; col < a->width; col++) {
+      bool mismatch = false;
+      for(int channel = 0; channel < a->nChannels; channel++) {
+        double diff = fabs(bench_pixel(a, row, col, channel) - bench_pixel(b, row, col, channel));
+        *max_abs_diff = MAX(*max_abs_diff, diff);
+        mismatch = mismatch || diff > 0.0;
+      }
+      *n_mismatches += mismatch;
+    }
+  }
+}
+
+// Times one backend and prints its row. If reference is given, output (which fn
+// writes) is checked against it; a difference above tolerance is a failure.
+static void bench_report(const char *kernel, CvSize size, const char *backend, bench_fn fn, void *context,
+                         const IplImage *output, const IplImage *reference, double tolerance) {
+  fn(context); // warm up, and produce output for the check
+  double max_abs_diff = 0.0;
+  int n_mismatches = 0;
+  const char *status = "-";
+  if(reference != NULL && output != NULL && output != reference) {
+    bench_compare(output, reference, &max_abs_diff, &n_mismatches);
+    if(tolerance < 0.0) {
+      status = "info";
+    } else if(max_abs_diff > tolerance) {
+      status = "FAIL";
+      options.n_failures++;
+    } else {
+      status = "ok";
+    }
+  }
+
+  uint32_t calls;
+  double median_ns, min_ns;
+  bench_time(fn, context, &calls, &median_ns, &min_ns);
+  printf("%s,%dx%d,%s,%u,%.0f,%.0f,%g,%d,%s\n", kernel, size.width, size.height, backend,
+         calls, median_ns, min_ns, max_abs_diff, n_mismatches, status);
+  fflush(stdout);
+}
+
+// Scalar results: the difference is reported relative to the reference.
+static void bench_report_scalar(const char *kernel, CvSize size, const char *backend, bench_fn fn, void *context,
+                                const float *output, const float *reference, double tolerance) {
+  fn(context);
+  double relative_diff = 0.0;
+  const char *status = "-";
+  if(reference != NULL && output != reference) {
+    relative_diff = fabs((double)*output - *reference) / MAX(fabs((double)*reference), 1e-9);
+    status = relative_diff > tolerance ? "FAIL" : "ok";
+    options.n_failures += relative_diff > tolerance;
+  }
+
+  uint32_t calls;
+  double median_ns, min_ns;
+  bench_time(fn, context, &calls, &median_ns, &min_ns);
+  printf("%s,%dx%d,%s,%u,%.0f,%.0f,%g,%d,%s\n", kernel, size.width, size.height, backend,
+         calls, median_ns, min_ns, relative_diff, relative_diff > 0.0, status);
+  fflush(stdout);
+}
+
+static const char *bench_c_neon_backend(void) {
+  return dmz_has_neon_runtime() ? "neon" : "c";
+}
+
+// The dispatchers prefer NEON, so a DMZ_NEON_2_SSE build runs its NEON rows even on x86.
+static const char *bench_simd_backend(void) {
+#if DMZ_HAS_NEON_COMPILETIME
+  return dmz_has_neon_runtime() ? "neon" : "c";
+#elif DMZ_HAS_AVX2_COMPILETIME
+  return "avx2";
+#elif DMZ_HAS_SSE2_COMPILETIME
+  return "sse2";
+#else
+  return "c";
+#endif
+}
+
+
+#pragma mark inputs
+
+static uint32_t bench_random_state = 12345;
+
+static uint8_t bench_random_u8(void) {
+  bench_random_state = bench_random_state * 1103515245 + 12345;
+  return (uint8_t)(bench_random_state >> 16);
+}
+
+// A noisy, card-like scene: a bright rectangle on a darker background, so that
+// edge detection, Canny and Hough have real work to do.
+static IplImage *bench_create_scene(CvSize size, int channels) {
+  IplImage *image = cvCreateImage(size, IPL_DEPTH_8U, channels);
+  int inset_x = size.width / 8;
+  int inset_y = size.height / 8;
+  for(int row = 0; row < size.height; row++) {
+    uint8_t *row_data = (uint8_t *)image->imageData + row * image->widthStep;
+    for(int col = 0; col < size.width * channels; col++) {
+      int x = col / channels;
+      bool inside = x >= inset_x && x < size.width - inset_x && row >= inset_y && row < size.height - inset_y;
+      int value = (inside ? 170 : 60) + (x * 3 + row) % 23 + (bench_random_u8() & 15);
+      row_data[col] = (uint8_t)MIN(value, 255);
+    }
+  }
+  return image;
+}
+
+static IplImage *bench_create_like(const IplImage *image, int depth, int channels) {
+  return cvCreateImage(cvGetSize(image), depth, channels);
+}
+
+typedef struct {
+  dmz_context *dmz;
+  IplImage *src;
+  IplImage *src2;
+  IplImage *src3;
+  IplImage *pristine;
+  IplImage *scratch;
+  IplImage *dx;
+  IplImage *dy;
+  IplImage *dst;
+  float result;
+  CvRect rect;
+  dmz_point src_points[4];
+  dmz_rect dst_rect;
+} bench_context;
+
+static void bench_context_init(bench_context *context) {
+  memset(context, 0, sizeof(*context));
+}
+
+static void bench_context_release(bench_context *context) {
+  IplImage **images[] = {&context->src, &context->src2, &context->src3, &context->pristine,
+                         &context->scratch, &context->dx, &context->dy, &context->dst};
+  for(size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+    if(*images[i] != NULL) {
+      cvReleaseImage(images[i]);
+    }
+  }
+}
+
+
+#pragma mark backends
+
+static void bench_sobel7_dx_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 1, 0, 7);
+}
+
+static void bench_sobel7_dy_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 0, 1, 7);
+}
+
+static void bench_sobel7_dx_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel7_dx_dy_rows(c->src, c->dst, NULL, c->scratch, false);
+}
+
+static void bench_sobel7_dx_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel7_dx_dy(c->src, c->dst, NULL, c->scratch);
+}
+
+static void bench_sobel7_dy_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel7_dx_dy_rows(c->src, NULL, c->dst, c->scratch, false);
+}
+
+static void bench_sobel7_dy_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel7_dx_dy(c->src, NULL, c->dst, c->scratch);
+}
+
+static void bench_sobel7_dx_dy_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 1, 0, 7);
+  cvSobel(c->src, c->dy, 0, 1, 7);
+}
+
+static void bench_sobel7_dx_dy_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel7_dx_dy(c->src, c->dst, c->dy, c->scratch);
+}
+
+static void bench_scharr3_dx_abs_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 1, 0, CV_SCHARR);
+  cvAbs(c->dst, c->dst);
+}
+
+static void bench_scharr3_dx_abs_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_scharr3_dx_abs_c_neon(c->src, c->dst);
+}
+
+static void bench_scharr3_dy_abs_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 0, 1, CV_SCHARR);
+  cvAbs(c->dst, c->dst);
+}
+
+static void bench_scharr3_dy_abs_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_scharr3_dy_abs_c_neon(c->src, c->dst);
+}
+
+static void bench_sobel3_dx_dy_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSobel(c->src, c->dst, 1, 1, 3);
+}
+
+static void bench_sobel3_dx_dy_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_sobel3_dx_dy_c_neon(c->src, c->dst);
+}
+
+#define kBenchCannyLowThreshold 3000.0
+#define kBenchCannyHighThreshold 6000.0
+
+static void bench_canny7_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvCanny(c->src, c->dst, kBenchCannyLowThreshold, kBenchCannyHighThreshold, 7);
+}
+
+static void bench_canny7_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_canny7(c->src, c->dst, kBenchCannyLowThreshold, kBenchCannyHighThreshold);
+}
+
+static void bench_canny7_precomputed_sobel_copy(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_canny7_precomputed_sobel_opencv(c->src, c->dst, c->dx, c->dy, kBenchCannyLowThreshold, kBenchCannyHighThreshold);
+}
+
+static void bench_canny7_precomputed_sobel_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_canny7_precomputed_sobel_rows(c->src, c->dst, c->dx, c->dy, kBenchCannyLowThreshold, kBenchCannyHighThreshold, c->scratch, false);
+}
+
+static void bench_canny7_precomputed_sobel_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_canny7_precomputed_sobel(c->src, c->dst, c->dx, c->dy, kBenchCannyLowThreshold, kBenchCannyHighThreshold, c->scratch);
+}
+
+static void bench_adaptive_canny7_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_adaptive_canny7_precomputed_sobel(c->src, c->dst, c->dx, c->dy, c->scratch);
+}
+
+static void bench_hough_llcv(void *context) {
+  bench_context *c = (bench_context *)context;
+  CvSize size = cvGetSize(c->src);
+  bool vertical = size.height > size.width;
+  float base_angle = vertical ? kVerticalAngle : kHorizontalAngle;
+  CvLinePolar line = llcv_hough(c->src2, c->dx, c->dy, 1, (float)CV_PI / 180.0f,
+                                MAX(size.width, size.height) / kHoughThresholdLengthDivisor,
+                                base_angle - kMaxAngleDeviationAllowed, base_angle + kMaxAngleDeviationAllowed,
+                                vertical, kHoughGradientAngleThreshold);
+  bench_sink = line.rho;
+}
+
+// Also the 1d gradient, for a single row.
+static void bench_morph_grad3_2d_cross_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  IplConvKernel *kernel = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_CROSS, NULL);
+  cvMorphologyEx(c->src, c->dst, NULL, kernel, CV_MOP_GRADIENT, 1);
+  cvReleaseStructuringElement(&kernel);
+}
+
+// A single row is its own north and south.
+static void bench_morph_grad3_1d_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  const uint8_t *row = (const uint8_t *)llcv_get_data_origin(c->src);
+  llcv_morph_grad3_cross_row_u8(row, row, row, (uint8_t *)llcv_get_data_origin(c->dst), (uint16_t)cvGetSize(c->src).width);
+}
+
+static void bench_morph_grad3_2d_cross_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_morph_grad3_2d_cross_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->dst));
+}
+
+// What vseg did per row before the three were fused (as the unfused kernels did it without NEON):
+// gradient into scratch, downsample into src2, normalize.
+static void bench_grad3_lineardown2_norm_separate(void *context) {
+  bench_context *c = (bench_context *)context;
+  const uint8_t *row = (const uint8_t *)llcv_get_data_origin(c->src);
+  llcv_morph_grad3_cross_row_u8(row, row, row, (uint8_t *)llcv_get_data_origin(c->scratch), (uint16_t)cvGetSize(c->src).width);
+  cvResize(c->scratch, c->src2, CV_INTER_LINEAR);
+  cvConvertScale(c->src2, c->dst, 1.0f / 255.0f, 0);
+  cvNormalize(c->dst, c->dst, 0.0f, 1.0f, CV_MINMAX, NULL);
+}
+
+static void bench_grad3_lineardown2_norm_fused(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32(llcv_view_of_image(c->src), (float *)llcv_get_data_origin(c->dst));
+}
+
+#if SCAN_EXPIRY
+static void bench_equalize_hist_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvEqualizeHist(c->src, c->dst);
+}
+
+static void bench_equalize_hist_small(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_equalize_hist_small(llcv_view_of_image(c->src), llcv_view_of_image(c->dst));
+}
+#endif
+
+// What the digit categorizer did before the conversion was fused in: equalize into scratch, then convert.
+static void bench_equalize_hist_to_f32_separate(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvEqualizeHist(c->src, c->scratch);
+  cvConvertScale(c->scratch, c->dst, 1.0f / 255.0f, 0);
+}
+
+static void bench_equalize_hist_small_to_f32(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_equalize_hist_small_to_f32(llcv_view_of_image(c->src), llcv_view_of_image(c->dst));
+}
+
+// llcv_stddev_of_abs_c takes the absolute value in place, so every call starts from a fresh copy.
+static void bench_stddev_of_abs_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvCopy(c->pristine, c->src);
+  c->result = llcv_stddev_of_abs_c(c->src);
+}
+
+#if DMZ_HAS_NEON_COMPILETIME
+static void bench_stddev_of_abs_neon(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvCopy(c->pristine, c->src);
+  c->result = llcv_stddev_of_abs_neon(c->src);
+}
+#endif
+
+static void bench_frame_quality_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_frame_quality_sums sums;
+  llcv_frame_quality_sums_for_rect(c->src, c->rect, true, false, &sums);
+  c->result = (float)sums.sum_squared_dx_dy;
+}
+
+static void bench_frame_quality_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_frame_quality_sums sums;
+  llcv_frame_quality_sums_for_rect(c->src, c->rect, true, true, &sums);
+  c->result = (float)sums.sum_squared_dx_dy;
+}
+
+static void bench_split_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvSplit(c->src, c->dst, c->scratch, NULL, NULL);
+}
+
+static void bench_split_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_split_u8_c(c->src, c->dst, c->scratch);
+}
+
+#if DMZ_HAS_NEON_COMPILETIME
+static void bench_split_neon(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_split_u8_neon(c->src, c->dst, c->scratch);
+}
+#endif
+
+static void bench_YCbCr2RGB_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvMerge(c->src, c->src3, c->src2, NULL, c->scratch);
+  cvCvtColor(c->scratch, c->dst, CV_YCrCb2RGB);
+}
+
+static void bench_YCbCr2RGB_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_YCbCr2RGB_u8_c(c->src, c->src2, c->src3, c->dst);
+}
+
+static void bench_YCbCr2RGB_half_chroma_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_YCbCr2RGB_half_chroma_u8_rows(c->src, c->src2, c->src3, c->dst, false);
+}
+
+static void bench_YCbCr2RGB_half_chroma_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_YCbCr2RGB_half_chroma_u8_rows(c->src, c->src2, c->src3, c->dst, true);
+}
+
+static void bench_area_down2_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  cvResize(c->src, c->dst, CV_INTER_AREA);
+}
+
+static void bench_area_down2_c(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_view src = llcv_view_of_image(c->src);
+  llcv_view dst = llcv_view_of_image(c->dst);
+  for(uint16_t row_index = 0; row_index < dst.height; row_index++) {
+    llcv_area_down2_row_c(llcv_view_row(src, 2 * row_index), llcv_view_row(src, 2 * row_index + 1), llcv_view_row(dst, row_index), 0, dst.width);
+  }
+}
+
+static void bench_area_down2_simd(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_area_down2_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->dst));
+}
+
+static void bench_area_down2_morph_grad3_cross_separate(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_area_down2_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->src2));
+  llcv_morph_grad3_2d_cross_u8(llcv_view_of_image(c->src2), llcv_view_of_image(c->dst));
+}
+
+static void bench_area_down2_morph_grad3_cross_fused(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_area_down2_morph_grad3_2d_cross_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->dst), (uint8_t *)c->scratch->imageData);
+}
+
+// src and src2 (the gradient of all of src) both have the window's roi
+static void bench_morph_grad3_2d_cross_crop(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_morph_grad3_2d_cross_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->dst));
+}
+
+static void bench_morph_grad3_2d_cross_window(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_morph_grad3_2d_cross_window_u8(llcv_view_of_image(c->src), llcv_view_of_image(c->src2), llcv_view_of_image(c->dst));
+}
+
+static void bench_detect_edges_dmz(void *context) {
+  bench_context *c = (bench_context *)context;
+  dmz_edges found_edges;
+  dmz_corner_points corner_points;
+  bench_sink = dmz_detect_edges(c->src, c->src2, c->src3, FrameOrientationPortrait, &found_edges, &corner_points);
+}
+
+static void bench_unwarp_opencv(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_unwarp(c->dmz, c->src, c->src_points, c->dst_rect, c->dst);
+}
+
+static void bench_unwarp_plane(void *context) {
+  bench_context *c = (bench_context *)context;
+  llcv_unwarp_plane(c->dmz, c->src, c->src_points, c->dst_rect, c->scratch);
+}
+
+
+#pragma mark kernels
+
+static void bench_sobel7(CvSize size) {
+  if(!bench_selected("llcv_sobel7")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.scratch = cvCreateImage(cvSize(size.width + 6, 2), IPL_DEPTH_16S, 1);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  c.dy = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  IplImage *reference = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+
+  bench_sobel7_dx_opencv(&c);
+  cvCopy(c.dst, reference);
+  bench_report("llcv_sobel7_dx", size, "opencv", bench_sobel7_dx_opencv, &c, NULL, NULL, kBenchExact);
+  bench_report("llcv_sobel7_dx", size, "c", bench_sobel7_dx_c, &c, c.dst, reference, kBenchExact);
+  bench_report("llcv_sobel7_dx", size, bench_simd_backend(), bench_sobel7_dx_simd, &c, c.dst, reference, kBenchExact);
+
+  // dx and dy together, from one vertical pass (dy is checked above and below on its own)
+  bench_report("llcv_sobel7_dx_dy", size, "opencv", bench_sobel7_dx_dy_opencv, &c, NULL, NULL, kBenchExact);
+  bench_report("llcv_sobel7_dx_dy", size, bench_simd_backend(), bench_sobel7_dx_dy_simd, &c, c.dst, reference, kBenchExact);
+
+  bench_sobel7_dy_opencv(&c);
+  cvCopy(c.dst, reference);
+  bench_report("llcv_sobel7_dy", size, "opencv", bench_sobel7_dy_opencv, &c, NULL, NULL, kBenchExact);
+  bench_report("llcv_sobel7_dy", size, "c", bench_sobel7_dy_c, &c, c.dst, reference, kBenchExact);
+  bench_report("llcv_sobel7_dy", size, bench_simd_backend(), bench_sobel7_dy_simd, &c, c.dst, reference, kBenchExact);
+  cvReleaseImage(&reference);
+
+  // within an roi, as dmz's line finding uses it; the border comes from around the roi, except with NEON
+  double roi_tolerance = dmz_has_neon_runtime() ? kBenchInformational : kBenchExact;
+  CvSize roi_size = cvSize(size.width - 9, size.height - 4);
+  cvSetImageROI(c.src, cvRect(5, 2, roi_size.width, roi_size.height));
+  cvReleaseImage(&c.dst);
+  cvReleaseImage(&c.dy);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  c.dy = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  IplImage *roi_reference = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  IplImage *roi_dy_reference = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  bench_sobel7_dx_dy_opencv(&c);
+  cvCopy(c.dst, roi_reference);
+  cvCopy(c.dy, roi_dy_reference);
+  bench_report("llcv_sobel7_dx_roi", roi_size, "c", bench_sobel7_dx_c, &c, c.dst, roi_reference, roi_tolerance);
+  bench_report("llcv_sobel7_dx_dy_roi", roi_size, bench_simd_backend(), bench_sobel7_dx_dy_simd, &c, c.dst, roi_reference, roi_tolerance);
+  bench_report("llcv_sobel7_dy_roi", roi_size, bench_simd_backend(), bench_sobel7_dy_simd, &c, c.dst, roi_dy_reference, roi_tolerance);
+  cvReleaseImage(&roi_reference);
+  cvReleaseImage(&roi_dy_reference);
+
+  bench_context_release(&c);
+}
+
+// Runs reference_fn once into a copy, then reports both backends, checking llcv_fn against it.
+static void bench_pair(const char *kernel, bench_context *c, const char *reference_backend, bench_fn reference_fn,
+                       const char *llcv_backend, bench_fn llcv_fn, double tolerance) {
+  reference_fn(c);
+  IplImage *reference = cvCloneImage(c->dst);
+  bench_report(kernel, cvGetSize(c->src), reference_backend, reference_fn, c, NULL, NULL, tolerance);
+  bench_report(kernel, cvGetSize(c->src), llcv_backend, llcv_fn, c, c->dst, reference, tolerance);
+  cvReleaseImage(&reference);
+}
+
+static void bench_gradients(CvSize size) {
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  if(bench_selected("llcv_scharr3_dx_abs")) {
+    bench_pair("llcv_scharr3_dx_abs", &c, "opencv", bench_scharr3_dx_abs_opencv,
+               bench_c_neon_backend(), bench_scharr3_dx_abs_llcv, kBenchExact);
+  }
+  if(bench_selected("llcv_scharr3_dy_abs")) {
+    bench_pair("llcv_scharr3_dy_abs", &c, "opencv", bench_scharr3_dy_abs_opencv,
+               bench_c_neon_backend(), bench_scharr3_dy_abs_llcv, kBenchExact);
+  }
+  if(bench_selected("llcv_sobel3_dx_dy")) {
+    bench_pair("llcv_sobel3_dx_dy", &c, "opencv", bench_sobel3_dx_dy_opencv,
+               bench_c_neon_backend(), bench_sobel3_dx_dy_llcv, kBenchExact);
+  }
+  bench_context_release(&c);
+}
+
+static void bench_canny_hough(CvSize size) {
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+  c.dx = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  c.dy = bench_create_like(c.src, IPL_DEPTH_16S, 1);
+  llcv_sobel7_dx_dy(c.src, c.dx, c.dy, NULL);
+  llcv_canny7_reserve_scratch(&c.scratch, size);
+
+  // llcv_canny7 started as a modified copy of cvCanny, so differences are expected and only reported
+  if(bench_selected("llcv_canny7")) {
+    bench_pair("llcv_canny7", &c, "opencv", bench_canny7_opencv, "llcv", bench_canny7_llcv, kBenchInformational);
+  }
+  // ...but must match that copy exactly
+  if(bench_selected("llcv_canny7_precomputed_sobel")) {
+    bench_pair("llcv_canny7_precomputed_sobel", &c, "copy", bench_canny7_precomputed_sobel_copy,
+               "c", bench_canny7_precomputed_sobel_c, kBenchExact);
+    bench_pair("llcv_canny7_precomputed_sobel", &c, "copy", bench_canny7_precomputed_sobel_copy,
+               bench_simd_backend(), bench_canny7_precomputed_sobel_simd, kBenchExact);
+  }
+  if(bench_selected("llcv_adaptive_canny7_precomputed_sobel")) {
+    bench_report("llcv_adaptive_canny7_precomputed_sobel", size, "llcv", bench_adaptive_canny7_llcv, &c, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("llcv_hough")) {
+    c.src2 = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+    llcv_adaptive_canny7_precomputed_sobel(c.src, c.src2, c.dx, c.dy, NULL);
+    bench_report("llcv_hough", size, "llcv", bench_hough_llcv, &c, NULL, NULL, kBenchExact);
+  }
+  bench_context_release(&c);
+}
+
+static void bench_vseg_row(void) {
+  bench_context c;
+  bench_context_init(&c);
+  if(bench_selected("llcv_morph_grad3_cross_row_u8")) {
+    c.src = bench_create_scene(cvSize(408, 1), 1);
+    c.dst = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+    bench_pair("llcv_morph_grad3_cross_row_u8", &c, "opencv", bench_morph_grad3_2d_cross_opencv, bench_simd_backend(),
+               bench_morph_grad3_1d_simd, kBenchExact);
+    bench_context_release(&c);
+    bench_context_init(&c);
+  }
+  if(bench_selected("llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32")) {
+    c.src = bench_create_scene(cvSize(408, 1), 1);
+    c.scratch = cvCreateImage(cvSize(408, 1), IPL_DEPTH_8U, 1);
+    c.src2 = cvCreateImage(cvSize(204, 1), IPL_DEPTH_8U, 1);
+    c.dst = cvCreateImage(cvSize(204, 1), IPL_DEPTH_32F, 1);
+    bench_pair("llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32", &c, "separate", bench_grad3_lineardown2_norm_separate,
+               bench_simd_backend(), bench_grad3_lineardown2_norm_fused, 1e-5);
+  }
+  bench_context_release(&c);
+}
+
+static void bench_morph_equalize(CvSize size) {
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+  if(bench_selected("llcv_morph_grad3_2d_cross_u8")) {
+    bench_pair("llcv_morph_grad3_2d_cross_u8", &c, "opencv", bench_morph_grad3_2d_cross_opencv,
+               bench_simd_backend(), bench_morph_grad3_2d_cross_simd, kBenchExact);
+  }
+#if SCAN_EXPIRY
+  if(bench_selected("llcv_equalize_hist_small")) {
+    bench_pair("llcv_equalize_hist_small", &c, "opencv", bench_equalize_hist_opencv, bench_simd_backend(),
+               bench_equalize_hist_small, kBenchExact);
+  }
+#endif
+  if(bench_selected("llcv_equalize_hist_small_to_f32")) {
+    cvReleaseImage(&c.dst);
+    c.dst = bench_create_like(c.src, IPL_DEPTH_32F, 1);
+    c.scratch = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+    bench_pair("llcv_equalize_hist_small_to_f32", &c, "separate", bench_equalize_hist_to_f32_separate, bench_simd_backend(),
+               bench_equalize_hist_small_to_f32, kBenchExact);
+  }
+  bench_context_release(&c);
+}
+
+static void bench_stats(CvSize size) {
+  bench_context c;
+  bench_context_init(&c);
+  IplImage *scene = bench_create_scene(size, 1);
+  if(bench_selected("llcv_stddev_of_abs")) {
+    c.pristine = bench_create_like(scene, IPL_DEPTH_16S, 1);
+    c.src = bench_create_like(scene, IPL_DEPTH_16S, 1);
+    llcv_sobel3_dx_dy(scene, c.pristine);
+    bench_stddev_of_abs_c(&c);
+#if DMZ_HAS_NEON_COMPILETIME
+    float reference = c.result;
+#endif
+    bench_report_scalar("llcv_stddev_of_abs", size, "c", bench_stddev_of_abs_c, &c, NULL, NULL, kBenchExact);
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      bench_report_scalar("llcv_stddev_of_abs", size, "neon", bench_stddev_of_abs_neon, &c, &c.result, &reference, 1e-3);
+    }
+#endif
+    bench_context_release(&c);
+    bench_context_init(&c);
+  }
+  if(bench_selected("llcv_frame_quality")) {
+    c.src = cvCloneImage(scene);
+    c.rect = cvRect(0, 0, size.width, size.height);
+    bench_frame_quality_c(&c);
+    float reference = c.result;
+    bench_report_scalar("llcv_frame_quality", size, "c", bench_frame_quality_c, &c, NULL, NULL, kBenchExact);
+    bench_report_scalar("llcv_frame_quality", size, bench_simd_backend(), bench_frame_quality_simd, &c, &c.result, &reference, kBenchExact);
+  }
+  cvReleaseImage(&scene);
+  bench_context_release(&c);
+}
+
+static void bench_split(CvSize size) {
+  if(!bench_selected("llcv_split_u8")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 2);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+  c.scratch = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+  bench_pair("llcv_split_u8", &c, "opencv", bench_split_opencv, "c", bench_split_c, kBenchExact);
+#if DMZ_HAS_NEON_COMPILETIME
+  if(dmz_has_neon_runtime()) {
+    bench_split_c(&c);
+    IplImage *reference = cvCloneImage(c.dst);
+    bench_report("llcv_split_u8", size, "neon", bench_split_neon, &c, c.dst, reference, kBenchExact);
+    cvReleaseImage(&reference);
+  }
+#endif
+  bench_context_release(&c);
+}
+
+static void bench_area_down2(CvSize size) {
+  if(!bench_selected("llcv_area_down2_u8")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.dst = cvCreateImage(cvSize(size.width / 2, size.height / 2), IPL_DEPTH_8U, 1);
+  // OpenCV rounds halves to even
+  bench_pair("llcv_area_down2_u8", &c, "opencv", bench_area_down2_opencv, "c", bench_area_down2_c, 1.0);
+  bench_pair("llcv_area_down2_u8", &c, "c", bench_area_down2_c, bench_simd_backend(), bench_area_down2_simd, kBenchExact);
+  bench_context_release(&c);
+}
+
+// size is the 1x result; the source is twice that, as from dmz_transform_card_y_2x
+static void bench_area_down2_morph_grad3_cross(CvSize size) {
+  if(!bench_selected("llcv_area_down2_morph_grad3_2d_cross_u8")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(cvSize(2 * size.width, 2 * size.height), 1);
+  c.src2 = cvCreateImage(size, IPL_DEPTH_8U, 1);
+  c.dst = cvCreateImage(size, IPL_DEPTH_8U, 1);
+  c.scratch = cvCreateImage(cvSize(size.width, 3), IPL_DEPTH_8U, 1);
+  bench_pair("llcv_area_down2_morph_grad3_2d_cross_u8", &c, "separate", bench_area_down2_morph_grad3_cross_separate,
+             "fused", bench_area_down2_morph_grad3_cross_fused, kBenchExact);
+  bench_context_release(&c);
+}
+
+// One digit's gradient: computed from its own crop, or sliced from the whole number strip's as number_scores does.
+static void bench_morph_grad3_window(void) {
+  if(!bench_selected("llcv_morph_grad3_2d_cross_window_u8")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(cvSize(kCreditCardTargetWidth, 27), 1);
+  c.src2 = bench_create_like(c.src, IPL_DEPTH_8U, 1);
+  llcv_morph_grad3_2d_cross_u8(llcv_view_of_image(c.src), llcv_view_of_image(c.src2));
+  CvRect window = cvRect(137, 0, kNumberWidth, 27);
+  cvSetImageROI(c.src, window);
+  cvSetImageROI(c.src2, window);
+  c.dst = cvCreateImage(cvSize(kNumberWidth, 27), IPL_DEPTH_8U, 1);
+  bench_pair("llcv_morph_grad3_2d_cross_window_u8", &c, "crop", bench_morph_grad3_2d_cross_crop,
+             "window", bench_morph_grad3_2d_cross_window, kBenchExact);
+  bench_context_release(&c);
+}
+
+// The whole of edge detection, to check that its cost stays put as the capture resolution goes up.
+static void bench_detect_edges(CvSize size) {
+  if(!bench_selected("dmz_detect_edges")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.src2 = bench_create_scene(cvSize(size.width / 2, size.height / 2), 1);
+  c.src3 = bench_create_scene(cvSize(size.width / 2, size.height / 2), 1);
+  bench_report("dmz_detect_edges", size, "dmz", bench_detect_edges_dmz, &c, NULL, NULL, kBenchExact);
+  bench_context_release(&c);
+}
+
+static void bench_color(CvSize size) {
+  bench_context c;
+  bench_context_init(&c);
+  c.src = bench_create_scene(size, 1);
+  c.dst = bench_create_like(c.src, IPL_DEPTH_8U, 3);
+  if(bench_selected("llcv_YCbCr2RGB_u8")) {
+    c.src2 = bench_create_scene(size, 1);
+    c.src3 = bench_create_scene(size, 1);
+    c.scratch = bench_create_like(c.src, IPL_DEPTH_8U, 3);
+    // OpenCV rounds its coefficients differently
+    bench_pair("llcv_YCbCr2RGB_u8", &c, "opencv", bench_YCbCr2RGB_opencv, "c", bench_YCbCr2RGB_c, 2.0);
+    cvReleaseImage(&c.src2);
+    cvReleaseImage(&c.src3);
+  }
+  if(bench_selected("llcv_YCbCr2RGB_half_chroma_u8")) {
+    c.src2 = bench_create_scene(cvSize((size.width + 1) / 2, (size.height + 1) / 2), 1);
+    c.src3 = bench_create_scene(cvSize((size.width + 1) / 2, (size.height + 1) / 2), 1);
+    bench_pair("llcv_YCbCr2RGB_half_chroma_u8", &c, "c", bench_YCbCr2RGB_half_chroma_c,
+               bench_simd_backend(), bench_YCbCr2RGB_half_chroma_simd, kBenchExact);
+  }
+  bench_context_release(&c);
+}
+
+static void bench_unwarp(CvSize sample_size) {
+  if(!bench_selected("llcv_unwarp")) {
+    return;
+  }
+  bench_context c;
+  bench_context_init(&c);
+  c.dmz = dmz_context_create();
+  c.src = bench_create_scene(sample_size, 1);
+  c.dst = cvCreateImage(cvSize(kCreditCardTargetWidth, kCreditCardTargetHeight), IPL_DEPTH_8U, 1);
+  c.scratch = llcv_create_aligned_image(cvGetSize(c.dst), IPL_DEPTH_8U, 1);
+  // a slightly keystoned card, as found by edge detection
+  c.src_points[0] = dmz_create_point(sample_size.width * 0.13f, sample_size.height * 0.22f);
+  c.src_points[1] = dmz_create_point(sample_size.width * 0.88f, sample_size.height * 0.21f);
+  c.src_points[2] = dmz_create_point(sample_size.width * 0.11f, sample_size.height * 0.79f);
+  c.src_points[3] = dmz_create_point(sample_size.width * 0.89f, sample_size.height * 0.80f);
+  c.dst_rect = dmz_create_rect(0, 0, kCreditCardTargetWidth - 1, kCreditCardTargetHeight - 1);
+
+  bench_unwarp_opencv(&c);
+  IplImage *reference = cvCloneImage(c.dst);
+  bench_report("llcv_unwarp", sample_size, "opencv", bench_unwarp_opencv, &c, NULL, NULL, kBenchExact);
+  bench_report("llcv_unwarp_plane", sample_size, "opencv", bench_unwarp_plane, &c, c.scratch, reference, kBenchExact);
+  cvReleaseImage(&reference);
+
+  llcv_release_aligned_image(&c.scratch);
+  dmz_context_destroy(c.dmz);
+  bench_context_release(&c);
+}
+
+
+#pragma mark models
+
+template <typename Input>
+static void bench_fill_model_input(Input *input) {
+  for(int row = 0; row < input->rows(); row++) {
+    for(int col = 0; col < input->cols(); col++) {
+      (*input)(row, col) = bench_random_u8() / 255.0f;
+    }
+  }
+}
+
+static ModelCInput_5c241121 bench_number_input;
+static ModelMInput_befe75da bench_vseg_input;
+#if SCAN_EXPIRY
+static ModelCInput_bf4dd6c8 bench_expiry_digit_input;
+static ModelMInput_730c4cbd bench_slash_input;
+#endif
+
+// The models take views; these alias the inputs above.
+static ModelCInputView_5c241121 bench_number_view(bench_number_input.data(), Eigen::OuterStride<>(bench_number_input.cols()));
+static ModelMBatchInputView_befe75da bench_vseg_view(bench_vseg_input.data(), 204, 1);
+static Eigen::Matrix<float, 204, kModelMMaxBatch_befe75da> bench_vseg_batch_input;
+static ModelMBatchInputView_befe75da bench_vseg_batch_view(bench_vseg_batch_input.data(), 204, kModelMMaxBatch_befe75da);
+#if SCAN_EXPIRY
+static ModelCInputView_bf4dd6c8 bench_expiry_digit_view(bench_expiry_digit_input.data(), Eigen::OuterStride<>(bench_expiry_digit_input.cols()));
+static ModelMInputView_730c4cbd bench_slash_view(bench_slash_input.data());
+#endif
+
+static void bench_applyc_5c241121(void *) {
+  bench_sink = applyc_5c241121(bench_number_view)(0);
+}
+
+static void bench_applyc_01266c1b(void *) {
+  bench_sink = applyc_01266c1b(bench_number_view)(0);
+}
+
+static void bench_applyc_b00bf70c(void *) {
+  bench_sink = applyc_b00bf70c(bench_number_view)(0);
+}
+
+// The scanner only runs the vseg model in batches, so a single input is a batch of one
+static void bench_applym_befe75da(void *) {
+  bench_sink = applym_batch_befe75da(bench_vseg_view)(0, 0);
+}
+
+// A batch of vseg rows, one at a time vs. all at once
+static void bench_applym_befe75da_each(void *) {
+  for(int col = 0; col < kModelMMaxBatch_befe75da; col++) {
+    bench_sink = applym_batch_befe75da(ModelMBatchInputView_befe75da(bench_vseg_batch_input.col(col).data(), 204, 1))(0, 0);
+  }
+}
+
+static void bench_applym_batch_befe75da(void *) {
+  bench_sink = applym_batch_befe75da(bench_vseg_batch_view)(0, 0);
+}
+
+#if SCAN_EXPIRY
+static void bench_applyc_bf4dd6c8(void *) {
+  bench_sink = applyc_bf4dd6c8(bench_expiry_digit_view)(0);
+}
+
+static void bench_applym_730c4cbd(void *) {
+  bench_sink = applym_730c4cbd(bench_slash_view)(0);
+}
+#endif
+
+static void bench_models(void) {
+  // the three number models share an input type; the typedefs are identical
+  bench_fill_model_input(&bench_number_input);
+  bench_fill_model_input(&bench_vseg_input);
+  CvSize number_size = cvSize((int)bench_number_input.cols(), (int)bench_number_input.rows());
+  CvSize vseg_size = cvSize(1, (int)bench_vseg_input.rows());
+  if(bench_selected("applyc_5c241121")) {
+    bench_report("applyc_5c241121", number_size, "eigen", bench_applyc_5c241121, NULL, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("applyc_01266c1b")) {
+    bench_report("applyc_01266c1b", number_size, "eigen", bench_applyc_01266c1b, NULL, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("applyc_b00bf70c")) {
+    bench_report("applyc_b00bf70c", number_size, "eigen", bench_applyc_b00bf70c, NULL, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("applym_befe75da")) {
+    bench_report("applym_befe75da", vseg_size, "eigen", bench_applym_befe75da, NULL, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("applym_batch_befe75da")) {
+    bench_fill_model_input(&bench_vseg_batch_input);
+    CvSize batch_size = cvSize(kModelMMaxBatch_befe75da, (int)bench_vseg_batch_input.rows());
+    bench_report("applym_batch_befe75da", batch_size, "each", bench_applym_befe75da_each, NULL, NULL, NULL, kBenchExact);
+    bench_report("applym_batch_befe75da", batch_size, "eigen", bench_applym_batch_befe75da, NULL, NULL, NULL, kBenchExact);
+  }
+#if SCAN_EXPIRY
+  bench_fill_model_input(&bench_expiry_digit_input);
+  bench_fill_model_input(&bench_slash_input);
+  if(bench_selected("applyc_bf4dd6c8")) {
+    bench_report("applyc_bf4dd6c8", cvSize((int)bench_expiry_digit_input.cols(), (int)bench_expiry_digit_input.rows()),
+                 "eigen", bench_applyc_bf4dd6c8, NULL, NULL, NULL, kBenchExact);
+  }
+  if(bench_selected("applym_730c4cbd")) {
+    bench_report("applym_730c4cbd", cvSize(1, (int)bench_slash_input.rows()), "eigen", bench_applym_730c4cbd, NULL, NULL, NULL, kBenchExact);
+  }
+#endif
+}
+
+
+#pragma mark main
+
+int main(int argc, char **argv) {
+  options.min_sample_ms = 20.0;
+  options.filter = NULL;
+  options.n_failures = 0;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else if(strcmp(argv[i], "--min-sample-ms") == 0 && i + 1 < argc) {
+      options.min_sample_ms = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: kernels [--filter SUBSTRING] [--min-sample-ms MS]\n");
+      return 2;
+    }
+  }
+
+  printf("# neon=%d sse2=%d avx2=%d\n", dmz_has_neon_runtime(), DMZ_HAS_SSE2_COMPILETIME, DMZ_HAS_AVX2_COMPILETIME);
+  printf("kernel,size,backend,calls,median_ns,min_ns,max_abs_diff,mismatches,check\n");
+
+  // edge detection strips, as cut from a 640x480 portrait frame
+  CvSize sample_size = cvSize(kLandscapeSampleWidth, kLandscapeSampleHeight);
+  IplImage *sample = cvCreateImage(sample_size, IPL_DEPTH_8U, 1);
+  DetectionBoxes boxes = detection_boxes_for_sample(sample, FrameOrientationPortrait);
+  cvReleaseImage(&sample);
+  CvSize strips[2] = {cvSize(boxes.top.width, boxes.top.height), cvSize(boxes.left.width, boxes.left.height)};
+
+  CvSize card_size = cvSize(kCreditCardTargetWidth, kCreditCardTargetHeight);
+  for(int strip = 0; strip < 2; strip++) {
+    bench_sobel7(strips[strip]);
+    bench_canny_hough(strips[strip]);
+  }
+  CvSize capture_sizes[3] = {sample_size, cvSize(1280, 720), cvSize(1920, 1080)};
+  for(int capture = 0; capture < 3; capture++) {
+    bench_detect_edges(capture_sizes[capture]);
+  }
+  bench_area_down2(capture_sizes[2]);
+  bench_gradients(card_size);
+  bench_stats(card_size);
+  bench_vseg_row();
+  bench_morph_equalize(cvSize(kCreditCardTargetWidth, 27)); // hseg strip
+  bench_area_down2_morph_grad3_cross(cvSize(kCreditCardTargetWidth, 27)); // hseg strip of a 2x card
+  bench_area_down2_morph_grad3_cross(cvSize(kNumberWidth, 27)); // one digit of a 2x card
+  bench_morph_equalize(cvSize(kNumberWidth, 27)); // one digit
+  bench_morph_grad3_window(); // one digit, from the strip's gradient
+  bench_split(cvSize(sample_size.width / 2, sample_size.height / 2));
+  bench_color(card_size);
+  bench_unwarp(sample_size);
+  bench_models();
+
+  if(options.n_failures > 0) {
+    fprintf(stderr, "%d cross-backend check(s) failed\n", options.n_failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,741 @@
+//
+//  replay.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+//  Command-line benchmark: replays recorded camera frames through edge detection,
+//  card rectification and the scanner, and reports throughput, per-stage latency,
+//  allocations per frame, time to first result, and accuracy against labels.
+//  Build with `fab bench`; see bench/README.md for the input formats.
+//
+
+// The whole dmz is one translation unit (see dmz_all.cpp), which also gives the
+// benchmark access to DMZ_INTERNAL helpers such as llcv_split_u8.
+#include "dmz_all.cpp"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define kMaxCardNumberLength 16
+
+
+#pragma mark allocation counting
+
+// glibc only: interpose the allocator so that every malloc made by the dmz (and OpenCV) is counted.
+#if defined(__GLIBC__)
+#define REPLAY_COUNTS_ALLOCATIONS 1
+
+static volatile unsigned long allocation_count = 0;
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+
+  void *malloc(size_t size) {
+    __sync_fetch_and_add(&allocation_count, 1);
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t count, size_t size) {
+    __sync_fetch_and_add(&allocation_count, 1);
+    return __libc_calloc(count, size);
+  }
+
+  void *realloc(void *ptr, size_t size) {
+    if(ptr == NULL) {
+      __sync_fetch_and_add(&allocation_count, 1);
+    }
+    return __libc_realloc(ptr, size);
+  }
+}
+
+static unsigned long replay_allocation_count(void) {
+  return allocation_count;
+}
+#else
+#define REPLAY_COUNTS_ALLOCATIONS 0
+
+static unsigned long replay_allocation_count(void) {
+  return 0;
+}
+#endif
+
+
+#pragma mark options
+
+typedef struct {
+  int width; // raw .yuv frames only; recordings carry their own size
+  int height;
+  FrameOrientation orientation; // raw .yuv frames only
+  bool scan_expiry;
+  bool pregate;
+  float cadence_budget_ms; // if non-zero, let dmz_cadence_decide thin out frames to this budget
+  bool legacy_transform; // dmz_transform_card (allocating) instead of dmz_transform_card_y
+  bool card_2x; // dmz_transform_card_y_2x instead of dmz_transform_card_y
+  bool run_to_end; // keep scanning after the first complete result
+  bool recorded_cards; // recordings only: scan the recorded card images instead of running the frames through the pipeline
+  int threads; // if non-zero, scan all sessions at once with a ScanService of this many threads
+  int number_window; // see scanner_set_number_window
+  int repeat;
+  const char *labels_path;
+} replay_options;
+
+typedef struct {
+  std::string name;
+  std::string number;
+  int expiry_month; // 0 if unlabelled
+  int expiry_year; // two digits
+} replay_label;
+
+static void replay_usage(void) {
+  fprintf(stderr,
+          "usage: replay [options] SESSION...\n"
+          "  SESSION is a directory of raw .yuv frames or a .dmzrec recording\n"
+          "  --size WxH          raw frame size (default 640x480)\n"
+          "  --orientation N     raw frame FrameOrientation (default 1, portrait)\n"
+          "  --labels FILE       ground truth: one 'SESSION_NAME NUMBER [MM/YY]' per line\n"
+          "  --expiry            also scan expiry dates\n"
+          "  --pregate           run the frame pre-gate ahead of edge detection\n"
+          "  --cadence MS        skip frames (and expiry scans) as dmz_cadence_decide advises, for a budget of MS per frame\n"
+          "  --legacy-transform  rectify with dmz_transform_card instead of dmz_transform_card_y\n"
+          "  --card-2x           rectify to 856x540 with dmz_transform_card_y_2x\n"
+          "  --run-to-end        keep scanning after the first complete result\n"
+          "  --recorded-cards    replay a recording's scanner inputs rather than its frames\n"
+          "  --threads N         scan all sessions concurrently on a scan service with N threads\n"
+          "  --number-window N   combine digit scores over the last N frames, instead of decaying them (N <= 16)\n"
+          "  --repeat N          replay every session N times (default 1)\n");
+}
+
+static bool replay_parse_options(int argc, char **argv, replay_options *options, std::vector<const char *> *sessions) {
+  options->width = 640;
+  options->height = 480;
+  options->orientation = FrameOrientationPortrait;
+  options->scan_expiry = false;
+  options->pregate = false;
+  options->cadence_budget_ms = 0.0f;
+  options->legacy_transform = false;
+  options->card_2x = false;
+  options->run_to_end = false;
+  options->recorded_cards = false;
+  options->threads = 0;
+  options->number_window = 0;
+  options->repeat = 1;
+  options->labels_path = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if(strcmp(arg, "--size") == 0 && has_value) {
+      if(sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2) {
+        return false;
+      }
+    } else if(strcmp(arg, "--orientation") == 0 && has_value) {
+      options->orientation = (FrameOrientation)atoi(argv[++i]);
+    } else if(strcmp(arg, "--labels") == 0 && has_value) {
+      options->labels_path = argv[++i];
+    } else if(strcmp(arg, "--cadence") == 0 && has_value) {
+      options->cadence_budget_ms = (float)atof(argv[++i]);
+    } else if(strcmp(arg, "--threads") == 0 && has_value) {
+      options->threads = MAX(0, atoi(argv[++i]));
+    } else if(strcmp(arg, "--number-window") == 0 && has_value) {
+      options->number_window = atoi(argv[++i]);
+      if(options->number_window < 0 || options->number_window > kNumberAggregateMaxWindow) {
+        return false;
+      }
+    } else if(strcmp(arg, "--repeat") == 0 && has_value) {
+      options->repeat = MAX(1, atoi(argv[++i]));
+    } else if(strcmp(arg, "--expiry") == 0) {
+      options->scan_expiry = true;
+    } else if(strcmp(arg, "--pregate") == 0) {
+      options->pregate = true;
+    } else if(strcmp(arg, "--legacy-transform") == 0) {
+      options->legacy_transform = true;
+    } else if(strcmp(arg, "--card-2x") == 0) {
+      options->card_2x = true;
+    } else if(strcmp(arg, "--run-to-end") == 0) {
+      options->run_to_end = true;
+    } else if(strcmp(arg, "--recorded-cards") == 0) {
+      options->recorded_cards = true;
+    } else if(arg[0] == '-') {
+      return false;
+    } else {
+      sessions->push_back(arg);
+    }
+  }
+  return !sessions->empty() && options->width > 0 && options->height > 0 && options->width % 2 == 0 && options->height % 2 == 0;
+}
+
+static std::string replay_session_name(const char *path) {
+  std::string name(path);
+  while(name.size() > 1 && name[name.size() - 1] == '/') {
+    name.erase(name.size() - 1);
+  }
+  size_t slash = name.rfind('/');
+  if(slash != std::string::npos) {
+    name = name.substr(slash + 1);
+  }
+  size_t dot = name.rfind('.');
+  if(dot != std::string::npos && dot > 0) {
+    name = name.substr(0, dot);
+  }
+  return name;
+}
+
+static void replay_load_labels(const char *path, std::vector<replay_label> *labels) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL) {
+    fprintf(stderr, "replay: cannot read labels %s\n", path);
+    return;
+  }
+  char line[256];
+  while(fgets(line, sizeof(line), file) != NULL) {
+    char name[128];
+    char number[32];
+    int month = 0;
+    int year = 0;
+    int n_fields = sscanf(line, "%127s %31s %d/%d", name, number, &month, &year);
+    if(n_fields < 2 || name[0] == '#') {
+      continue;
+    }
+    replay_label label;
+    label.name = name;
+    label.number = number;
+    label.expiry_month = n_fields == 4 ? month : 0;
+    label.expiry_year = n_fields == 4 ? year % 100 : 0;
+    labels->push_back(label);
+  }
+  fclose(file);
+}
+
+static const replay_label *replay_find_label(const std::vector<replay_label> &labels, const std::string &name) {
+  for(size_t i = 0; i < labels.size(); i++) {
+    if(labels[i].name == name) {
+      return &labels[i];
+    }
+  }
+  return NULL;
+}
+
+
+#pragma mark frame sources
+
+// A session's frames, either raw files in a directory or the entries of a recording (see dmz_recording_start).
+typedef struct {
+  std::vector<std::string> frame_paths;
+  size_t next_frame;
+  FrameOrientation orientation;
+  IplImage *y; // raw frames are read into these
+  IplImage *cbcr;
+  dmz_recording_reader *recording;
+} replay_source;
+
+static bool replay_ends_with(const std::string &s, const char *suffix) {
+  size_t suffix_length = strlen(suffix);
+  return s.size() >= suffix_length && s.compare(s.size() - suffix_length, suffix_length, suffix) == 0;
+}
+
+static bool replay_source_open(const char *path, const replay_options *options, replay_source *source) {
+  source->next_frame = 0;
+  source->orientation = options->orientation;
+  source->y = NULL;
+  source->cbcr = NULL;
+  source->recording = NULL;
+
+  DIR *dir = opendir(path);
+  if(dir != NULL) {
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+      std::string filename(entry->d_name);
+      if(replay_ends_with(filename, ".yuv")) {
+        source->frame_paths.push_back(std::string(path) + "/" + filename);
+      }
+    }
+    closedir(dir);
+    std::sort(source->frame_paths.begin(), source->frame_paths.end());
+    source->y = cvCreateImage(cvSize(options->width, options->height), IPL_DEPTH_8U, 1);
+    source->cbcr = cvCreateImage(cvSize(options->width / 2, options->height / 2), IPL_DEPTH_8U, 2);
+    return true;
+  }
+
+  source->recording = dmz_recording_open(path);
+  return source->recording != NULL;
+}
+
+static void replay_source_close(replay_source *source) {
+  dmz_recording_close(source->recording);
+  source->recording = NULL;
+  if(source->y != NULL) {
+    cvReleaseImage(&source->y);
+    cvReleaseImage(&source->cbcr);
+  }
+}
+
+// Reads the next raw frame: Y, then interleaved CbCr at half size.
+static bool replay_source_read_raw(replay_source *source) {
+  if(source->next_frame >= source->frame_paths.size()) {
+    return false;
+  }
+  FILE *file = fopen(source->frame_paths[source->next_frame].c_str(), "rb");
+  if(file == NULL) {
+    return false;
+  }
+  source->next_frame++;
+
+  IplImage *y = source->y;
+  IplImage *cbcr = source->cbcr;
+  bool ok = true;
+  for(int row = 0; ok && row < y->height; row++) {
+    ok = fread(y->imageData + row * y->widthStep, 1, y->width, file) == (size_t)y->width;
+  }
+  for(int row = 0; ok && row < cbcr->height; row++) {
+    ok = fread(cbcr->imageData + row * cbcr->widthStep, 1, 2 * cbcr->width, file) == (size_t)(2 * cbcr->width);
+  }
+  fclose(file);
+  return ok;
+}
+
+// Raw frames come back as DMZRecordingFrame entries with only y set; their chroma is left
+// interleaved in source->cbcr, so that splitting it is timed along with the rest of the frame.
+static bool replay_source_next(replay_source *source, dmz_recording_entry *entry) {
+  if(source->recording != NULL) {
+    return dmz_recording_next(source->recording, entry);
+  }
+  if(!replay_source_read_raw(source)) {
+    return false;
+  }
+  memset(entry, 0, sizeof(dmz_recording_entry));
+  entry->type = DMZRecordingFrame;
+  entry->orientation = source->orientation;
+  entry->y = source->y;
+  return true;
+}
+
+
+#pragma mark measurement
+
+static uint64_t replay_now_microseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static float replay_percentile(const std::vector<float> &sorted, float percentile) {
+  if(sorted.empty()) {
+    return 0.0f;
+  }
+  size_t rank = (size_t)(percentile * (sorted.size() - 1) + 0.5f);
+  return sorted[rank];
+}
+
+typedef struct {
+  int sessions;
+  int sessions_with_result;
+  int labelled_sessions;
+  int correct_numbers;
+  int labelled_expiries;
+  int correct_expiries;
+  unsigned long frames;
+  unsigned long frames_with_edges;
+  unsigned long allocations;
+  uint64_t total_microseconds;
+  std::vector<float> frame_ms;
+  std::vector<float> first_result_ms;
+  std::vector<float> first_result_frames;
+} replay_totals;
+
+static void replay_totals_init(replay_totals *totals) {
+  totals->sessions = 0;
+  totals->sessions_with_result = 0;
+  totals->labelled_sessions = 0;
+  totals->correct_numbers = 0;
+  totals->labelled_expiries = 0;
+  totals->correct_expiries = 0;
+  totals->frames = 0;
+  totals->frames_with_edges = 0;
+  totals->allocations = 0;
+  totals->total_microseconds = 0;
+}
+
+static std::string replay_number_string(const ScannerResult *result) {
+  std::string number;
+  for(uint8_t i = 0; i < result->n_numbers && i < kMaxCardNumberLength; i++) {
+    number += (char)('0' + result->predictions(i, 0));
+  }
+  return number;
+}
+
+
+#pragma mark replay
+
+// Tallies a finished session against its label (if any) and prints it.
+static void replay_score_session(const std::string &name, unsigned long frames, const ScannerResult *result,
+                                 const replay_label *label, replay_totals *totals) {
+  totals->sessions++;
+  std::string number;
+  if(result->complete) {
+    totals->sessions_with_result++;
+    number = replay_number_string(result);
+  }
+  if(label != NULL) {
+    totals->labelled_sessions++;
+    if(number == label->number) {
+      totals->correct_numbers++;
+    }
+    if(label->expiry_month != 0) {
+      totals->labelled_expiries++;
+      if(result->complete &&
+         result->expiry_month == label->expiry_month &&
+         result->expiry_year % 100 == label->expiry_year) {
+        totals->correct_expiries++;
+      }
+    }
+  }
+  printf("session %s: %lu frames, %s%s\n", name.c_str(), frames,
+         result->complete ? number.c_str() : "no result",
+         label == NULL ? "" : (number == label->number ? " (correct)" : " (WRONG)"));
+}
+
+static void replay_session(dmz_context *dmz, const char *path, const replay_options *options,
+                           const std::vector<replay_label> &labels, dmz_profile *scan_profile, replay_totals *totals) {
+  replay_source source;
+  if(!replay_source_open(path, options, &source)) {
+    fprintf(stderr, "replay: cannot open session %s\n", path);
+    return;
+  }
+
+  IplImage *cb = NULL; // for raw frames' chroma, allocated on first use
+  IplImage *cr = NULL;
+
+  ScannerState state;
+  scanner_initialize(&state);
+  scanner_set_number_window(&state, (uint8_t)options->number_window);
+  state.profile = *scan_profile; // accumulate scan stage timings across sessions
+
+  std::string name = replay_session_name(path);
+  const replay_label *label = replay_find_label(labels, name);
+  ScannerResult result;
+  result.complete = false;
+  bool have_result = false;
+  bool recorded_first_result = false;
+  unsigned long session_frames = 0;
+  uint64_t session_start = replay_now_microseconds();
+
+  dmz_recording_entry entry;
+  while(replay_source_next(&source, &entry)) {
+    if(entry.type == DMZRecordingScannerReset) {
+      scanner_reset(&state);
+      continue;
+    }
+    // Either the frames go through the whole pipeline, or the recorded cards go straight to the scanner.
+    if(entry.type != (options->recorded_cards ? DMZRecordingScannerInput : DMZRecordingFrame)) {
+      continue;
+    }
+
+    unsigned long allocations_before = replay_allocation_count();
+    uint64_t frame_start = replay_now_microseconds();
+
+    dmz_cadence_decision cadence; // processes everything, unless --cadence
+    dmz_cadence_decide(dmz, &state, options->scan_expiry, &cadence);
+
+    if(entry.type == DMZRecordingScannerInput) {
+      totals->frames_with_edges++;
+      FrameScanResult frame_result;
+      scanner_replay_entry(&state, &entry, &frame_result);
+      if(!have_result) {
+        scanner_result(&state, &result);
+        have_result = result.complete;
+      }
+    } else if(cadence.process_frame) {
+      IplImage *y = entry.y;
+      if(entry.cb == NULL) {
+        if(cb == NULL) {
+          cb = cvCreateImage(cvGetSize(source.cbcr), IPL_DEPTH_8U, 1);
+          cr = cvCreateImage(cvGetSize(source.cbcr), IPL_DEPTH_8U, 1);
+        }
+        llcv_split_u8(source.cbcr, cb, cr);
+        entry.cb = cb;
+        entry.cr = cr;
+      }
+      FrameOrientation orientation = entry.orientation;
+
+      dmz_edges found_edges;
+      dmz_corner_points corner_points;
+      bool found = dmz_detect_edges_with_pregate(dmz, y, entry.cb, entry.cr, orientation, &found_edges, &corner_points, NULL);
+      if(found) {
+        totals->frames_with_edges++;
+        IplImage *card_y = NULL;
+        if(options->legacy_transform) {
+          dmz_transform_card(dmz, y, corner_points, orientation, false, &card_y);
+        } else if(options->card_2x) {
+          card_y = dmz_transform_card_y_2x(dmz, &state, y, corner_points, orientation);
+        } else {
+          card_y = dmz_transform_card_y(dmz, &state, y, corner_points, orientation);
+        }
+
+        FrameScanResult frame_result; // the rest is filled in by the scanner
+        frame_result.focus_score = dmz_focus_score(y, false);
+        frame_result.brightness_score = dmz_brightness_score(y, false);
+        frame_result.flipped = false;
+        frame_result.iso_speed = 0;
+        frame_result.shutter_speed = 0.0f;
+        frame_result.torch_is_on = false;
+        scanner_add_frame_with_expiry(&state, card_y, cadence.scan_expiry, &frame_result);
+
+        if(options->legacy_transform) {
+          cvReleaseImage(&card_y);
+        }
+
+        if(!have_result) {
+          scanner_result(&state, &result);
+          have_result = result.complete;
+        }
+      }
+    }
+
+    uint64_t frame_end = replay_now_microseconds();
+    session_frames++;
+    totals->frames++;
+    totals->allocations += replay_allocation_count() - allocations_before;
+    totals->total_microseconds += frame_end - frame_start;
+    totals->frame_ms.push_back((frame_end - frame_start) / 1000.0f);
+
+    if(have_result && !recorded_first_result) {
+      recorded_first_result = true;
+      totals->first_result_ms.push_back((frame_end - session_start) / 1000.0f);
+      totals->first_result_frames.push_back((float)session_frames);
+      if(!options->run_to_end) {
+        break;
+      }
+    }
+  }
+
+  if(have_result) {
+    scanner_result(&state, &result); // pick up any expiry found since the number completed
+  }
+  replay_score_session(name, session_frames, &result, label, totals);
+
+  *scan_profile = state.profile;
+  scanner_destroy(&state);
+  if(cb != NULL) {
+    cvReleaseImage(&cb);
+    cvReleaseImage(&cr);
+  }
+  replay_source_close(&source);
+}
+
+static const char *replay_stage_name(dmz_stage stage) {
+  switch(stage) {
+    case DMZStageEdgeDetection:
+      return "edges";
+    case DMZStageUnwarp:
+      return "unwarp";
+    case DMZStageVSeg:
+      return "vseg";
+    case DMZStageHSeg:
+      return "hseg";
+    case DMZStageNumberCategorize:
+      return "number";
+    case DMZStageExpirySeg:
+      return "expiry_seg";
+    case DMZStageExpiryCategorize:
+      return "expiry";
+    default:
+      return "?";
+  }
+}
+
+static void replay_print_stages(const dmz_profile *profile, dmz_stage first, dmz_stage last) {
+  dmz_timing_snapshot snapshot;
+  dmz_profile_snapshot(profile, &snapshot);
+  for(dmz_stage stage = first; stage <= last; stage++) {
+    const dmz_stage_timing *timing = &snapshot.stages[stage];
+    if(timing->count == 0) {
+      continue;
+    }
+    printf("  %-11s n=%-7u mean %7.3f  p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f ms\n",
+           replay_stage_name(stage), timing->count, timing->mean_ms, timing->p50_ms, timing->p90_ms, timing->p99_ms, timing->max_ms);
+  }
+}
+
+static void replay_print_totals(replay_totals *totals, dmz_context *dmz, const dmz_profile *scan_profile) {
+  std::sort(totals->frame_ms.begin(), totals->frame_ms.end());
+  std::sort(totals->first_result_ms.begin(), totals->first_result_ms.end());
+  std::sort(totals->first_result_frames.begin(), totals->first_result_frames.end());
+
+  double seconds = totals->total_microseconds / 1e6;
+  printf("\nframes: %lu (%lu with edges), %.1f frames/s\n", totals->frames, totals->frames_with_edges,
+         seconds > 0 ? totals->frames / seconds : 0.0);
+  printf("frame latency: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f ms\n",
+         replay_percentile(totals->frame_ms, 0.5f), replay_percentile(totals->frame_ms, 0.9f),
+         replay_percentile(totals->frame_ms, 0.99f), totals->frame_ms.empty() ? 0.0f : totals->frame_ms.back());
+  printf("stages:\n");
+  replay_print_stages(&dmz->profile, DMZStageEdgeDetection, DMZStageUnwarp);
+  replay_print_stages(scan_profile, DMZStageVSeg, DMZStageExpiryCategorize);
+#if REPLAY_COUNTS_ALLOCATIONS
+  printf("allocations: %.2f per frame\n", totals->frames > 0 ? (double)totals->allocations / totals->frames : 0.0);
+#else
+  printf("allocations: not counted on this platform\n");
+#endif
+  if(dmz->pregate_config.enabled) {
+    printf("pre-gate: skipped %.1f%% of frames\n", 100.0f * dmz_pregate_skip_rate(dmz));
+  }
+  if(dmz->cadence_config.enabled) {
+    const dmz_cadence_stats *cadence = &dmz->cadence_stats;
+    printf("cadence: skipped %u/%u frames, %u expiry scans; over budget %u, settling %u\n",
+           cadence->frames_skipped, cadence->frames, cadence->expiry_skipped,
+           cadence->frames_by_reason[DMZCadenceOverBudget], cadence->frames_by_reason[DMZCadenceSettling]);
+  }
+  printf("time to first result: %d/%d sessions, p50 %.1f ms (%.0f frames), p90 %.1f ms (%.0f frames)\n",
+         totals->sessions_with_result, totals->sessions,
+         replay_percentile(totals->first_result_ms, 0.5f), replay_percentile(totals->first_result_frames, 0.5f),
+         replay_percentile(totals->first_result_ms, 0.9f), replay_percentile(totals->first_result_frames, 0.9f));
+  if(totals->labelled_sessions > 0) {
+    printf("accuracy: numbers %d/%d", totals->correct_numbers, totals->labelled_sessions);
+    if(totals->labelled_expiries > 0) {
+      printf(", expiries %d/%d", totals->correct_expiries, totals->labelled_expiries);
+    }
+    printf("\n");
+  }
+}
+
+#pragma mark scan service
+
+// Feeds every session's frames to a ScanService, with all sessions in flight at once, and reports
+// what the service measured. Frames are queued as fast as they can be read, so this needs enough
+// memory for every frame of every session.
+static void replay_with_service(const std::vector<const char *> &sessions, const replay_options *options,
+                                const std::vector<replay_label> &labels) {
+  ScanServiceConfig config;
+  scan_service_default_config(&config);
+  config.n_threads = options->threads;
+  config.scan_expiry = options->scan_expiry;
+  config.pregate = options->pregate;
+  config.stop_at_result = !options->run_to_end;
+  config.number_window = (uint8_t)options->number_window;
+  ScanService *service = scan_service_create(&config);
+  if(service == NULL) {
+    fprintf(stderr, "replay: cannot start the scan service\n");
+    return;
+  }
+
+  std::vector<ScanServiceSession *> service_sessions;
+  std::vector<std::string> names;
+  std::vector<unsigned long> frame_counts;
+  for(int pass = 0; pass < options->repeat; pass++) {
+    for(size_t i = 0; i < sessions.size(); i++) {
+      replay_source source;
+      if(!replay_source_open(sessions[i], options, &source)) {
+        fprintf(stderr, "replay: cannot open session %s\n", sessions[i]);
+        continue;
+      }
+      IplImage *cb = NULL;
+      IplImage *cr = NULL;
+      ScanServiceSession *session = scan_service_session_open(service);
+      unsigned long frames = 0;
+      dmz_recording_entry entry;
+      while(replay_source_next(&source, &entry)) {
+        if(entry.type != DMZRecordingFrame) {
+          continue;
+        }
+        if(entry.cb == NULL) {
+          if(cb == NULL) {
+            cb = cvCreateImage(cvGetSize(source.cbcr), IPL_DEPTH_8U, 1);
+            cr = cvCreateImage(cvGetSize(source.cbcr), IPL_DEPTH_8U, 1);
+          }
+          llcv_split_u8(source.cbcr, cb, cr);
+          entry.cb = cb;
+          entry.cr = cr;
+        }
+        scan_service_session_add_frame(session, entry.y, entry.cb, entry.cr, entry.orientation);
+        frames++;
+      }
+      scan_service_session_close(session);
+      service_sessions.push_back(session);
+      names.push_back(replay_session_name(sessions[i]));
+      frame_counts.push_back(frames);
+      if(cb != NULL) {
+        cvReleaseImage(&cb);
+        cvReleaseImage(&cr);
+      }
+      replay_source_close(&source);
+    }
+  }
+
+  replay_totals totals;
+  replay_totals_init(&totals);
+  for(size_t i = 0; i < service_sessions.size(); i++) {
+    ScannerResult result;
+    scan_service_session_wait(service_sessions[i], &result);
+    replay_score_session(names[i], frame_counts[i], &result, replay_find_label(labels, names[i]), &totals);
+  }
+
+  ScanServiceStats stats;
+  scan_service_get_stats(service, &stats);
+  scan_service_destroy(service);
+
+  printf("\nscan service: %d threads, %u sessions, %llu frames scanned (%llu skipped), %llu steals\n",
+         options->threads, stats.sessions_completed, (unsigned long long)stats.frames_scanned,
+         (unsigned long long)stats.frames_skipped, (unsigned long long)stats.steals);
+  printf("throughput: %.1f frames/s over %.2f s\n", stats.frames_per_second, stats.elapsed_seconds);
+  printf("frame latency (queued + scanned): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f ms\n",
+         stats.frame_latency.p50_ms, stats.frame_latency.p90_ms, stats.frame_latency.p99_ms, stats.frame_latency.max_ms);
+  printf("frame scan: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f ms\n",
+         stats.frame_scan.p50_ms, stats.frame_scan.p90_ms, stats.frame_scan.p99_ms, stats.frame_scan.max_ms);
+  printf("session latency: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms\n",
+         stats.session_latency.p50_ms, stats.session_latency.p90_ms, stats.session_latency.p99_ms, stats.session_latency.max_ms);
+  if(totals.labelled_sessions > 0) {
+    printf("accuracy: numbers %d/%d", totals.correct_numbers, totals.labelled_sessions);
+    if(totals.labelled_expiries > 0) {
+      printf(", expiries %d/%d", totals.correct_expiries, totals.labelled_expiries);
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  replay_options options;
+  std::vector<const char *> sessions;
+  if(!replay_parse_options(argc, argv, &options, &sessions)) {
+    replay_usage();
+    return 2;
+  }
+
+  std::vector<replay_label> labels;
+  if(options.labels_path != NULL) {
+    replay_load_labels(options.labels_path, &labels);
+  }
+
+  if(options.threads > 0) {
+    replay_with_service(sessions, &options, labels);
+    return 0;
+  }
+
+  dmz_context *dmz = dmz_context_create();
+  dmz->pregate_config.enabled = options.pregate;
+  dmz->cadence_config.enabled = options.cadence_budget_ms > 0.0f;
+  dmz->cadence_config.frame_budget_ms = options.cadence_budget_ms;
+  dmz_profile_set_enabled(&dmz->profile, true);
+
+  dmz_profile scan_profile;
+  memset(&scan_profile, 0, sizeof(scan_profile));
+  dmz_profile_set_enabled(&scan_profile, true);
+
+  replay_totals totals;
+  replay_totals_init(&totals);
+  for(int pass = 0; pass < options.repeat; pass++) {
+    for(size_t i = 0; i < sessions.size(); i++) {
+      replay_session(dmz, sessions[i], &options, labels, &scan_profile, &totals);
+    }
+  }
+
+  replay_print_totals(&totals, dmz, &scan_profile);
+  dmz_context_destroy(dmz);
+  return 0;
+}
@@ -46,16 +46,23 @@
 
 #include "dmz_macros.h"
 #include "processor_support.h"
+#include "neon.h"
 #include "canny.h"
 #include "sobel.h"
+#include "image_util.h"
 #include "opencv2/core/core.hpp" // needed for IplImage
 #include "opencv2/core/internal.hpp"
 
-#if DMZ_HAS_NEON_COMPILETIME
-  #include <arm_neon.h>
-#endif // DMZ_HAS_NEON_COMPILETIME
+#if DMZ_HAS_SSE2_COMPILETIME
+  #include <emmintrin.h>
+#endif
+
+#pragma mark llcv_canny7_precomputed_sobel_opencv
 
-DMZ_INTERNAL void llcv_canny7_precomputed_sobel(IplImage *srcarr, IplImage *dstarr, IplImage *sobel_dx, IplImage *sobel_dy, double low_thresh, double high_thresh) {
+// The OpenCV 2.x copy. No longer used by the pipeline; kept (for the kernel bench only) as the
+// reference that llcv_canny7_precomputed_sobel (below) must match exactly.
+#if DMZ_BENCH
+DMZ_INTERNAL void llcv_canny7_precomputed_sobel_opencv(IplImage *srcarr, IplImage *dstarr, IplImage *sobel_dx, IplImage *sobel_dy, double low_thresh, double high_thresh) {
     cv::AutoBuffer<char> buffer;
     std::vector<uchar*> stack;
     uchar **stack_top = 0, **stack_bottom = 0;
@@ -334,18 +341,460 @@ DMZ_INTERNAL void llcv_canny7_precomputed_sobel(IplImage *srcarr, IplImage *dsta
             _dst[j] = (uchar)-(_map[j] >> 1);
     }
 }
+#endif // DMZ_BENCH
+
+#pragma mark llcv_canny7_precomputed_sobel
+
+// The same edges as the copy above, found differently:
+//   * magnitudes (|dx| + |dy|) and the gradient's sector are computed a vector at a time
+//   * non-maximum suppression writes two bitmaps, one bit per pixel: candidates (local maxima above
+//     low_thresh) and strong edges (candidates above high_thresh)
+//   * hysteresis grows the strong edges through the 8-connected candidates they touch, sweeping the
+//     bitmaps down and up 64 pixels at a time until a sweep changes nothing
+// The copy's edge stack only decides the order pixels are visited in, not which of them end up
+// as edges, so the results are identical. All working memory is in one scratch image.
+
+#define kCannyShift 15
+#define kCannyTan22 ((int32_t)(0.4142135623730950488016887242097 * (1 << kCannyShift) + 0.5)) // tan(22.5 degrees)
+
+DMZ_INTERNAL inline uint16_t llcv_canny7_words_per_row(int width) {
+  return (uint16_t)((width + 63) / 64);
+}
+
+DMZ_INTERNAL inline size_t llcv_canny7_magnitude_bytes(int width) {
+  return (3 * (size_t)(width + 2) * sizeof(int32_t) + 7) & ~(size_t)7;
+}
+
+// Three padded magnitude rows; candidate and edge bitmaps; one bitmap row to work in.
+DMZ_INTERNAL size_t llcv_canny7_scratch_bytes(CvSize src_size) {
+  size_t words_per_row = llcv_canny7_words_per_row(src_size.width);
+  return llcv_canny7_magnitude_bytes(src_size.width) + (2 * src_size.height + 1) * words_per_row * sizeof(uint64_t);
+}
+
+DMZ_INTERNAL IplImage *llcv_canny7_reserve_scratch(IplImage **scratch, CvSize src_size) {
+  int bytes = (int)llcv_canny7_scratch_bytes(src_size);
+  if(*scratch != NULL && (*scratch)->width < bytes) {
+    cvReleaseImage(scratch);
+  }
+  if(*scratch == NULL) {
+    *scratch = cvCreateImage(cvSize(bytes, 1), IPL_DEPTH_8U, 1);
+  }
+  return *scratch;
+}
+
+#pragma mark magnitude rows
+
+DMZ_INTERNAL void llcv_canny7_magnitude_row_c(const int16_t *dx_row, const int16_t *dy_row, int32_t *mag_row, uint16_t col_index, uint16_t width) {
+  for(; col_index < width; col_index++) {
+    mag_row[col_index] = abs(dx_row[col_index]) + abs(dy_row[col_index]);
+  }
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+DMZ_INTERNAL inline __m128i llcv_abs_epi32_sse2(__m128i v) {
+  __m128i sign = _mm_srai_epi32(v, 31);
+  return _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+}
+
+// Only the low 32 bits of each product; SSE2 has no _mm_mullo_epi32.
+DMZ_INTERNAL inline __m128i llcv_mullo_epi32_sse2(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// 4 int16s, sign extended
+DMZ_INTERNAL inline __m128i llcv_load_s16x4_as_s32_sse2(const int16_t *values) {
+  __m128i v = _mm_loadl_epi64((const __m128i *)values);
+  return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+DMZ_INTERNAL uint16_t llcv_canny7_magnitude_row_sse2(const int16_t *dx_row, const int16_t *dy_row, int32_t *mag_row, uint16_t width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    __m128i dx = _mm_loadu_si128((const __m128i *)(dx_row + col_index));
+    __m128i dy = _mm_loadu_si128((const __m128i *)(dy_row + col_index));
+    // widen first: |-32768| doesn't fit in int16
+    __m128i lo = _mm_add_epi32(llcv_abs_epi32_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(dx, dx), 16)),
+                               llcv_abs_epi32_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(dy, dy), 16)));
+    __m128i hi = _mm_add_epi32(llcv_abs_epi32_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(dx, dx), 16)),
+                               llcv_abs_epi32_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(dy, dy), 16)));
+    _mm_storeu_si128((__m128i *)(mag_row + col_index), lo);
+    _mm_storeu_si128((__m128i *)(mag_row + col_index + 4), hi);
+  }
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_canny7_magnitude_row_neon(const int16_t *dx_row, const int16_t *dy_row, int32_t *mag_row, uint16_t width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    int16x8_t dx = vld1q_s16(dx_row + col_index);
+    int16x8_t dy = vld1q_s16(dy_row + col_index);
+    int32x4_t lo = vaddq_s32(vabsq_s32(vmovl_s16(vget_low_s16(dx))), vabsq_s32(vmovl_s16(vget_low_s16(dy))));
+    int32x4_t hi = vaddq_s32(vabsq_s32(vmovl_s16(vget_high_s16(dx))), vabsq_s32(vmovl_s16(vget_high_s16(dy))));
+    vst1q_s32(mag_row + col_index, lo);
+    vst1q_s32(mag_row + col_index + 4, hi);
+  }
+  return col_index;
+}
+#endif
+
+// Fills in mag_row[-1, width], with zeros at either end.
+DMZ_INTERNAL void llcv_canny7_magnitude_row(const int16_t *dx_row, const int16_t *dy_row, int32_t *mag_row, uint16_t width, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_canny7_magnitude_row_neon(dx_row, dy_row, mag_row, width);
+    }
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_canny7_magnitude_row_sse2(dx_row, dy_row, mag_row, width);
+#endif
+  }
+  llcv_canny7_magnitude_row_c(dx_row, dy_row, mag_row, col_index, width);
+  mag_row[-1] = mag_row[width] = 0;
+}
+
+#pragma mark non-maximum suppression rows
+
+// Sets the candidate (and strong) bits of the center row's local maxima above low (and high).
+// The magnitude rows are padded by one zero at each end.
+DMZ_INTERNAL void llcv_canny7_suppress_row_c(const int16_t *dx_row, const int16_t *dy_row,
+                                             const int32_t *above, const int32_t *center, const int32_t *below,
+                                             int32_t low, int32_t high, uint64_t *candidates, uint64_t *strong,
+                                             uint16_t col_index, uint16_t width) {
+  for(; col_index < width; col_index++) {
+    int32_t m = center[col_index];
+    if(m <= low) {
+      continue;
+    }
+    int64_t x = abs(dx_row[col_index]);
+    int64_t y = abs(dy_row[col_index]);
+    int64_t tg22x = x * kCannyTan22;
+    int64_t tg67x = tg22x + ((x + x) << kCannyShift);
+    y <<= kCannyShift;
+
+    bool is_max;
+    if(y < tg22x) {
+      is_max = m > center[col_index - 1] && m >= center[col_index + 1];
+    } else if(y > tg67x) {
+      is_max = m > above[col_index] && m >= below[col_index];
+    } else {
+      int s = (dx_row[col_index] ^ dy_row[col_index]) < 0 ? -1 : 1;
+      is_max = m > above[col_index - s] && m > below[col_index + s];
+    }
+
+    if(is_max) {
+      uint64_t bit = (uint64_t)1 << (col_index & 63);
+      candidates[col_index >> 6] |= bit;
+      if(m > high) {
+        strong[col_index >> 6] |= bit;
+      }
+    }
+  }
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_canny7_suppress_row_sse2(const int16_t *dx_row, const int16_t *dy_row,
+                                                    const int32_t *above, const int32_t *center, const int32_t *below,
+                                                    int32_t low, int32_t high, uint64_t *candidates, uint64_t *strong, uint16_t width) {
+  const __m128i low_threshold = _mm_set1_epi32(low);
+  const __m128i high_threshold = _mm_set1_epi32(high);
+  const __m128i tan22 = _mm_set1_epi32(kCannyTan22);
+
+  uint16_t col_index = 0;
+  for(; col_index + 4 <= width; col_index += 4) {
+    __m128i m = _mm_loadu_si128((const __m128i *)(center + col_index));
+    __m128i dx = llcv_load_s16x4_as_s32_sse2(dx_row + col_index);
+    __m128i dy = llcv_load_s16x4_as_s32_sse2(dy_row + col_index);
+    __m128i x = llcv_abs_epi32_sse2(dx);
+    __m128i y = llcv_abs_epi32_sse2(dy);
+
+    // Sectors, in int32 (x, y <= 32768): y << 15 > tg22x + (2x << 15) is rearranged so that nothing overflows.
+    __m128i tg22x = llcv_mullo_epi32_sse2(x, tan22);
+    __m128i is_horizontal = _mm_cmplt_epi32(_mm_slli_epi32(y, kCannyShift), tg22x);
+    __m128i is_vertical = _mm_cmpgt_epi32(_mm_slli_epi32(_mm_sub_epi32(y, _mm_add_epi32(x, x)), kCannyShift), tg22x);
+    __m128i is_negative = _mm_srai_epi32(_mm_xor_si128(dx, dy), 31); // s == -1
+
+    __m128i horizontal_max = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(center + col_index + 1)), m),
+                                              _mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(center + col_index - 1))));
+    __m128i vertical_max = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(below + col_index)), m),
+                                            _mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(above + col_index))));
+    __m128i positive_max = _mm_and_si128(_mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(above + col_index - 1))),
+                                         _mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(below + col_index + 1))));
+    __m128i negative_max = _mm_and_si128(_mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(above + col_index + 1))),
+                                         _mm_cmpgt_epi32(m, _mm_loadu_si128((const __m128i *)(below + col_index - 1))));
+    __m128i diagonal_max = _mm_or_si128(_mm_and_si128(is_negative, negative_max), _mm_andnot_si128(is_negative, positive_max));
+
+    __m128i is_max = _mm_or_si128(_mm_or_si128(_mm_and_si128(is_horizontal, horizontal_max), _mm_and_si128(is_vertical, vertical_max)),
+                                  _mm_andnot_si128(_mm_or_si128(is_horizontal, is_vertical), diagonal_max));
+    __m128i is_candidate = _mm_and_si128(is_max, _mm_cmpgt_epi32(m, low_threshold));
+    __m128i is_strong = _mm_and_si128(is_candidate, _mm_cmpgt_epi32(m, high_threshold));
+
+    // col_index is a multiple of 4, so these 4 bits never straddle two words
+    candidates[col_index >> 6] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(is_candidate)) << (col_index & 63);
+    strong[col_index >> 6] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(is_strong)) << (col_index & 63);
+  }
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+DMZ_INTERNAL inline uint64_t llcv_lane_bits_neon(uint32x4_t mask) {
+  const uint32_t lane_bit_values[4] = {1, 2, 4, 8};
+  uint32x4_t bits = vandq_u32(mask, vld1q_u32(lane_bit_values));
+  uint32x2_t sum = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+  return vget_lane_u32(vpadd_u32(sum, sum), 0);
+}
+
+DMZ_INTERNAL uint16_t llcv_canny7_suppress_row_neon(const int16_t *dx_row, const int16_t *dy_row,
+                                                    const int32_t *above, const int32_t *center, const int32_t *below,
+                                                    int32_t low, int32_t high, uint64_t *candidates, uint64_t *strong, uint16_t width) {
+  const int32x4_t low_threshold = vdupq_n_s32(low);
+  const int32x4_t high_threshold = vdupq_n_s32(high);
+  const int32x4_t zero = vdupq_n_s32(0);
+
+  uint16_t col_index = 0;
+  for(; col_index + 4 <= width; col_index += 4) {
+    int32x4_t m = vld1q_s32(center + col_index);
+    int32x4_t dx = vmovl_s16(vld1_s16(dx_row + col_index));
+    int32x4_t dy = vmovl_s16(vld1_s16(dy_row + col_index));
+    int32x4_t x = vabsq_s32(dx);
+    int32x4_t y = vabsq_s32(dy);
+
+    // as in the SSE2 version
+    int32x4_t tg22x = vmulq_n_s32(x, kCannyTan22);
+    uint32x4_t is_horizontal = vcltq_s32(vshlq_n_s32(y, kCannyShift), tg22x);
+    uint32x4_t is_vertical = vcgtq_s32(vshlq_n_s32(vsubq_s32(y, vaddq_s32(x, x)), kCannyShift), tg22x);
+    uint32x4_t is_negative = vcltq_s32(veorq_s32(dx, dy), zero);
+
+    uint32x4_t horizontal_max = vandq_u32(vcgtq_s32(m, vld1q_s32(center + col_index - 1)), vcgeq_s32(m, vld1q_s32(center + col_index + 1)));
+    uint32x4_t vertical_max = vandq_u32(vcgtq_s32(m, vld1q_s32(above + col_index)), vcgeq_s32(m, vld1q_s32(below + col_index)));
+    uint32x4_t positive_max = vandq_u32(vcgtq_s32(m, vld1q_s32(above + col_index - 1)), vcgtq_s32(m, vld1q_s32(below + col_index + 1)));
+    uint32x4_t negative_max = vandq_u32(vcgtq_s32(m, vld1q_s32(above + col_index + 1)), vcgtq_s32(m, vld1q_s32(below + col_index - 1)));
+
+    uint32x4_t is_max = vbslq_u32(is_horizontal, horizontal_max,
+                                  vbslq_u32(is_vertical, vertical_max, vbslq_u32(is_negative, negative_max, positive_max)));
+    uint32x4_t is_candidate = vandq_u32(is_max, vcgtq_s32(m, low_threshold));
+    uint32x4_t is_strong = vandq_u32(is_candidate, vcgtq_s32(m, high_threshold));
+
+    candidates[col_index >> 6] |= llcv_lane_bits_neon(is_candidate) << (col_index & 63);
+    strong[col_index >> 6] |= llcv_lane_bits_neon(is_strong) << (col_index & 63);
+  }
+  return col_index;
+}
+#endif
+
+DMZ_INTERNAL void llcv_canny7_suppress_row(const int16_t *dx_row, const int16_t *dy_row,
+                                           const int32_t *above, const int32_t *center, const int32_t *below,
+                                           int32_t low, int32_t high, uint64_t *candidates, uint64_t *strong,
+                                           uint16_t width, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_canny7_suppress_row_neon(dx_row, dy_row, above, center, below, low, high, candidates, strong, width);
+    }
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_canny7_suppress_row_sse2(dx_row, dy_row, above, center, below, low, high, candidates, strong, width);
+#endif
+  }
+  llcv_canny7_suppress_row_c(dx_row, dy_row, above, center, below, low, high, candidates, strong, col_index, width);
+}
+
+#pragma mark hysteresis
+
+DMZ_INTERNAL inline uint64_t llcv_reverse_bits_u64(uint64_t x) {
+  x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return __builtin_bswap64(x);
+}
+
+// Within one word: seeds (a subset of mask), grown upward to the top of each run of mask bits they're in.
+// Adding a seed to the mask carries through its run, clearing it from the seed up; later seeds in the
+// same run just set their own (already cleared) bit, hence the final | seeds.
+DMZ_INTERNAL inline uint64_t llcv_fill_runs_up_u64(uint64_t mask, uint64_t seeds) {
+  return (mask & ~(mask + seeds)) | seeds;
+}
+
+// Grows seeds to cover every run of consecutive mask bits they touch, along a whole row of words.
+// Up within each word, carrying into the next; then down the same way, with the bits reversed.
+DMZ_INTERNAL void llcv_fill_runs_row_u64(const uint64_t *mask, uint64_t *seeds, uint16_t n_words) {
+  const uint64_t top_bit = (uint64_t)1 << 63;
+  uint64_t carry = 0;
+  for(uint16_t word_index = 0; word_index < n_words; word_index++) {
+    uint64_t filled = llcv_fill_runs_up_u64(mask[word_index], seeds[word_index] | (carry & mask[word_index]));
+    seeds[word_index] = filled;
+    carry = filled >> 63;
+  }
+  carry = 0;
+  for(int word_index = n_words - 1; word_index >= 0; word_index--) {
+    uint64_t word_seeds = seeds[word_index] | (carry & mask[word_index]);
+    uint64_t filled = llcv_reverse_bits_u64(llcv_fill_runs_up_u64(llcv_reverse_bits_u64(mask[word_index]), llcv_reverse_bits_u64(word_seeds)));
+    seeds[word_index] = filled;
+    carry = (filled & 1) ? top_bit : 0;
+  }
+}
+
+// A row of bits, and each bit's left and right neighbors.
+DMZ_INTERNAL inline uint64_t llcv_dilate_row_word_u64(const uint64_t *row, uint16_t word_index, uint16_t n_words) {
+  uint64_t word = row[word_index];
+  uint64_t dilated = word | (word << 1) | (word >> 1);
+  if(word_index > 0) {
+    dilated |= row[word_index - 1] >> 63;
+  }
+  if(word_index + 1 < n_words) {
+    dilated |= row[word_index + 1] << 63;
+  }
+  return dilated;
+}
+
+// Adds to a row's edges every candidate connected to them, or to the edges in the rows above and below.
+// Returns whether the row changed.
+DMZ_INTERNAL bool llcv_canny7_grow_row(const uint64_t *candidates, uint64_t *edges, uint64_t *grown,
+                                       uint16_t row_index, uint16_t height, uint16_t words_per_row) {
+  const uint64_t *mask = candidates + row_index * words_per_row;
+  uint64_t *row_edges = edges + row_index * words_per_row;
+  const uint64_t *edges_above = row_index > 0 ? row_edges - words_per_row : NULL;
+  const uint64_t *edges_below = row_index + 1 < height ? row_edges + words_per_row : NULL;
+
+  uint64_t any_new = 0;
+  for(uint16_t word_index = 0; word_index < words_per_row; word_index++) {
+    uint64_t neighbors = 0;
+    if(edges_above != NULL) {
+      neighbors |= llcv_dilate_row_word_u64(edges_above, word_index, words_per_row);
+    }
+    if(edges_below != NULL) {
+      neighbors |= llcv_dilate_row_word_u64(edges_below, word_index, words_per_row);
+    }
+    grown[word_index] = row_edges[word_index] | (mask[word_index] & neighbors);
+    any_new |= grown[word_index] ^ row_edges[word_index];
+  }
+  if(any_new == 0) {
+    return false;
+  }
+
+  llcv_fill_runs_row_u64(mask, grown, words_per_row);
+  memcpy(row_edges, grown, words_per_row * sizeof(uint64_t));
+  return true;
+}
+
+// edges starts out as the strong edges; candidates includes them.
+DMZ_INTERNAL void llcv_canny7_hysteresis(const uint64_t *candidates, uint64_t *edges, uint64_t *grown, uint16_t height, uint16_t words_per_row) {
+  // Strong edges first grow along their own rows. Then each sweep lets edges grow any distance
+  // in its direction; once a sweep changes nothing, every row is stable against its neighbors.
+  for(uint16_t row_index = 0; row_index < height; row_index++) {
+    llcv_fill_runs_row_u64(candidates + row_index * words_per_row, edges + row_index * words_per_row, words_per_row);
+  }
+  bool changed = true;
+  for(bool downward = true; changed; downward = !downward) {
+    changed = false;
+    for(uint16_t step = 0; step < height; step++) {
+      uint16_t row_index = downward ? step : height - 1 - step;
+      changed |= llcv_canny7_grow_row(candidates, edges, grown, row_index, height, words_per_row);
+    }
+  }
+}
+
+#pragma mark llcv_canny7_precomputed_sobel
+
+DMZ_INTERNAL void llcv_canny7_precomputed_sobel_rows(IplImage *src, IplImage *dst, IplImage *sobel_dx, IplImage *sobel_dy,
+                                                     double low_thresh, double high_thresh, IplImage *scratch, bool use_simd) {
+  CvSize size = cvGetSize(src);
+  uint16_t width = (uint16_t)size.width;
+  uint16_t height = (uint16_t)size.height;
+
+  if(low_thresh > high_thresh) {
+    double t;
+    CV_SWAP(low_thresh, high_thresh, t);
+  }
+  int32_t low = cvFloor(low_thresh);
+  int32_t high = cvFloor(high_thresh);
+
+  bool scratch_provided = scratch != NULL;
+  llcv_canny7_reserve_scratch(&scratch, size);
+
+  uint16_t words_per_row = llcv_canny7_words_per_row(width);
+  size_t bitmap_words = (size_t)words_per_row * height;
+  int32_t *mag_origin = (int32_t *)scratch->imageData;
+  uint64_t *candidates = (uint64_t *)(scratch->imageData + llcv_canny7_magnitude_bytes(width));
+  uint64_t *edges = candidates + bitmap_words;
+  uint64_t *grown = edges + bitmap_words;
+  memset(candidates, 0, 2 * bitmap_words * sizeof(uint64_t));
+
+  const uint8_t *dx_origin = (const uint8_t *)llcv_get_data_origin(sobel_dx);
+  const uint8_t *dy_origin = (const uint8_t *)llcv_get_data_origin(sobel_dy);
+
+  // A ring of three magnitude rows: the row being suppressed, and its neighbors (zeros beyond the image).
+  int32_t *above = mag_origin + 1;
+  int32_t *center = above + width + 2;
+  int32_t *below = center + width + 2;
+  memset(above - 1, 0, (width + 2) * sizeof(int32_t));
+  llcv_canny7_magnitude_row((const int16_t *)dx_origin, (const int16_t *)dy_origin, center, width, use_simd);
+
+  for(uint16_t row_index = 0; row_index < height; row_index++) {
+    const int16_t *dx_row = (const int16_t *)(dx_origin + row_index * sobel_dx->widthStep);
+    const int16_t *dy_row = (const int16_t *)(dy_origin + row_index * sobel_dy->widthStep);
+    if(row_index + 1 < height) {
+      llcv_canny7_magnitude_row((const int16_t *)((const uint8_t *)dx_row + sobel_dx->widthStep),
+                                (const int16_t *)((const uint8_t *)dy_row + sobel_dy->widthStep), below, width, use_simd);
+    } else {
+      memset(below - 1, 0, (width + 2) * sizeof(int32_t));
+    }
+
+    llcv_canny7_suppress_row(dx_row, dy_row, above, center, below, low, high,
+                             candidates + row_index * words_per_row, edges + row_index * words_per_row, width, use_simd);
+
+    int32_t *recycled = above;
+    above = center;
+    center = below;
+    below = recycled;
+  }
+
+  llcv_canny7_hysteresis(candidates, edges, grown, height, words_per_row);
+
+  uint8_t *dst_origin = (uint8_t *)llcv_get_data_origin(dst);
+  for(uint16_t row_index = 0; row_index < height; row_index++) {
+    const uint64_t *row_edges = edges + row_index * words_per_row;
+    uint8_t *dst_row = dst_origin + row_index * dst->widthStep;
+    for(uint16_t col_index = 0; col_index < width; col_index++) {
+      dst_row[col_index] = (uint8_t)-(int)((row_edges[col_index >> 6] >> (col_index & 63)) & 1);
+    }
+  }
+
+  if(!scratch_provided) {
+    cvReleaseImage(&scratch);
+  }
+}
+
+DMZ_INTERNAL void llcv_canny7_precomputed_sobel(IplImage *src, IplImage *dst, IplImage *dx, IplImage *dy, double low_thresh, double high_thresh, IplImage *scratch) {
+  assert(src->nChannels == 1 && src->depth == IPL_DEPTH_8U);
+  assert(dst->nChannels == 1 && dst->depth == IPL_DEPTH_8U);
+  assert(dx->depth == (int)IPL_DEPTH_16S && dy->depth == (int)IPL_DEPTH_16S); // IPL_DEPTH_16S is unsigned
+  CvSize size = cvGetSize(src);
+#pragma unused(size) // work around broken compiler warnings
+  assert(size.width == cvGetSize(dst).width && size.height == cvGetSize(dst).height);
+  assert(size.width == cvGetSize(dx).width && size.height == cvGetSize(dx).height);
+  assert(size.width == cvGetSize(dy).width && size.height == cvGetSize(dy).height);
+  assert(scratch == NULL || (size_t)scratch->width >= llcv_canny7_scratch_bytes(size));
+
+  llcv_canny7_precomputed_sobel_rows(src, dst, dx, dy, low_thresh, high_thresh, scratch, true);
+}
+
+#undef kCannyShift
+#undef kCannyTan22
 
 DMZ_INTERNAL void llcv_canny7(IplImage *src, IplImage *dst, double low_thresh, double high_thresh) {
   CvSize src_size = cvGetSize(src);
 
-  IplImage *sobel_scratch = cvCreateImage(cvSize(src_size.height, src_size.width), IPL_DEPTH_16S, 1);
   IplImage *dx = cvCreateImage(src_size, IPL_DEPTH_16S, 1);
   IplImage *dy = cvCreateImage(src_size, IPL_DEPTH_16S, 1);
-  llcv_sobel7(src, dx, sobel_scratch, 1, 0);
-  llcv_sobel7(src, dy, sobel_scratch, 0, 1);
-  cvReleaseImage(&sobel_scratch);
+  llcv_sobel7_dx_dy(src, dx, dy, NULL);
 
-  llcv_canny7_precomputed_sobel(src, dst, dx, dy, low_thresh, high_thresh);
+  llcv_canny7_precomputed_sobel(src, dst, dx, dy, low_thresh, high_thresh, NULL);
 
   cvReleaseImage(&dx);
   cvReleaseImage(&dy);
@@ -565,7 +1014,7 @@ DMZ_INTERNAL double sum_abs_magnitude(IplImage *image) {
     }
 }
 
-DMZ_INTERNAL void llcv_adaptive_canny7_precomputed_sobel(IplImage *src, IplImage *dst, IplImage *dx, IplImage *dy) {
+DMZ_INTERNAL void llcv_adaptive_canny7_precomputed_sobel(IplImage *src, IplImage *dst, IplImage *dx, IplImage *dy, IplImage *scratch) {
   CvSize src_size = cvGetSize(src);
   // We can use either sum_abs_magnitude (|dx| + |dy|) or sum_magnitude (sqrt(dx^2 + dy^2)) here. They yield
   // comparable results, and sum_abs_magnitude is marginally faster to compute, and can be made faster
@@ -576,7 +1025,7 @@ DMZ_INTERNAL void llcv_adaptive_canny7_precomputed_sobel(IplImage *src, IplImage
   double low_threshold = mean;
   double high_threshold = 3.0f * low_threshold;
 
-  llcv_canny7_precomputed_sobel(src, dst, dx, dy, low_threshold, high_threshold);
+  llcv_canny7_precomputed_sobel(src, dst, dx, dy, low_threshold, high_threshold, scratch);
 }
 
 #endif
@@ -6,6 +6,13 @@
 
 // Canny on an image, with aperature 7.
 DMZ_INTERNAL void llcv_canny7(IplImage *src, IplImage *dst, double low_thresh, double high_thresh);
-DMZ_INTERNAL void llcv_adaptive_canny7_precomputed_sobel(IplImage *src, IplImage *dst, IplImage *dx, IplImage *dy);
+
+// Canny with thresholds picked from the mean gradient magnitude, given the image's llcv_sobel7 dx and dy.
+// scratch may be NULL (in which case it will be allocated internally), or come from llcv_canny7_reserve_scratch.
+DMZ_INTERNAL void llcv_adaptive_canny7_precomputed_sobel(IplImage *src, IplImage *dst, IplImage *dx, IplImage *dy, IplImage *scratch);
+
+// Makes *scratch (NULL, or an earlier result) big enough for canny on an image of src_size, and returns it.
+// It only ever grows, so one scratch can serve a series of images; the caller releases it.
+DMZ_INTERNAL IplImage *llcv_canny7_reserve_scratch(IplImage **scratch, CvSize src_size);
 
 #endif
@@ -10,8 +10,10 @@
 #include "opencv2/imgproc/imgproc_c.h"
 #include "image_util.h"
 
-#if DMZ_HAS_NEON_COMPILETIME
-#include <arm_neon.h>
+#if DMZ_HAS_AVX2_COMPILETIME
+#include <immintrin.h>
+#elif DMZ_HAS_SSE2_COMPILETIME
+#include <emmintrin.h>
 #endif
 
 typedef uint16_t uint8x2_t;
@@ -62,9 +64,9 @@ DMZ_INTERNAL void llcv_split_u8_neon(IplImage *interleaved, IplImage *channel1,
     
     for(uint16_t scalar_index = 0; scalar_index < scalar_cols; scalar_index++) {
       uint16_t col_index = scalar_index + vector_cols;
-      uint8x2_t pixel_val = image_row_origin[col_index];
-      channel1_row_origin[col_index] = (uint8_t)(pixel_val >> 8);
-      channel2_row_origin[col_index] = (uint8_t)(pixel_val & 0xFF);
+      const uint8_t *pixel = (const uint8_t *)(image_row_origin + col_index);
+      channel1_row_origin[col_index] = pixel[0]; // the first byte, as vld2q_u8 and cvSplit have it
+      channel2_row_origin[col_index] = pixel[1];
     }
   }
 #undef kVectorSize
@@ -126,306 +128,188 @@ DMZ_INTERNAL void llcv_split_u8(IplImage *interleaved, IplImage *channel1, IplIm
   }
 }
 
-#if DMZ_HAS_NEON_COMPILETIME
-// linear2 support functions
-
-static inline void vec_lineardown2_1d_u8_q(const uint8_t *src, uint8_t *dst) {
-  asm volatile
-  (
-   // load src pixels
-   "mov r0, %[src]" "\n\t"
-   "vld2.8 {q0-q1}, [r0]" "\n\t"
-
-   // halving rounding add
-   "vrhadd.u8 q2, q0, q1" "\n\t"
-
-   // write to dst
-   "mov r0, %[dst]" "\n\t"
-   "vst1.8 {q2}, [r0]" "\n\t"
-   
-   : // output
-   
-   : // input
-   [src]"r" (src),
-   [dst]"r" (dst)
-   
-   : // clobbered
-   "r0", // used for src, dst pointers
-   "q0", "q1", "q2",
-   "memory"
-   );
+#pragma mark grad3 lineardown2 norm 1d
+
+// Stage one: the 3x3 cross morphological gradient along a row, its horizontally adjacent pairs averaged (rounded)
+// into dst, and the running min/max of dst. north, center and south are the row and those above and below it,
+// each with a pixel of context on either side, so pixel i of the row is center[i + 1] and its neighbors need
+// no bounds checks. (Passing the same row three times gives the 1d gradient: the cross's vertical arm then only
+// sees the center pixel again.)
+
+DMZ_INTERNAL inline uint8_t llcv_grad3_at_c(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint16_t index) {
+  uint8_t n = north[index + 1];
+  uint8_t w = center[index];
+  uint8_t c = center[index + 1];
+  uint8_t e = center[index + 2];
+  uint8_t s = south[index + 1];
+  return (uint8_t)(MAX(MAX(MAX(n, w), MAX(c, e)), s) - MIN(MIN(MIN(n, w), MIN(c, e)), s));
 }
 
-#endif
-
-DMZ_INTERNAL void llcv_lineardown2_1d_u8_neon(IplImage *src, IplImage *dst) {
-#if DMZ_HAS_NEON_COMPILETIME
-
-  uint8_t *src_data = (uint8_t *)src->imageData;
-  if(dmz_unlikely(NULL != src->roi)) {
-    src_data += src->roi->yOffset * src->widthStep + src->roi->xOffset * sizeof(uint8_t);
+DMZ_INTERNAL void llcv_grad3_down2_row_c(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst, uint16_t col_index, uint16_t dst_width, uint8_t *min_val, uint8_t *max_val) {
+  for(; col_index < dst_width; col_index++) {
+    uint8_t value = (uint8_t)((llcv_grad3_at_c(north, center, south, 2 * col_index) + llcv_grad3_at_c(north, center, south, 2 * col_index + 1) + 1) >> 1);
+    dst[col_index] = value;
+    *min_val = MIN(*min_val, value);
+    *max_val = MAX(*max_val, value);
   }
-  
-  uint8_t *dst_data = (uint8_t *)dst->imageData;
-  if(dmz_unlikely(NULL != dst->roi)) {
-    dst_data += dst->roi->yOffset * dst->widthStep + dst->roi->xOffset * sizeof(uint8_t);
-  }
-  
-  CvSize src_size = cvGetSize(src);
-  
-  uint16_t src_index = 0;
+}
 
-  bool done = false;
-  while(!done) {
-    // calc using 2 q registers at a time
-    vec_lineardown2_1d_u8_q(src_data + src_index, dst_data + (src_index >> 1));
-    src_index += (kQRegisterElements8 << 1);
-    
-    if(src_index == src_size.width) {
-      done = true;
-    } else if(src_index > src_size.width - (kQRegisterElements8 << 1)) {
-      // backtrack to handle leftovers
-      src_index = (uint16_t)(src_size.width - (kQRegisterElements8 << 1));
-    }
+// Stage two: dst[i] = (src[i] - min_val) * multiplier.
+DMZ_INTERNAL void llcv_norm_convert_row_c(const uint8_t *src, float *dst, uint16_t col_index, uint16_t width, uint8_t min_val, float multiplier) {
+  for(; col_index < width; col_index++) {
+    dst[col_index] = (float)(src[col_index] - min_val) * multiplier;
   }
-
-#endif
 }
 
-DMZ_INTERNAL void llcv_lineardown2_1d_u8_c(IplImage *src, IplImage *dst) {
-  cvResize(src, dst, CV_INTER_LINEAR);
+#if DMZ_HAS_SSE2_COMPILETIME
+// The gradient at pixels index through index + 15
+DMZ_INTERNAL inline __m128i llcv_grad3_sse2(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint16_t index) {
+  __m128i n = _mm_loadu_si128((const __m128i *)(north + index + 1));
+  __m128i w = _mm_loadu_si128((const __m128i *)(center + index));
+  __m128i c = _mm_loadu_si128((const __m128i *)(center + index + 1));
+  __m128i e = _mm_loadu_si128((const __m128i *)(center + index + 2));
+  __m128i s = _mm_loadu_si128((const __m128i *)(south + index + 1));
+  __m128i max_vec = _mm_max_epu8(n, _mm_max_epu8(w, _mm_max_epu8(c, _mm_max_epu8(e, s))));
+  __m128i min_vec = _mm_min_epu8(n, _mm_min_epu8(w, _mm_min_epu8(c, _mm_min_epu8(e, s))));
+  return _mm_sub_epi8(max_vec, min_vec);
 }
 
-#define TEST_LINEAR_DOWN2 0
-
-DMZ_INTERNAL void llcv_lineardown2_1d_u8(IplImage *src, IplImage *dst) {
-  assert(src->depth == IPL_DEPTH_8U);
-  assert(dst->depth == IPL_DEPTH_8U);
-  assert(src != dst);
-  assert(src->nChannels == 1);
-  assert(dst->nChannels == 1);
-#if DMZ_DEBUG
-  CvSize src_size = cvGetSize(src);
-  CvSize dst_size = cvGetSize(dst);
-  assert(src_size.height == dst_size.height);
-  assert(src_size.height == 1);  // 1d!
-  assert(src_size.width >= (kQRegisterElements8 << 1));
-  assert(src_size.width % 2 == 0);
-  assert(src_size.width / 2 == dst_size.width);
-#endif
-  
-  if(dmz_has_neon_runtime()) {
-    llcv_lineardown2_1d_u8_neon(src, dst);
-#if TEST_LINEAR_DOWN2
-    IplImage *dst_c = cvCreateImage(dst_size, IPL_DEPTH_8U, 1);
-    
-    llcv_lineardown2_1d_u8_c(src, dst_c);
-    
-    IplImage *delta = cvCreateImage(dst_size, IPL_DEPTH_8U, 1);
-    
-    cvAbsDiff(dst, dst_c, delta);
-    
-    int n_errors = cvCountNonZero(delta);
-    if(n_errors > 0) {
-      fprintf(stderr, "llcv_lineardown2_1d_u8 errors: %i\n", n_errors);
-      // for (uint16_t x = 0; x < dst_size.width; x++) {
-      //   fprintf(stderr, "%d, ", int(cvGet1D(dst_c, x).val[0]));
-      // }
-      // fprintf(stderr, "\n");
-    }
-    
-    cvReleaseImage(&dst_c);
-    cvReleaseImage(&delta);
-#endif
-  } else {
-    llcv_lineardown2_1d_u8_c(src, dst);
+DMZ_INTERNAL uint16_t llcv_grad3_down2_row_sse2(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst, uint16_t dst_width, uint8_t *min_val, uint8_t *max_val) {
+  const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+  __m128i running_min = _mm_set1_epi8((char)*min_val);
+  __m128i running_max = _mm_set1_epi8((char)*max_val);
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= dst_width; col_index += 16) {
+    __m128i grad_lo = llcv_grad3_sse2(north, center, south, 2 * col_index);
+    __m128i grad_hi = llcv_grad3_sse2(north, center, south, 2 * col_index + 16);
+    __m128i evens = _mm_packus_epi16(_mm_and_si128(grad_lo, low_bytes), _mm_and_si128(grad_hi, low_bytes));
+    __m128i odds = _mm_packus_epi16(_mm_srli_epi16(grad_lo, 8), _mm_srli_epi16(grad_hi, 8));
+    __m128i down = _mm_avg_epu8(evens, odds); // rounds, as in the c version
+    _mm_storeu_si128((__m128i *)(dst + col_index), down);
+    running_min = _mm_min_epu8(running_min, down);
+    running_max = _mm_max_epu8(running_max, down);
+  }
+  uint8_t mins[16];
+  uint8_t maxes[16];
+  _mm_storeu_si128((__m128i *)mins, running_min);
+  _mm_storeu_si128((__m128i *)maxes, running_max);
+  for(uint8_t lane = 0; lane < 16; lane++) {
+    *min_val = MIN(*min_val, mins[lane]);
+    *max_val = MAX(*max_val, maxes[lane]);
   }
+  return col_index;
 }
-
-
-#define TEST_NORM_CONVERT 0
-
-DMZ_INTERNAL void llcv_minmax_1d_u8_neon(uint8_t *src_data, uint16_t src_length, uint8_t *min_val, uint8_t *max_val) {
-#if DMZ_HAS_NEON_COMPILETIME
-  uint8x16_t running_min = vdupq_n_u8(UINT8_MAX);
-  uint8x16_t running_max = vdupq_n_u8(0);
-
-  uint16_t index = 0;
-  bool done = false;
-  while(!done) {
-    uint8x16_t chunk = vld1q_u8(src_data + index);
-    running_min = vminq_u8(running_min, chunk);
-    running_max = vmaxq_u8(running_max, chunk);
-    index += kQRegisterElements8;
-  
-    if(index == src_length) {
-      done = true;
-    } else if(index > src_length - kQRegisterElements8) {
-      // backtrack to handle leftovers
-      index = src_length - kQRegisterElements8;
-    }
+DMZ_INTERNAL uint16_t llcv_norm_convert_row_sse2(const uint8_t *src, float *dst, uint16_t width, uint8_t min_val, float multiplier) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i vec_min = _mm_set1_epi8((char)min_val);
+  const __m128 vec_mult = _mm_set1_ps(multiplier);
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    __m128i chunk8 = _mm_subs_epu8(_mm_loadu_si128((const __m128i *)(src + col_index)), vec_min);
+    __m128i chunk16l = _mm_unpacklo_epi8(chunk8, zero);
+    __m128i chunk16h = _mm_unpackhi_epi8(chunk8, zero);
+    _mm_storeu_ps(dst + col_index, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(chunk16l, zero)), vec_mult));
+    _mm_storeu_ps(dst + col_index + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(chunk16l, zero)), vec_mult));
+    _mm_storeu_ps(dst + col_index + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(chunk16h, zero)), vec_mult));
+    _mm_storeu_ps(dst + col_index + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(chunk16h, zero)), vec_mult));
   }
-
-  // collapse q registers (16) to d registers (8)
-  uint8x8_t max_8 = vmax_u8(vget_low_u8(running_max), vget_high_u8(running_max));
-  uint8x8_t min_8 = vmin_u8(vget_low_u8(running_min), vget_high_u8(running_min));
-
-  // see diagrams at http://blogs.arm.com/software-enablement/684-coding-for-neon-part-5-rearranging-vectors/
-  
-  // collapse adjacent pairs: 0-1, 2-3, 4-5, 6-7
-  max_8 = vmax_u8(max_8, vrev16_u8(max_8));
-  min_8 = vmin_u8(min_8, vrev16_u8(min_8));
-
-  // collapse adjacent pairs-of-pairs, so now: 0-3, 4-7
-  max_8 = vmax_u8(max_8, vrev32_u8(max_8));
-  min_8 = vmin_u8(min_8, vrev32_u8(min_8));
-
-  // now a simple scalar max 0, 4 is enough
-  uint8_t max_first = vget_lane_u8(max_8, 0);
-  uint8_t max_second = vget_lane_u8(max_8, 4);
-  *max_val = MAX(max_first, max_second);
-
-  uint8_t min_first = vget_lane_u8(min_8, 0);
-  uint8_t min_second = vget_lane_u8(min_8, 4);
-  *min_val = MIN(min_first, min_second);
-#endif
+  return col_index;
 }
+#endif
 
-
-DMZ_INTERNAL void llcv_norm_convert_1d_u8_to_f32_neon(IplImage *src, IplImage *dst) {
 #if DMZ_HAS_NEON_COMPILETIME
-  // Find min/max
-  
-  uint8_t *src_data = (uint8_t *)src->imageData;
-  if(dmz_unlikely(NULL != src->roi)) {
-    src_data += src->roi->yOffset * src->widthStep + src->roi->xOffset * sizeof(uint8_t);
-  }
-  
-  uint8_t *dst_data_origin = (uint8_t *)dst->imageData;
-  if(dmz_unlikely(NULL != dst->roi)) {
-    dst_data_origin += dst->roi->yOffset * dst->widthStep + dst->roi->xOffset * sizeof(float32_t);
-  }
-  float32_t *dst_data = (float32_t *)dst_data_origin;
-
-  CvSize src_size = cvGetSize(src);
-  
-  uint8_t src_min;
-  uint8_t src_max;
-  llcv_minmax_1d_u8_neon(src_data, (uint16_t)src_size.width, &src_min, &src_max);
+DMZ_INTERNAL inline uint8x16_t llcv_grad3_neon(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint16_t index) {
+  uint8x16_t n = vld1q_u8(north + index + 1);
+  uint8x16_t w = vld1q_u8(center + index);
+  uint8x16_t c = vld1q_u8(center + index + 1);
+  uint8x16_t e = vld1q_u8(center + index + 2);
+  uint8x16_t s = vld1q_u8(south + index + 1);
+  uint8x16_t max_vec = vmaxq_u8(n, vmaxq_u8(w, vmaxq_u8(c, vmaxq_u8(e, s))));
+  uint8x16_t min_vec = vminq_u8(n, vminq_u8(w, vminq_u8(c, vminq_u8(e, s))));
+  return vsubq_u8(max_vec, min_vec);
+}
 
-#if TEST_NORM_CONVERT
-  double cv_min, cv_max;
-  cvMinMaxLoc(src, &cv_min, &cv_max, NULL, NULL);
-  if(int(cv_min) != src_min || int(cv_max) != src_max) {
-    fprintf(stderr, "cv_min %f src_min %d; cv_max %f, src_max %d\n", cv_min, src_min, cv_max, src_max);
+DMZ_INTERNAL uint16_t llcv_grad3_down2_row_neon(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst, uint16_t dst_width, uint8_t *min_val, uint8_t *max_val) {
+  uint8x16_t running_min = vdupq_n_u8(*min_val);
+  uint8x16_t running_max = vdupq_n_u8(*max_val);
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= dst_width; col_index += 16) {
+    uint8x16x2_t pairs = vuzpq_u8(llcv_grad3_neon(north, center, south, 2 * col_index),
+                                  llcv_grad3_neon(north, center, south, 2 * col_index + 16)); // evens, odds
+    uint8x16_t down = vrhaddq_u8(pairs.val[0], pairs.val[1]); // halving rounding add
+    vst1q_u8(dst + col_index, down);
+    running_min = vminq_u8(running_min, down);
+    running_max = vmaxq_u8(running_max, down);
   }
-#endif
+  uint8_t mins[16];
+  uint8_t maxes[16];
+  vst1q_u8(mins, running_min);
+  vst1q_u8(maxes, running_max);
+  for(uint8_t lane = 0; lane < 16; lane++) {
+    *min_val = MIN(*min_val, mins[lane]);
+    *max_val = MAX(*max_val, maxes[lane]);
+  }
+  return col_index;
+}
 
-  uint8_t delta = src_max - src_min;
-  float32_t multiplier = delta == 0 ? 0.5f : 1.0f / delta; // if delta == 0, they're *all* identical, so it doesn't really matter where we map them, it's going to be bad...
-  
-  uint8x16_t vec_min = vdupq_n_u8(src_min);
+DMZ_INTERNAL uint16_t llcv_norm_convert_row_neon(const uint8_t *src, float *dst, uint16_t width, uint8_t min_val, float multiplier) {
+  uint8x16_t vec_min = vdupq_n_u8(min_val);
   float32x4_t vec_mult = vdupq_n_f32(multiplier);
-
-  uint16_t src_index = 0;
-  bool done = false;
-  while(!done) {
-    // calc using a q register
-    uint8x16_t chunk8 = vld1q_u8(src_data + src_index);
-
-    // subtract off min value
-    if(src_min > 0) {
-      // src_min == 0 is a common case, so optimize it away
-      chunk8 = vsubq_u8(chunk8, vec_min);
-    }
-
-    // scale up from uint8_t to uint32_t
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    uint8x16_t chunk8 = vsubq_u8(vld1q_u8(src + col_index), vec_min);
     uint16x8_t chunk16l = vmovl_u8(vget_low_u8(chunk8));
     uint16x8_t chunk16h = vmovl_u8(vget_high_u8(chunk8));
-    uint32x4_t chunk32ll = vmovl_u16(vget_low_u16(chunk16l));
-    uint32x4_t chunk32lh = vmovl_u16(vget_high_u16(chunk16l));
-    uint32x4_t chunk32hl = vmovl_u16(vget_low_u16(chunk16h));
-    uint32x4_t chunk32hh = vmovl_u16(vget_high_u16(chunk16h));
-
-    // convert from uint32_t to float32_t
-    float32x4_t float32ll = vcvtq_f32_u32(chunk32ll);
-    float32x4_t float32lh = vcvtq_f32_u32(chunk32lh);
-    float32x4_t float32hl = vcvtq_f32_u32(chunk32hl);
-    float32x4_t float32hh = vcvtq_f32_u32(chunk32hh);
-
-    // multiply out by the normalization factor
-    float32ll = vmulq_f32(float32ll, vec_mult);
-    float32lh = vmulq_f32(float32lh, vec_mult);
-    float32hl = vmulq_f32(float32hl, vec_mult);
-    float32hh = vmulq_f32(float32hh, vec_mult);
-
-    // store to the destination
-    vst1q_f32(dst_data + src_index, float32ll);
-    vst1q_f32(dst_data + src_index + 4, float32lh);
-    vst1q_f32(dst_data + src_index + 8, float32hl);
-    vst1q_f32(dst_data + src_index + 12, float32hh);
-
-    src_index += kQRegisterElements8;
-
-    if(src_index == src_size.width) {
-      done = true;
-    } else if(src_index > src_size.width - kQRegisterElements8) {
-      // backtrack to handle leftovers
-      src_index = (uint16_t)(src_size.width - kQRegisterElements8);
-    }
+    vst1q_f32(dst + col_index, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(chunk16l))), vec_mult));
+    vst1q_f32(dst + col_index + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(chunk16l))), vec_mult));
+    vst1q_f32(dst + col_index + 8, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(chunk16h))), vec_mult));
+    vst1q_f32(dst + col_index + 12, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(chunk16h))), vec_mult));
   }
-#endif
+  return col_index;
 }
+#endif
 
-DMZ_INTERNAL void llcv_norm_convert_1d_u8_to_f32_c(IplImage *src, IplImage *dst) {
-  cvConvertScale(src, dst, 1.0f / 255.0f, 0);
-  cvNormalize(dst, dst, 0.0f, 1.0f, CV_MINMAX, NULL);
-}
+DMZ_INTERNAL void llcv_morph_grad3_cross_lineardown2_norm_u8_to_f32(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint16_t width, float *dst) {
+  assert(width % 2 == 0);
+  uint16_t dst_width = width / 2;
 
-DMZ_INTERNAL void llcv_norm_convert_1d_u8_to_f32(IplImage *src, IplImage *dst) {
-  assert(src->depth == IPL_DEPTH_8U);
-  assert(dst->depth == IPL_DEPTH_32F);
-  assert(src->nChannels == 1);
-  assert(dst->nChannels == 1);
-#if DMZ_DEBUG
-  CvSize src_size = cvGetSize(src);
-  CvSize dst_size = cvGetSize(dst);
-  assert(src_size.height == dst_size.height);
-  assert(src_size.height == 1);  // 1d!
-  assert(src_size.width >= kQRegisterElements8);
-  assert(src_size.width == dst_size.width);
-#endif
-  
+  uint8_t down[dst_width];
+  uint8_t min_val = UINT8_MAX;
+  uint8_t max_val = 0;
+  uint16_t col_index = 0;
+#if DMZ_HAS_NEON_COMPILETIME
   if(dmz_has_neon_runtime()) {
-    llcv_norm_convert_1d_u8_to_f32_neon(src, dst);
-#if TEST_NORM_CONVERT
-    IplImage *dst_c = cvCreateImage(dst_size, IPL_DEPTH_32F, 1);
-    
-    llcv_norm_convert_1d_u8_to_f32_c(src, dst_c);
-    
-    IplImage *delta = cvCreateImage(dst_size, IPL_DEPTH_32F, 1);
-    
-    cvAbsDiff(dst, dst_c, delta);
-    float epsilon = 0.0001f;
-    cvThreshold(delta, delta, epsilon, 1.0, CV_THRESH_TOZERO);
-    
-    int n_errors = cvCountNonZero(delta);
-    if(n_errors > 0) {
-      fprintf(stderr, "llcv_norm_convert_1d_u8_to_f32 errors: %i\n", n_errors);
-      for(uint16_t x = 0; x < dst_size.width; x++) {
-        if(cvGet1D(delta, x).val[0] > epsilon) {
-          fprintf(stderr, "<%i: %f, %f, %f>, ", x, cvGet1D(src, x).val[0], cvGet1D(dst, x).val[0], cvGet1D(dst_c, x).val[0]);
-        }
-      }
-      fprintf(stderr, "\n");
-    }
-    
-    cvReleaseImage(&dst_c);
-    cvReleaseImage(&delta);
+    col_index = llcv_grad3_down2_row_neon(north, center, south, down, dst_width, &min_val, &max_val);
+  }
+#elif DMZ_HAS_SSE2_COMPILETIME
+  col_index = llcv_grad3_down2_row_sse2(north, center, south, down, dst_width, &min_val, &max_val);
 #endif
-  } else {
-    llcv_norm_convert_1d_u8_to_f32_c(src, dst);
+  llcv_grad3_down2_row_c(north, center, south, down, col_index, dst_width, &min_val, &max_val);
+
+  // as llcv_norm_convert_1d_u8_to_f32_neon: if delta == 0, every value maps to 0 anyway
+  uint8_t delta = max_val - min_val;
+  float multiplier = delta == 0 ? 0.5f : 1.0f / delta;
+  col_index = 0;
+#if DMZ_HAS_NEON_COMPILETIME
+  if(dmz_has_neon_runtime()) {
+    col_index = llcv_norm_convert_row_neon(down, dst, dst_width, min_val, multiplier);
   }
+#elif DMZ_HAS_SSE2_COMPILETIME
+  col_index = llcv_norm_convert_row_sse2(down, dst, dst_width, min_val, multiplier);
+#endif
+  llcv_norm_convert_row_c(down, dst, col_index, dst_width, min_val, multiplier);
+}
+
+DMZ_INTERNAL void llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32(llcv_view src, float *dst) {
+  assert(src.pixel_size == 1);
+  assert(src.height == 1);  // 1d!
+
+  // the row is its own context, with its end pixels repeated
+  uint8_t padded[src.width + 2];
+  padded[0] = src.data[0];
+  memcpy(padded + 1, src.data, src.width);
+  padded[src.width + 1] = src.data[src.width - 1];
+  llcv_morph_grad3_cross_lineardown2_norm_u8_to_f32(padded, padded, padded, src.width, dst);
 }
 
 #define TEST_YCbCr2RGB 0
@@ -595,5 +479,383 @@ DMZ_INTERNAL void llcv_YCbCr2RGB_u8(IplImage *y, IplImage *cb, IplImage *cr, Ipl
 
 }
 
+#define TEST_YCbCr2RGB_HALF_CHROMA 0
+#define TIME_YCbCr2RGB_HALF_CHROMA 0
+
+#if TIME_YCbCr2RGB_HALF_CHROMA
+static clock_t fastest_half_chroma = CLOCKS_PER_SEC * 1000;
+static clock_t fastest_upsample_then_convert = CLOCKS_PER_SEC * 1000;
+#define TIME_YCbCr2RGB_HALF_CHROMA_TIMING_ITERATIONS 100
+#endif
+
+// Fixed point coefficients, identical to those in llcv_YCbCr2RGB_u8_c
+#define kCbToB 29049
+#define kCbToG -5636
+#define kCrToG -11698
+#define kCrToR 22987
+
+// Converts pixels [col_index, width) of one row. Chroma sample i covers luma pixels 2i and 2i + 1.
+DMZ_INTERNAL void llcv_YCbCr2RGB_half_chroma_row_c(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row, uint8_t *dst_row, uint16_t col_index, uint16_t width, uint8_t n_channels) {
+  for(; col_index < width; col_index++) {
+    int32_t pix_y = y_row[col_index];
+    int32_t sCb = cb_row[col_index / 2] - 128;
+    int32_t sCr = cr_row[col_index / 2] - 128;
+    int32_t pix_b = pix_y + DESCALE_14(sCb * kCbToB);
+    int32_t pix_g = pix_y + DESCALE_14(sCb * kCbToG + sCr * kCrToG);
+    int32_t pix_r = pix_y + DESCALE_14(sCr * kCrToR);
+
+    uint8_t *dst_pixel = dst_row + col_index * n_channels;
+    dst_pixel[0] = SATURATED_BYTE(pix_r);
+    dst_pixel[1] = SATURATED_BYTE(pix_g);
+    dst_pixel[2] = SATURATED_BYTE(pix_b);
+    if(n_channels == 4) {
+      dst_pixel[3] = 0xff;
+    }
+  }
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+// Interleave 16 pixels worth of r, g, b planes into dst.
+DMZ_INTERNAL void llcv_store_rgb_u8_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b, uint8_t n_channels) {
+  if(n_channels == 4) {
+    __m128i a = _mm_set1_epi8((char)0xff);
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+    _mm_storeu_si128((__m128i *)(dst), _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+  } else {
+    // SSE2 has no byte shuffle, so pack three channels through the stack. The math is the expensive part anyway.
+    uint8_t planes[3][16];
+    _mm_storeu_si128((__m128i *)planes[0], r);
+    _mm_storeu_si128((__m128i *)planes[1], g);
+    _mm_storeu_si128((__m128i *)planes[2], b);
+    for(uint8_t i = 0; i < 16; i++) {
+      dst[3 * i] = planes[0][i];
+      dst[3 * i + 1] = planes[1][i];
+      dst[3 * i + 2] = planes[2][i];
+    }
+  }
+}
+
+// Chroma deltas, one int16 per chroma sample, for 8 samples. (cb_cr_lo/hi hold Cb,Cr pairs.)
+DMZ_INTERNAL inline __m128i llcv_chroma_delta_sse2(__m128i cb_cr_lo, __m128i cb_cr_hi, __m128i coefficients) {
+  __m128i rounding = _mm_set1_epi32(1 << 13);
+  __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_cr_lo, coefficients), rounding), 14);
+  __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_cr_hi, coefficients), rounding), 14);
+  return _mm_packs_epi32(lo, hi);
+}
+
+// Cb,Cr coefficient pairs for _mm_madd_epi16: Cb in the low half of each 32 bit lane, Cr in the high half.
+#define LLCV_CHROMA_COEFFICIENTS(cb, cr) ((int32_t)(((uint32_t)(uint16_t)(int16_t)(cr) << 16) | (uint16_t)(int16_t)(cb)))
+
+DMZ_INTERNAL uint16_t llcv_YCbCr2RGB_half_chroma_row_sse2(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row, uint8_t *dst_row, uint16_t width, uint8_t n_channels) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i to_b = _mm_set1_epi32(LLCV_CHROMA_COEFFICIENTS(kCbToB, 0));
+  const __m128i to_g = _mm_set1_epi32(LLCV_CHROMA_COEFFICIENTS(kCbToG, kCrToG));
+  const __m128i to_r = _mm_set1_epi32(LLCV_CHROMA_COEFFICIENTS(0, kCrToR));
+
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    __m128i y = _mm_loadu_si128((const __m128i *)(y_row + col_index));
+    __m128i s_cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cb_row + col_index / 2)), zero), bias);
+    __m128i s_cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cr_row + col_index / 2)), zero), bias);
+    __m128i cb_cr_lo = _mm_unpacklo_epi16(s_cb, s_cr);
+    __m128i cb_cr_hi = _mm_unpackhi_epi16(s_cb, s_cr);
+
+    __m128i y_lo = _mm_unpacklo_epi8(y, zero);
+    __m128i y_hi = _mm_unpackhi_epi8(y, zero);
+
+    // Upsample by pairing each chroma delta with itself
+    __m128i delta = llcv_chroma_delta_sse2(cb_cr_lo, cb_cr_hi, to_r);
+    __m128i r = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(delta, delta)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(delta, delta)));
+    delta = llcv_chroma_delta_sse2(cb_cr_lo, cb_cr_hi, to_g);
+    __m128i g = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(delta, delta)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(delta, delta)));
+    delta = llcv_chroma_delta_sse2(cb_cr_lo, cb_cr_hi, to_b);
+    __m128i b = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(delta, delta)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(delta, delta)));
+
+    llcv_store_rgb_u8_sse2(dst_row + col_index * n_channels, r, g, b, n_channels);
+  }
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_AVX2_COMPILETIME
+DMZ_INTERNAL inline __m256i llcv_chroma_delta_avx2(__m256i cb_cr_lo, __m256i cb_cr_hi, __m256i coefficients) {
+  __m256i rounding = _mm256_set1_epi32(1 << 13);
+  __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cb_cr_lo, coefficients), rounding), 14);
+  __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cb_cr_hi, coefficients), rounding), 14);
+  return _mm256_packs_epi32(lo, hi); // the in-lane unpack + pack round trip leaves samples in order
+}
+
+// Upsample 16 chroma deltas and add them to 32 luma values (already widened: pixels 0-15 and 16-31).
+DMZ_INTERNAL inline __m256i llcv_add_upsampled_delta_avx2(__m256i y_0_15, __m256i y_16_31, __m256i delta) {
+  __m256i delta_lo = _mm256_unpacklo_epi16(delta, delta); // pixels 0-7 | 16-23
+  __m256i delta_hi = _mm256_unpackhi_epi16(delta, delta); // pixels 8-15 | 24-31
+  __m256i sum_0_15 = _mm256_add_epi16(y_0_15, _mm256_permute2x128_si256(delta_lo, delta_hi, 0x20));
+  __m256i sum_16_31 = _mm256_add_epi16(y_16_31, _mm256_permute2x128_si256(delta_lo, delta_hi, 0x31));
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(sum_0_15, sum_16_31), 0xD8);
+}
+
+DMZ_INTERNAL uint16_t llcv_YCbCr2RGB_half_chroma_row_avx2(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row, uint8_t *dst_row, uint16_t width, uint8_t n_channels) {
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i to_b = _mm256_set1_epi32(LLCV_CHROMA_COEFFICIENTS(kCbToB, 0));
+  const __m256i to_g = _mm256_set1_epi32(LLCV_CHROMA_COEFFICIENTS(kCbToG, kCrToG));
+  const __m256i to_r = _mm256_set1_epi32(LLCV_CHROMA_COEFFICIENTS(0, kCrToR));
+
+  uint16_t col_index = 0;
+  for(; col_index + 32 <= width; col_index += 32) {
+    __m256i y = _mm256_loadu_si256((const __m256i *)(y_row + col_index));
+    __m256i y_0_15 = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y));
+    __m256i y_16_31 = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1));
+    __m256i s_cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(cb_row + col_index / 2))), bias);
+    __m256i s_cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(cr_row + col_index / 2))), bias);
+    __m256i cb_cr_lo = _mm256_unpacklo_epi16(s_cb, s_cr);
+    __m256i cb_cr_hi = _mm256_unpackhi_epi16(s_cb, s_cr);
+
+    __m256i r = llcv_add_upsampled_delta_avx2(y_0_15, y_16_31, llcv_chroma_delta_avx2(cb_cr_lo, cb_cr_hi, to_r));
+    __m256i g = llcv_add_upsampled_delta_avx2(y_0_15, y_16_31, llcv_chroma_delta_avx2(cb_cr_lo, cb_cr_hi, to_g));
+    __m256i b = llcv_add_upsampled_delta_avx2(y_0_15, y_16_31, llcv_chroma_delta_avx2(cb_cr_lo, cb_cr_hi, to_b));
+
+    uint8_t *dst = dst_row + col_index * n_channels;
+    llcv_store_rgb_u8_sse2(dst, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b), n_channels);
+    llcv_store_rgb_u8_sse2(dst + 16 * n_channels, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1), n_channels);
+  }
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+// Chroma deltas for 8 chroma samples; vrshrn_n_s32(x, 14) is exactly DESCALE_14 followed by a narrow.
+#define LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta) \
+  vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, vzipq_s16(delta, delta).val[0])), \
+              vqmovun_s16(vaddq_s16(y_hi, vzipq_s16(delta, delta).val[1])))
+
+DMZ_INTERNAL uint16_t llcv_YCbCr2RGB_half_chroma_row_neon(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row, uint8_t *dst_row, uint16_t width, uint8_t n_channels) {
+  const uint8x8_t bias = vdup_n_u8(128);
+
+  uint16_t col_index = 0;
+  for(; col_index + kQRegisterElements8 <= width; col_index += kQRegisterElements8) {
+    uint8x16_t y = vld1q_u8(y_row + col_index);
+    int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+    int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+    int16x8_t s_cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(cb_row + col_index / 2), bias));
+    int16x8_t s_cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(cr_row + col_index / 2), bias));
+
+    int16x8_t delta_r = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(s_cr), kCrToR), 14),
+                                     vrshrn_n_s32(vmull_n_s16(vget_high_s16(s_cr), kCrToR), 14));
+    int16x8_t delta_g = vcombine_s16(vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(s_cb), kCbToG), vget_low_s16(s_cr), kCrToG), 14),
+                                     vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(s_cb), kCbToG), vget_high_s16(s_cr), kCrToG), 14));
+    int16x8_t delta_b = vcombine_s16(vrshrn_n_s32(vmull_n_s16(vget_low_s16(s_cb), kCbToB), 14),
+                                     vrshrn_n_s32(vmull_n_s16(vget_high_s16(s_cb), kCbToB), 14));
+
+    uint8_t *dst = dst_row + col_index * n_channels;
+    if(n_channels == 4) {
+      uint8x16x4_t rgba;
+      rgba.val[0] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_r);
+      rgba.val[1] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_g);
+      rgba.val[2] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_b);
+      rgba.val[3] = vdupq_n_u8(0xff);
+      vst4q_u8(dst, rgba);
+    } else {
+      uint8x16x3_t rgb;
+      rgb.val[0] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_r);
+      rgb.val[1] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_g);
+      rgb.val[2] = LLCV_UPSAMPLED_CHANNEL_NEON(y_lo, y_hi, delta_b);
+      vst3q_u8(dst, rgb);
+    }
+  }
+  return col_index;
+}
+#endif
+
+DMZ_INTERNAL void llcv_YCbCr2RGB_half_chroma_row(const uint8_t *y_row, const uint8_t *cb_row, const uint8_t *cr_row, uint8_t *dst_row, uint16_t width, uint8_t n_channels, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_YCbCr2RGB_half_chroma_row_neon(y_row, cb_row, cr_row, dst_row, width, n_channels);
+    }
+#elif DMZ_HAS_AVX2_COMPILETIME
+    col_index = llcv_YCbCr2RGB_half_chroma_row_avx2(y_row, cb_row, cr_row, dst_row, width, n_channels);
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_YCbCr2RGB_half_chroma_row_sse2(y_row, cb_row, cr_row, dst_row, width, n_channels);
+#endif
+  }
+  // leftovers (or everything, without SIMD)
+  llcv_YCbCr2RGB_half_chroma_row_c(y_row, cb_row, cr_row, dst_row, col_index, width, n_channels);
+}
+
+// use_simd is false only to check (or time) the SIMD rows against the C ones.
+DMZ_INTERNAL void llcv_YCbCr2RGB_half_chroma_u8_rows(IplImage *y, IplImage *cb, IplImage *cr, IplImage *dst, bool use_simd) {
+  CvSize y_size = cvGetSize(y);
+  uint8_t *y_data_origin = (uint8_t *)llcv_get_data_origin(y);
+  uint8_t *cb_data_origin = (uint8_t *)llcv_get_data_origin(cb);
+  uint8_t *cr_data_origin = (uint8_t *)llcv_get_data_origin(cr);
+  uint8_t *dst_data_origin = (uint8_t *)llcv_get_data_origin(dst);
+
+  for(uint16_t row_index = 0; row_index < y_size.height; row_index++) {
+    llcv_YCbCr2RGB_half_chroma_row(y_data_origin + row_index * y->widthStep,
+                                   cb_data_origin + (row_index / 2) * cb->widthStep,
+                                   cr_data_origin + (row_index / 2) * cr->widthStep,
+                                   dst_data_origin + row_index * dst->widthStep,
+                                   (uint16_t)y_size.width, (uint8_t)dst->nChannels, use_simd);
+  }
+}
+
+#if TIME_YCbCr2RGB_HALF_CHROMA
+// The path this replaces: upsample both chroma planes to full size, then convert.
+DMZ_INTERNAL void llcv_YCbCr2RGB_upsample_then_convert(IplImage *y, IplImage *cb, IplImage *cr, IplImage *dst) {
+  IplImage *cb_full = cvCreateImage(cvGetSize(y), IPL_DEPTH_8U, 1);
+  IplImage *cr_full = cvCreateImage(cvGetSize(y), IPL_DEPTH_8U, 1);
+  cvResize(cb, cb_full, CV_INTER_NN);
+  cvResize(cr, cr_full, CV_INTER_NN);
+  llcv_YCbCr2RGB_u8(y, cb_full, cr_full, dst);
+  cvReleaseImage(&cb_full);
+  cvReleaseImage(&cr_full);
+}
+#endif
+
+DMZ_INTERNAL void llcv_YCbCr2RGB_half_chroma_u8(IplImage *y, IplImage *cb, IplImage *cr, IplImage *dst) {
+#if DMZ_DEBUG
+  CvSize y_size = cvGetSize(y);
+  CvSize cb_size = cvGetSize(cb);
+  CvSize cr_size = cvGetSize(cr);
+  CvSize dst_size = cvGetSize(dst);
+
+  assert(cb_size.width == (y_size.width + 1) / 2);
+  assert(cb_size.height == (y_size.height + 1) / 2);
+  assert(cb_size.width == cr_size.width);
+  assert(cb_size.height == cr_size.height);
+  assert(dst_size.width == y_size.width);
+  assert(dst_size.height == y_size.height);
+#endif
+
+  assert(y->nChannels == 1);
+  assert(cb->nChannels == 1);
+  assert(cr->nChannels == 1);
+  assert(dst->nChannels == 3 || dst->nChannels == 4);
+
+  assert(y->depth == IPL_DEPTH_8U);
+  assert(cb->depth == IPL_DEPTH_8U);
+  assert(cr->depth == IPL_DEPTH_8U);
+  assert(dst->depth == IPL_DEPTH_8U);
+
+#if TIME_YCbCr2RGB_HALF_CHROMA
+  clock_t start_half_chroma = clock();
+  for(int iter = 0; iter < TIME_YCbCr2RGB_HALF_CHROMA_TIMING_ITERATIONS; iter++) {
+#endif
+
+    llcv_YCbCr2RGB_half_chroma_u8_rows(y, cb, cr, dst, true);
+
+#if TIME_YCbCr2RGB_HALF_CHROMA
+  }
+  clock_t elapsed_half_chroma = clock() - start_half_chroma;
+  if(elapsed_half_chroma < fastest_half_chroma) {
+    fastest_half_chroma = elapsed_half_chroma;
+    dmz_debug_log("(llcv_YCbCr2RGB_half_chroma_u8) fastest fused: %f ms", (1000.0 * (double)fastest_half_chroma / (double)CLOCKS_PER_SEC) / (double)TIME_YCbCr2RGB_HALF_CHROMA_TIMING_ITERATIONS);
+  }
+
+  IplImage *timing_dst = cvCreateImage(cvGetSize(y), dst->depth, dst->nChannels);
+  clock_t start_upsample = clock();
+  for(int iter = 0; iter < TIME_YCbCr2RGB_HALF_CHROMA_TIMING_ITERATIONS; iter++) {
+    llcv_YCbCr2RGB_upsample_then_convert(y, cb, cr, timing_dst);
+  }
+  clock_t elapsed_upsample = clock() - start_upsample;
+  if(elapsed_upsample < fastest_upsample_then_convert) {
+    fastest_upsample_then_convert = elapsed_upsample;
+    dmz_debug_log("(llcv_YCbCr2RGB_half_chroma_u8) fastest upsample then convert: %f ms", (1000.0 * (double)fastest_upsample_then_convert / (double)CLOCKS_PER_SEC) / (double)TIME_YCbCr2RGB_HALF_CHROMA_TIMING_ITERATIONS);
+  }
+  cvReleaseImage(&timing_dst);
+#endif
+
+#if TEST_YCbCr2RGB_HALF_CHROMA
+  IplImage *c_dst = cvCreateImage(cvGetSize(y), dst->depth, dst->nChannels);
+  llcv_YCbCr2RGB_half_chroma_u8_rows(y, cb, cr, c_dst, false);
+
+  IplImage *delta = cvCreateImage(cvGetSize(y), dst->depth, dst->nChannels);
+  cvAbsDiff(dst, c_dst, delta);
+  CvScalar delta_sum = cvSum(delta);
+  if(delta_sum.val[0] + delta_sum.val[1] + delta_sum.val[2] + delta_sum.val[3] > 0) {
+    dmz_debug_log("(llcv_YCbCr2RGB_half_chroma_u8) errors: %f, %f, %f, %f", delta_sum.val[0], delta_sum.val[1], delta_sum.val[2], delta_sum.val[3]);
+  }
+
+  cvReleaseImage(&delta);
+  cvReleaseImage(&c_dst);
+#endif
+}
+
+
+#pragma mark area down2
+
+DMZ_INTERNAL void llcv_area_down2_row_c(const uint8_t *row0, const uint8_t *row1, uint8_t *dst_row, uint16_t col_index, uint16_t dst_width) {
+  for(; col_index < dst_width; col_index++) {
+    uint16_t sum = row0[2 * col_index] + row0[2 * col_index + 1] + row1[2 * col_index] + row1[2 * col_index + 1];
+    dst_row[col_index] = (uint8_t)((sum + 2) >> 2);
+  }
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+// Sums of horizontally adjacent pairs, from both rows, for 16 source pixels.
+DMZ_INTERNAL inline __m128i llcv_area_down2_sums_sse2(__m128i src0, __m128i src1) {
+  const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+  __m128i sum = _mm_add_epi16(_mm_and_si128(src0, low_bytes), _mm_srli_epi16(src0, 8));
+  return _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(src1, low_bytes), _mm_srli_epi16(src1, 8)));
+}
+
+DMZ_INTERNAL uint16_t llcv_area_down2_row_sse2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst_row, uint16_t dst_width) {
+  const __m128i rounding = _mm_set1_epi16(2);
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= dst_width; col_index += 16) {
+    __m128i lo = llcv_area_down2_sums_sse2(_mm_loadu_si128((const __m128i *)(row0 + 2 * col_index)),
+                                           _mm_loadu_si128((const __m128i *)(row1 + 2 * col_index)));
+    __m128i hi = llcv_area_down2_sums_sse2(_mm_loadu_si128((const __m128i *)(row0 + 2 * col_index + 16)),
+                                           _mm_loadu_si128((const __m128i *)(row1 + 2 * col_index + 16)));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, rounding), 2);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, rounding), 2);
+    _mm_storeu_si128((__m128i *)(dst_row + col_index), _mm_packus_epi16(lo, hi));
+  }
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_area_down2_row_neon(const uint8_t *row0, const uint8_t *row1, uint8_t *dst_row, uint16_t dst_width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= dst_width; col_index += 8) {
+    uint16x8_t sum = vpaddlq_u8(vld1q_u8(row0 + 2 * col_index));
+    sum = vpadalq_u8(sum, vld1q_u8(row1 + 2 * col_index));
+    vst1_u8(dst_row + col_index, vrshrn_n_u16(sum, 2));
+  }
+  return col_index;
+}
+#endif
+
+DMZ_INTERNAL void llcv_area_down2_row_u8(const uint8_t *row0, const uint8_t *row1, uint8_t *dst_row, uint16_t dst_width) {
+  uint16_t col_index = 0;
+#if DMZ_HAS_NEON_COMPILETIME
+  if(dmz_has_neon_runtime()) {
+    col_index = llcv_area_down2_row_neon(row0, row1, dst_row, dst_width);
+  }
+#elif DMZ_HAS_SSE2_COMPILETIME
+  col_index = llcv_area_down2_row_sse2(row0, row1, dst_row, dst_width);
+#endif
+  // leftovers (or everything, without SIMD)
+  llcv_area_down2_row_c(row0, row1, dst_row, col_index, dst_width);
+}
+
+DMZ_INTERNAL void llcv_area_down2_u8(llcv_view src, llcv_view dst) {
+  assert(src.pixel_size == 1 && dst.pixel_size == 1);
+  assert(src.width / 2 == dst.width);
+  assert(src.height / 2 == dst.height);
+  for(uint16_t row_index = 0; row_index < dst.height; row_index++) {
+    llcv_area_down2_row_u8(llcv_view_row(src, 2 * row_index), llcv_view_row(src, 2 * row_index + 1), llcv_view_row(dst, row_index), dst.width);
+  }
+}
+
 
 #endif
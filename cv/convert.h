@@ -5,10 +5,32 @@
 
 #include "opencv2/core/core_c.h"
 #include "dmz_macros.h"
+#include "image_util.h"
 
 DMZ_INTERNAL void llcv_split_u8(IplImage *interleaved, IplImage *channel1, IplImage *channel2);
-DMZ_INTERNAL void llcv_lineardown2_1d_u8(IplImage *src, IplImage *dst);
-DMZ_INTERNAL void llcv_norm_convert_1d_u8_to_f32(IplImage *src, IplImage *dst);
+
+// The 1d morph gradient of a single row, halved by averaging adjacent pairs (rounded) and min-max normalized
+// to [0, 1] floats, all fused: the gradient is downsampled as it's computed, and only the downsampled bytes
+// (on the stack) are read twice.
+// dst (src's width / 2 floats) may be anywhere, e.g. a column of a model's batched input.
+DMZ_INTERNAL void llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32(llcv_view src, float *dst);
+
+// The same, but with the 3x3 cross gradient of the row center within its image, as cvMorphologyEx takes it
+// for a one-row roi: north and south are the rows above and below (or center again, at the image's edge).
+// Each row starts a pixel before the width pixels being processed and runs a pixel past them.
+DMZ_INTERNAL void llcv_morph_grad3_cross_lineardown2_norm_u8_to_f32(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint16_t width, float *dst);
+
 DMZ_INTERNAL void llcv_YCbCr2RGB_u8(IplImage *y, IplImage *cb, IplImage *cr, IplImage *dst);
 
+// As llcv_YCbCr2RGB_u8, but cb and cr are half size (rounded up) in each dimension,
+// as they come off the camera, and are upsampled (by replication) on the fly.
+DMZ_INTERNAL void llcv_YCbCr2RGB_half_chroma_u8(IplImage *y, IplImage *cb, IplImage *cr, IplImage *dst);
+
+// Halve each dimension by averaging 2x2 blocks (rounded). dst must be src's size / 2 (rounded down);
+// a trailing odd row or column of src is ignored.
+DMZ_INTERNAL void llcv_area_down2_u8(llcv_view src, llcv_view dst);
+
+// One row of llcv_area_down2_u8: dst_row[i] is the rounded mean of row0 and row1 at 2i and 2i + 1.
+DMZ_INTERNAL void llcv_area_down2_row_u8(const uint8_t *row0, const uint8_t *row1, uint8_t *dst_row, uint16_t dst_width);
+
 #endif
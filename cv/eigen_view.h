@@ -0,0 +1,51 @@
+//
+//  eigen_view.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef LLCV_EIGEN_VIEW_H
+#define LLCV_EIGEN_VIEW_H
+
+#include "eigen.h"
+#include "opencv2/core/core_c.h"
+#include "dmz_macros.h"
+#include "image_util.h"
+
+// Eigen views of a float llcv_view's pixels (or an image's roi), for handing images to the models
+// without copying them. The Eigen type must match the view's size exactly.
+
+// A row-major matrix views the pixels row for row, with rows stride apart, so any roi of any image will do.
+template <typename Matrix>
+DMZ_INTERNAL inline Eigen::Map<const Matrix, Eigen::Unaligned, Eigen::OuterStride<> > llcv_eigen_matrix_view(llcv_view view) {
+  EIGEN_STATIC_ASSERT(Matrix::IsRowMajor, THIS_METHOD_IS_ONLY_FOR_ROW_MAJOR_MATRICES);
+  assert(view.pixel_size == sizeof(float));
+  assert(view.stride % sizeof(float) == 0);
+  assert(view.height == Matrix::RowsAtCompileTime && view.width == Matrix::ColsAtCompileTime);
+  return Eigen::Map<const Matrix, Eigen::Unaligned, Eigen::OuterStride<> >((const float *)view.data,
+                                                                           Eigen::OuterStride<>(view.stride / sizeof(float)));
+}
+
+template <typename Matrix>
+DMZ_INTERNAL inline Eigen::Map<const Matrix, Eigen::Unaligned, Eigen::OuterStride<> > llcv_eigen_matrix_view(IplImage *image) {
+  assert(image->depth == IPL_DEPTH_32F && image->nChannels == 1);
+  return llcv_eigen_matrix_view<Matrix>(llcv_view_of_image(image));
+}
+
+// A vector views the pixels in raster order, which only works if there are no gaps between rows:
+// a single row, or rows exactly width floats apart.
+template <typename Vector>
+DMZ_INTERNAL inline Eigen::Map<const Vector> llcv_eigen_vector_view(llcv_view view) {
+  EIGEN_STATIC_ASSERT_VECTOR_ONLY(Vector);
+  assert(view.pixel_size == sizeof(float));
+  assert(view.width * view.height == Vector::SizeAtCompileTime);
+  assert(view.height == 1 || view.stride == (int)(view.width * sizeof(float)));
+  return Eigen::Map<const Vector>((const float *)view.data);
+}
+
+template <typename Vector>
+DMZ_INTERNAL inline Eigen::Map<const Vector> llcv_eigen_vector_view(IplImage *image) {
+  assert(image->depth == IPL_DEPTH_32F && image->nChannels == 1);
+  return llcv_eigen_vector_view<Vector>(llcv_view_of_image(image));
+}
+
+#endif
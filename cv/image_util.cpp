@@ -36,4 +36,63 @@ DMZ_INTERNAL void* llcv_get_data_origin(IplImage *image) {
   return data_origin;
 }
 
+#pragma mark views
+
+DMZ_INTERNAL llcv_view llcv_view_of_image(IplImage *image) {
+  CvSize size = cvGetSize(image);
+  return llcv_view_of_data(llcv_get_data_origin(image), (uint16_t)size.width, (uint16_t)size.height, image->widthStep,
+                           (uint8_t)(llcv_get_pixel_step(image) * image->nChannels));
+}
+
+DMZ_INTERNAL llcv_view llcv_view_of_data(void *data, uint16_t width, uint16_t height, int stride, uint8_t pixel_size) {
+  llcv_view view;
+  view.data = (uint8_t *)data;
+  view.width = width;
+  view.height = height;
+  view.stride = stride;
+  view.pixel_size = pixel_size;
+  return view;
+}
+
+DMZ_INTERNAL llcv_view llcv_view_rect(llcv_view view, CvRect rect) {
+  assert(rect.x >= 0 && rect.y >= 0 && rect.width >= 0 && rect.height >= 0);
+  assert(rect.x + rect.width <= view.width && rect.y + rect.height <= view.height);
+  return llcv_view_of_data(view.data + rect.y * view.stride + rect.x * view.pixel_size,
+                           (uint16_t)rect.width, (uint16_t)rect.height, view.stride, view.pixel_size);
+}
+
+DMZ_INTERNAL void llcv_image_header_for_view(llcv_view view, int depth, IplImage *header) {
+  cvInitImageHeader(header, cvSize(view.width, view.height), depth, 1, IPL_ORIGIN_TL, 4);
+  assert(llcv_get_pixel_step(header) == view.pixel_size);
+  header->widthStep = view.stride;
+  header->imageSize = view.stride * view.height;
+  header->imageData = (char *)view.data;
+  header->imageDataOrigin = header->imageData;
+}
+
+#pragma mark aligned images
+
+DMZ_INTERNAL IplImage *llcv_create_aligned_image(CvSize size, int depth, int channels) {
+  IplImage *image = cvCreateImageHeader(size, depth, channels);
+  int row_bytes = size.width * channels * llcv_get_pixel_step(image);
+  int width_step = (row_bytes + kLLCVImageRowAlignment - 1) & ~(kLLCVImageRowAlignment - 1);
+
+  // Over-allocate so that the data can be slid forward to an aligned address.
+  // imageDataOrigin keeps the pointer that was actually allocated, for llcv_release_aligned_image.
+  uint8_t *allocated = (uint8_t *)malloc(width_step * size.height + kLLCVImageRowAlignment - 1);
+  uint8_t *aligned = (uint8_t *)(((uintptr_t)allocated + kLLCVImageRowAlignment - 1) & ~(uintptr_t)(kLLCVImageRowAlignment - 1));
+
+  cvSetData(image, aligned, width_step);
+  image->imageDataOrigin = (char *)allocated;
+  return image;
+}
+
+DMZ_INTERNAL void llcv_release_aligned_image(IplImage **image) {
+  if(NULL == *image) {
+    return;
+  }
+  free((*image)->imageDataOrigin);
+  cvReleaseImageHeader(image);
+}
+
 #endif
\ No newline at end of file
@@ -12,4 +12,41 @@
 DMZ_INTERNAL void* llcv_get_data_origin(IplImage *image);
 DMZ_INTERNAL uint8_t llcv_get_pixel_step(IplImage *image);
 
+// A window onto a single channel image's pixels: where the first one is, how many there are, and how far
+// apart the rows are. Unlike setting a roi, taking a view changes nothing about the image and allocates
+// nothing, so any number of views (from any number of threads) can look into the same image at once.
+typedef struct {
+  uint8_t *data;
+  uint16_t width;
+  uint16_t height;
+  int stride;         // bytes from one row to the next
+  uint8_t pixel_size; // bytes per pixel
+} llcv_view;
+
+// The image's roi, or all of it if it has none.
+DMZ_INTERNAL llcv_view llcv_view_of_image(IplImage *image);
+
+// A view of pixels laid out row after row, stride bytes apart -- e.g. a stack buffer.
+DMZ_INTERNAL llcv_view llcv_view_of_data(void *data, uint16_t width, uint16_t height, int stride, uint8_t pixel_size);
+
+// rect, in view's coordinates; it must lie within view.
+DMZ_INTERNAL llcv_view llcv_view_rect(llcv_view view, CvRect rect);
+
+DMZ_INTERNAL inline uint8_t *llcv_view_row(llcv_view view, uint16_t row_index) {
+  return view.data + row_index * view.stride;
+}
+
+// Fills in header (typically on the stack) as an image of view's pixels, with no roi and no pixels of
+// its own, so that view can be handed to OpenCV. Nothing needs releasing.
+DMZ_INTERNAL void llcv_image_header_for_view(llcv_view view, int depth, IplImage *header);
+
+// Row alignment used by llcv_create_aligned_image -- one cache line, which is also a whole number of q registers.
+#define kLLCVImageRowAlignment 64
+
+// Create an image whose data and every row start on a kLLCVImageRowAlignment boundary.
+// widthStep is padded accordingly, so it will generally be larger than width * nChannels.
+// Must be released with llcv_release_aligned_image, not cvReleaseImage.
+DMZ_INTERNAL IplImage *llcv_create_aligned_image(CvSize size, int depth, int channels);
+DMZ_INTERNAL void llcv_release_aligned_image(IplImage **image);
+
 #endif
@@ -7,321 +7,153 @@
 #if COMPILE_DMZ
 
 #include "morph.h"
+#include "convert.h"
 #include "image_util.h"
 #include "neon.h"
 #include "processor_support.h"
 #include "dmz_debug.h"
 
-#if DMZ_HAS_NEON_COMPILETIME
-#include <arm_neon.h>
+#if DMZ_HAS_SSE2_COMPILETIME
+#include <emmintrin.h>
 #endif
 
-#if DMZ_HAS_NEON_COMPILETIME
-// Morph NEON support functions
-
-static inline void vec_morph3_1d_u8_q(const uint8_t *src, uint8_t *dst) {
-  asm volatile
-  (
-   // load src pixel vectors (src - 1, src, src + 1)
-   "mov r0, %[src]" "\n\t"
-   "sub r0, r0, #1" "\n\t"
-   "vld1.8 {q0}, [r0]" "\n\t"
-   "add r0, r0, #1" "\n\t"
-   "vld1.8 {q1}, [r0]" "\n\t"
-   "add r0, r0, #1" "\n\t"
-   "vld1.8 {q2}, [r0]" "\n\t"
-
-   // pairwise max, pairwise min
-   "vmax.u8 q3, q0, q1" "\n\t"
-   "vmin.u8 q8, q0, q1" "\n\t"
-   "vmax.u8 q9, q3, q2" "\n\t"
-   "vmin.u8 q10, q8, q2" "\n\t"
+#define MAX5(a, b, c, d, e) MAX(a, MAX(b, MAX(c, MAX(d, e))))
+#define MIN5(a, b, c, d, e) MIN(a, MIN(b, MIN(c, MIN(d, e))))
 
-   // subtract
-   "vsub.u8 q11, q9, q10" "\n\t"
+#pragma mark morph grad3 cross
 
-   // write to dst
-   "mov r0, %[dst]" "\n\t"
-   "vst1.8 {q11}, [r0]" "\n\t"
-   
-   : // output
-   
-   : // input
-   [src]"r" (src),
-   [dst]"r" (dst)
-   
-   : // clobbered
-   "r0", // used for src, dst pointers
-   // skip q4-q7, since then gcc will have to save them, see http://stackoverflow.com/questions/261419/arm-to-c-calling-convention-registers-to-save
-   "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11", //
-   "memory"
-   );
+DMZ_INTERNAL void llcv_morph_grad3_cross_row_c(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst_row, uint16_t col_index, uint16_t col_end, uint16_t width) {
+  for(; col_index < col_end; col_index++) {
+    uint16_t west = col_index == 0 ? col_index : col_index - 1;
+    uint16_t east = col_index == width - 1 ? col_index : col_index + 1;
+    dst_row[col_index] = MAX5(north[col_index], center[west], center[col_index], center[east], south[col_index]) -
+                         MIN5(north[col_index], center[west], center[col_index], center[east], south[col_index]);
+  }
 }
 
+// The vector rows start at column 1 and stop short of the last column, which have no west/east neighbor.
+#if DMZ_HAS_SSE2_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_morph_grad3_cross_row_sse2(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst_row, uint16_t width) {
+  uint16_t col_index = 1;
+  for(; col_index + 17 <= width; col_index += 16) {
+    __m128i n = _mm_loadu_si128((const __m128i *)(north + col_index));
+    __m128i w = _mm_loadu_si128((const __m128i *)(center + col_index - 1));
+    __m128i c = _mm_loadu_si128((const __m128i *)(center + col_index));
+    __m128i e = _mm_loadu_si128((const __m128i *)(center + col_index + 1));
+    __m128i s = _mm_loadu_si128((const __m128i *)(south + col_index));
+    __m128i max_vec = _mm_max_epu8(n, _mm_max_epu8(w, _mm_max_epu8(c, _mm_max_epu8(e, s))));
+    __m128i min_vec = _mm_min_epu8(n, _mm_min_epu8(w, _mm_min_epu8(c, _mm_min_epu8(e, s))));
+    _mm_storeu_si128((__m128i *)(dst_row + col_index), _mm_sub_epi8(max_vec, min_vec));
+  }
+  return col_index;
+}
 #endif
 
-DMZ_INTERNAL void llcv_morph_grad3_1d_u8_neon(IplImage *src, IplImage *dst) {
 #if DMZ_HAS_NEON_COMPILETIME
-
-  uint8_t *src_data = (uint8_t *)src->imageData;
-  if(dmz_likely(NULL != src->roi)) {
-    src_data += src->roi->yOffset * src->widthStep + src->roi->xOffset * sizeof(uint8_t);
+DMZ_INTERNAL uint16_t llcv_morph_grad3_cross_row_neon(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst_row, uint16_t width) {
+  uint16_t col_index = 1;
+  for(; col_index + 17 <= width; col_index += 16) {
+    uint8x16_t n = vld1q_u8(north + col_index);
+    uint8x16_t w = vld1q_u8(center + col_index - 1);
+    uint8x16_t c = vld1q_u8(center + col_index);
+    uint8x16_t e = vld1q_u8(center + col_index + 1);
+    uint8x16_t s = vld1q_u8(south + col_index);
+    uint8x16_t max_vec = vmaxq_u8(n, vmaxq_u8(w, vmaxq_u8(c, vmaxq_u8(e, s))));
+    uint8x16_t min_vec = vminq_u8(n, vminq_u8(w, vminq_u8(c, vminq_u8(e, s))));
+    vst1q_u8(dst_row + col_index, vsubq_u8(max_vec, min_vec));
   }
-
-  uint8_t *dst_data = (uint8_t *)dst->imageData;
-  if(dmz_unlikely(NULL != dst->roi)) {
-    dst_data += dst->roi->yOffset * dst->widthStep + dst->roi->xOffset * sizeof(uint8_t);
-  }
-
-  CvSize dst_size = cvGetSize(dst);
-
-  // Calc first output (special, due to edge effects)
-  uint16_t dst_index = 0;
-  uint8_t f0 = src_data[dst_index];
-  uint8_t f1 = src_data[dst_index + 1];  // safe b/c already asserted src width > 1
-  dst_data[0] = MAX(f0, f1) - MIN(f0, f1);
-  dst_index++;
-
-  // + 1 in the below because size 3 kernel involves dst_index - 1, dst_index, dst_index + 1 (and we can assume dst_index - 1 is available)
-  // strictly < below, because the last pixel is special
-  bool done = false;
-  while(!done) {
-     // calc using q registers
-    vec_morph3_1d_u8_q(src_data + dst_index, dst_data + dst_index);
-    dst_index += kQRegisterElements8;
-
-    if(dst_index + 1 == dst_size.width) {
-      done = true;
-    } else if(dst_index + 1 > dst_size.width - kQRegisterElements8) {
-      // backtrack to handle leftovers
-      dst_index = (uint16_t)(dst_size.width - kQRegisterElements8 - 1);
-    }
-  }
-
-  // Calc last output (special, due to edge effects)
-  uint8_t l0 = src_data[dst_index - 1];
-  uint8_t l1 = src_data[dst_index];
-  dst_data[dst_index] = MAX(l0, l1) - MIN(l0, l1);
-#endif
+  return col_index;
 }
-
-DMZ_INTERNAL void llcv_morph_grad3_1d_u8_c(IplImage *src, IplImage *dst) {
-  IplConvKernel *kernel = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_CROSS, NULL);
-  cvMorphologyEx(src, dst, NULL, kernel, CV_MOP_GRADIENT, 1);
-  cvReleaseStructuringElement(&kernel);
-}
-
-#define TEST_MORPH_NEON 0
-
-DMZ_INTERNAL void llcv_morph_grad3_1d_u8(IplImage *src, IplImage *dst) {
-  assert(src->depth == IPL_DEPTH_8U);
-  assert(dst->depth == IPL_DEPTH_8U);
-  assert(src != dst);
-  assert(src->nChannels == 1);
-  assert(dst->nChannels == 1);
-#if DMZ_DEBUG
-  CvSize src_size = cvGetSize(src);
-  CvSize dst_size = cvGetSize(dst);
-  assert(src_size.width == dst_size.width);
-  assert(src_size.height == dst_size.height);
-  assert(src_size.height == 1);  // 1d!
-  assert(src_size.width > 1); // sanity
 #endif
-  
+
+DMZ_INTERNAL void llcv_morph_grad3_cross_row_u8(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst_row, uint16_t width) {
+  llcv_morph_grad3_cross_row_c(north, center, south, dst_row, 0, 1, width);
+  uint16_t col_index = 1;
+#if DMZ_HAS_NEON_COMPILETIME
   if(dmz_has_neon_runtime()) {
-    llcv_morph_grad3_1d_u8_neon(src, dst);
-#if TEST_MORPH_NEON
-    IplImage *dst_c = cvCreateImage(dst_size, IPL_DEPTH_8U, 1);
-    
-    llcv_morph_grad3_1d_u8_c(src, dst_c);
-    
-    IplImage *delta = cvCreateImage(dst_size, IPL_DEPTH_8U, 1);
-    
-    cvAbsDiff(dst, dst_c, delta);
-    
-    int n_errors = cvCountNonZero(delta);
-    if(n_errors > 0) {
-      fprintf(stderr, "llcv_morph_grad3_1d_u8 errors: %i\n", n_errors);
-    }
-    
-    cvReleaseImage(&dst_c);
-    cvReleaseImage(&delta);
-#endif
-  } else {
-    llcv_morph_grad3_1d_u8_c(src, dst);
+    col_index = llcv_morph_grad3_cross_row_neon(north, center, south, dst_row, width);
   }
-}
-
-
-
-#define TEST_MORPH2D 0
-#define TIME_MORPH2D 0
-
-#if TIME_MORPH2D
-static clock_t fastest_c_neon = CLOCKS_PER_SEC * 1000;
-static clock_t fastest_opencv = CLOCKS_PER_SEC * 1000;
-#define TIME_MORPH2D_TIMING_ITERATIONS 1000
+#elif DMZ_HAS_SSE2_COMPILETIME
+  col_index = llcv_morph_grad3_cross_row_sse2(north, center, south, dst_row, width);
 #endif
+  // leftovers, including the last column (or everything, without SIMD)
+  llcv_morph_grad3_cross_row_c(north, center, south, dst_row, col_index, width, width);
+}
 
-#if TEST_MORPH2D
-DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8_opencv(IplImage *src, IplImage *dst) {
-  IplConvKernel *kernel = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_CROSS, NULL);
-  cvMorphologyEx(src, dst, NULL, kernel, CV_MOP_GRADIENT, 1);
-  cvReleaseStructuringElement(&kernel);
+DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8(llcv_view src, llcv_view dst) {
+  assert(src.pixel_size == 1 && dst.pixel_size == 1);
+  assert(src.width == dst.width && src.height == dst.height);
+  for(uint16_t row_index = 0; row_index < src.height; row_index++) {
+    uint16_t north_index = row_index == 0 ? row_index : row_index - 1;
+    uint16_t south_index = row_index + 1 < src.height ? row_index + 1 : row_index;
+    llcv_morph_grad3_cross_row_u8(llcv_view_row(src, north_index), llcv_view_row(src, row_index), llcv_view_row(src, south_index),
+                                  llcv_view_row(dst, row_index), src.width);
+  }
 }
-#endif
 
-#define MAX5(a, b, c, d, e) MAX(a, MAX(b, MAX(c, MAX(d, e))))
-#define MIN5(a, b, c, d, e) MIN(a, MIN(b, MIN(c, MIN(d, e))))
+#pragma mark area down2 + morph grad3 cross
 
-DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8_c_neon(IplImage *src, IplImage *dst) {
-#define kMorphGrad3Cross2DVectorSize 16
+DMZ_INTERNAL void llcv_area_down2_morph_grad3_2d_cross_u8(llcv_view src, llcv_view dst, uint8_t *scratch) {
+  assert(src.pixel_size == 1 && dst.pixel_size == 1);
+  assert(src.width / 2 == dst.width);
+  assert(src.height / 2 == dst.height);
+  uint16_t width = dst.width;
+  uint16_t height = dst.height;
 
-  CvSize src_size = cvGetSize(src);
-  assert(src_size.width > kMorphGrad3Cross2DVectorSize);
+  bool scratch_provided = scratch != NULL;
+  if(!scratch_provided) {
+    scratch = (uint8_t *)malloc(3 * width);
+  }
 
-  uint8_t *src_data_origin = (uint8_t *)llcv_get_data_origin(src);
-  uint16_t src_width_step = (uint16_t)src->widthStep;
-  
-  uint8_t *dst_data_origin = (uint8_t *)llcv_get_data_origin(dst);
-  uint16_t dst_width_step = (uint16_t)dst->widthStep;
-  bool can_use_neon = dmz_has_neon_runtime();
-  
-  for(uint16_t row_index = 0; row_index < src_size.height; row_index++) {
-    uint16_t row1_index = row_index == 0 ? row_index : row_index - 1;
-    uint16_t row2_index = row_index;
-    uint16_t row3_index = row_index == src_size.height - 1 ? row_index : row_index + 1;
-    
-    const uint8_t *src_row1_origin = src_data_origin + row1_index * src_width_step;
-    const uint8_t *src_row2_origin = src_data_origin + row2_index * src_width_step;
-    const uint8_t *src_row3_origin = src_data_origin + row3_index * src_width_step;
-    
-    uint8_t *dst_row_origin = dst_data_origin + row_index * dst_width_step;
-    
-    uint16_t col_index = 0;
-    while(col_index < src_size.width) {
-      bool is_first_col = col_index == 0;
-      uint16_t last_col_index = (uint16_t)(src_size.width - 1);
-      bool is_last_col = col_index == last_col_index;
-      bool can_process_next_chunk_as_vector = col_index + kMorphGrad3Cross2DVectorSize < last_col_index;
-      if(is_first_col || is_last_col || !can_use_neon || !can_process_next_chunk_as_vector) {
-        // scalar step
-        uint16_t col1_index = is_first_col ? col_index : col_index - 1;
-        uint16_t col2_index = col_index;
-        uint16_t col3_index = is_last_col ? col_index : col_index + 1;
-        
-        uint8_t grad =
-        MAX5(src_row1_origin[col2_index], src_row2_origin[col1_index], src_row2_origin[col2_index], src_row2_origin[col3_index], src_row3_origin[col2_index]) -
-        MIN5(src_row1_origin[col2_index], src_row2_origin[col1_index], src_row2_origin[col2_index], src_row2_origin[col3_index], src_row3_origin[col2_index]);
-        
-        // write result
-        dst_row_origin[col_index] = grad;
-        
-        col_index++;
-      } else {
-        // vector step
-#if DMZ_HAS_NEON_COMPILETIME
-        // north, east, center, west, south
-        uint8x16_t n = vld1q_u8(src_row1_origin + col_index);
-        uint8x16_t w = vld1q_u8(src_row2_origin + col_index - 1);
-        uint8x16_t c = vld1q_u8(src_row2_origin + col_index);
-        uint8x16_t e = vld1q_u8(src_row2_origin + col_index + 1);
-        uint8x16_t s = vld1q_u8(src_row3_origin + col_index);
-        uint8x16_t max_vec = vmaxq_u8(n, vmaxq_u8(w, vmaxq_u8(c, vmaxq_u8(e, s))));
-        uint8x16_t min_vec = vminq_u8(n, vminq_u8(w, vminq_u8(c, vminq_u8(e, s))));
-        uint8x16_t grad_vec = vsubq_u8(max_vec, min_vec);
-        dst_row_origin[col_index +  0] = vgetq_lane_u8(grad_vec,  0);
-        dst_row_origin[col_index +  1] = vgetq_lane_u8(grad_vec,  1);
-        dst_row_origin[col_index +  2] = vgetq_lane_u8(grad_vec,  2);
-        dst_row_origin[col_index +  3] = vgetq_lane_u8(grad_vec,  3);
-        dst_row_origin[col_index +  4] = vgetq_lane_u8(grad_vec,  4);
-        dst_row_origin[col_index +  5] = vgetq_lane_u8(grad_vec,  5);
-        dst_row_origin[col_index +  6] = vgetq_lane_u8(grad_vec,  6);
-        dst_row_origin[col_index +  7] = vgetq_lane_u8(grad_vec,  7);
-        dst_row_origin[col_index +  8] = vgetq_lane_u8(grad_vec,  8);
-        dst_row_origin[col_index +  9] = vgetq_lane_u8(grad_vec,  9);
-        dst_row_origin[col_index + 10] = vgetq_lane_u8(grad_vec, 10);
-        dst_row_origin[col_index + 11] = vgetq_lane_u8(grad_vec, 11);
-        dst_row_origin[col_index + 12] = vgetq_lane_u8(grad_vec, 12);
-        dst_row_origin[col_index + 13] = vgetq_lane_u8(grad_vec, 13);
-        dst_row_origin[col_index + 14] = vgetq_lane_u8(grad_vec, 14);
-        dst_row_origin[col_index + 15] = vgetq_lane_u8(grad_vec, 15);
-        col_index += kMorphGrad3Cross2DVectorSize;
-#endif
-      }
+  // Downsampled row r lives in scratch row r % 3 while it is needed (as rows r - 1, r, r + 1 of the gradient).
+#define DOWN_ROW(r) (scratch + ((r) % 3) * width)
+#define FILL_DOWN_ROW(r) llcv_area_down2_row_u8(llcv_view_row(src, 2 * (r)), llcv_view_row(src, 2 * (r) + 1), DOWN_ROW(r), width)
+  FILL_DOWN_ROW(0);
+  for(uint16_t row_index = 0; row_index < height; row_index++) {
+    uint16_t south_index = row_index + 1 < height ? row_index + 1 : row_index;
+    if(south_index != row_index) {
+      FILL_DOWN_ROW(south_index);
     }
+    uint16_t north_index = row_index == 0 ? row_index : row_index - 1;
+    llcv_morph_grad3_cross_row_u8(DOWN_ROW(north_index), DOWN_ROW(row_index), DOWN_ROW(south_index),
+                                  llcv_view_row(dst, row_index), width);
   }
-#undef kMorphGrad3Cross2DVectorSize
-}
+#undef FILL_DOWN_ROW
+#undef DOWN_ROW
 
-DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8(IplImage *src, IplImage *dst) {
-#if DMZ_DEBUG
-  assert(src->nChannels == 1);
-  assert(src->depth == IPL_DEPTH_8U);
-  
-  assert(dst->nChannels == 1);
-  assert(dst->depth == IPL_DEPTH_8U);
-  
-  CvSize src_size = cvGetSize(src);
-  CvSize dst_size = cvGetSize(dst);
-  
-  assert(dst_size.width == src_size.width);
-  assert(dst_size.height == src_size.height);
-#endif
-  
-#if TIME_MORPH2D
-  clock_t start_c_neon, end_c_neon;
-  start_c_neon = clock();
-  for(int iter = 0; iter < TIME_MORPH2D_TIMING_ITERATIONS; iter++) {
-#endif
-    
-    llcv_morph_grad3_2d_cross_u8_c_neon(src, dst);
-    
-#if TIME_MORPH2D
-  }
-  end_c_neon = clock();
-  clock_t elapsed_c_neon = end_c_neon - start_c_neon;
-  if(elapsed_c_neon < fastest_c_neon) {
-    fastest_c_neon = elapsed_c_neon;
-    dmz_debug_log("fastest c/neon %f ms", (1000.0 * (double)fastest_c_neon / (double)CLOCKS_PER_SEC) / (double)TIME_MORPH2D_TIMING_ITERATIONS);
-  }
-#endif
-  
-  // Start test-only code
-  
-#if TEST_MORPH2D
-  IplImage *opencv_dst = cvCreateImage(dst_size, dst->depth, dst->nChannels);
-#if TIME_MORPH2D
-  clock_t start_opencv, end_opencv;
-  start_opencv = clock();
-  for(int iter = 0; iter < TIME_MORPH2D_TIMING_ITERATIONS; iter++) {
-#endif
-    llcv_morph_grad3_2d_cross_u8_opencv(src, opencv_dst);
-#if TIME_MORPH2D
+  if(!scratch_provided) {
+    free(scratch);
   }
-  end_opencv = clock();
-  clock_t elapsed_opencv = end_opencv - start_opencv;
-  if(elapsed_opencv < fastest_opencv) {
-    fastest_opencv = elapsed_opencv;
-    dmz_debug_log("fastest opencv %f ms", (1000.0 * (double)fastest_opencv / (double)CLOCKS_PER_SEC) / (double)TIME_MORPH2D_TIMING_ITERATIONS);
-  }
-#endif
-  
-  IplImage *delta = cvCreateImage(dst_size, dst->depth, dst->nChannels);
-  
-  cvSub(dst, opencv_dst, delta);
-  
-  int n_errors = cvCountNonZero(delta);
-  if(n_errors > 0) {
-    dmz_debug_log("llcv_morph_grad3_2d_cross_u8 errors: %i", n_errors);
-  } else {
-    // dmz_debug_log("llcv_morph_grad3_2d_cross_u8 ok");
-  }
-  
-  cvReleaseImage(&delta);
-  cvReleaseImage(&opencv_dst);
-#endif  // TEST_MORPH2D
 }
 
+#pragma mark cross gradient of a window
+
+DMZ_INTERNAL void llcv_morph_grad3_2d_cross_window_u8(llcv_view src_window, llcv_view grad_window, llcv_view dst) {
+  assert(src_window.pixel_size == 1 && grad_window.pixel_size == 1 && dst.pixel_size == 1);
+  assert(src_window.width == dst.width && src_window.height == dst.height);
+  assert(grad_window.width == dst.width && grad_window.height == dst.height);
+  assert(dst.width > 1);
+  uint16_t width = dst.width;
+  uint16_t height = dst.height;
+
+  for(uint16_t row_index = 0; row_index < height; row_index++) {
+    uint16_t north_index = row_index == 0 ? row_index : row_index - 1;
+    uint16_t south_index = row_index + 1 < height ? row_index + 1 : row_index;
+    const uint8_t *north = llcv_view_row(src_window, north_index);
+    const uint8_t *center = llcv_view_row(src_window, row_index);
+    const uint8_t *south = llcv_view_row(src_window, south_index);
+    uint8_t *dst_row = llcv_view_row(dst, row_index);
+
+    if(row_index == 0 || row_index == height - 1) {
+      // the window's own top and bottom rows replicate, rather than reading the rows beyond it
+      llcv_morph_grad3_cross_row_c(north, center, south, dst_row, 0, width, width);
+    } else {
+      // likewise its first and last columns; everything in between is the same as the whole image's
+      memcpy(dst_row, llcv_view_row(grad_window, row_index), width);
+      llcv_morph_grad3_cross_row_c(north, center, south, dst_row, 0, 1, width);
+      llcv_morph_grad3_cross_row_c(north, center, south, dst_row, width - 1, width, width);
+    }
+  }
+}
 
 #endif
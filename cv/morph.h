@@ -8,8 +8,23 @@
 
 #include "opencv2/imgproc/imgproc_c.h"
 #include "dmz_macros.h"
+#include "image_util.h"
 
-DMZ_INTERNAL void llcv_morph_grad3_1d_u8(IplImage *src, IplImage *dst);
-DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8(IplImage *src, IplImage *dst);
+DMZ_INTERNAL void llcv_morph_grad3_2d_cross_u8(llcv_view src, llcv_view dst);
+
+// One row of the 3x3 cross gradient: north and south are the rows above and below center, and the
+// first and last columns take their missing west/east neighbor to be themselves.
+// A single row (north, center and south all the same row) gets the 1d gradient, max - min of each pixel's 3 neighbors.
+DMZ_INTERNAL void llcv_morph_grad3_cross_row_u8(const uint8_t *north, const uint8_t *center, const uint8_t *south, uint8_t *dst_row, uint16_t width);
+
+// llcv_morph_grad3_2d_cross_u8 of llcv_area_down2_u8 of src, without the downsampled image ever existing:
+// rows are downsampled one at a time into a three-row window. dst is src's size / 2.
+// scratch (3 * dst's width bytes) may be NULL, in which case it is allocated and released.
+DMZ_INTERNAL void llcv_area_down2_morph_grad3_2d_cross_u8(llcv_view src, llcv_view dst, uint8_t *scratch);
+
+// llcv_morph_grad3_2d_cross_u8 of src_window (a roi of some larger image), given grad_window, the same roi of
+// that whole image's gradient: only the window's border differs, since there the window's own gradient
+// replicates its edge pixels instead of reading past them. Lets many overlapping windows share one gradient.
+DMZ_INTERNAL void llcv_morph_grad3_2d_cross_window_u8(llcv_view src_window, llcv_view grad_window, llcv_view dst);
 
 #endif
@@ -0,0 +1,401 @@
+//
+//  redact.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "redact.h"
+#include <pthread.h>
+#include <string.h>
+
+#define kMaxRedactionThreads 8
+
+// Two level histogram, as in Perreault & Hebert, "Median Filtering in Constant Time".
+// The coarse bins count values by their high nibble, so a median search touches at most 16 + 16 bins.
+typedef struct {
+  uint16_t coarse[16];
+  uint16_t fine[256];
+} llcv_u8_histogram;
+
+typedef struct {
+  const uint8_t *src; // private copy of the region, rows of width * n_channels bytes
+  uint8_t *dst;       // region origin within the image being redacted
+  int dst_step;
+  int width;
+  int height;
+  int n_channels;
+  int aperture;
+  dmz_redaction_mode mode;
+  int row_begin;
+  int row_end;
+} llcv_redaction_band;
+
+// Replicate the region's edge pixels: the window never reads outside the region.
+DMZ_INTERNAL inline int llcv_clamp_index(int index, int n) {
+  return index < 0 ? 0 : (index >= n ? n - 1 : index);
+}
+
+DMZ_INTERNAL void llcv_redact_median_band(const llcv_redaction_band *band) {
+  const int width = band->width;
+  const int height = band->height;
+  const int n_channels = band->n_channels;
+  const int src_step = width * n_channels;
+  const int radius = band->aperture / 2;
+  const int half_count = (band->aperture * band->aperture) / 2; // the median is the first value whose cumulative count exceeds this
+
+  llcv_u8_histogram *columns = (llcv_u8_histogram *)malloc(width * sizeof(llcv_u8_histogram));
+  llcv_u8_histogram kernel;
+  int fine_x[16]; // the x for which each fine segment of kernel was last brought up to date
+
+  for(int channel = 0; channel < n_channels; channel++) {
+    const uint8_t *src = band->src + channel;
+
+    // Column histograms cover rows [y - radius, y + radius]
+    memset(columns, 0, width * sizeof(llcv_u8_histogram));
+    for(int k = -radius; k <= radius; k++) {
+      const uint8_t *row = src + llcv_clamp_index(band->row_begin + k, height) * src_step;
+      for(int x = 0; x < width; x++) {
+        uint8_t value = row[x * n_channels];
+        columns[x].coarse[value >> 4]++;
+        columns[x].fine[value]++;
+      }
+    }
+
+    for(int y = band->row_begin; y < band->row_end; y++) {
+      if(y > band->row_begin) {
+        const uint8_t *leaving_row = src + llcv_clamp_index(y - radius - 1, height) * src_step;
+        const uint8_t *entering_row = src + llcv_clamp_index(y + radius, height) * src_step;
+        for(int x = 0; x < width; x++) {
+          uint8_t leaving = leaving_row[x * n_channels];
+          uint8_t entering = entering_row[x * n_channels];
+          columns[x].coarse[leaving >> 4]--;
+          columns[x].fine[leaving]--;
+          columns[x].coarse[entering >> 4]++;
+          columns[x].fine[entering]++;
+        }
+      }
+
+      memset(kernel.coarse, 0, sizeof(kernel.coarse));
+      for(int k = -radius; k <= radius; k++) {
+        const llcv_u8_histogram *column = &columns[llcv_clamp_index(k, width)];
+        for(int bin = 0; bin < 16; bin++) {
+          kernel.coarse[bin] += column->coarse[bin];
+        }
+      }
+      for(int bin = 0; bin < 16; bin++) {
+        fine_x[bin] = -band->aperture; // stale
+      }
+
+      uint8_t *dst_row = band->dst + y * band->dst_step + channel;
+      for(int x = 0; x < width; x++) {
+        if(x > 0) {
+          const llcv_u8_histogram *leaving = &columns[llcv_clamp_index(x - radius - 1, width)];
+          const llcv_u8_histogram *entering = &columns[llcv_clamp_index(x + radius, width)];
+          for(int bin = 0; bin < 16; bin++) {
+            kernel.coarse[bin] += entering->coarse[bin] - leaving->coarse[bin];
+          }
+        }
+
+        int count = 0;
+        int coarse_bin = 0;
+        while(count + kernel.coarse[coarse_bin] <= half_count) {
+          count += kernel.coarse[coarse_bin];
+          coarse_bin++;
+        }
+
+        // Only the fine segment that holds the median gets updated, and only when it is needed
+        uint16_t *fine = kernel.fine + 16 * coarse_bin;
+        if(x - fine_x[coarse_bin] >= band->aperture) {
+          memset(fine, 0, 16 * sizeof(uint16_t));
+          for(int k = -radius; k <= radius; k++) {
+            const uint16_t *column_fine = columns[llcv_clamp_index(x + k, width)].fine + 16 * coarse_bin;
+            for(int i = 0; i < 16; i++) {
+              fine[i] += column_fine[i];
+            }
+          }
+        } else {
+          for(int fx = fine_x[coarse_bin]; fx < x; fx++) {
+            const uint16_t *leaving = columns[llcv_clamp_index(fx - radius, width)].fine + 16 * coarse_bin;
+            const uint16_t *entering = columns[llcv_clamp_index(fx + radius + 1, width)].fine + 16 * coarse_bin;
+            for(int i = 0; i < 16; i++) {
+              fine[i] += entering[i] - leaving[i];
+            }
+          }
+        }
+        fine_x[coarse_bin] = x;
+
+        int fine_bin = 0;
+        while(count + fine[fine_bin] <= half_count) {
+          count += fine[fine_bin];
+          fine_bin++;
+        }
+        dst_row[x * n_channels] = (uint8_t)(16 * coarse_bin + fine_bin);
+      }
+    }
+  }
+
+  free(columns);
+}
+
+DMZ_INTERNAL void llcv_redact_box_band(const llcv_redaction_band *band) {
+  const int width = band->width;
+  const int height = band->height;
+  const int n_channels = band->n_channels;
+  const int src_step = width * n_channels;
+  const int radius = band->aperture / 2;
+  const uint32_t window_count = band->aperture * band->aperture;
+
+  // Per column (and channel) sums over rows [y - radius, y + radius]
+  uint32_t *column_sums = (uint32_t *)calloc(src_step, sizeof(uint32_t));
+  for(int k = -radius; k <= radius; k++) {
+    const uint8_t *row = band->src + llcv_clamp_index(band->row_begin + k, height) * src_step;
+    for(int i = 0; i < src_step; i++) {
+      column_sums[i] += row[i];
+    }
+  }
+
+  for(int y = band->row_begin; y < band->row_end; y++) {
+    if(y > band->row_begin) {
+      const uint8_t *leaving_row = band->src + llcv_clamp_index(y - radius - 1, height) * src_step;
+      const uint8_t *entering_row = band->src + llcv_clamp_index(y + radius, height) * src_step;
+      for(int i = 0; i < src_step; i++) {
+        column_sums[i] += entering_row[i] - leaving_row[i];
+      }
+    }
+
+    uint8_t *dst_row = band->dst + y * band->dst_step;
+    for(int channel = 0; channel < n_channels; channel++) {
+      uint32_t sum = 0;
+      for(int k = -radius; k <= radius; k++) {
+        sum += column_sums[llcv_clamp_index(k, width) * n_channels + channel];
+      }
+      for(int x = 0; x < width; x++) {
+        if(x > 0) {
+          sum += column_sums[llcv_clamp_index(x + radius, width) * n_channels + channel];
+          sum -= column_sums[llcv_clamp_index(x - radius - 1, width) * n_channels + channel];
+        }
+        dst_row[x * n_channels + channel] = (uint8_t)((sum + window_count / 2) / window_count);
+      }
+    }
+  }
+
+  free(column_sums);
+}
+
+// Bands for pixelation always start on a block boundary, see llcv_redact_region.
+DMZ_INTERNAL void llcv_redact_pixelate_band(const llcv_redaction_band *band) {
+  const int n_channels = band->n_channels;
+  const int src_step = band->width * n_channels;
+  const int block_size = band->aperture;
+
+  for(int block_y = band->row_begin; block_y < band->row_end; block_y += block_size) {
+    int block_height = MIN(block_size, band->row_end - block_y);
+    for(int block_x = 0; block_x < band->width; block_x += block_size) {
+      int block_width = MIN(block_size, band->width - block_x);
+      uint32_t count = block_width * block_height;
+
+      for(int channel = 0; channel < n_channels; channel++) {
+        uint32_t sum = 0;
+        for(int y = block_y; y < block_y + block_height; y++) {
+          const uint8_t *src_row = band->src + y * src_step + channel;
+          for(int x = block_x; x < block_x + block_width; x++) {
+            sum += src_row[x * n_channels];
+          }
+        }
+
+        uint8_t average = (uint8_t)((sum + count / 2) / count);
+        for(int y = block_y; y < block_y + block_height; y++) {
+          uint8_t *dst_row = band->dst + y * band->dst_step + channel;
+          for(int x = block_x; x < block_x + block_width; x++) {
+            dst_row[x * n_channels] = average;
+          }
+        }
+      }
+    }
+  }
+}
+
+DMZ_INTERNAL void *llcv_redact_band(void *arg) {
+  const llcv_redaction_band *band = (const llcv_redaction_band *)arg;
+  switch(band->mode) {
+    case DMZRedactionMedian:
+      llcv_redact_median_band(band);
+      break;
+    case DMZRedactionBoxBlur:
+      llcv_redact_box_band(band);
+      break;
+    case DMZRedactionPixelate:
+      llcv_redact_pixelate_band(band);
+      break;
+  }
+  return NULL;
+}
+
+DMZ_INTERNAL void llcv_redact_region(IplImage *image, CvRect rect, dmz_redaction_mode mode, int aperture, int n_threads) {
+  const int n_channels = image->nChannels;
+  const int src_step = rect.width * n_channels;
+  uint8_t *dst = (uint8_t *)image->imageData + rect.y * image->widthStep + rect.x * n_channels;
+
+  // Every band reads from a private copy of the region, so bands never see each other's output
+  uint8_t *src = (uint8_t *)malloc(src_step * rect.height);
+  for(int y = 0; y < rect.height; y++) {
+    memcpy(src + y * src_step, dst + y * image->widthStep, src_step);
+  }
+
+  // Median and box bands pay for priming their window, so don't bother with bands of fewer than aperture rows
+  int unit = (mode == DMZRedactionPixelate) ? aperture : 1;
+  int n_units = (rect.height + unit - 1) / unit;
+  int n_bands = MIN(MAX(n_threads, 1), kMaxRedactionThreads);
+  n_bands = MIN(n_bands, n_units);
+  if(mode != DMZRedactionPixelate) {
+    n_bands = MIN(n_bands, MAX(rect.height / aperture, 1));
+  }
+
+  llcv_redaction_band bands[kMaxRedactionThreads];
+  pthread_t threads[kMaxRedactionThreads];
+  bool spawned[kMaxRedactionThreads];
+  for(int i = 0; i < n_bands; i++) {
+    bands[i].src = src;
+    bands[i].dst = dst;
+    bands[i].dst_step = image->widthStep;
+    bands[i].width = rect.width;
+    bands[i].height = rect.height;
+    bands[i].n_channels = n_channels;
+    bands[i].aperture = aperture;
+    bands[i].mode = mode;
+    bands[i].row_begin = unit * (n_units * i / n_bands);
+    bands[i].row_end = MIN(rect.height, unit * (n_units * (i + 1) / n_bands));
+  }
+
+  // Band 0 runs on the calling thread; if a thread can't be created, its band does too
+  for(int i = 1; i < n_bands; i++) {
+    spawned[i] = (0 == pthread_create(&threads[i], NULL, llcv_redact_band, &bands[i]));
+  }
+  llcv_redact_band(&bands[0]);
+  for(int i = 1; i < n_bands; i++) {
+    if(spawned[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      llcv_redact_band(&bands[i]);
+    }
+  }
+
+  free(src);
+}
+
+// Merge pairs of rects whose union is exactly a rect: same rows and overlapping/abutting columns, or vice versa.
+DMZ_INTERNAL int llcv_merge_rects(CvRect *rects, int n_rects) {
+  bool merged = true;
+  while(merged) {
+    merged = false;
+    for(int i = 0; i < n_rects && !merged; i++) {
+      for(int j = i + 1; j < n_rects && !merged; j++) {
+        CvRect a = rects[i];
+        CvRect b = rects[j];
+        bool same_rows = a.y == b.y && a.height == b.height && a.x <= b.x + b.width && b.x <= a.x + a.width;
+        bool same_cols = a.x == b.x && a.width == b.width && a.y <= b.y + b.height && b.y <= a.y + a.height;
+        if(same_rows || same_cols) {
+          int x = MIN(a.x, b.x);
+          int y = MIN(a.y, b.y);
+          rects[i] = cvRect(x, y, MAX(a.x + a.width, b.x + b.width) - x, MAX(a.y + a.height, b.y + b.height) - y);
+          rects[j] = rects[n_rects - 1];
+          n_rects--;
+          merged = true;
+        }
+      }
+    }
+  }
+  return n_rects;
+}
+
+// Appends to pieces the parts of p outside q, which must overlap it: the full-width rows above and
+// below q, then the columns to either side of q within its rows. Returns how many (at most 4).
+DMZ_INTERNAL int llcv_rect_minus(CvRect p, CvRect q, CvRect *pieces) {
+  int n_pieces = 0;
+  int top = MAX(p.y, q.y);
+  int bottom = MIN(p.y + p.height, q.y + q.height);
+  if(q.y > p.y) {
+    pieces[n_pieces++] = cvRect(p.x, p.y, p.width, q.y - p.y);
+  }
+  if(q.y + q.height < p.y + p.height) {
+    pieces[n_pieces++] = cvRect(p.x, bottom, p.width, p.y + p.height - bottom);
+  }
+  if(q.x > p.x) {
+    pieces[n_pieces++] = cvRect(p.x, top, q.x - p.x, bottom - top);
+  }
+  if(q.x + q.width < p.x + p.width) {
+    pieces[n_pieces++] = cvRect(q.x + q.width, top, p.x + p.width - (q.x + q.width), bottom - top);
+  }
+  return n_pieces;
+}
+
+// Split rects into disjoint pieces covering the same pixels: each rect keeps only what the rects
+// before it don't cover. Returns a malloc'd array of *n_pieces rects.
+DMZ_INTERNAL CvRect *llcv_disjoint_rects(const CvRect *rects, int n_rects, int *n_pieces) {
+  int capacity = 4 * (n_rects + 1);
+  CvRect *pieces = (CvRect *)malloc(capacity * sizeof(CvRect));
+  int n = 0;
+  for(int i = 0; i < n_rects; i++) {
+    // rects[i] is carved up in [first, n); pieces carved away are left with width 0 until the end
+    int first = n;
+    pieces[n++] = rects[i];
+    for(int k = 0; k < first; k++) {
+      CvRect q = pieces[k];
+      int end = n; // new pieces are already clear of q
+      for(int j = first; j < end; j++) {
+        CvRect p = pieces[j];
+        bool overlap = p.width > 0 && p.x < q.x + q.width && q.x < p.x + p.width && p.y < q.y + q.height && q.y < p.y + p.height;
+        if(!overlap) {
+          continue;
+        }
+        if(n + 4 > capacity) {
+          capacity *= 2;
+          pieces = (CvRect *)realloc(pieces, capacity * sizeof(CvRect));
+        }
+        n += llcv_rect_minus(p, q, pieces + n);
+        pieces[j].width = 0;
+      }
+    }
+    int kept = first;
+    for(int j = first; j < n; j++) {
+      if(pieces[j].width > 0) {
+        pieces[kept++] = pieces[j];
+      }
+    }
+    n = kept;
+  }
+  *n_pieces = n;
+  return pieces;
+}
+
+DMZ_INTERNAL void llcv_redact_rects(IplImage *image, CvRect *rects, int n_rects, dmz_redaction_mode mode, int aperture, int n_threads) {
+  assert(image->depth == IPL_DEPTH_8U);
+  assert(aperture >= 1 && aperture % 2 == 1);
+  assert(aperture <= 255); // keeps median window counts within uint16_t
+
+  // Clip to the image (ignoring any roi), dropping anything that falls entirely outside
+  int n_clipped = 0;
+  for(int i = 0; i < n_rects; i++) {
+    int x0 = MAX(rects[i].x, 0);
+    int y0 = MAX(rects[i].y, 0);
+    int x1 = MIN(rects[i].x + rects[i].width, image->width);
+    int y1 = MIN(rects[i].y + rects[i].height, image->height);
+    if(x1 > x0 && y1 > y0) {
+      rects[n_clipped++] = cvRect(x0, y0, x1 - x0, y1 - y0);
+    }
+  }
+
+  // Merging first keeps the pieces few; merging again rejoins pieces that line up
+  n_rects = llcv_merge_rects(rects, n_clipped);
+  int n_regions;
+  CvRect *regions = llcv_disjoint_rects(rects, n_rects, &n_regions);
+  n_regions = llcv_merge_rects(regions, n_regions);
+  for(int i = 0; i < n_regions; i++) {
+    llcv_redact_region(image, regions[i], mode, aperture, n_threads);
+  }
+  free(regions);
+}
+
+#endif // COMPILE_DMZ
@@ -0,0 +1,22 @@
+//
+//  redact.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef REDACT_H
+#define REDACT_H
+
+#include "opencv2/core/core_c.h" // for IplImage
+#include "dmz_macros.h"
+#include "dmz.h"
+
+// Redacts (in place) the given rects of a u8 image with any number of channels.
+// Rects are clipped to the image, rects whose union is itself a rect are merged, and any other
+// overlaps are split off into separate regions, so every pixel is processed once. Work within
+// each region is split into bands of rows across n_threads threads (0 or 1 means just the
+// calling thread).
+// aperture is the (odd) median/box window, or the pixelate block size.
+// rects may be reordered and modified.
+DMZ_INTERNAL void llcv_redact_rects(IplImage *image, CvRect *rects, int n_rects, dmz_redaction_mode mode, int aperture, int n_threads);
+
+#endif
@@ -5,530 +5,387 @@
 
 #include "sobel.h"
 #include "processor_support.h"
+#include "neon.h"
 #include "image_util.h"
 #include "eigen.h"
 #include "dmz_debug.h"
 
-#if DMZ_HAS_NEON_COMPILETIME
-
-#include <arm_neon.h>
-
-static inline void convolve_eight_pixels_u8(const uint8_t *source_pixels, size_t source_stride, int16_t *dest_pixel, size_t dest_stride, const int16_t *kernel) {
-  asm volatile
-  (
-
-   // load kernel
-   "vld1.16 {q15}, [%[kernel]]" "\n\t"
-
-   // load pixels
-   "mov r4, %[source_pixels]" "\n\t"
-   "vld1.8 {d0}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d2}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d4}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d6}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d8}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d10}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d12}, [r4], %[source_stride]" "\n\t"
-   "vld1.8 {d14}, [r4], %[source_stride]" "\n\t"
-
-   // expand pixels
-   "vmovl.u8 q0,  d0" "\n\t"
-   "vmovl.u8 q1,  d2" "\n\t"
-   "vmovl.u8 q2,  d4" "\n\t"
-   "vmovl.u8 q3,  d6" "\n\t"
-   "vmovl.u8 q4,  d8" "\n\t"
-   "vmovl.u8 q5, d10" "\n\t"
-   "vmovl.u8 q6, d12" "\n\t"
-   "vmovl.u8 q7, d14" "\n\t"
-
-   // multiply kernel by pixels
-   "vmul.s16 q0, q0, q15" "\n\t"
-   "vmul.s16 q1, q1, q15" "\n\t"
-   "vmul.s16 q2, q2, q15" "\n\t"
-   "vmul.s16 q3, q3, q15" "\n\t"
-   "vmul.s16 q4, q4, q15" "\n\t"
-   "vmul.s16 q5, q5, q15" "\n\t"
-   "vmul.s16 q6, q6, q15" "\n\t"
-   "vmul.s16 q7, q7, q15" "\n\t"
-
-   // Pairwise add -- first sum reduction -- after this, each q contains 4 int32_ts
-   "vpaddl.s16 q0, q0" "\n\t"
-   "vpaddl.s16 q1, q1" "\n\t"
-   "vpaddl.s16 q2, q2" "\n\t"
-   "vpaddl.s16 q3, q3" "\n\t"
-   "vpaddl.s16 q4, q4" "\n\t"
-   "vpaddl.s16 q5, q5" "\n\t"
-   "vpaddl.s16 q6, q6" "\n\t"
-   "vpaddl.s16 q7, q7" "\n\t"
-
-   // Add d registers -- second sum reduction -- move to new d registers starting at q8 / d16, combining pairs of output values
-   "vadd.s32 d16,  d0,  d1" "\n\t"
-   "vadd.s32 d17,  d2,  d3" "\n\t"
-   "vadd.s32 d18,  d4,  d5" "\n\t"
-   "vadd.s32 d19,  d6,  d7" "\n\t"
-   "vadd.s32 d20,  d8,  d9" "\n\t"
-   "vadd.s32 d21, d10, d11" "\n\t"
-   "vadd.s32 d22, d12, d13" "\n\t"
-   "vadd.s32 d23, d14, d15" "\n\t"
-
-   // Pairwise add -- third sum reduction -- after this, each q contains 2 int64_ts
-   "vpaddl.s32  q8,  q8" "\n\t"
-   "vpaddl.s32  q9,  q9" "\n\t"
-   "vpaddl.s32 q10, q10" "\n\t"
-   "vpaddl.s32 q11, q11" "\n\t"
-
-   // Narrow -- after this, each q contains 4 int32_ts
-   "vqmovn.s64 d24, q8" "\n\t"
-   "vqmovn.s64 d25, q9" "\n\t"
-   "vqmovn.s64 d26, q10" "\n\t"
-   "vqmovn.s64 d27, q11" "\n\t"
-
-   // Narrow again -- after this, each q contains 8 int16_ts!
-   "vqmovn.s32 d28,  q12" "\n\t"
-   "vqmovn.s32 d29,  q13" "\n\t"
-
-   // Write to their destinations!
-   "mov r4, %[dest_pixel]" "\n\t"
-   "vst1.16 {d28[0]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d28[1]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d28[2]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d28[3]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d29[0]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d29[1]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d29[2]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d29[3]}, [r4], %[dest_stride]" "\n\t"
-
-   : // output
-
-   : // input
-   [source_pixels]"r" (source_pixels),
-   [source_stride]"r" (source_stride),
-   [dest_pixel]"r" (dest_pixel),
-   [dest_stride]"r" (dest_stride),
-   [kernel]"r" (kernel)
-
-   : // clobbered
-   "r4", // mutable copies of source_pixels, dest_pixel; TODO: how to simply specify that these are read/write?
-   "q0", "q1", "q2", "q3", "q4", "q5", "q6", "q7", // contain data loaded from the source pixels
-   "q8", "q9", "q10", "q11", // reduced data (pairs)
-   "q12", "q13", // reduced data (quads)
-   "q14", // reduced data (oct)
-   "q15", // kernel
-   "memory"
-
-   );
-}
+#if DMZ_HAS_AVX2_COMPILETIME
+#include <immintrin.h>
+#elif DMZ_HAS_SSE2_COMPILETIME
+#include <emmintrin.h>
+#endif
 
+// The 7-tap Sobel kernels, as cvSobel builds them:
+//   smooth = 1, 6, 15, 20, 15, 6, 1
+//   edge   = -1, -4, -5, 0, 5, 4, 1
+// dx is edge horizontally after smooth vertically; dy is smooth horizontally after edge vertically.
+// So a single vertical pass over 7 rows gives both column sums (sharing the loads), and a horizontal
+// pass over each gives dx and dy. No transposes, and no second trip through the source.
+//
+// Vertical sums of u8 fit in int16 (|sum| <= 64 * 255), so they're kept in two int16 rows,
+// padded by 3 replicated values at either end. Horizontal sums can exceed int16, so they're
+// taken in int32 and saturated, which is what cvSobel does with a 16S destination.
+#define kSobel7Radius 3
 
-static inline void convolve_four_pixels_s16(const int16_t *source_pixels, size_t source_stride, int16_t *dest_pixel, size_t dest_stride, const int16_t *kernel) {
-
-  assert(source_pixels != NULL);
-  assert(dest_pixel != NULL);
-  assert(kernel != NULL);
-
-  asm volatile
-  (
-
-   // load kernel
-   "vld1.16 {q15}, [%[kernel]]" "\n\t"
-
-   // load pixels
-   "mov r4, %[source_pixels]" "\n\t"
-   "vld1.s16 {q0}, [r4], %[source_stride]" "\n\t"
-   "vld1.s16 {q1}, [r4], %[source_stride]" "\n\t"
-   "vld1.s16 {q2}, [r4], %[source_stride]" "\n\t"
-   "vld1.s16 {q3}, [r4], %[source_stride]" "\n\t"
-
-   // multiply kernel by pixels
-   "vmull.s16  q4, d0, d30" "\n\t"
-   "vmull.s16  q5, d1, d31" "\n\t"
-   "vmull.s16  q6, d2, d30" "\n\t"
-   "vmull.s16  q7, d3, d31" "\n\t"
-   "vmull.s16  q8, d4, d30" "\n\t"
-   "vmull.s16  q9, d5, d31" "\n\t"
-   "vmull.s16 q10, d6, d30" "\n\t"
-   "vmull.s16 q11, d7, d31" "\n\t"
-
-   // Pairwise add -- first sum reduction -- after this, each q contains 2 int64_ts
-   "vpaddl.s32  q4,  q4" "\n\t"
-   "vpaddl.s32  q5,  q5" "\n\t"
-   "vpaddl.s32  q6,  q6" "\n\t"
-   "vpaddl.s32  q7,  q7" "\n\t"
-   "vpaddl.s32  q8,  q8" "\n\t"
-   "vpaddl.s32  q9,  q9" "\n\t"
-   "vpaddl.s32 q10, q10" "\n\t"
-   "vpaddl.s32 q11, q11" "\n\t"
-
-   // Add q registers -- second sum reduction
-   "vadd.s64 q0,  q4,  q5" "\n\t"
-   "vadd.s64 q1,  q6,  q7" "\n\t"
-   "vadd.s64 q2,  q8,  q9" "\n\t"
-   "vadd.s64 q3, q10, q11" "\n\t"
-
-   // Add d registers -- third sum reduction -- move to new, adjacent registers (q4, q5) to prepare for narrowing
-   "vadd.s64  d8, d0, d1" "\n\t"
-   "vadd.s64  d9, d2, d3" "\n\t"
-   "vadd.s64 d10, d4, d5" "\n\t"
-   "vadd.s64 d11, d6, d7" "\n\t"
-
-   // Narrow -- after this, q6 contains 4 int32_ts
-   "vqmovn.s64 d12, q4" "\n\t"
-   "vqmovn.s64 d13, q5" "\n\t"
-
-   // Narrow again -- after this, each d14 contains 4 int16_ts!
-   "vqmovn.s32 d14, q6" "\n\t"
-
-   // Write to their destinations!
-   "mov r4, %[dest_pixel]" "\n\t"
-   "vst1.16 {d14[0]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d14[1]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d14[2]}, [r4], %[dest_stride]" "\n\t"
-   "vst1.16 {d14[3]}, [r4], %[dest_stride]" "\n\t"
-
-   : // output
-
-   : // input
-   [source_pixels]"r" (source_pixels),
-   [source_stride]"r" (source_stride),
-   [dest_pixel]"r" (dest_pixel),
-   [dest_stride]"r" (dest_stride),
-   [kernel]"r" (kernel)
-
-   : // clobbered
-   "r4", // mutable copies of source_pixels, dest_pixel; TODO: how to simply specify that these are read/write?
-   "q0", "q1", "q2", "q3", "q4", "q5", "q6", "q7", // contain data loaded from the source pixels
-   "q8", "q9", "q10", "q11", // reduced data (pairs)
-   "q12", "q13", // reduced data (quads)
-   "q14", // reduced data (oct)
-   "q15", // kernel
-   "memory"
-
-   );
+DMZ_INTERNAL inline int16_t llcv_saturate_s16(int32_t value) {
+  return (int16_t)(value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value));
 }
 
+#pragma mark llcv_sobel7 rows
 
-static inline void edge_convolve_u8(const uint8_t *source_pixels, int16_t *dest_pixel, size_t dest_stride, const int16_t *kernels, size_t kernel_stride) {
-  asm volatile
-  (
-   // load pixels
-   "vld1.8 {d0}, [%[source_pixels]]" "\n\t"
-
-   // load kernels (part 1)
-   "mov r0, %[kernels]" "\n\t"
-   "vld1.16 {q12}, [r0]" "\n\t"
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q13}, [r0]" "\n\t"
-
-   // expand pixels
-   "vmovl.u8 q0,  d0" "\n\t"
-
-   // load kernels (part 2)
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q14}, [r0]" "\n\t"
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q15}, [r0]" "\n\t"
-
-   // multiply kernel by pixels
-   "vmul.s16 q1, q0, q12" "\n\t"
-   "vmul.s16 q2, q0, q13" "\n\t"
-   "vmul.s16 q3, q0, q14" "\n\t"
-   "vmul.s16 q4, q0, q15" "\n\t"
-
-   // Pairwise add -- first sum reduction -- after this, each q contains 4 int32_ts
-   "vpaddl.s16 q1, q1" "\n\t"
-   "vpaddl.s16 q2, q2" "\n\t"
-   "vpaddl.s16 q3, q3" "\n\t"
-   "vpaddl.s16 q4, q4" "\n\t"
-
-   // Add d registers -- second sum reduction -- move to new d registers starting at q5 / d10, combining pairs of output values
-   "vadd.s32 d10,  d2,  d3" "\n\t"
-   "vadd.s32 d11,  d4,  d5" "\n\t"
-   "vadd.s32 d12,  d6,  d7" "\n\t"
-   "vadd.s32 d13,  d8,  d9" "\n\t"
-
-   // Pairwise add -- third sum reduction -- after this, each q contains 2 int64_ts
-   "vpaddl.s32  q7,  q5" "\n\t"
-   "vpaddl.s32  q8,  q6" "\n\t"
-
-   // Narrow -- after this, each q contains 4 int32_ts
-   "vqmovn.s64 d18, q7" "\n\t"
-   "vqmovn.s64 d19, q8" "\n\t"
-
-   // Narrow again -- after this, each q contains 8 int16_ts!
-   "vqmovn.s32 d20,  q9" "\n\t"
-
-   // Write to their destinations!
-   "mov r0, %[dest_pixel]" "\n\t"
-   "vst1.16 {d20[0]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[1]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[2]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[3]}, [r0]" "\n\t"
-
-   : // output
-
-   : // input
-   [source_pixels]"r" (source_pixels),
-   [dest_pixel]"r" (dest_pixel),
-   [dest_stride]"r" (dest_stride),
-   [kernels]"r" (kernels),
-   [kernel_stride]"r" (kernel_stride)
-
-   : // clobbered
-   "r0", // mutable copies of dest_pixel, kernels; TODO: how to simply specify that these are read/write?
-   "q0", "q1", "q2", "q3", "q4", "q5", "q6", "q7", //
-   "q8", "q9", "q10", "q11", //
-   "q12", "q13", //
-   "q14", //
-   "q15", //
-   "memory"
-
-   );
+DMZ_INTERNAL void llcv_sobel7_vertical_row_c(const uint8_t *rows[7], int16_t *smooth, int16_t *edge, uint16_t col_index, uint16_t width) {
+  for(; col_index < width; col_index++) {
+    int16_t r0 = rows[0][col_index], r1 = rows[1][col_index], r2 = rows[2][col_index], r3 = rows[3][col_index];
+    int16_t r4 = rows[4][col_index], r5 = rows[5][col_index], r6 = rows[6][col_index];
+    smooth[col_index] = (int16_t)((r0 + r6) + 6 * (r1 + r5) + 15 * (r2 + r4) + 20 * r3);
+    edge[col_index] = (int16_t)((r6 - r0) + 4 * (r5 - r1) + 5 * (r4 - r2));
+  }
 }
 
-static inline void edge_convolve_s16(const int16_t *source_pixels, int16_t *dest_pixel, size_t dest_stride, const int16_t *kernels, size_t kernel_stride) {
-  asm volatile
-  (
-   // load pixels
-   "vld1.s16 {q0}, [%[source_pixels]]" "\n\t"
-
-   // load kernels
-   "mov r0, %[kernels]" "\n\t"
-   "vld1.16 {q12}, [r0]" "\n\t"
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q13}, [r0]" "\n\t"
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q14}, [r0]" "\n\t"
-   "add r0, r0, %[kernel_stride]" "\n\t"
-   "vld1.16 {q15}, [r0]" "\n\t"
-
-   // multiply kernel by pixels
-   "vmull.s16 q1, d0, d24" "\n\t"
-   "vmull.s16 q2, d1, d25" "\n\t"
-   "vmull.s16 q3, d0, d26" "\n\t"
-   "vmull.s16 q4, d1, d27" "\n\t"
-   "vmull.s16 q5, d0, d28" "\n\t"
-   "vmull.s16 q6, d1, d29" "\n\t"
-   "vmull.s16 q7, d0, d30" "\n\t"
-   "vmull.s16 q8, d1, d31" "\n\t"
-
-   // Pairwise add -- first sum reduction -- after this, each q contains 2 int64_ts
-   "vpaddl.s32 q1, q1" "\n\t"
-   "vpaddl.s32 q2, q2" "\n\t"
-   "vpaddl.s32 q3, q3" "\n\t"
-   "vpaddl.s32 q4, q4" "\n\t"
-   "vpaddl.s32 q5, q5" "\n\t"
-   "vpaddl.s32 q6, q6" "\n\t"
-   "vpaddl.s32 q7, q7" "\n\t"
-   "vpaddl.s32 q8, q8" "\n\t"
-
-   // Add q registers -- second sum reduction
-   "vadd.s64 q1, q1, q2" "\n\t"
-   "vadd.s64 q3, q3, q4" "\n\t"
-   "vadd.s64 q5, q5, q6" "\n\t"
-   "vadd.s64 q7, q7, q8" "\n\t"
-
-   // Add d registers -- third sum reduction -- move to new, adjacent registers (q9, q10) to prepare for narrowing
-   "vadd.s64 d18,  d2,  d3" "\n\t"
-   "vadd.s64 d19,  d6,  d7" "\n\t"
-   "vadd.s64 d20, d10, d11" "\n\t"
-   "vadd.s64 d21, d14, d15" "\n\t"
-
-   // Narrow -- after this, each q contains 4 int32_ts
-   "vqmovn.s64 d18, q9" "\n\t"
-   "vqmovn.s64 d19, q10" "\n\t"
-
-   // Narrow again -- after this, each q contains 8 int16_ts!
-   "vqmovn.s32 d20,  q9" "\n\t"
-
-   // Write to their destinations!
-   "mov r0, %[dest_pixel]" "\n\t"
-   "vst1.16 {d20[0]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[1]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[2]}, [r0]" "\n\t"
-   "add r0, r0, %[dest_stride]" "\n\t"
-   "vst1.16 {d20[3]}, [r0]" "\n\t"
-
-   : // output
-
-   : // input
-   [source_pixels]"r" (source_pixels),
-   [dest_pixel]"r" (dest_pixel),
-   [dest_stride]"r" (dest_stride),
-   [kernels]"r" (kernels),
-   [kernel_stride]"r" (kernel_stride)
-
-   : // clobbered
-   "r0", // mutable copies of dest_pixel, kernels; TODO: how to simply specify that these are read/write?
-   "q0", "q1", "q2", "q3", "q4", "q5", "q6", "q7", //
-   "q8", "q9", "q10", "q11", //
-   "q12", "q13", //
-   "q14", //
-   "q15", //
-   "memory"
-
-   );
+// smooth has kSobel7Radius valid values either side of [0, width)
+DMZ_INTERNAL void llcv_sobel7_dx_row_c(const int16_t *smooth, int16_t *dx_row, uint16_t col_index, uint16_t width) {
+  for(; col_index < width; col_index++) {
+    const int16_t *s = smooth + col_index;
+    int32_t sum = (s[3] - s[-3]) + 4 * (s[2] - s[-2]) + 5 * (s[1] - s[-1]);
+    dx_row[col_index] = llcv_saturate_s16(sum);
+  }
 }
 
-#pragma mark vectorized_convolve_transpose7
-
-DMZ_INTERNAL void vectorized_convolve_transpose7(IplImage *image, IplImage *dest, int16_t *kernel7) {
-
-#define kKernelSize 7
-#define kStartBorderSize 3
-#define kEndBorderSize 4
+// edge has kSobel7Radius valid values either side of [0, width)
+DMZ_INTERNAL void llcv_sobel7_dy_row_c(const int16_t *edge, int16_t *dy_row, uint16_t col_index, uint16_t width) {
+  for(; col_index < width; col_index++) {
+    const int16_t *e = edge + col_index;
+    int32_t sum = (e[-3] + e[3]) + 6 * (e[-2] + e[2]) + 15 * (e[-1] + e[1]) + 20 * e[0];
+    dy_row[col_index] = llcv_saturate_s16(sum);
+  }
+}
 
-  CvSize imageSize = cvGetSize(image);
-  assert(image->depth == IPL_DEPTH_8U || image->depth == IPL_DEPTH_16S);
-  bool is_u8 = image->depth == IPL_DEPTH_8U;
-  assert(image->width > kKernelSize);
+#if DMZ_HAS_SSE2_COMPILETIME && !DMZ_HAS_AVX2_COMPILETIME
+// r0...r6 are 8 pixels from each of the 7 rows, widened to int16
+#define LLCV_SOBEL7_VERTICAL_SSE2(r0, r1, r2, r3, r4, r5, r6, smooth, edge) \
+  smooth = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(r0, r6), _mm_mullo_epi16(_mm_add_epi16(r1, r5), six)), \
+                         _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(r2, r4), fifteen), _mm_mullo_epi16(r3, twenty))); \
+  edge = _mm_add_epi16(_mm_sub_epi16(r6, r0), _mm_add_epi16(_mm_slli_epi16(_mm_sub_epi16(r5, r1), 2), \
+                                                            _mm_mullo_epi16(_mm_sub_epi16(r4, r2), five)))
+
+DMZ_INTERNAL uint16_t llcv_sobel7_vertical_row_sse2(const uint8_t *rows[7], int16_t *smooth, int16_t *edge, uint16_t width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i five = _mm_set1_epi16(5);
+  const __m128i six = _mm_set1_epi16(6);
+  const __m128i fifteen = _mm_set1_epi16(15);
+  const __m128i twenty = _mm_set1_epi16(20);
+
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    __m128i lo[7], hi[7];
+    for(int row = 0; row < 7; row++) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)(rows[row] + col_index));
+      lo[row] = _mm_unpacklo_epi8(pixels, zero);
+      hi[row] = _mm_unpackhi_epi8(pixels, zero);
+    }
+    __m128i smooth_lo, edge_lo, smooth_hi, edge_hi;
+    LLCV_SOBEL7_VERTICAL_SSE2(lo[0], lo[1], lo[2], lo[3], lo[4], lo[5], lo[6], smooth_lo, edge_lo);
+    LLCV_SOBEL7_VERTICAL_SSE2(hi[0], hi[1], hi[2], hi[3], hi[4], hi[5], hi[6], smooth_hi, edge_hi);
+    _mm_storeu_si128((__m128i *)(smooth + col_index), smooth_lo);
+    _mm_storeu_si128((__m128i *)(smooth + col_index + 8), smooth_hi);
+    _mm_storeu_si128((__m128i *)(edge + col_index), edge_lo);
+    _mm_storeu_si128((__m128i *)(edge + col_index + 8), edge_hi);
+  }
+  return col_index;
+}
 
-  uint8_t *data_origin = (uint8_t *)llcv_get_data_origin(image);
-  uint16_t data_width_step = (uint16_t)image->widthStep;
+#undef LLCV_SOBEL7_VERTICAL_SSE2
+
+DMZ_INTERNAL uint16_t llcv_sobel7_dx_row_sse2(const int16_t *smooth, int16_t *dx_row, uint16_t width) {
+  const __m128i five_four = _mm_set1_epi32(5 | (4 << 16));
+
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    const int16_t *s = smooth + col_index;
+    // differences of int16 sums of u8 still fit in int16
+    __m128i d1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(s + 1)), _mm_loadu_si128((const __m128i *)(s - 1)));
+    __m128i d2 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(s + 2)), _mm_loadu_si128((const __m128i *)(s - 2)));
+    __m128i d3 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(s + 3)), _mm_loadu_si128((const __m128i *)(s - 3)));
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(d1, d2), five_four), _mm_srai_epi32(_mm_unpacklo_epi16(d3, d3), 16));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(d1, d2), five_four), _mm_srai_epi32(_mm_unpackhi_epi16(d3, d3), 16));
+    _mm_storeu_si128((__m128i *)(dx_row + col_index), _mm_packs_epi32(lo, hi));
+  }
+  return col_index;
+}
 
-  uint8_t *dest_data = (uint8_t *)dest->imageData;
-  uint16_t dest_width_step = (uint16_t)dest->widthStep;
+DMZ_INTERNAL uint16_t llcv_sobel7_dy_row_sse2(const int16_t *edge, int16_t *dy_row, uint16_t width) {
+  const __m128i one_six = _mm_set1_epi32(1 | (6 << 16));
+  const __m128i fifteen_twenty = _mm_set1_epi32(15 | (20 << 16));
+
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    const int16_t *e = edge + col_index;
+    __m128i s1 = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(e - 1)), _mm_loadu_si128((const __m128i *)(e + 1)));
+    __m128i s2 = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(e - 2)), _mm_loadu_si128((const __m128i *)(e + 2)));
+    __m128i s3 = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(e - 3)), _mm_loadu_si128((const __m128i *)(e + 3)));
+    __m128i s0 = _mm_loadu_si128((const __m128i *)e);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s3, s2), one_six), _mm_madd_epi16(_mm_unpacklo_epi16(s1, s0), fifteen_twenty));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s3, s2), one_six), _mm_madd_epi16(_mm_unpackhi_epi16(s1, s0), fifteen_twenty));
+    _mm_storeu_si128((__m128i *)(dy_row + col_index), _mm_packs_epi32(lo, hi));
+  }
+  return col_index;
+}
+#endif
 
-  uint16_t n_internal_cols = (uint16_t)(imageSize.width - (kStartBorderSize + kEndBorderSize));
-  uint8_t col_vector_size = is_u8 ? 8 : 4;
-  uint8_t scalar_cols = n_internal_cols % col_vector_size;
+#if DMZ_HAS_AVX2_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_sobel7_vertical_row_avx2(const uint8_t *rows[7], int16_t *smooth, int16_t *edge, uint16_t width) {
+  const __m256i five = _mm256_set1_epi16(5);
+  const __m256i six = _mm256_set1_epi16(6);
+  const __m256i fifteen = _mm256_set1_epi16(15);
+  const __m256i twenty = _mm256_set1_epi16(20);
+
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    __m256i r[7];
+    for(int row = 0; row < 7; row++) {
+      r[row] = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[row] + col_index)));
+    }
+    __m256i s = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(r[0], r[6]), _mm256_mullo_epi16(_mm256_add_epi16(r[1], r[5]), six)),
+                                 _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(r[2], r[4]), fifteen), _mm256_mullo_epi16(r[3], twenty)));
+    __m256i e = _mm256_add_epi16(_mm256_sub_epi16(r[6], r[0]), _mm256_add_epi16(_mm256_slli_epi16(_mm256_sub_epi16(r[5], r[1]), 2),
+                                                                                _mm256_mullo_epi16(_mm256_sub_epi16(r[4], r[2]), five)));
+    _mm256_storeu_si256((__m256i *)(smooth + col_index), s);
+    _mm256_storeu_si256((__m256i *)(edge + col_index), e);
+  }
+  return col_index;
+}
 
-  int16_t kernels[8][8] = {
-    // leading edge replication
-    {kernel7[0] + kernel7[1] + kernel7[2] + kernel7[3], kernel7[4], kernel7[5], kernel7[6],          0,          0, 0, 0},
-    {kernel7[0] + kernel7[1] + kernel7[2],              kernel7[3], kernel7[4], kernel7[5], kernel7[6],          0, 0, 0},
-    {kernel7[0] + kernel7[1],                           kernel7[2], kernel7[3], kernel7[4], kernel7[5], kernel7[6], 0, 0},
+// The in-lane unpacks and pack below undo each other, leaving outputs in order.
+DMZ_INTERNAL uint16_t llcv_sobel7_dx_row_avx2(const int16_t *smooth, int16_t *dx_row, uint16_t width) {
+  const __m256i five_four = _mm256_set1_epi32(5 | (4 << 16));
+
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    const int16_t *s = smooth + col_index;
+    __m256i d1 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(s + 1)), _mm256_loadu_si256((const __m256i *)(s - 1)));
+    __m256i d2 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(s + 2)), _mm256_loadu_si256((const __m256i *)(s - 2)));
+    __m256i d3 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(s + 3)), _mm256_loadu_si256((const __m256i *)(s - 3)));
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(d1, d2), five_four), _mm256_srai_epi32(_mm256_unpacklo_epi16(d3, d3), 16));
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(d1, d2), five_four), _mm256_srai_epi32(_mm256_unpackhi_epi16(d3, d3), 16));
+    _mm256_storeu_si256((__m256i *)(dx_row + col_index), _mm256_packs_epi32(lo, hi));
+  }
+  return col_index;
+}
 
-    // main body
-    {kernel7[0], kernel7[1], kernel7[2], kernel7[3], kernel7[4], kernel7[5], kernel7[6], 0},
+DMZ_INTERNAL uint16_t llcv_sobel7_dy_row_avx2(const int16_t *edge, int16_t *dy_row, uint16_t width) {
+  const __m256i one_six = _mm256_set1_epi32(1 | (6 << 16));
+  const __m256i fifteen_twenty = _mm256_set1_epi32(15 | (20 << 16));
+
+  uint16_t col_index = 0;
+  for(; col_index + 16 <= width; col_index += 16) {
+    const int16_t *e = edge + col_index;
+    __m256i s1 = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(e - 1)), _mm256_loadu_si256((const __m256i *)(e + 1)));
+    __m256i s2 = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(e - 2)), _mm256_loadu_si256((const __m256i *)(e + 2)));
+    __m256i s3 = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(e - 3)), _mm256_loadu_si256((const __m256i *)(e + 3)));
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)e);
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(s3, s2), one_six), _mm256_madd_epi16(_mm256_unpacklo_epi16(s1, s0), fifteen_twenty));
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(s3, s2), one_six), _mm256_madd_epi16(_mm256_unpackhi_epi16(s1, s0), fifteen_twenty));
+    _mm256_storeu_si256((__m256i *)(dy_row + col_index), _mm256_packs_epi32(lo, hi));
+  }
+  return col_index;
+}
+#endif
 
-    // trailing edge replication
-    {0, kernel7[0], kernel7[1], kernel7[2], kernel7[3], kernel7[4], kernel7[5], kernel7[6]},
-    {0,          0, kernel7[0], kernel7[1], kernel7[2], kernel7[3], kernel7[4], kernel7[5] + kernel7[6]},
-    {0,          0,          0, kernel7[0], kernel7[1], kernel7[2], kernel7[3], kernel7[4] + kernel7[5] + kernel7[6]},
-    {0,          0,          0,          0, kernel7[0], kernel7[1], kernel7[2], kernel7[3] + kernel7[4] + kernel7[5] + kernel7[6]}
-  };
+#if DMZ_HAS_NEON_COMPILETIME
+DMZ_INTERNAL uint16_t llcv_sobel7_vertical_row_neon(const uint8_t *rows[7], int16_t *smooth, int16_t *edge, uint16_t width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    uint8x8_t r0 = vld1_u8(rows[0] + col_index), r1 = vld1_u8(rows[1] + col_index), r2 = vld1_u8(rows[2] + col_index);
+    uint8x8_t r3 = vld1_u8(rows[3] + col_index), r4 = vld1_u8(rows[4] + col_index), r5 = vld1_u8(rows[5] + col_index);
+    uint8x8_t r6 = vld1_u8(rows[6] + col_index);
+    uint16x8_t s = vaddl_u8(r0, r6);
+    s = vmlaq_n_u16(s, vaddl_u8(r1, r5), 6);
+    s = vmlaq_n_u16(s, vaddl_u8(r2, r4), 15);
+    s = vmlaq_n_u16(s, vmovl_u8(r3), 20);
+    // the u16 differences wrap, which is exactly their s16 value
+    int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(r6, r0));
+    e = vmlaq_n_s16(e, vreinterpretq_s16_u16(vsubl_u8(r5, r1)), 4);
+    e = vmlaq_n_s16(e, vreinterpretq_s16_u16(vsubl_u8(r4, r2)), 5);
+    vst1q_s16(smooth + col_index, vreinterpretq_s16_u16(s));
+    vst1q_s16(edge + col_index, e);
+  }
+  return col_index;
+}
 
-  for(uint16_t row_index = 0; row_index < imageSize.height; row_index++) {
-    const uint8_t *row_origin = data_origin + row_index * data_width_step;
-    uint16_t dest_col_index = row_index; // transposed!
-    uint16_t dest_row_index; // transposed!
+DMZ_INTERNAL uint16_t llcv_sobel7_dx_row_neon(const int16_t *smooth, int16_t *dx_row, uint16_t width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    const int16_t *s = smooth + col_index;
+    int16x8_t d1 = vsubq_s16(vld1q_s16(s + 1), vld1q_s16(s - 1));
+    int16x8_t d2 = vsubq_s16(vld1q_s16(s + 2), vld1q_s16(s - 2));
+    int16x8_t d3 = vsubq_s16(vld1q_s16(s + 3), vld1q_s16(s - 3));
+    int32x4_t lo = vmlal_n_s16(vmovl_s16(vget_low_s16(d3)), vget_low_s16(d2), 4);
+    int32x4_t hi = vmlal_n_s16(vmovl_s16(vget_high_s16(d3)), vget_high_s16(d2), 4);
+    lo = vmlal_n_s16(lo, vget_low_s16(d1), 5);
+    hi = vmlal_n_s16(hi, vget_high_s16(d1), 5);
+    vst1q_s16(dx_row + col_index, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+  return col_index;
+}
 
-    int16_t *leading_edge_dest_pixel = (int16_t *)(dest_data /* + 0 * dest_width_step */) + dest_col_index;
-    if(is_u8) {
-      edge_convolve_u8(row_origin, leading_edge_dest_pixel, dest_width_step, kernels[0], sizeof(int16_t) * 8);
-    }  else {
-      edge_convolve_s16((const int16_t *)row_origin, leading_edge_dest_pixel, dest_width_step, kernels[0], sizeof(int16_t) * 8);
-    }
+DMZ_INTERNAL uint16_t llcv_sobel7_dy_row_neon(const int16_t *edge, int16_t *dy_row, uint16_t width) {
+  uint16_t col_index = 0;
+  for(; col_index + 8 <= width; col_index += 8) {
+    const int16_t *e = edge + col_index;
+    int16x8_t s1 = vaddq_s16(vld1q_s16(e - 1), vld1q_s16(e + 1));
+    int16x8_t s2 = vaddq_s16(vld1q_s16(e - 2), vld1q_s16(e + 2));
+    int16x8_t s3 = vaddq_s16(vld1q_s16(e - 3), vld1q_s16(e + 3));
+    int16x8_t s0 = vld1q_s16(e);
+    int32x4_t lo = vmlal_n_s16(vmovl_s16(vget_low_s16(s3)), vget_low_s16(s2), 6);
+    int32x4_t hi = vmlal_n_s16(vmovl_s16(vget_high_s16(s3)), vget_high_s16(s2), 6);
+    lo = vmlal_n_s16(vmlal_n_s16(lo, vget_low_s16(s1), 15), vget_low_s16(s0), 20);
+    hi = vmlal_n_s16(vmlal_n_s16(hi, vget_high_s16(s1), 15), vget_high_s16(s0), 20);
+    vst1q_s16(dy_row + col_index, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+  return col_index;
+}
+#endif
 
-    for(uint16_t internal_col_index = 0; internal_col_index < n_internal_cols / col_vector_size; internal_col_index++) {
-      uint16_t col_index = internal_col_index * col_vector_size;
-      dest_row_index = col_index + kStartBorderSize; // transposed!
-      int16_t *dest_pixel = (int16_t *)(dest_data + dest_row_index * dest_width_step) + dest_col_index;
-      if(is_u8) {
-        const uint8_t *source_pixels = row_origin + col_index;
-        convolve_eight_pixels_u8(source_pixels, sizeof(uint8_t), dest_pixel, dest_width_step, kernels[3]);
-      } else {
-        const int16_t *source_pixels = (int16_t *)row_origin + col_index;
-        convolve_four_pixels_s16(source_pixels, sizeof(int16_t), dest_pixel, dest_width_step, kernels[3]);
-      }
+DMZ_INTERNAL void llcv_sobel7_vertical_row(const uint8_t *rows[7], int16_t *smooth, int16_t *edge, uint16_t width, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_sobel7_vertical_row_neon(rows, smooth, edge, width);
     }
+#elif DMZ_HAS_AVX2_COMPILETIME
+    col_index = llcv_sobel7_vertical_row_avx2(rows, smooth, edge, width);
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_sobel7_vertical_row_sse2(rows, smooth, edge, width);
+#endif
+  }
+  // leftovers (or everything, without SIMD)
+  llcv_sobel7_vertical_row_c(rows, smooth, edge, col_index, width);
+}
 
-    if(scalar_cols > 0) {
-      // do some overlapping work, to clean up the bits at the end
-      uint16_t col_index = (n_internal_cols / col_vector_size) * col_vector_size - (col_vector_size - scalar_cols);
-      dest_row_index = col_index + kStartBorderSize; // transposed!
-      int16_t *dest_pixel = (int16_t *)(dest_data + dest_row_index * dest_width_step) + dest_col_index;
-      if(is_u8) {
-        const uint8_t *source_pixels = row_origin + col_index;
-        convolve_eight_pixels_u8(source_pixels, sizeof(uint8_t), dest_pixel, dest_width_step, kernels[3]);
-      } else {
-        const int16_t *source_pixels = (int16_t *)row_origin + col_index;
-        convolve_four_pixels_s16(source_pixels, sizeof(int16_t), dest_pixel, dest_width_step, kernels[3]);
-      }
+DMZ_INTERNAL void llcv_sobel7_dx_row(const int16_t *smooth, int16_t *dx_row, uint16_t width, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_sobel7_dx_row_neon(smooth, dx_row, width);
     }
+#elif DMZ_HAS_AVX2_COMPILETIME
+    col_index = llcv_sobel7_dx_row_avx2(smooth, dx_row, width);
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_sobel7_dx_row_sse2(smooth, dx_row, width);
+#endif
+  }
+  llcv_sobel7_dx_row_c(smooth, dx_row, col_index, width);
+}
 
-    uint16_t trailing_edge_col = (uint16_t)(imageSize.width - 8);
-    dest_row_index = trailing_edge_col + kEndBorderSize; // transposed!
-    int16_t *trailing_edge_dest_pixel = (int16_t *)(dest_data + dest_row_index * dest_width_step) + dest_col_index;
-    if(is_u8) {
-      const uint8_t *trailing_edge_source_pixels = row_origin + trailing_edge_col;
-      edge_convolve_u8(trailing_edge_source_pixels, trailing_edge_dest_pixel, dest_width_step, kernels[4], sizeof(int16_t) * 8);
-    } else {
-      const int16_t *trailing_edge_source_pixels = (int16_t *)row_origin + trailing_edge_col;
-      edge_convolve_s16(trailing_edge_source_pixels, trailing_edge_dest_pixel, dest_width_step, kernels[4], sizeof(int16_t) * 8);
+DMZ_INTERNAL void llcv_sobel7_dy_row(const int16_t *edge, int16_t *dy_row, uint16_t width, bool use_simd) {
+  uint16_t col_index = 0;
+  if(use_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+    if(dmz_has_neon_runtime()) {
+      col_index = llcv_sobel7_dy_row_neon(edge, dy_row, width);
     }
+#elif DMZ_HAS_AVX2_COMPILETIME
+    col_index = llcv_sobel7_dy_row_avx2(edge, dy_row, width);
+#elif DMZ_HAS_SSE2_COMPILETIME
+    col_index = llcv_sobel7_dy_row_sse2(edge, dy_row, width);
+#endif
   }
-
-#undef kKernelSize
-#undef kStartBorderSize
-#undef kEndBorderSize
+  llcv_sobel7_dy_row_c(edge, dy_row, col_index, width);
 }
 
-#endif // DMZ_HAS_NEON_COMPILETIME
-
-#pragma mark llcv_sobel7_c
+#pragma mark llcv_sobel7_dx_dy
 
-DMZ_INTERNAL void llcv_sobel7_c(IplImage *src, IplImage *dst, bool dx, bool dy) {
-  cvSobel(src, dst, !!dx, !!dy, 7); // !! to ensure 0/1-ness of dx, dy
-}
+// Without NEON, the borders come from outside src's roi where there's image there, as cvSobel's
+// do (this used to be cvSobel on those builds); with NEON they replicate the roi's edges.
+DMZ_INTERNAL void llcv_sobel7_dx_dy_rows(IplImage *src, IplImage *dx, IplImage *dy, IplImage *scratch, bool use_simd) {
+  CvSize src_size = cvGetSize(src);
+  uint16_t width = (uint16_t)src_size.width;
+  uint16_t last_row = (uint16_t)(src_size.height - 1);
+
+  // how far past the roi the rows may reach, and how many columns of context each side
+  int first_source_row = 0;
+  int last_source_row = last_row;
+  int left_context = 0;
+  int right_context = 0;
+  if(!dmz_has_neon_runtime()) {
+    CvRect roi = cvGetImageROI(src);
+    first_source_row = -roi.y;
+    last_source_row = src->height - 1 - roi.y;
+    left_context = MIN(roi.x, kSobel7Radius);
+    right_context = MIN(src->width - (roi.x + roi.width), kSobel7Radius);
+  }
 
-#pragma mark llcv_sobel7_neon
+  bool scratch_provided = scratch != NULL;
+  if(!scratch_provided) {
+    scratch = cvCreateImage(cvSize(width + 2 * kSobel7Radius, 2), IPL_DEPTH_16S, 1);
+  }
+  int16_t *smooth = (int16_t *)scratch->imageData + kSobel7Radius;
+  int16_t *edge = (int16_t *)(scratch->imageData + scratch->widthStep) + kSobel7Radius;
+
+  const uint8_t *src_data_origin = (const uint8_t *)llcv_get_data_origin(src);
+  uint8_t *dx_data_origin = dx == NULL ? NULL : (uint8_t *)llcv_get_data_origin(dx);
+  uint8_t *dy_data_origin = dy == NULL ? NULL : (uint8_t *)llcv_get_data_origin(dy);
+
+  for(uint16_t row_index = 0; row_index <= last_row; row_index++) {
+    // rows beyond those available replicate the nearest one
+    const uint8_t *rows[7];
+    for(int k = 0; k < 7; k++) {
+      int source_row = MIN(MAX(row_index + k - kSobel7Radius, first_source_row), last_source_row);
+      rows[k] = src_data_origin + source_row * src->widthStep - left_context;
+    }
+    llcv_sobel7_vertical_row(rows, smooth - left_context, edge - left_context, (uint16_t)(width + left_context + right_context), use_simd);
+    for(int k = left_context + 1; k <= kSobel7Radius; k++) {
+      smooth[-k] = smooth[-left_context];
+      edge[-k] = edge[-left_context];
+    }
+    for(int k = right_context + 1; k <= kSobel7Radius; k++) {
+      smooth[width - 1 + k] = smooth[width - 1 + right_context];
+      edge[width - 1 + k] = edge[width - 1 + right_context];
+    }
 
-DMZ_INTERNAL void llcv_sobel7_neon(IplImage *src, IplImage *dst, IplImage *scratch, bool dx, bool dy) {
-#if DMZ_HAS_NEON_COMPILETIME
-  int16_t edge_kernel[7] = {-1, -4, -5, 0, 5, 4, 1};
-  int16_t smooth_kernel[7] = {1, 6, 15, 20, 15, 6, 1};
+    if(dx != NULL) {
+      llcv_sobel7_dx_row(smooth, (int16_t *)(dx_data_origin + row_index * dx->widthStep), width, use_simd);
+    }
+    if(dy != NULL) {
+      llcv_sobel7_dy_row(edge, (int16_t *)(dy_data_origin + row_index * dy->widthStep), width, use_simd);
+    }
+  }
 
-  if(dx) {
-    vectorized_convolve_transpose7(src, scratch, edge_kernel);
-    vectorized_convolve_transpose7(scratch, dst, smooth_kernel);
-  } else {
-    // this must be dy, since we asserted (dx ^ dy) in llcvSobel7.
-    vectorized_convolve_transpose7(src, scratch, smooth_kernel);
-    vectorized_convolve_transpose7(scratch, dst, edge_kernel);
-  } 
-#endif
+  if(!scratch_provided) {
+    cvReleaseImage(&scratch);
+  }
 }
 
-#pragma mark llcv_sobel7
-
-DMZ_INTERNAL void llcv_sobel7(IplImage *src, IplImage *dst, IplImage *scratch, bool dx, bool dy) {
+DMZ_INTERNAL void llcv_sobel7_dx_dy(IplImage *src, IplImage *dx, IplImage *dy, IplImage *scratch) {
   assert(src != NULL);
-  assert(dst != NULL);
-  assert(dx ^ dy);
+  assert(dx != NULL || dy != NULL);
   assert(src->nChannels == 1);
   assert(src->depth == IPL_DEPTH_8U);
-  assert(dst->nChannels == 1);
-  assert(dst->depth == IPL_DEPTH_16S);
-
-  if(dmz_has_neon_runtime()) {
-    bool scratch_provided = scratch != NULL;
-    CvSize src_size = cvGetSize(src);
-    if(scratch_provided) {
-      CvSize scratch_size = cvGetSize(scratch);
-#pragma unused(scratch_size) // work around broken compiler warnings
-      assert(scratch->nChannels == 1);
-      assert(scratch->depth == IPL_DEPTH_16S);
-      assert(scratch_size.width == src_size.height);
-      assert(scratch_size.height == src_size.width);
-    }
-    if(!scratch_provided) {
-      scratch = cvCreateImage(cvSize(src_size.height, src_size.width), IPL_DEPTH_16S, 1);
-    }
-    llcv_sobel7_neon(src, dst, scratch, dx, dy);
-    if(!scratch_provided) {
-      cvReleaseImage(&scratch);
+  CvSize src_size = cvGetSize(src);
+#pragma unused(src_size) // work around broken compiler warnings
+  IplImage *dsts[2] = {dx, dy};
+  for(int i = 0; i < 2; i++) {
+    if(dsts[i] != NULL) {
+      assert(dsts[i]->nChannels == 1);
+      assert(dsts[i]->depth == IPL_DEPTH_16S);
+      assert(cvGetSize(dsts[i]).width == src_size.width && cvGetSize(dsts[i]).height == src_size.height);
     }
-  } else {
-    llcv_sobel7_c(src, dst, dx, dy);
   }
+  if(scratch != NULL) {
+    assert(scratch->nChannels == 1);
+    assert(scratch->depth == IPL_DEPTH_16S);
+    assert(scratch->width >= src_size.width + 2 * kSobel7Radius);
+    assert(scratch->height >= 2);
+  }
+
+  llcv_sobel7_dx_dy_rows(src, dx, dy, scratch, true);
 }
 
+#undef kSobel7Radius
+
 
 #define TEST_SOBEL3 0
 #define TIME_SOBEL3 0
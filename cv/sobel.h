@@ -7,12 +7,13 @@
 #include "opencv2/imgproc/imgproc_c.h"
 #include "dmz_macros.h"
 
-// Convolve with a sobel kernel of size 7.
-// src must be of type 8UC1; dst must be of type 16SC1.
-// (dx, dy) must be either (0, 1) or (1, 0).
+// Convolve with sobel kernels of size 7, giving both derivatives from one pass over src.
+// src must be of type 8UC1; dx and dy must be of type 16SC1 and the size of src. Either may be NULL.
+// Borders replicate the edge pixels of src, and results saturate as cvSobel's do. For an roi, the border
+// is taken from the image outside it, as cvSobel's is, except on NEON builds, which replicate the roi's edges.
 // scratch space may be NULL (in which it will be allocated internally), or it may be
-// an image of size (src_height, src_width) -- yes, transposed! -- of type 16SC1.
-DMZ_INTERNAL void llcv_sobel7(IplImage *src, IplImage *dst, IplImage *scratch, bool dx, bool dy);
+// an image of at least size (src_width + 6, 2) of type 16SC1.
+DMZ_INTERNAL void llcv_sobel7_dx_dy(IplImage *src, IplImage *dx, IplImage *dy, IplImage *scratch);
 
 // Note that this function actually returns the ABSOLUTE VALUE of each Scharr score.
 #if DMZ_DEBUG
@@ -6,12 +6,16 @@
 #include "dmz_macros.h"
 #include "stats.h"
 #include "processor_support.h"
+#include "neon.h"
+#include "image_util.h"
+#include "dmz_debug.h"
+#include "sobel.h" // for TEST_FRAME_QUALITY
 
 #include "opencv2/core/core.hpp"
-#include "opencv2/core/internal.hpp"  // used in llcv_equalize_hist
+#include "opencv2/core/internal.hpp"  // for CV_CAST_8U, in llcv_equalize_hist_lut_c
 
-#if DMZ_HAS_NEON_COMPILETIME
-  #include <arm_neon.h>
+#if DMZ_HAS_SSE2_COMPILETIME
+  #include <emmintrin.h>
 #endif
 
 DMZ_INTERNAL float llcv_stddev_of_abs_neon(IplImage *image) {
@@ -111,51 +115,341 @@ DMZ_INTERNAL float llcv_stddev_of_abs(IplImage *image) {
 }
 
 
-// This implementation copied directly from OpenCV's cvEqualizeHist, as
-// part of an effort to remove dependencies on libopencv_imgproc.a.
-DMZ_INTERNAL void llcv_equalize_hist(const IplImage *srcimg, IplImage *dstimg) {
-  CvMat sstub, *src = cvGetMat(srcimg, &sstub);
-  CvMat dstub, *dst = cvGetMat(dstimg, &dstub);
-  
-  CV_Assert( CV_ARE_SIZES_EQ(src, dst) && CV_ARE_TYPES_EQ(src, dst) &&
-            CV_MAT_TYPE(src->type) == CV_8UC1 );
-  CvSize size = cvGetMatSize(src);
-  if( CV_IS_MAT_CONT(src->type & dst->type) )
-  {
-    size.width *= size.height;
-    size.height = 1;
-  }
-  int x, y;
-  const int hist_sz = 256;
-  int hist[hist_sz];
-  memset(hist, 0, sizeof(hist));
-  
-  for( y = 0; y < size.height; y++ )
-  {
-    const uchar* sptr = src->data.ptr + src->step*y;
-    for( x = 0; x < size.width; x++ )
-      hist[sptr[x]]++;
-  }
-  
-  float scale = 255.f/(size.width*size.height);
+#pragma mark llcv_equalize_hist_small
+
+// The equalization LUT cvEqualizeHist builds: lut[i] = cvRound(cumulative count through i * 255 / n_pixels),
+// except that lut[0] is always 0. hist is 16 bits per bin, which is plenty for small patches.
+DMZ_INTERNAL void llcv_equalize_hist_lut_c(const uint16_t *hist, uint16_t n_pixels, uint8_t *lut) {
+  float scale = 255.f / n_pixels;
   int sum = 0;
-  uchar lut[hist_sz+1];
-  
-  for( int i = 0; i < hist_sz; i++ )
-  {
+  for(int i = 0; i < 256; i++) {
     sum += hist[i];
-    int val = cvRound(sum*scale);
+    int val = cvRound(sum * scale);
     lut[i] = CV_CAST_8U(val);
   }
-  
   lut[0] = 0;
-  for( y = 0; y < size.height; y++ )
-  {
-    const uchar* sptr = src->data.ptr + src->step*y;
-    uchar* dptr = dst->data.ptr + dst->step*y;
-    for( x = 0; x < size.width; x++ )
-      dptr[x] = lut[sptr[x]];
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+// 8 bins at a time: an in-register prefix sum, carried from one vector to the next. cvtps rounds half to even, as cvRound does.
+DMZ_INTERNAL void llcv_equalize_hist_lut_sse2(const uint16_t *hist, uint16_t n_pixels, uint8_t *lut) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(255.f / n_pixels);
+  __m128i carry = zero;
+  for(int i = 0; i < 256; i += 8) {
+    __m128i sums = _mm_loadu_si128((const __m128i *)(hist + i));
+    sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 2));
+    sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 4));
+    sums = _mm_add_epi16(sums, _mm_slli_si128(sums, 8));
+    sums = _mm_add_epi16(sums, carry);
+    carry = _mm_unpackhi_epi64(_mm_shufflehi_epi16(sums, 0xFF), _mm_shufflehi_epi16(sums, 0xFF)); // the last lane, everywhere
+
+    __m128i vals_lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(sums, zero)), scale));
+    __m128i vals_hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(sums, zero)), scale));
+    _mm_storel_epi64((__m128i *)(lut + i), _mm_packus_epi16(_mm_packs_epi32(vals_lo, vals_hi), zero));
+  }
+  lut[0] = 0;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+// As the SSE2 version. armv7 has no round-to-nearest conversion, so there the rounding is done by adding
+// and subtracting 2^23, which leaves a (non-negative, smaller) float rounded half to even.
+DMZ_INTERNAL void llcv_equalize_hist_lut_neon(const uint16_t *hist, uint16_t n_pixels, uint8_t *lut) {
+  const uint16x8_t zero = vdupq_n_u16(0);
+  const float32_t scale = 255.f / n_pixels;
+#if !defined(__aarch64__)
+  const float32x4_t round_bias = vdupq_n_f32(8388608.0f);
+#endif
+  uint16x8_t carry = zero;
+  for(int i = 0; i < 256; i += 8) {
+    uint16x8_t sums = vld1q_u16(hist + i);
+    sums = vaddq_u16(sums, vextq_u16(zero, sums, 7));
+    sums = vaddq_u16(sums, vextq_u16(zero, sums, 6));
+    sums = vaddq_u16(sums, vextq_u16(zero, sums, 4));
+    sums = vaddq_u16(sums, carry);
+    carry = vdupq_n_u16(vgetq_lane_u16(sums, 7));
+
+    float32x4_t scaled_lo = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(sums))), scale);
+    float32x4_t scaled_hi = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(sums))), scale);
+#if defined(__aarch64__)
+    uint32x4_t vals_lo = vcvtnq_u32_f32(scaled_lo);
+    uint32x4_t vals_hi = vcvtnq_u32_f32(scaled_hi);
+#else
+    uint32x4_t vals_lo = vcvtq_u32_f32(vsubq_f32(vaddq_f32(scaled_lo, round_bias), round_bias));
+    uint32x4_t vals_hi = vcvtq_u32_f32(vsubq_f32(vaddq_f32(scaled_hi, round_bias), round_bias));
+#endif
+    vst1_u8(lut + i, vqmovn_u16(vcombine_u16(vmovn_u32(vals_lo), vmovn_u32(vals_hi))));
+  }
+  lut[0] = 0;
+}
+#endif
+
+// The histogram and LUT shared by both flavors of llcv_equalize_hist_small.
+DMZ_INTERNAL void llcv_equalize_hist_small_lut(llcv_view src, uint8_t *lut) {
+  assert(src.pixel_size == 1);
+  CvSize size = cvSize(src.width, src.height);
+  assert(size.width * size.height <= UINT16_MAX);
+
+  // Two interleaved histograms, so that runs of equal pixels (common in gradient images) don't
+  // serialize on one counter.
+  uint16_t hist[2][256];
+  memset(hist, 0, sizeof(hist));
+  for(int row_index = 0; row_index < size.height; row_index++) {
+    const uint8_t *src_row = llcv_view_row(src, row_index);
+    int col_index = 0;
+    for(; col_index + 2 <= size.width; col_index += 2) {
+      hist[0][src_row[col_index]]++;
+      hist[1][src_row[col_index + 1]]++;
+    }
+    if(col_index < size.width) {
+      hist[0][src_row[col_index]]++;
+    }
+  }
+  for(int i = 0; i < 256; i++) {
+    hist[0][i] += hist[1][i];
+  }
+
+  uint16_t n_pixels = (uint16_t)(size.width * size.height);
+#if DMZ_HAS_NEON_COMPILETIME
+  if(dmz_has_neon_runtime()) {
+    llcv_equalize_hist_lut_neon(hist[0], n_pixels, lut);
+    return;
+  }
+#elif DMZ_HAS_SSE2_COMPILETIME
+  llcv_equalize_hist_lut_sse2(hist[0], n_pixels, lut);
+  return;
+#endif
+  llcv_equalize_hist_lut_c(hist[0], n_pixels, lut);
+}
+
+#if SCAN_EXPIRY
+DMZ_INTERNAL void llcv_equalize_hist_small(llcv_view src, llcv_view dst) {
+  assert(dst.pixel_size == 1);
+  assert(src.width == dst.width && src.height == dst.height);
+  uint8_t lut[256];
+  llcv_equalize_hist_small_lut(src, lut);
+
+  for(uint16_t row_index = 0; row_index < src.height; row_index++) {
+    const uint8_t *src_row = llcv_view_row(src, row_index);
+    uint8_t *dst_row = llcv_view_row(dst, row_index);
+    for(uint16_t col_index = 0; col_index < src.width; col_index++) {
+      dst_row[col_index] = lut[src_row[col_index]];
+    }
+  }
+}
+#endif
+
+DMZ_INTERNAL void llcv_equalize_hist_small_to_f32(llcv_view src, llcv_view dst) {
+  assert(dst.pixel_size == sizeof(float));
+  assert(src.width == dst.width && src.height == dst.height);
+  uint8_t lut[256];
+  llcv_equalize_hist_small_lut(src, lut);
+
+  // What cvConvertScale(equalized, dst, 1.0f / 255.0f, 0) computes: (float)pixel * scale + 0.0f, in float
+  const float scale = 1.0f / 255.0f;
+  for(uint16_t row_index = 0; row_index < src.height; row_index++) {
+    const uint8_t *src_row = llcv_view_row(src, row_index);
+    float *dst_row = (float *)llcv_view_row(dst, row_index);
+    for(uint16_t col_index = 0; col_index < src.width; col_index++) {
+      dst_row[col_index] = lut[src_row[col_index]] * scale;
+    }
   }
 }
 
+#pragma mark llcv_frame_quality
+
+typedef struct {
+  int64_t sum_abs_dx_dy;
+  int64_t sum_squared_dx_dy;
+  int64_t sum;
+  int64_t n_saturated;
+} llcv_frame_quality_sums;
+
+// Scalar sobel3_dx_dy (see llcv_sobel3_dx_dy_c_neon) and pixel stats for cols [col_begin, col_end) of one row.
+// The image edges are replicated, exactly as in llcv_sobel3_dx_dy.
+DMZ_INTERNAL void llcv_frame_quality_row_c(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint16_t width,
+                                           uint16_t col_begin, uint16_t col_end, bool count_saturated, llcv_frame_quality_sums *sums) {
+  for(uint16_t col_index = col_begin; col_index < col_end; col_index++) {
+    uint16_t left = col_index == 0 ? 0 : col_index - 1;
+    uint16_t right = col_index == width - 1 ? col_index : col_index + 1;
+    int32_t dx_dy = above[left] - above[right] - below[left] + below[right];
+    sums->sum_abs_dx_dy += abs(dx_dy);
+    sums->sum_squared_dx_dy += dx_dy * dx_dy;
+    sums->sum += row[col_index];
+    if(count_saturated && row[col_index] >= kSaturatedPixelValue) {
+      sums->n_saturated++;
+    }
+  }
+}
+
+#if DMZ_HAS_SSE2_COMPILETIME
+// Handles cols [1, returned col), 16 at a time; the caller finishes off the rest.
+DMZ_INTERNAL uint16_t llcv_frame_quality_row_sse2(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint16_t width,
+                                                  bool count_saturated, llcv_frame_quality_sums *sums) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones16 = _mm_set1_epi16(1);
+  const __m128i ones8 = _mm_set1_epi8(1);
+  const __m128i saturated = _mm_set1_epi8((char)kSaturatedPixelValue);
+  __m128i sum_abs = zero;     // 4 x int32; can't overflow within a row
+  __m128i sum_squared = zero; // 2 x int64
+  __m128i sum = zero;         // 2 x int64
+  __m128i n_saturated = zero; // 2 x int64
+
+  uint16_t col_index = 1;
+  for(; col_index + 16 < width; col_index += 16) {
+    __m128i tl = _mm_loadu_si128((const __m128i *)(above + col_index - 1));
+    __m128i tr = _mm_loadu_si128((const __m128i *)(above + col_index + 1));
+    __m128i bl = _mm_loadu_si128((const __m128i *)(below + col_index - 1));
+    __m128i br = _mm_loadu_si128((const __m128i *)(below + col_index + 1));
+    __m128i dx_dy_lo = _mm_sub_epi16(_mm_add_epi16(_mm_unpacklo_epi8(tl, zero), _mm_unpacklo_epi8(br, zero)),
+                                     _mm_add_epi16(_mm_unpacklo_epi8(tr, zero), _mm_unpacklo_epi8(bl, zero)));
+    __m128i dx_dy_hi = _mm_sub_epi16(_mm_add_epi16(_mm_unpackhi_epi8(tl, zero), _mm_unpackhi_epi8(br, zero)),
+                                     _mm_add_epi16(_mm_unpackhi_epi8(tr, zero), _mm_unpackhi_epi8(bl, zero)));
+
+    __m128i abs_lo = _mm_max_epi16(dx_dy_lo, _mm_sub_epi16(zero, dx_dy_lo));
+    __m128i abs_hi = _mm_max_epi16(dx_dy_hi, _mm_sub_epi16(zero, dx_dy_hi));
+    sum_abs = _mm_add_epi32(sum_abs, _mm_add_epi32(_mm_madd_epi16(abs_lo, ones16), _mm_madd_epi16(abs_hi, ones16)));
+
+    // squares are non-negative, so zero extension to 64 bits is safe
+    __m128i squared = _mm_add_epi32(_mm_madd_epi16(dx_dy_lo, dx_dy_lo), _mm_madd_epi16(dx_dy_hi, dx_dy_hi));
+    sum_squared = _mm_add_epi64(sum_squared, _mm_add_epi64(_mm_unpacklo_epi32(squared, zero), _mm_unpackhi_epi32(squared, zero)));
+
+    __m128i pixels = _mm_loadu_si128((const __m128i *)(row + col_index));
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+    if(count_saturated) {
+      __m128i is_saturated = _mm_cmpeq_epi8(_mm_max_epu8(pixels, saturated), pixels);
+      n_saturated = _mm_add_epi64(n_saturated, _mm_sad_epu8(_mm_and_si128(is_saturated, ones8), zero));
+    }
+  }
+
+  int32_t lanes32[4];
+  int64_t lanes64[2];
+  _mm_storeu_si128((__m128i *)lanes32, sum_abs);
+  sums->sum_abs_dx_dy += (int64_t)lanes32[0] + lanes32[1] + lanes32[2] + lanes32[3];
+  _mm_storeu_si128((__m128i *)lanes64, sum_squared);
+  sums->sum_squared_dx_dy += lanes64[0] + lanes64[1];
+  _mm_storeu_si128((__m128i *)lanes64, sum);
+  sums->sum += lanes64[0] + lanes64[1];
+  _mm_storeu_si128((__m128i *)lanes64, n_saturated);
+  sums->n_saturated += lanes64[0] + lanes64[1];
+  return col_index;
+}
+#endif
+
+#if DMZ_HAS_NEON_COMPILETIME
+// Handles cols [1, returned col), 16 at a time; the caller finishes off the rest.
+DMZ_INTERNAL uint16_t llcv_frame_quality_row_neon(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint16_t width,
+                                                  bool count_saturated, llcv_frame_quality_sums *sums) {
+  const uint8x16_t saturated = vdupq_n_u8(kSaturatedPixelValue);
+  uint32x4_t sum_abs = vdupq_n_u32(0);
+  int64x2_t sum_squared = vdupq_n_s64(0);
+  uint32x4_t sum = vdupq_n_u32(0);
+  uint16x8_t n_saturated = vdupq_n_u16(0);
+
+  uint16_t col_index = 1;
+  for(; col_index + kQRegisterElements8 < width; col_index += kQRegisterElements8) {
+    uint8x16_t tl = vld1q_u8(above + col_index - 1);
+    uint8x16_t tr = vld1q_u8(above + col_index + 1);
+    uint8x16_t bl = vld1q_u8(below + col_index - 1);
+    uint8x16_t br = vld1q_u8(below + col_index + 1);
+    // (tl + br) - (tr + bl), wrapping in u16 and reinterpreted as the (small) signed result
+    int16x8_t dx_dy_lo = vreinterpretq_s16_u16(vsubq_u16(vaddl_u8(vget_low_u8(tl), vget_low_u8(br)), vaddl_u8(vget_low_u8(tr), vget_low_u8(bl))));
+    int16x8_t dx_dy_hi = vreinterpretq_s16_u16(vsubq_u16(vaddl_u8(vget_high_u8(tl), vget_high_u8(br)), vaddl_u8(vget_high_u8(tr), vget_high_u8(bl))));
+
+    sum_abs = vpadalq_u16(sum_abs, vreinterpretq_u16_s16(vabsq_s16(dx_dy_lo)));
+    sum_abs = vpadalq_u16(sum_abs, vreinterpretq_u16_s16(vabsq_s16(dx_dy_hi)));
+
+    sum_squared = vpadalq_s32(sum_squared, vmull_s16(vget_low_s16(dx_dy_lo), vget_low_s16(dx_dy_lo)));
+    sum_squared = vpadalq_s32(sum_squared, vmull_s16(vget_high_s16(dx_dy_lo), vget_high_s16(dx_dy_lo)));
+    sum_squared = vpadalq_s32(sum_squared, vmull_s16(vget_low_s16(dx_dy_hi), vget_low_s16(dx_dy_hi)));
+    sum_squared = vpadalq_s32(sum_squared, vmull_s16(vget_high_s16(dx_dy_hi), vget_high_s16(dx_dy_hi)));
+
+    uint8x16_t pixels = vld1q_u8(row + col_index);
+    sum = vpadalq_u16(sum, vpaddlq_u8(pixels));
+    if(count_saturated) {
+      n_saturated = vpadalq_u8(n_saturated, vshrq_n_u8(vcgeq_u8(pixels, saturated), 7));
+    }
+  }
+
+  sums->sum_abs_dx_dy += (int64_t)vgetq_lane_u32(sum_abs, 0) + vgetq_lane_u32(sum_abs, 1) + vgetq_lane_u32(sum_abs, 2) + vgetq_lane_u32(sum_abs, 3);
+  sums->sum_squared_dx_dy += vgetq_lane_s64(sum_squared, 0) + vgetq_lane_s64(sum_squared, 1);
+  sums->sum += (int64_t)vgetq_lane_u32(sum, 0) + vgetq_lane_u32(sum, 1) + vgetq_lane_u32(sum, 2) + vgetq_lane_u32(sum, 3);
+  uint32x4_t n_saturated_32 = vpaddlq_u16(n_saturated);
+  sums->n_saturated += (int64_t)vgetq_lane_u32(n_saturated_32, 0) + vgetq_lane_u32(n_saturated_32, 1) + vgetq_lane_u32(n_saturated_32, 2) + vgetq_lane_u32(n_saturated_32, 3);
+  return col_index;
+}
+#endif
+
+DMZ_INTERNAL void llcv_frame_quality_sums_for_rect(IplImage *image, CvRect rect, bool count_saturated, bool allow_simd, llcv_frame_quality_sums *sums) {
+  const uint8_t *data_origin = (uint8_t *)image->imageData + rect.y * image->widthStep + rect.x;
+  uint16_t width = (uint16_t)rect.width;
+  uint16_t last_row = (uint16_t)(rect.height - 1);
+
+  sums->sum_abs_dx_dy = 0;
+  sums->sum_squared_dx_dy = 0;
+  sums->sum = 0;
+  sums->n_saturated = 0;
+
+  for(uint16_t row_index = 0; row_index <= last_row; row_index++) {
+    const uint8_t *above = data_origin + (row_index == 0 ? 0 : row_index - 1) * image->widthStep;
+    const uint8_t *row = data_origin + row_index * image->widthStep;
+    const uint8_t *below = data_origin + (row_index == last_row ? last_row : row_index + 1) * image->widthStep;
+
+    uint16_t col_index = 1;
+    if(allow_simd) {
+#if DMZ_HAS_NEON_COMPILETIME
+      if(dmz_has_neon_runtime()) {
+        col_index = llcv_frame_quality_row_neon(above, row, below, width, count_saturated, sums);
+      }
+#elif DMZ_HAS_SSE2_COMPILETIME
+      col_index = llcv_frame_quality_row_sse2(above, row, below, width, count_saturated, sums);
+#endif
+    }
+    llcv_frame_quality_row_c(above, row, below, width, 0, 1, count_saturated, sums);
+    llcv_frame_quality_row_c(above, row, below, width, col_index, width, count_saturated, sums);
+  }
+}
+
+#define TEST_FRAME_QUALITY 0
+
+DMZ_INTERNAL void llcv_frame_quality(IplImage *image, CvRect rect, bool count_saturated, llcv_frame_quality_stats *stats) {
+  assert(image->nChannels == 1);
+  assert(image->depth == IPL_DEPTH_8U);
+  assert(rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= image->width && rect.y + rect.height <= image->height);
+  assert(rect.width > 1);
+  assert(rect.height > 0);
+
+  llcv_frame_quality_sums sums;
+  llcv_frame_quality_sums_for_rect(image, rect, count_saturated, true, &sums);
+
+  // Same statistic as llcv_stddev_of_abs (|x|^2 == x^2), in double precision as cvAvgSdv does
+  double n_pixels = (double)rect.width * rect.height;
+  double mean_abs = sums.sum_abs_dx_dy / n_pixels;
+  double variance = sums.sum_squared_dx_dy / n_pixels - mean_abs * mean_abs;
+  stats->stddev_of_abs_dx_dy = (float)sqrt(MAX(variance, 0.0));
+  stats->mean = (float)(sums.sum / n_pixels);
+  stats->saturated_fraction = count_saturated ? (float)(sums.n_saturated / n_pixels) : 0.0f;
+
+#if TEST_FRAME_QUALITY
+  llcv_frame_quality_sums c_sums;
+  llcv_frame_quality_sums_for_rect(image, rect, count_saturated, false, &c_sums);
+  if(c_sums.sum_abs_dx_dy != sums.sum_abs_dx_dy || c_sums.sum_squared_dx_dy != sums.sum_squared_dx_dy ||
+     c_sums.sum != sums.sum || c_sums.n_saturated != sums.n_saturated) {
+    dmz_debug_log("llcv_frame_quality simd/c mismatch");
+  }
+
+  // and against the two pass version that it replaces
+  cvSetImageROI(image, rect);
+  IplImage *sobel_image = cvCreateImage(cvGetSize(image), IPL_DEPTH_16S, 1);
+  llcv_sobel3_dx_dy(image, sobel_image);
+  float two_pass_focus = llcv_stddev_of_abs(sobel_image);
+  float two_pass_brightness = (float)cvAvg(image, NULL).val[0];
+  cvReleaseImage(&sobel_image);
+  cvResetImageROI(image);
+  dmz_debug_log("llcv_frame_quality focus %f (two pass %f), brightness %f (two pass %f)", stats->stddev_of_abs_dx_dy, two_pass_focus, stats->mean, two_pass_brightness);
+#endif
+}
+
+
 #endif
@@ -5,9 +5,32 @@
 
 #include "opencv2/core/core_c.h" // for IplImage
 #include "dmz_macros.h"
+#include "image_util.h"
 
 // NOTE: For performance reasons, this function may alter the contents of image!
 DMZ_INTERNAL float llcv_stddev_of_abs(IplImage *image);
-DMZ_INTERNAL void llcv_equalize_hist(const IplImage *srcimg, IplImage *dstimg);
+
+// cvEqualizeHist, with identical output, for small patches (at most 65535 pixels: a 19x27 digit,
+// an 11x16 expiry character). The LUT is built from a 16-bit histogram 8 bins at a time.
+// src may be dst. Only the expiry categorizer equalizes in 8 bits.
+#if SCAN_EXPIRY
+DMZ_INTERNAL void llcv_equalize_hist_small(llcv_view src, llcv_view dst);
+#endif
+
+// llcv_equalize_hist_small followed by cvConvertScale(..., 1.0f / 255.0f, 0) into dst (32F), in one pass.
+DMZ_INTERNAL void llcv_equalize_hist_small_to_f32(llcv_view src, llcv_view dst);
+
+// Pixels at or above this value count as saturated (blown out)
+#define kSaturatedPixelValue 250
+
+typedef struct {
+  float stddev_of_abs_dx_dy; // llcv_stddev_of_abs of llcv_sobel3_dx_dy, i.e. the focus score
+  float mean;                // i.e. the brightness score
+  float saturated_fraction;  // fraction of pixels >= kSaturatedPixelValue; 0 unless requested
+} llcv_frame_quality_stats;
+
+// Computes all of the above over rect of a single channel u8 image, in one pass and with no temporary image.
+// Borders are replicated at the edges of rect, just as llcv_sobel3_dx_dy sees an image with rect as its roi.
+DMZ_INTERNAL void llcv_frame_quality(IplImage *image, CvRect rect, bool count_saturated, llcv_frame_quality_stats *stats);
 
 #endif
@@ -7,6 +7,7 @@
 #if COMPILE_DMZ
 
 #include "warp.h"
+#include "image_util.h"
 #include "dmz_debug.h"
 #include "processor_support.h"
 
@@ -168,6 +169,48 @@ void llcv_unwarp(dmz_context *dmz, IplImage *input, const dmz_point source_point
 #endif // !IOS_DMZ
 }
 
+void llcv_unwarp_plane(dmz_context *dmz, IplImage *input, const dmz_point source_points[4], const dmz_rect to_rect, IplImage *output) {
+  assert(input->nChannels == 1);
+  assert(output->nChannels == 1);
+  assert(output->imageData != NULL);
+
+#ifdef IOS_DMZ
+  // The GPU transform filter reads back tightly packed rows, so a padded output is warped into dmz's
+  // (grow-only) staging buffer and copied out a row at a time. Either way the warp, and so the meaning
+  // of source_points, is the GPU's.
+  if(output->widthStep == output->width) {
+    ios_gpu_unwarp(dmz, input, source_points, output);
+    return;
+  }
+  size_t staging_size = (size_t)output->width * output->height;
+  if(dmz->unwarp_staging_size < staging_size) {
+    free(dmz->unwarp_staging);
+    dmz->unwarp_staging = (uint8_t *)malloc(staging_size);
+    if(dmz->unwarp_staging == NULL) {
+      dmz->unwarp_staging_size = 0;
+      return;
+    }
+    dmz->unwarp_staging_size = staging_size;
+  }
+  IplImage staging;
+  llcv_image_header_for_view(llcv_view_of_data(dmz->unwarp_staging, output->width, output->height, output->width, sizeof(uint8_t)),
+                             IPL_DEPTH_8U, &staging);
+  ios_gpu_unwarp(dmz, input, source_points, &staging);
+  for(int row = 0; row < output->height; row++) {
+    memcpy(output->imageData + row * output->widthStep, dmz->unwarp_staging + row * output->width, output->width);
+  }
+#else
+  float matrix[9];
+  dmz_point dest_points[4];
+  dmz_rect_get_points(to_rect, dest_points);
+  llcv_calc_persp_transform(matrix, 9, true, source_points, dest_points);
+
+  // Wrap the matrix in place rather than allocating a CvMat per frame
+  CvMat cv_persp_mat = cvMat(3, 3, CV_32FC1, matrix);
+  cvWarpPerspective(input, output, &cv_persp_mat, CV_INTER_LINEAR + CV_WARP_FILL_OUTLIERS, cvScalarAll(0));
+#endif
+}
+
 
 
 #endif
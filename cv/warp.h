@@ -19,6 +19,12 @@ DMZ_INTERNAL bool llcv_warp_auto_upsamples();
 // Image is written to output IplImage.
 void llcv_unwarp(void *dmz, IplImage *input, const dmz_point src_points[4], const dmz_rect dst_rect, IplImage *output);
 
+// Single-channel variant of llcv_unwarp that always writes straight into output,
+// honoring its widthStep (which may be padded). Skips the GLES warp, since that
+// can only read back RGBA and would need an extra buffer plus a deinterleave. On iOS every
+// output goes to the GPU warp, a padded one by way of a staging buffer kept on dmz.
+void llcv_unwarp_plane(dmz_context *dmz, IplImage *input, const dmz_point src_points[4], const dmz_rect dst_rect, IplImage *output);
+
 // Solves and writes perpsective matrix to the matrixData buffer. 
 // If matrixDataSize >= 16, uses a 4x4 matrix. Otherwise a 3x3. 
 // Specifying rowMajor true writes to the buffer in row major format.
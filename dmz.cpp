@@ -8,26 +8,38 @@
 #include "eigen.h"
 #include "processor_support.h"
 #include "geometry.h"
+#include "dmz_profile.h"
 #include "cv/canny.h"
 #include "cv/convert.h"
 #include "cv/hough.h"
+#include "cv/image_util.h"
+#include "cv/redact.h"
 #include "cv/sobel.h"
 #include "cv/stats.h"
 #include "cv/warp.h"
 #include "opencv2/core/core_c.h" // needed for IplImage
-#include "opencv2/imgproc/imgproc.hpp"
 #include "scan/scan.h"
 
 #pragma mark life cycle
 
+DMZ_INTERNAL void dmz_pregate_buffers_destroy(void *pregate);
+DMZ_INTERNAL void dmz_edge_detection_scratch_destroy(void *edge_scratch);
+
 dmz_context *dmz_context_create(void) {
   dmz_context *dmz = (dmz_context *) calloc(1, sizeof(dmz_context));
   dmz->mz = mz_create();
+  dmz_pregate_default_config(&dmz->pregate_config);
+  dmz_cadence_default_config(&dmz->cadence_config);
   return dmz;
 }
 
 void dmz_context_destroy(dmz_context *dmz) {
+  dmz_recording_stop(dmz);
   mz_destroy(dmz->mz);
+  dmz_pregate_buffers_destroy(dmz->pregate);
+  dmz_edge_detection_scratch_destroy(dmz->edge_scratch);
+  free(dmz->cadence);
+  free(dmz->unwarp_staging);
   free(dmz);
 }
 
@@ -63,6 +75,10 @@ void dmz_YCbCr_to_RGB(IplImage *y, IplImage *cb, IplImage *cr, IplImage **rgb) {
   llcv_YCbCr2RGB_u8(y, cb, cr, *rgb);
 }
 
+void dmz_YCbCr_half_chroma_to_RGB(IplImage *y, IplImage *cb, IplImage *cr, IplImage *rgb) {
+  llcv_YCbCr2RGB_half_chroma_u8(y, cb, cr, rgb);
+}
+
 void dmz_deinterleave_RGBA_to_R(uint8_t *source, uint8_t *dest, int size) {
 #if DMZ_HAS_NEON_COMPILETIME
   if (dmz_has_neon_runtime()) {
@@ -162,7 +178,7 @@ CvRect dmz_card_rect_for_screen(CvSize standardCardSize, CvSize standardScreenSi
   return actualCardRect;
 }
 
-void dmz_set_roi_for_scoring(IplImage *image, bool use_full_image) {
+CvRect dmz_rect_for_scoring(IplImage *image, bool use_full_image) {
   // Usually we calculate the focus score only on the center 1/9th of the credit card
   // in the image (assume it is centered), for performance reasons
   CvSize focus_size;
@@ -173,25 +189,38 @@ void dmz_set_roi_for_scoring(IplImage *image, bool use_full_image) {
     focus_size = cvSize(kCreditCardTargetWidth / 3, kCreditCardTargetHeight / 3);
   }
   
-  CvRect focus_rect = dmz_card_rect_for_screen(focus_size,
-                                               cvSize(kLandscapeSampleWidth, kLandscapeSampleHeight),
-                                               cvGetSize(image));
-  
-  cvSetImageROI(image, focus_rect);
+  return dmz_card_rect_for_screen(focus_size,
+                                  cvSize(kLandscapeSampleWidth, kLandscapeSampleHeight),
+                                  cvGetSize(image));
+}
+
+void dmz_set_roi_for_scoring(IplImage *image, bool use_full_image) {
+  cvSetImageROI(image, dmz_rect_for_scoring(image, use_full_image));
+}
+
+// A header for just the scoring rect, so that image itself (and any roi it has) is left alone.
+DMZ_INTERNAL void dmz_scoring_header(IplImage *image, bool use_full_image, IplImage *header) {
+  llcv_image_header_for_view(llcv_view_rect(llcv_view_of_image(image), dmz_rect_for_scoring(image, use_full_image)), IPL_DEPTH_8U, header);
 }
 
 float dmz_focus_score(IplImage *image, bool use_full_image) {
-  dmz_set_roi_for_scoring(image, use_full_image);
-  float focus_score = dmz_focus_score_for_image(image);
-  cvResetImageROI(image);
-  return focus_score;
+  IplImage scoring_image;
+  dmz_scoring_header(image, use_full_image, &scoring_image);
+  return dmz_focus_score_for_image(&scoring_image);
 }
 
 float dmz_brightness_score(IplImage *image, bool use_full_image) {
-  dmz_set_roi_for_scoring(image, use_full_image);
-  float focus_score = dmz_brightness_score_for_image(image);
-  cvResetImageROI(image);
-  return focus_score;
+  IplImage scoring_image;
+  dmz_scoring_header(image, use_full_image, &scoring_image);
+  return dmz_brightness_score_for_image(&scoring_image);
+}
+
+void dmz_frame_quality(IplImage *image, bool use_full_image, bool compute_saturation, dmz_frame_quality_scores *scores) {
+  llcv_frame_quality_stats stats;
+  llcv_frame_quality(image, dmz_rect_for_scoring(image, use_full_image), compute_saturation, &stats);
+  scores->focus_score = stats.stddev_of_abs_dx_dy;
+  scores->brightness_score = stats.mean;
+  scores->saturated_fraction = stats.saturated_fraction;
 }
 
 #pragma mark detection
@@ -220,38 +249,32 @@ enum {
 };
 typedef uint8_t LineOrientation;
 
-#pragma mark: best_line_for_sample
-ParametricLine best_line_for_sample(IplImage *image, LineOrientation expectedOrientation) {
+#pragma mark: best_line_in_theta_range
+// canny_scratch is grown as needed and kept for the next call (see llcv_canny7_reserve_scratch).
+ParametricLine best_line_in_theta_range(IplImage *image, LineOrientation expectedOrientation, float theta_min, float theta_max, float theta_resolution, IplImage **canny_scratch) {
   bool expected_vertical = expectedOrientation == LineOrientationVertical;
 
   // Calculate dx and dy derivatives; they'll be reused a lot throughout
   CvSize image_size = cvGetSize(image);
   assert(image_size.width > 0 && image_size.height > 0);
   dmz_trace_log("looking for best line in %ix%i patch with orientation:%i", image_size.width, image_size.height, expectedOrientation);
-  IplImage *sobel_scratch = cvCreateImage(cvSize(image_size.height, image_size.width), IPL_DEPTH_16S, 1);
-  assert(sobel_scratch != NULL);
   IplImage *dx = cvCreateImage(image_size, IPL_DEPTH_16S, 1);
   assert(dx != NULL);
   IplImage *dy = cvCreateImage(image_size, IPL_DEPTH_16S, 1);
   assert(dy != NULL);
-  llcv_sobel7(image, dx, sobel_scratch, 1, 0);
-  llcv_sobel7(image, dy, sobel_scratch, 0, 1);
-  cvReleaseImage(&sobel_scratch);
+  llcv_sobel7_dx_dy(image, dx, dy, NULL);
 
   // Calculate the canny image
   IplImage *canny_image = cvCreateImage(image_size, IPL_DEPTH_8U, 1);
-  llcv_adaptive_canny7_precomputed_sobel(image, canny_image, dx, dy);
+  llcv_adaptive_canny7_precomputed_sobel(image, canny_image, dx, dy, llcv_canny7_reserve_scratch(canny_scratch, image_size));
 
   // Calculate the hough transform, throwing away edge components with the wrong gradient angles
   int hough_accumulator_threshold = MAX(image_size.width, image_size.height) / kHoughThresholdLengthDivisor;
-  float base_angle = expected_vertical ? kVerticalAngle : kHorizontalAngle;
-  float theta_min = base_angle - kMaxAngleDeviationAllowed;
-  float theta_max = base_angle + kMaxAngleDeviationAllowed;
 
   CvLinePolar best_line = llcv_hough(canny_image,
                                      dx, dy,
                                      1, // rho resolution
-                                     (float)CV_PI / 180.0f, // theta resolution
+                                     theta_resolution,
                                      hough_accumulator_threshold,
                                      theta_min,
                                      theta_max,
@@ -270,6 +293,137 @@ ParametricLine best_line_for_sample(IplImage *image, LineOrientation expectedOri
   return ret;
 }
 
+#pragma mark: best_line_for_sample
+ParametricLine best_line_for_sample(IplImage *image, LineOrientation expectedOrientation, IplImage **canny_scratch) {
+  float base_angle = expectedOrientation == LineOrientationVertical ? kVerticalAngle : kHorizontalAngle;
+  return best_line_in_theta_range(image, expectedOrientation,
+                                  base_angle - kMaxAngleDeviationAllowed,
+                                  base_angle + kMaxAngleDeviationAllowed,
+                                  (float)CV_PI / 180.0f, canny_scratch);
+}
+
+#pragma mark: edge detection pyramid
+
+// Lines are first looked for on a downsampled copy of each plane no taller than this, so that
+// detection costs about the same whatever the capture resolution. Each line found there is then
+// refined at full resolution, within a narrow band around it. (At 640x480 there's nothing to refine.)
+#define kEdgeDetectionCoarseMaxHeight 480
+#define kEdgeDetectionMaxCoarseScale 4
+
+#define kNumColorPlanes 3
+
+// Refinement band: the coarse line, give or take this many coarse pixels, at angles within
+// kEdgeRefinementThetaWindow of the coarse angle (which was found at 1 degree resolution).
+#define kEdgeRefinementMarginCoarsePixels 2
+#define kEdgeRefinementThetaWindow ((float)(0.75f * (CV_PI / 180.0f)))
+#define kEdgeRefinementThetaResolution ((float)(0.25f * (CV_PI / 180.0f)))
+#define kEdgeRefinementMinBandSize 8
+
+typedef struct {
+  IplImage *sample; // as captured
+  IplImage *coarse; // sample itself, or a downsampled copy
+  int coarse_scale; // sample size / coarse size
+  DetectionBoxes boxes;
+  DetectionBoxes coarse_boxes;
+  float rho_multiplier; // to Y coordinates
+} EdgeDetectionPlane;
+
+// Kept from frame to frame (in dmz_context when there is one), so that edge detection allocates
+// nothing once the capture size settles.
+typedef struct {
+  IplImage *levels[kNumColorPlanes][kEdgeDetectionMaxCoarseScale / 2]; // each plane at 1/2, then 1/4, as needed
+  IplImage *canny; // see llcv_canny7_reserve_scratch
+} dmz_edge_detection_scratch;
+
+DMZ_INTERNAL void dmz_edge_detection_scratch_release(dmz_edge_detection_scratch *scratch) {
+  for(int i = 0; i < kNumColorPlanes; i++) {
+    for(int level = 0; level < kEdgeDetectionMaxCoarseScale / 2; level++) {
+      cvReleaseImage(&scratch->levels[i][level]);
+    }
+  }
+  cvReleaseImage(&scratch->canny);
+}
+
+DMZ_INTERNAL void dmz_edge_detection_scratch_destroy(void *edge_scratch) {
+  dmz_edge_detection_scratch *scratch = (dmz_edge_detection_scratch *)edge_scratch;
+  if(scratch == NULL) {
+    return;
+  }
+  dmz_edge_detection_scratch_release(scratch);
+  free(scratch);
+}
+
+// levels are the plane's pyramid images, (re)created when the sample size changes.
+DMZ_INTERNAL IplImage *edge_detection_coarse_sample(IplImage *sample, IplImage **levels, int *coarse_scale) {
+  IplImage *coarse = sample;
+  *coarse_scale = 1;
+  CvSize size = cvGetSize(sample);
+  for(int level = 0; size.height > kEdgeDetectionCoarseMaxHeight && *coarse_scale < kEdgeDetectionMaxCoarseScale; level++) {
+    size = cvSize(size.width / 2, size.height / 2);
+    if(levels[level] != NULL && (levels[level]->width != size.width || levels[level]->height != size.height)) {
+      cvReleaseImage(&levels[level]);
+    }
+    if(levels[level] == NULL) {
+      levels[level] = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    }
+    llcv_area_down2_u8(llcv_view_of_image(coarse), llcv_view_of_image(levels[level]));
+    coarse = levels[level];
+    *coarse_scale *= 2;
+  }
+  return coarse;
+}
+
+// Coarse pixel (u, v) averages the scale x scale block whose center is at (scale * u + c, scale * v + c),
+// c = (scale - 1) / 2.
+DMZ_INTERNAL ParametricLine line_from_coarse(ParametricLine coarse_line, int coarse_scale) {
+  ParametricLine line = coarse_line;
+  float center_offset = (coarse_scale - 1) / 2.0f;
+  line.rho = coarse_scale * coarse_line.rho + center_offset * (cosf(coarse_line.theta) + sinf(coarse_line.theta));
+  return line;
+}
+
+#pragma mark: refine_line_for_sample
+// Looks for the line again in the part of detection_rect within a few pixels of approximate_line
+// (in sample coordinates). Returns approximate_line if the band is too small or holds no line.
+ParametricLine refine_line_for_sample(IplImage *sample, CvRect detection_rect, ParametricLine approximate_line, int margin, LineOrientation line_orientation,
+                                      IplImage **canny_scratch) {
+  bool vertical = line_orientation == LineOrientationVertical;
+  float cos_theta = cosf(approximate_line.theta);
+  float sin_theta = sinf(approximate_line.theta);
+
+  // Where the line (or any line within the theta window that crosses it mid-rect) enters and leaves the rect, across its length
+  float along_start = vertical ? detection_rect.y : detection_rect.x;
+  float along_end = along_start + (vertical ? detection_rect.height : detection_rect.width);
+  float across_start = vertical ? (approximate_line.rho - along_start * sin_theta) / cos_theta : (approximate_line.rho - along_start * cos_theta) / sin_theta;
+  float across_end = vertical ? (approximate_line.rho - along_end * sin_theta) / cos_theta : (approximate_line.rho - along_end * cos_theta) / sin_theta;
+  float slop = margin + 0.5f * (along_end - along_start) * tanf(kEdgeRefinementThetaWindow);
+
+  int rect_across_start = vertical ? detection_rect.x : detection_rect.y;
+  int rect_across_end = rect_across_start + (vertical ? detection_rect.width : detection_rect.height);
+  int band_start = MAX(rect_across_start, (int)floorf(MIN(across_start, across_end) - slop));
+  int band_end = MIN(rect_across_end, (int)ceilf(MAX(across_start, across_end) + slop) + 1);
+  if(band_end - band_start < kEdgeRefinementMinBandSize) {
+    return approximate_line;
+  }
+
+  CvRect band = vertical ?
+    cvRect(band_start, detection_rect.y, band_end - band_start, detection_rect.height) :
+    cvRect(detection_rect.x, band_start, detection_rect.width, band_end - band_start);
+  dmz_trace_log("refinement band {x:%i y:%i w:%i h:%i}", band.x, band.y, band.width, band.height);
+
+  float base_angle = vertical ? kVerticalAngle : kHorizontalAngle;
+  float theta_min = MAX(base_angle - kMaxAngleDeviationAllowed, approximate_line.theta - kEdgeRefinementThetaWindow);
+  float theta_max = MIN(base_angle + kMaxAngleDeviationAllowed, approximate_line.theta + kEdgeRefinementThetaWindow);
+
+  cvSetImageROI(sample, band);
+  ParametricLine local_line = best_line_in_theta_range(sample, line_orientation, theta_min, theta_max, kEdgeRefinementThetaResolution, canny_scratch);
+  cvResetImageROI(sample);
+  if(is_parametric_line_none(local_line)) {
+    return approximate_line;
+  }
+  return lineByShiftingOrigin(local_line, band.x, band.y);
+}
+
 #pragma mark: dmz_found_all_edges
 bool dmz_found_all_edges(dmz_edges found_edges) {
   return (found_edges.top.found && found_edges.bottom.found && found_edges.left.found && found_edges.right.found);
@@ -340,36 +494,46 @@ DetectionBoxes detection_boxes_for_sample(IplImage *sample, FrameOrientation ori
   return boxes;
 }
 
-#define kNumColorPlanes 3
-
 #pragma mark: find_line_in_detection_rects
-void find_line_in_detection_rects(IplImage **samples, float *rho_multiplier, CvRect *detection_rects, dmz_found_edge *found_edge, LineOrientation line_orientation) {
+void find_line_in_detection_rects(EdgeDetectionPlane *planes, CvRect *detection_rects, CvRect *coarse_detection_rects, dmz_found_edge *found_edge, LineOrientation line_orientation,
+                                  IplImage **canny_scratch) {
+  assert(planes != NULL);
   assert(detection_rects != NULL);
+  assert(coarse_detection_rects != NULL);
   assert(found_edge != NULL);
-  assert(samples != NULL);
   dmz_trace_log("inputs to find_line_in_detection_rects are valid");
   for(int i = 0; i < kNumColorPlanes && !found_edge->found; i++) {
-    IplImage *image = samples[i];
-    assert(image != NULL);
+    EdgeDetectionPlane *plane = &planes[i];
+    assert(plane->coarse != NULL);
     #if DMZ_TRACE
-    CvSize imageSize = cvGetSize(image);
-    dmz_trace_log("sample %i has size %ix%i", i, imageSize.width, imageSize.height);
-    CvRect r = detection_rects[i];
+    CvSize imageSize = cvGetSize(plane->coarse);
+    dmz_trace_log("sample %i has size %ix%i (scale %i)", i, imageSize.width, imageSize.height, plane->coarse_scale);
+    CvRect r = coarse_detection_rects[i];
     dmz_trace_log("detection_rect {x:%i y:%i w:%i h:%i}", r.x, r.y, r.width, r.height);
     #endif
-    cvSetImageROI(image, detection_rects[i]);
-    ParametricLine local_edge = best_line_for_sample(image, line_orientation);
+    cvSetImageROI(plane->coarse, coarse_detection_rects[i]);
+    ParametricLine local_edge = best_line_for_sample(plane->coarse, line_orientation, canny_scratch);
     dmz_trace_log("local_edge - {rho:%f theta:%f}", local_edge.rho, local_edge.theta);
-    cvResetImageROI(image);
-    found_edge->location = lineByShiftingOrigin(local_edge, detection_rects[i].x, detection_rects[i].y);
-    found_edge->location.rho *= rho_multiplier[i];
-    found_edge->found = !is_parametric_line_none(found_edge->location);
+    cvResetImageROI(plane->coarse);
+    if(is_parametric_line_none(local_edge)) {
+      continue;
+    }
+    ParametricLine edge = lineByShiftingOrigin(local_edge, coarse_detection_rects[i].x, coarse_detection_rects[i].y);
+    if(plane->coarse_scale > 1) {
+      edge = refine_line_for_sample(plane->sample, detection_rects[i], line_from_coarse(edge, plane->coarse_scale),
+                                    kEdgeRefinementMarginCoarsePixels * plane->coarse_scale, line_orientation, canny_scratch);
+      dmz_trace_log("refined edge - {rho:%f theta:%f}", edge.rho, edge.theta);
+    }
+    found_edge->location = edge;
+    found_edge->location.rho *= plane->rho_multiplier;
+    found_edge->found = true;
   }
   dmz_trace_log("resulting edge - {found:%i ...}", found_edge->found);
 }
 
-bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
-                      FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points) {
+DMZ_INTERNAL bool dmz_detect_edges_with_scratch(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                                                FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points,
+                                                dmz_edge_detection_scratch *scratch) {
   assert(y_sample != NULL);
   assert(cb_sample != NULL);
   assert(cr_sample != NULL);
@@ -379,11 +543,16 @@ bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_samp
   dmz_trace_log("dmz_detect_edges");
 
   IplImage *samples[kNumColorPlanes] = {y_sample, cb_sample, cr_sample};
-  DetectionBoxes boxes[kNumColorPlanes];
   float rho_multiplier[kNumColorPlanes] = {1.0f, 2.0f, 2.0f}; // cb and cr are half the size of Y
+  EdgeDetectionPlane planes[kNumColorPlanes];
 
   for(int i = 0; i < kNumColorPlanes; i++) {
-    boxes[i] = detection_boxes_for_sample(samples[i], orientation);
+    EdgeDetectionPlane *plane = &planes[i];
+    plane->sample = samples[i];
+    plane->coarse = edge_detection_coarse_sample(samples[i], scratch->levels[i], &plane->coarse_scale);
+    plane->boxes = detection_boxes_for_sample(plane->sample, orientation);
+    plane->coarse_boxes = plane->coarse_scale > 1 ? detection_boxes_for_sample(plane->coarse, orientation) : plane->boxes;
+    plane->rho_multiplier = rho_multiplier[i];
   }
 
   dmz_trace_log("got boxes, looking for lines...");
@@ -394,29 +563,34 @@ bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_samp
   found_edges->right.found = 0;
 
   CvRect detection_rects[kNumColorPlanes];
+  CvRect coarse_detection_rects[kNumColorPlanes];
 
   for(uint8_t i = 0; i < kNumColorPlanes; i++) {
-    detection_rects[i] = boxes[i].top;
+    detection_rects[i] = planes[i].boxes.top;
+    coarse_detection_rects[i] = planes[i].coarse_boxes.top;
   }
-  find_line_in_detection_rects(samples, rho_multiplier, detection_rects, &found_edges->top, LineOrientationHorizontal);
+  find_line_in_detection_rects(planes, detection_rects, coarse_detection_rects, &found_edges->top, LineOrientationHorizontal, &scratch->canny);
   dmz_trace_log("dmz top edge? %i", found_edges->top.found);
 
   for(uint8_t i = 0; i < kNumColorPlanes; i++) {
-    detection_rects[i] = boxes[i].bottom;
+    detection_rects[i] = planes[i].boxes.bottom;
+    coarse_detection_rects[i] = planes[i].coarse_boxes.bottom;
   }
-  find_line_in_detection_rects(samples, rho_multiplier, detection_rects, &found_edges->bottom, LineOrientationHorizontal);
+  find_line_in_detection_rects(planes, detection_rects, coarse_detection_rects, &found_edges->bottom, LineOrientationHorizontal, &scratch->canny);
   dmz_trace_log("dmz bottom edge? %i", found_edges->bottom.found);
 
   for(uint8_t i = 0; i < kNumColorPlanes; i++) {
-    detection_rects[i] = boxes[i].left;
+    detection_rects[i] = planes[i].boxes.left;
+    coarse_detection_rects[i] = planes[i].coarse_boxes.left;
   }
-  find_line_in_detection_rects(samples, rho_multiplier, detection_rects, &found_edges->left, LineOrientationVertical);
+  find_line_in_detection_rects(planes, detection_rects, coarse_detection_rects, &found_edges->left, LineOrientationVertical, &scratch->canny);
   dmz_trace_log("dmz left edge? %i", found_edges->left.found);
 
   for(uint8_t i = 0; i < kNumColorPlanes; i++) {
-    detection_rects[i] = boxes[i].right;
+    detection_rects[i] = planes[i].boxes.right;
+    coarse_detection_rects[i] = planes[i].coarse_boxes.right;
   }
-  find_line_in_detection_rects(samples, rho_multiplier, detection_rects, &found_edges->right, LineOrientationVertical);
+  find_line_in_detection_rects(planes, detection_rects, coarse_detection_rects, &found_edges->right, LineOrientationVertical, &scratch->canny);
   dmz_trace_log("dmz right edge? %i", found_edges->right.found);
 
   // Find corner intersections
@@ -438,11 +612,359 @@ bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_samp
   return found_all_corners;
 }
 
+bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                      FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points) {
+  dmz_edge_detection_scratch scratch = {};
+  bool found_all_corners = dmz_detect_edges_with_scratch(y_sample, cb_sample, cr_sample, orientation, found_edges, corner_points, &scratch);
+  dmz_edge_detection_scratch_release(&scratch);
+  return found_all_corners;
+}
+
+#pragma mark pregate
+
+#define kPregateScale 4 // the pre-gate looks at a 1/4 x 1/4 box-filtered Y plane
+
+typedef struct {
+  IplImage *current;
+  IplImage *previous;
+  bool has_previous;
+} dmz_pregate_buffers;
+
+void dmz_pregate_default_config(dmz_pregate_config *config) {
+  // Deliberately lax: the pre-gate should only reject frames that are clearly hopeless.
+  // Use audit mode to see what a tighter configuration would cost.
+  config->enabled = true;
+  config->audit = false;
+  config->min_brightness = 10.0f;
+  config->max_brightness = 245.0f;
+  config->min_focus = 1.0f;
+  config->max_motion = 40.0f;
+  config->edge_gradient_threshold = 16;
+  config->min_edge_fraction = 0.25f;
+  config->min_edge_boxes = 3; // allow for one edge that only shows up in Cb or Cr
+}
+
+DMZ_INTERNAL void dmz_pregate_buffers_destroy(void *pregate) {
+  dmz_pregate_buffers *buffers = (dmz_pregate_buffers *)pregate;
+  if (buffers == NULL) {
+    return;
+  }
+  cvReleaseImage(&buffers->current);
+  cvReleaseImage(&buffers->previous);
+  free(buffers);
+}
+
+// Fraction of the box, along the expected line, that has a strong gradient across it somewhere.
+// A card edge crosses (nearly) the whole box; an empty box has few, if any, such columns/rows.
+DMZ_INTERNAL float dmz_pregate_edge_fraction(IplImage *small, CvRect box, LineOrientation line_orientation, uint8_t threshold) {
+  const uint8_t *data = (uint8_t *)small->imageData;
+  int step = small->widthStep;
+  int x0 = MAX(box.x, 1);
+  int y0 = MAX(box.y, 1);
+  int x1 = MIN(box.x + box.width, small->width - 1);
+  int y1 = MIN(box.y + box.height, small->height - 1);
+  if (x1 <= x0 || y1 <= y0) {
+    return 1.0f; // too small to judge, so don't reject on it
+  }
+
+  int n_strong = 0;
+  if (line_orientation == LineOrientationHorizontal) {
+    for (int x = x0; x < x1; x++) {
+      int strongest = 0;
+      for (int y = y0; y < y1; y++) {
+        strongest = MAX(strongest, abs(data[(y + 1) * step + x] - data[(y - 1) * step + x]));
+      }
+      n_strong += strongest >= threshold;
+    }
+    return (float)n_strong / (float)(x1 - x0);
+  } else {
+    for (int y = y0; y < y1; y++) {
+      const uint8_t *row = data + y * step;
+      int strongest = 0;
+      for (int x = x0; x < x1; x++) {
+        strongest = MAX(strongest, abs(row[x + 1] - row[x - 1]));
+      }
+      n_strong += strongest >= threshold;
+    }
+    return (float)n_strong / (float)(y1 - y0);
+  }
+}
+
+DMZ_INTERNAL CvRect dmz_pregate_scale_rect(CvRect rect) {
+  return cvRect(rect.x / kPregateScale, rect.y / kPregateScale,
+                (rect.width + kPregateScale - 1) / kPregateScale, (rect.height + kPregateScale - 1) / kPregateScale);
+}
+
+dmz_pregate_verdict dmz_pregate_frame(dmz_context *dmz, IplImage *y_sample, FrameOrientation orientation) {
+  dmz_pregate_buffers *buffers = (dmz_pregate_buffers *)dmz->pregate;
+  if (buffers == NULL) {
+    buffers = (dmz_pregate_buffers *)calloc(1, sizeof(dmz_pregate_buffers));
+    dmz->pregate = buffers;
+  }
+
+  CvSize sample_size = cvGetSize(y_sample);
+  CvSize small_size = cvSize(sample_size.width / kPregateScale, sample_size.height / kPregateScale);
+  if (buffers->current == NULL || buffers->current->width != small_size.width || buffers->current->height != small_size.height) {
+    cvReleaseImage(&buffers->current);
+    cvReleaseImage(&buffers->previous);
+    buffers->current = cvCreateImage(small_size, IPL_DEPTH_8U, 1);
+    buffers->previous = cvCreateImage(small_size, IPL_DEPTH_8U, 1);
+    buffers->has_previous = false;
+  }
+  IplImage *small = buffers->current;
+  cvResize(y_sample, small, CV_INTER_AREA);
+
+  const dmz_pregate_config *config = &dmz->pregate_config;
+
+  // exposure and blur
+  llcv_frame_quality_stats quality;
+  llcv_frame_quality(small, cvRect(0, 0, small_size.width, small_size.height), false, &quality);
+
+  // motion: mean absolute difference from the previous frame
+  float motion = 0.0f;
+  if (buffers->has_previous) {
+    int64_t total_difference = 0;
+    for (int y = 0; y < small_size.height; y++) {
+      const uint8_t *row = (uint8_t *)small->imageData + y * small->widthStep;
+      const uint8_t *previous_row = (uint8_t *)buffers->previous->imageData + y * buffers->previous->widthStep;
+      for (int x = 0; x < small_size.width; x++) {
+        total_difference += abs(row[x] - previous_row[x]);
+      }
+    }
+    motion = (float)total_difference / (float)(small_size.width * small_size.height);
+  }
+
+  dmz_pregate_verdict verdict = DMZPregatePass;
+  if (quality.mean < config->min_brightness) {
+    verdict = DMZPregateTooDark;
+  } else if (quality.mean > config->max_brightness) {
+    verdict = DMZPregateTooBright;
+  } else if (quality.stddev_of_abs_dx_dy < config->min_focus) {
+    verdict = DMZPregateTooBlurry;
+  } else if (motion > config->max_motion) {
+    verdict = DMZPregateTooMuchMotion;
+  } else {
+    DetectionBoxes boxes = detection_boxes_for_sample(y_sample, orientation);
+    uint8_t n_edge_boxes = 0;
+    n_edge_boxes += dmz_pregate_edge_fraction(small, dmz_pregate_scale_rect(boxes.top), LineOrientationHorizontal, config->edge_gradient_threshold) >= config->min_edge_fraction;
+    n_edge_boxes += dmz_pregate_edge_fraction(small, dmz_pregate_scale_rect(boxes.bottom), LineOrientationHorizontal, config->edge_gradient_threshold) >= config->min_edge_fraction;
+    n_edge_boxes += dmz_pregate_edge_fraction(small, dmz_pregate_scale_rect(boxes.left), LineOrientationVertical, config->edge_gradient_threshold) >= config->min_edge_fraction;
+    n_edge_boxes += dmz_pregate_edge_fraction(small, dmz_pregate_scale_rect(boxes.right), LineOrientationVertical, config->edge_gradient_threshold) >= config->min_edge_fraction;
+    if (n_edge_boxes < config->min_edge_boxes) {
+      verdict = DMZPregateMissingEdges;
+    }
+  }
+
+  // this frame is the next one's previous
+  buffers->current = buffers->previous;
+  buffers->previous = small;
+  buffers->has_previous = true;
+
+  dmz->pregate_stats.frames++;
+  if (verdict != DMZPregatePass) {
+    dmz->pregate_stats.skipped++;
+    dmz->pregate_stats.skipped_by_verdict[verdict]++;
+  }
+  dmz_debug_log("pregate verdict:%i brightness:%f focus:%f motion:%f", verdict, quality.mean, quality.stddev_of_abs_dx_dy, motion);
+  return verdict;
+}
+
+bool dmz_detect_edges_with_pregate(dmz_context *dmz, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                                   FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points,
+                                   dmz_pregate_verdict *verdict) {
+  dmz_pregate_verdict pregate_verdict = DMZPregatePass;
+  if (dmz->pregate_config.enabled) {
+    pregate_verdict = dmz_pregate_frame(dmz, y_sample, orientation);
+  }
+  if (verdict != NULL) {
+    *verdict = pregate_verdict;
+  }
+
+  if (pregate_verdict != DMZPregatePass && !dmz->pregate_config.audit) {
+    found_edges->top.found = 0;
+    found_edges->bottom.found = 0;
+    found_edges->left.found = 0;
+    found_edges->right.found = 0;
+    return false;
+  }
+
+  if (dmz->edge_scratch == NULL) {
+    dmz->edge_scratch = calloc(1, sizeof(dmz_edge_detection_scratch));
+  }
+  uint64_t start = dmz_profile_start(&dmz->profile);
+  bool found_all_corners = dmz_detect_edges_with_scratch(y_sample, cb_sample, cr_sample, orientation, found_edges, corner_points,
+                                                         (dmz_edge_detection_scratch *)dmz->edge_scratch);
+  dmz_profile_end(&dmz->profile, DMZStageEdgeDetection, start);
+  if (pregate_verdict != DMZPregatePass && found_all_corners) {
+    // only reachable in audit mode: the pre-gate would have thrown away a good frame
+    dmz->pregate_stats.audit_false_rejects++;
+  }
+  return found_all_corners;
+}
+
+float dmz_pregate_skip_rate(dmz_context *dmz) {
+  if (dmz->pregate_stats.frames == 0) {
+    return 0.0f;
+  }
+  return (float)dmz->pregate_stats.skipped / (float)dmz->pregate_stats.frames;
+}
+
+void dmz_pregate_reset_stats(dmz_context *dmz) {
+  memset(&dmz->pregate_stats, 0, sizeof(dmz->pregate_stats));
+}
+
+#pragma mark cadence
+
+#define kCadenceSmoothing 0.2f // weight of each new sample in the smoothed timings
+
+typedef struct {
+  // Stage totals as of the previous decision, to time the frame processed since then
+  uint64_t edge_microseconds;
+  uint64_t scan_microseconds;
+  uint64_t expiry_microseconds;
+  bool have_totals;
+  bool processed_last_frame;
+  bool scanned_expiry_last_frame;
+
+  float frame_ms; // 0 until measured
+  float expiry_ms;
+  uint8_t frames_since_processed;
+  uint32_t frames_processed;
+  uint8_t frame_interval; // as last logged
+  uint8_t expiry_interval;
+  dmz_cadence_reason reason;
+} dmz_cadence_state;
+
+void dmz_cadence_default_config(dmz_cadence_config *config) {
+  config->enabled = false;
+  config->enforce = true;
+  config->frame_budget_ms = 33.0f; // 30 fps
+  config->max_frame_interval = 4;
+  config->max_expiry_interval = 4;
+  config->expiry_budget_fraction = 0.5f;
+  config->settling_convergence = 0.8f;
+  config->settling_frame_interval = 2;
+}
+
+void dmz_cadence_reset_stats(dmz_context *dmz) {
+  memset(&dmz->cadence_stats, 0, sizeof(dmz->cadence_stats));
+}
+
+DMZ_INTERNAL uint64_t dmz_cadence_stage_total(const dmz_profile *profile, dmz_stage first, dmz_stage last) {
+  uint64_t total = 0;
+  for(dmz_stage stage = first; stage <= last; stage++) {
+    total += profile->stages[stage].total_microseconds;
+  }
+  return total;
+}
+
+DMZ_INTERNAL float dmz_cadence_smooth(float smoothed, float sample) {
+  return smoothed == 0.0f ? sample : smoothed + kCadenceSmoothing * (sample - smoothed);
+}
+
+DMZ_INTERNAL uint8_t dmz_cadence_interval(float cost_ms, float budget_ms, uint8_t max_interval) {
+  if(cost_ms <= budget_ms || budget_ms <= 0.0f) {
+    return 1;
+  }
+  return (uint8_t)MIN(ceilf(cost_ms / budget_ms), (float)MAX(max_interval, 1));
+}
+
+// Fold the frame processed since the previous decision (if any) into the smoothed timings.
+DMZ_INTERNAL void dmz_cadence_measure(dmz_cadence_state *cadence, dmz_context *dmz, ScannerState *state) {
+  uint64_t edge_microseconds = dmz_cadence_stage_total(&dmz->profile, DMZStageEdgeDetection, DMZStageUnwarp);
+  uint64_t scan_microseconds = dmz_cadence_stage_total(&state->profile, DMZStageVSeg, DMZStageNumberCategorize);
+  uint64_t expiry_microseconds = dmz_cadence_stage_total(&state->profile, DMZStageExpirySeg, DMZStageExpiryCategorize);
+
+  // Profiles only ever grow, unless someone resets them; then just start again.
+  bool comparable = cadence->have_totals &&
+                    edge_microseconds >= cadence->edge_microseconds &&
+                    scan_microseconds >= cadence->scan_microseconds &&
+                    expiry_microseconds >= cadence->expiry_microseconds;
+  if(comparable && cadence->processed_last_frame) {
+    float frame_ms = ((edge_microseconds - cadence->edge_microseconds) + (scan_microseconds - cadence->scan_microseconds)) / 1000.0f;
+    cadence->frame_ms = dmz_cadence_smooth(cadence->frame_ms, frame_ms);
+    if(cadence->scanned_expiry_last_frame) {
+      cadence->expiry_ms = dmz_cadence_smooth(cadence->expiry_ms, (expiry_microseconds - cadence->expiry_microseconds) / 1000.0f);
+    }
+  }
+  cadence->edge_microseconds = edge_microseconds;
+  cadence->scan_microseconds = scan_microseconds;
+  cadence->expiry_microseconds = expiry_microseconds;
+  cadence->have_totals = true;
+}
+
+void dmz_cadence_decide(dmz_context *dmz, ScannerState *state, bool scan_expiry, dmz_cadence_decision *decision) {
+  const dmz_cadence_config *config = &dmz->cadence_config;
+  memset(decision, 0, sizeof(dmz_cadence_decision));
+  decision->process_frame = true;
+  decision->scan_expiry = scan_expiry;
+  decision->frame_interval = 1;
+  decision->expiry_interval = 1;
+  decision->reason = DMZCadenceEveryFrame;
+  if(!config->enabled) {
+    return;
+  }
+
+  dmz_cadence_state *cadence = (dmz_cadence_state *)dmz->cadence;
+  if(cadence == NULL) {
+    cadence = (dmz_cadence_state *)calloc(1, sizeof(dmz_cadence_state));
+    dmz->cadence = cadence;
+  }
+  dmz_profile_set_enabled(&dmz->profile, true);
+  dmz_profile_set_enabled(&state->profile, true);
+  dmz_cadence_measure(cadence, dmz, state);
+
+  decision->frame_ms = cadence->frame_ms;
+  decision->expiry_ms = cadence->expiry_ms;
+  decision->convergence = scanner_convergence(state);
+
+  float expiry_budget_ms = config->frame_budget_ms * config->expiry_budget_fraction;
+  if(scan_expiry) {
+    decision->expiry_interval = dmz_cadence_interval(cadence->expiry_ms, expiry_budget_ms, config->max_expiry_interval);
+  }
+  float cost_ms = cadence->frame_ms + (scan_expiry ? cadence->expiry_ms / decision->expiry_interval : 0.0f);
+  if(cost_ms > config->frame_budget_ms) {
+    decision->frame_interval = dmz_cadence_interval(cost_ms, config->frame_budget_ms, config->max_frame_interval);
+    decision->reason = DMZCadenceOverBudget;
+  } else if(decision->convergence >= config->settling_convergence && decision->convergence < 1.0f) {
+    // (once the number is complete, any remaining frames are for expiry, which needs all it can get)
+    decision->frame_interval = MAX(config->settling_frame_interval, 1);
+    decision->reason = DMZCadenceSettling;
+  }
+
+  cadence->frames_since_processed++;
+  bool process_frame = cadence->frames_since_processed >= decision->frame_interval;
+  bool scan_expiry_now = scan_expiry && process_frame && cadence->frames_processed % decision->expiry_interval == 0;
+  if(process_frame) {
+    cadence->frames_since_processed = 0;
+    cadence->frames_processed++;
+  }
+
+  dmz->cadence_stats.frames++;
+  dmz->cadence_stats.frames_by_reason[decision->reason]++;
+  if(config->enforce) {
+    decision->process_frame = process_frame;
+    decision->scan_expiry = scan_expiry_now;
+    dmz->cadence_stats.frames_skipped += !process_frame;
+    dmz->cadence_stats.expiry_skipped += scan_expiry && process_frame && !scan_expiry_now;
+  }
+  cadence->processed_last_frame = decision->process_frame;
+  cadence->scanned_expiry_last_frame = decision->process_frame && decision->scan_expiry;
+
+  if(decision->reason != cadence->reason || decision->frame_interval != cadence->frame_interval || decision->expiry_interval != cadence->expiry_interval) {
+    dmz_debug_log("cadence: reason %i, 1 in %i frames, expiry 1 in %i (frame %.1f ms, expiry %.1f ms, convergence %.2f)%s",
+                  decision->reason, decision->frame_interval, decision->expiry_interval,
+                  decision->frame_ms, decision->expiry_ms, decision->convergence, config->enforce ? "" : " [advisory]");
+    cadence->reason = decision->reason;
+    cadence->frame_interval = decision->frame_interval;
+    cadence->expiry_interval = decision->expiry_interval;
+  }
+}
+
 #pragma mark transform
 
-void dmz_transform_card(dmz_context *dmz, IplImage *sample, dmz_corner_points corner_points, FrameOrientation orientation, bool upsample, IplImage **transformed) {
-  
-  dmz_point src_points[4];
+DMZ_INTERNAL void dmz_src_points_for_card(dmz_corner_points corner_points, FrameOrientation orientation, bool upsample, dmz_point src_points[4]) {
+
   switch(orientation) {
     case FrameOrientationPortrait:
       src_points[0] = corner_points.bottom_left;
@@ -479,6 +1001,12 @@ void dmz_transform_card(dmz_context *dmz, IplImage *sample, dmz_corner_points co
       }    
     }
   }
+}
+
+void dmz_transform_card(dmz_context *dmz, IplImage *sample, dmz_corner_points corner_points, FrameOrientation orientation, bool upsample, IplImage **transformed) {
+  
+  dmz_point src_points[4];
+  dmz_src_points_for_card(corner_points, orientation, upsample, src_points);
   
   // Destination rectangle is the same as the size of the image
   dmz_rect dst_rect = dmz_create_rect(0, 0, kCreditCardTargetWidth - 1, kCreditCardTargetHeight - 1);
@@ -493,25 +1021,92 @@ void dmz_transform_card(dmz_context *dmz, IplImage *sample, dmz_corner_points co
   if (*transformed == NULL) {
 	  *transformed = cvCreateImage(cvSize(kCreditCardTargetWidth, kCreditCardTargetHeight), sample->depth, nChannels);
   }
+  uint64_t start = dmz_profile_start(dmz == NULL ? NULL : &dmz->profile);
   llcv_unwarp(dmz, sample, src_points, dst_rect, *transformed);
+  dmz_profile_end(dmz == NULL ? NULL : &dmz->profile, DMZStageUnwarp, start);
+}
+
+DMZ_INTERNAL IplImage *dmz_transform_card_y_scaled(dmz_context *dmz, ScannerState *state, IplImage *y_sample, dmz_corner_points corner_points, FrameOrientation orientation, int scale) {
+  CvSize card_size = cvSize(scale * kCreditCardTargetWidth, scale * kCreditCardTargetHeight);
+  if (state->card_y != NULL && state->card_y->width != card_size.width) {
+    llcv_release_aligned_image(&state->card_y);
+  }
+  if (state->card_y == NULL) {
+    state->card_y = llcv_create_aligned_image(card_size, IPL_DEPTH_8U, 1);
+  }
+  state->card_corner_points = corner_points;
+  state->card_orientation = orientation;
+
+  dmz_point src_points[4];
+  dmz_src_points_for_card(corner_points, orientation, false, src_points);
+  dmz_rect dst_rect = dmz_create_rect(0, 0, card_size.width - 1, card_size.height - 1);
+  uint64_t start = dmz_profile_start(&dmz->profile);
+  llcv_unwarp_plane(dmz, y_sample, src_points, dst_rect, state->card_y);
+  dmz_profile_end(&dmz->profile, DMZStageUnwarp, start);
+  return state->card_y;
+}
+
+IplImage *dmz_transform_card_y(dmz_context *dmz, ScannerState *state, IplImage *y_sample, dmz_corner_points corner_points, FrameOrientation orientation) {
+  return dmz_transform_card_y_scaled(dmz, state, y_sample, corner_points, orientation, 1);
+}
+
+IplImage *dmz_transform_card_y_2x(dmz_context *dmz, ScannerState *state, IplImage *y_sample, dmz_corner_points corner_points, FrameOrientation orientation) {
+  return dmz_transform_card_y_scaled(dmz, state, y_sample, corner_points, orientation, 2);
+}
+
+void dmz_card_color_image(dmz_context *dmz, ScannerState *state, IplImage *cb_sample, IplImage *cr_sample, IplImage **card_rgb) {
+  assert(state->card_y != NULL);
+
+  dmz_point src_points[4];
+  dmz_src_points_for_card(state->card_corner_points, state->card_orientation, true, src_points);
+
+  // Chroma is half resolution anyway, so warp it at half size and let the conversion upsample it.
+  // Only paid once per scan, so plain allocations are fine here.
+  CvSize chroma_size = cvSize(state->card_y->width / 2, state->card_y->height / 2);
+  dmz_rect dst_rect = dmz_create_rect(0, 0, chroma_size.width - 1, chroma_size.height - 1);
+  IplImage *card_cb = cvCreateImage(chroma_size, IPL_DEPTH_8U, 1);
+  IplImage *card_cr = cvCreateImage(chroma_size, IPL_DEPTH_8U, 1);
+  llcv_unwarp_plane(dmz, cb_sample, src_points, dst_rect, card_cb);
+  llcv_unwarp_plane(dmz, cr_sample, src_points, dst_rect, card_cr);
+
+  if (*card_rgb == NULL) {
+    *card_rgb = cvCreateImage(cvGetSize(state->card_y), IPL_DEPTH_8U, 3);
+  }
+  llcv_YCbCr2RGB_half_chroma_u8(state->card_y, card_cb, card_cr, *card_rgb);
+
+  cvReleaseImage(&card_cb);
+  cvReleaseImage(&card_cr);
 }
 
 void dmz_blur_card(IplImage* cardImageRGB, ScannerState* state, int unblurDigits)
+{
+    dmz_redaction_options options;
+    options.mode = DMZRedactionMedian;
+    options.aperture = 25;
+    options.n_threads = 1;
+    dmz_redact_card(cardImageRGB, state, unblurDigits, options);
+}
+
+void dmz_redact_card(IplImage* cardImage, ScannerState* state, int unblurDigits, dmz_redaction_options options)
 {
     if (unblurDigits < 0) return;
+    // options come from the caller, so don't leave them to llcv_redact_rects' asserts:
+    // no aperture means no redaction, and an even one drops to the odd one below it.
+    if (options.aperture == 0 || options.mode > DMZRedactionPixelate) return;
+    if (options.aperture % 2 == 0) options.aperture--;
+    CvRect rects[16];
+    int n_rects = 0;
     int blurCount = state->mostRecentUsableHSeg.n_offsets - unblurDigits;
+    int scale = cardImage->width / kCreditCardTargetWidth; // segmentation is in 428x270 coordinates
     for (int i = 0; i < state->mostRecentUsableHSeg.n_offsets && i < blurCount ; i++) {
         int num_x = state->mostRecentUsableHSeg.offsets[i] - 1;
         int num_y = state->mostRecentUsableVSeg.y_offset - 1;
         int num_w = state->mostRecentUsableHSeg.number_width + 2;
         int num_h = kNumberHeight + 2;
         if (i < 4) num_h *= 2; // blur smaller four digits below first bucket
-        cvSetImageROI(cardImageRGB, cvRect(num_x, num_y, num_w, num_h));
-        cv::Mat blurMat = cv::Mat(cardImageRGB, false);
-        cv::medianBlur(blurMat, blurMat, 25);
-        blurMat.release();
+        rects[n_rects++] = cvRect(scale * num_x, scale * num_y, scale * num_w, scale * num_h);
     }
-    cvResetImageROI(cardImageRGB);
+    llcv_redact_rects(cardImage, rects, n_rects, options.mode, options.aperture, options.n_threads);
 }
 
 // FOR CYTHON USE ONLY
@@ -606,7 +1201,7 @@ void dmz_best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset, CythonGro
   GroupedRectsList expiry_groups;
   GroupedRectsList name_groups;
   
-  best_expiry_seg(card_y, starting_y_offset, expiry_groups, name_groups);
+  best_expiry_seg(card_y, starting_y_offset, expiry_groups, name_groups, NULL);
 
   *cython_expiry_groups = (CythonGroupedRects *) malloc(expiry_groups.size() * sizeof(CythonGroupedRects));
   
@@ -638,7 +1233,7 @@ void dmz_expiry_extract(IplImage *card_y,
     new_groups.push_back(cythonGroupedRects_to_GroupedRects(*cython_new_groups + index));
   }
   
-  expiry_extract(card_y, expiry_groups, new_groups, expiry_month, expiry_year);
+  expiry_extract(card_y, expiry_groups, new_groups, expiry_month, expiry_year, NULL);
   
   *number_of_expiry_groups = expiry_groups.size();
   
@@ -663,7 +1258,7 @@ void dmz_expiry_extract_group(IplImage *card_y,
 
   ExpiryGroupScores old_scores = cythonScores_to_ExpiryGroupScores(cython_group.scores);
   
-  expiry_extract_group(card_y, group, old_scores, expiry_month, expiry_year);
+  expiry_extract_group(card_y, group, old_scores, expiry_month, expiry_year, NULL);
 
   for (int character_index = 0; character_index < kExpiryMaxValidLength; character_index++) {
     for (int digit_value = 0; digit_value < 10; digit_value++) {
@@ -14,9 +14,134 @@
 
 /******* Types *******/
 
+// Why the pre-gate (see dmz_pregate_frame) rejected a frame
+typedef uint8_t dmz_pregate_verdict;
+enum {
+  DMZPregatePass = 0,
+  DMZPregateTooDark = 1,
+  DMZPregateTooBright = 2,
+  DMZPregateTooBlurry = 3,
+  DMZPregateTooMuchMotion = 4,
+  DMZPregateMissingEdges = 5,
+  DMZPregateNumVerdicts = 6,
+};
+
+typedef struct {
+  bool enabled; // if false, dmz_detect_edges_with_pregate is plain (but profiled) edge detection
+  bool audit; // if true, rejected frames still go through edge detection, to count false rejects
+  float min_brightness; // mean Y
+  float max_brightness;
+  float min_focus; // focus score (see dmz_frame_quality) of the subsampled Y plane
+  float max_motion; // mean absolute Y difference from the previous frame
+  uint8_t edge_gradient_threshold; // gradient that counts as edge evidence
+  float min_edge_fraction; // fraction of a detection box's length that must show edge evidence
+  uint8_t min_edge_boxes; // number of detection boxes (of 4) that must show edge evidence
+} dmz_pregate_config;
+
+typedef struct {
+  uint32_t frames;
+  uint32_t skipped; // in audit mode, frames that would have been skipped
+  uint32_t skipped_by_verdict[DMZPregateNumVerdicts];
+  uint32_t audit_false_rejects; // audit mode only: skipped frames in which all four edges were found anyway
+} dmz_pregate_stats;
+
+// Why dmz_cadence_decide chose its frame interval
+typedef uint8_t dmz_cadence_reason;
+enum {
+  DMZCadenceEveryFrame = 0,
+  DMZCadenceOverBudget = 1, // processing takes longer than frames arrive
+  DMZCadenceSettling = 2,   // the scanner is nearly converged, so there's little to gain from every frame
+  DMZCadenceNumReasons = 3,
+};
+
+typedef struct {
+  bool enabled; // if false, dmz_cadence_decide says to process everything, and measures nothing
+  bool enforce; // if false, decisions are recommendations only: process_frame and scan_expiry are never withheld
+  float frame_budget_ms; // processing time available per camera frame
+  uint8_t max_frame_interval; // never process fewer than 1 in this many frames
+  uint8_t max_expiry_interval; // never scan expiry on fewer than 1 in this many processed frames
+  float expiry_budget_fraction; // expiry scanning may take this much of the budget before it's thinned out
+  float settling_convergence; // scanner_convergence at which a device with time to spare slows down
+  uint8_t settling_frame_interval;
+} dmz_cadence_config;
+
+typedef struct {
+  bool process_frame; // run edge detection and the scanner on this frame
+  bool scan_expiry; // what to pass to scanner_add_frame_with_expiry
+  uint8_t frame_interval; // process 1 frame in this many
+  uint8_t expiry_interval; // scan expiry on 1 processed frame in this many
+  dmz_cadence_reason reason;
+  float frame_ms; // smoothed time per processed frame, not counting expiry
+  float expiry_ms; // smoothed expiry time per frame that scanned it
+  float convergence; // scanner_convergence
+} dmz_cadence_decision;
+
+typedef struct {
+  uint32_t frames;
+  uint32_t frames_skipped; // enforced only
+  uint32_t expiry_skipped; // enforced only
+  uint32_t frames_by_reason[DMZCadenceNumReasons];
+} dmz_cadence_stats;
+
+// Pipeline stages with their own timing (see dmz_profile_snapshot)
+typedef uint8_t dmz_stage;
+enum {
+  DMZStageEdgeDetection = 0,    // dmz_detect_edges_with_pregate, in dmz_context
+  DMZStageUnwarp = 1,           // dmz_transform_card/dmz_transform_card_y, in dmz_context
+  DMZStageVSeg = 2,             // the rest are in ScannerState
+  DMZStageHSeg = 3,
+  DMZStageNumberCategorize = 4,
+  DMZStageExpirySeg = 5,
+  DMZStageExpiryCategorize = 6,
+  DMZNumStages = 7,
+};
+
+// Log-linear histogram: 4 linear buckets per power of two microseconds, so percentiles are within 25%.
+// Enough buckets for any uint32_t microseconds (over an hour), so no sample is clamped into the last.
+#define kDMZProfileBuckets (4 * 31)
+
+typedef struct {
+  uint32_t count;
+  uint64_t total_microseconds;
+  uint32_t min_microseconds;
+  uint32_t max_microseconds;
+  uint32_t buckets[kDMZProfileBuckets];
+} dmz_stage_profile;
+
+// Timing is off until enabled; while off, each instrumented stage costs one branch.
+typedef struct {
+  bool enabled;
+  dmz_stage_profile stages[DMZNumStages];
+  uint32_t frame_microseconds[DMZNumStages]; // per stage, since the last dmz_profile_begin_frame
+} dmz_profile;
+
+typedef struct {
+  uint32_t count;
+  float mean_ms;
+  float min_ms;
+  float max_ms;
+  float p50_ms;
+  float p90_ms;
+  float p99_ms;
+} dmz_stage_timing;
+
+typedef struct {
+  dmz_stage_timing stages[DMZNumStages];
+} dmz_timing_snapshot;
+
 typedef struct {
-  // TODO - add fields that persist over life of a dmz
   void *mz; // Pointer to whatever is needed for your platform's mz implementation
+  dmz_pregate_config pregate_config; // set to defaults by dmz_context_create; adjust freely
+  dmz_pregate_stats pregate_stats;
+  void *pregate; // private pre-gate buffers
+  void *edge_scratch; // private; dmz_detect_edges_with_pregate's pyramid and canny buffers
+  dmz_profile profile;
+  void *recorder; // private; non-NULL between dmz_recording_start and dmz_recording_stop
+  dmz_cadence_config cadence_config; // set to defaults by dmz_context_create; adjust freely
+  dmz_cadence_stats cadence_stats;
+  void *cadence; // private controller state
+  uint8_t *unwarp_staging; // private; iOS only, unpadded GPU warp output for llcv_unwarp_plane
+  size_t unwarp_staging_size;
 } dmz_context;
 
 typedef struct {
@@ -36,8 +161,87 @@ typedef struct {
   dmz_found_edge right;
 } dmz_edges;
 
+typedef struct {
+  float focus_score;        // as dmz_focus_score
+  float brightness_score;   // as dmz_brightness_score
+  float saturated_fraction; // fraction of (nearly) blown out pixels, if requested; otherwise 0
+} dmz_frame_quality_scores;
+
 typedef struct ScannerState ScannerState;
 
+// What a recording entry holds (see dmz_recording_start)
+typedef uint8_t dmz_recording_entry_type;
+enum {
+  DMZRecordingFrame = 1,        // a camera frame, as passed to dmz_detect_edges
+  DMZRecordingScannerInput = 2, // a card image, as passed to scanner_add_frame_with_expiry
+  DMZRecordingScannerReset = 3, // scanner_reset
+};
+
+// The arguments to scanner_add_frame_with_expiry, other than the card image itself,
+// and the FrameScanResult fields the client fills in before calling it.
+typedef struct {
+  bool scan_expiry;
+  float focus_score;
+  float brightness_score;
+  bool flipped;
+  uint16_t iso_speed;
+  float shutter_speed;
+  bool torch_is_on;
+} dmz_scanner_input;
+
+typedef struct {
+  uint32_t entries_recorded;
+  uint32_t entries_dropped; // the writer had fallen behind, or max_bytes was reached
+  uint64_t bytes_written;
+  bool full; // max_bytes reached; nothing more will be recorded
+} dmz_recording_stats;
+
+typedef struct {
+  dmz_recording_entry_type type;
+  uint32_t sequence; // position in the recording, counting dropped entries
+  uint64_t timestamp_microseconds; // monotonic clock, when the entry was queued
+  FrameOrientation orientation; // DMZRecordingFrame
+  IplImage *y; // DMZRecordingFrame
+  IplImage *cb;
+  IplImage *cr;
+  IplImage *card_y; // DMZRecordingScannerInput
+  dmz_scanner_input scanner_input; // DMZRecordingScannerInput
+} dmz_recording_entry;
+
+typedef struct dmz_recording_reader dmz_recording_reader;
+
+typedef struct dmz_frame_ring dmz_frame_ring;
+
+// A frame taken from a dmz_frame_ring; its images belong to the ring, and are valid until the next take.
+typedef struct {
+  IplImage *y;
+  IplImage *cb;
+  IplImage *cr;
+  FrameOrientation orientation;
+  uint32_t sequence; // counts every frame written, so gaps are frames that were overwritten
+  float queue_ms; // from written to taken
+} dmz_ring_frame;
+
+typedef struct {
+  uint32_t frames_written;
+  uint32_t frames_taken;
+  uint32_t frames_overwritten; // written, then replaced by a newer frame before being taken
+  dmz_stage_timing queue_latency; // written -> taken, for frames that were taken
+} dmz_frame_ring_stats;
+
+typedef uint8_t dmz_redaction_mode;
+enum {
+  DMZRedactionMedian = 0,   // median over the aperture, as dmz_blur_card has always done
+  DMZRedactionBoxBlur = 1,  // mean over the aperture; cheaper still
+  DMZRedactionPixelate = 2, // one average per aperture x aperture block
+};
+
+typedef struct {
+  dmz_redaction_mode mode;
+  uint8_t aperture;  // odd (even is rounded down, 0 redacts nothing); window size for median/box, block size for pixelate. dmz_blur_card uses 25.
+  uint8_t n_threads; // rows of each region are split across this many threads; 0 or 1 runs on the calling thread
+} dmz_redaction_options;
+
 
 /******* Functions *******/
 
@@ -71,6 +275,12 @@ void dmz_deinterleave_RGBA_to_R(uint8_t *source, uint8_t *dest, int size);
 // a valid IplImage. It is the caller's responsibility to free rgb.
 void dmz_YCbCr_to_RGB(IplImage *y, IplImage *cb, IplImage *cr, IplImage **rgb);
 
+// Convert a full-size Y plane and half-size Cb and Cr planes (as they come from the camera) to RGB,
+// upsampling the chroma on the fly rather than in separate full-frame passes.
+// rgb must already exist, be the same size as y, and have 3 (RGB) or 4 (RGBA, opaque) channels.
+// To write into your own buffer, wrap it in an IplImage header (cvInitImageHeader + cvSetData).
+void dmz_YCbCr_half_chroma_to_RGB(IplImage *y, IplImage *cb, IplImage *cr, IplImage *rgb);
+
 
 // DETECTION
 
@@ -78,6 +288,10 @@ float dmz_focus_score(IplImage *image, bool use_full_image);
 
 float dmz_brightness_score(IplImage *image, bool use_full_image);
 
+// Focus, brightness and (optionally) saturation over the same region as the two functions above,
+// but in a single pass over the image, with no temporary image and without touching its roi.
+void dmz_frame_quality(IplImage *image, bool use_full_image, bool compute_saturation, dmz_frame_quality_scores *scores);
+
 // Convenience method that returns whether a set of found_edges contains all edges as being found.
 bool dmz_found_all_edges(dmz_edges found_edges);
 
@@ -87,6 +301,109 @@ bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_samp
                                        FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points);
 
 
+// PROFILING
+
+// Turn stage timing on or off (it starts off). Use &dmz->profile or &scanner_state->profile.
+void dmz_profile_set_enabled(dmz_profile *profile, bool enabled);
+void dmz_profile_reset(dmz_profile *profile);
+
+// Summarize the timings so far. Stages never timed in this profile have count 0.
+void dmz_profile_snapshot(const dmz_profile *profile, dmz_timing_snapshot *snapshot);
+
+
+// PRE-GATE
+
+// Cheap checks, on a subsampled Y plane, for frames that clearly cannot yield four edges:
+// exposure, blur, motion since the previous frame, and edge evidence in the detection boxes.
+// Updates dmz->pregate_stats.
+dmz_pregate_verdict dmz_pregate_frame(dmz_context *dmz, IplImage *y_sample, FrameOrientation orientation);
+
+// dmz_detect_edges, skipped (returning false, with no edges found) if the pre-gate rejects the frame.
+// In audit mode, edge detection always runs. verdict may be NULL.
+// Edge detection time is recorded in dmz->profile, and its scratch images are kept in dmz from frame to frame.
+bool dmz_detect_edges_with_pregate(dmz_context *dmz, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                                   FrameOrientation orientation, dmz_edges *found_edges, dmz_corner_points *corner_points,
+                                   dmz_pregate_verdict *verdict);
+
+void dmz_pregate_default_config(dmz_pregate_config *config);
+
+// Fraction of frames skipped (or, in audit mode, that would have been) since the stats were last reset.
+float dmz_pregate_skip_rate(dmz_context *dmz);
+void dmz_pregate_reset_stats(dmz_context *dmz);
+
+
+// CADENCE
+
+// Call once per camera frame, before anything else, to decide how much of the pipeline to run on it.
+// Uses the stage timings from dmz->profile and state->profile (it turns them on), and scanner_convergence.
+// Frames are processed 1 in frame_interval, which grows when frames take longer than cadence_config.frame_budget_ms
+// (or when the scanner is settling and there's time to spare); expiry is likewise scanned 1 in expiry_interval
+// processed frames when it takes too much of the budget. scan_expiry is what the client would otherwise pass.
+// Updates dmz->cadence_stats, and logs whenever the policy changes.
+void dmz_cadence_decide(dmz_context *dmz, ScannerState *state, bool scan_expiry, dmz_cadence_decision *decision);
+
+void dmz_cadence_default_config(dmz_cadence_config *config);
+void dmz_cadence_reset_stats(dmz_context *dmz);
+
+
+// RECORDING
+
+// Opt-in capture of exactly what the dmz was given, so that field sessions can be replayed bit-exactly.
+// Truncates path, then appends entries until the file would exceed max_bytes. Frames must be
+// frame_width x frame_height, with half-size chroma. Returns false if the file or its writer thread can't be created.
+bool dmz_recording_start(dmz_context *dmz, const char *path, uint16_t frame_width, uint16_t frame_height, uint64_t max_bytes);
+
+// Writes out whatever is still queued and closes the file. Called by dmz_context_destroy.
+void dmz_recording_stop(dmz_context *dmz);
+
+void dmz_recording_get_stats(dmz_context *dmz, dmz_recording_stats *stats);
+
+// Queue an entry for the writer thread. These never block the caller: the data is copied into a
+// preallocated slot, or the entry is dropped (and counted) if every slot is still waiting to be written.
+// They do nothing unless recording.
+// Recording is client-driven: the dmz never calls these itself (scanner_add_frame_with_expiry has no
+// dmz_context, and the focus, exposure and torch values come from the camera). Call each just before
+// what it records: dmz_record_frame before dmz_detect_edges (or dmz_detect_edges_with_pregate),
+// dmz_record_scanner_input before scanner_add_frame_with_expiry, and dmz_record_scanner_reset
+// alongside scanner_reset.
+void dmz_record_frame(dmz_context *dmz, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample, FrameOrientation orientation);
+void dmz_record_scanner_input(dmz_context *dmz, IplImage *card_y, const dmz_scanner_input *input);
+void dmz_record_scanner_reset(dmz_context *dmz);
+
+// Read a recording back. The file is memory-mapped (privately, so the pipeline may write to the images);
+// an entry's images point straight into it, and are only valid until the next call.
+// See also scanner_replay_entry.
+dmz_recording_reader *dmz_recording_open(const char *path);
+bool dmz_recording_next(dmz_recording_reader *reader, dmz_recording_entry *entry);
+void dmz_recording_close(dmz_recording_reader *reader);
+
+
+// FRAME HAND-OFF
+
+// Decouples the camera thread from scanning: the camera thread writes each frame into the ring,
+// and a dmz worker thread takes the most recent one whenever it's ready for another, so a slow frame
+// never holds up capture. Frames the worker doesn't get to in time are overwritten (and counted).
+// Exactly one thread may write, and one (other) thread take. Writing never blocks or allocates.
+// Frames are frame_width x frame_height, with half-size chroma.
+dmz_frame_ring *dmz_frame_ring_create(uint16_t frame_width, uint16_t frame_height);
+void dmz_frame_ring_destroy(dmz_frame_ring *ring);
+
+// Camera thread: copy in a frame with separate chroma planes...
+void dmz_frame_ring_write(dmz_frame_ring *ring, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample, FrameOrientation orientation);
+
+// ...or fill the ring's own buffers directly (e.g. from a biplanar camera buffer), then commit.
+// cbcr is interleaved, Cb first; the worker splits it when it takes the frame.
+void dmz_frame_ring_begin_write(dmz_frame_ring *ring, IplImage **y_sample, IplImage **cbcr_sample);
+void dmz_frame_ring_commit_write(dmz_frame_ring *ring, FrameOrientation orientation);
+
+// Worker thread: take the newest frame not yet taken. Returns false if there isn't one, after
+// waiting up to timeout_ms for it (0 to not wait). The frame can go straight to dmz_detect_edges.
+bool dmz_frame_ring_take(dmz_frame_ring *ring, dmz_ring_frame *frame, uint32_t timeout_ms);
+
+// Call from the worker thread (the queue latency belongs to it).
+void dmz_frame_ring_get_stats(dmz_frame_ring *ring, dmz_frame_ring_stats *stats);
+
+
 // TRANSFORMATION
 
 // Convert a sample from the camera to a transformed, rectified card image.
@@ -95,11 +412,34 @@ bool dmz_detect_edges(IplImage *y_sample, IplImage *cb_sample, IplImage *cr_samp
 // to free transformed.
 void dmz_transform_card(dmz_context *dmz, IplImage *sample, dmz_corner_points corner_points, FrameOrientation orientation, bool upsample, IplImage **transformed);
 
+// Rectify only the Y plane of a sample, straight into a buffer owned by the scanner:
+// 428x270, no roi, with cache-aligned rows (widthStep is padded beyond the width).
+// That is exactly what scanner_add_frame wants, so there is no color warp and no allocation per frame.
+// The returned image belongs to state: do not free it, and expect the next call to overwrite it.
+IplImage *dmz_transform_card_y(dmz_context *dmz, ScannerState *state, IplImage *y_sample, dmz_corner_points corner_points, FrameOrientation orientation);
+
+// As dmz_transform_card_y, but at 856x540 (twice the size), for frames with the pixels to fill it
+// (720p and up). The scanner takes it as is, area-averaging it back down only where its models need
+// 428x270 input, and cropping digits from it at half-pixel precision. Results (hseg, vseg, redaction
+// rects) stay in 428x270 coordinates. Not recorded by dmz_record_scanner_input, which is 428x270 only.
+IplImage *dmz_transform_card_y_2x(dmz_context *dmz, ScannerState *state, IplImage *y_sample, dmz_corner_points corner_points, FrameOrientation orientation);
+
+// Produce the color card image for the frame most recently passed to dmz_transform_card_y,
+// typically once scanner_result reports complete. cb_sample and cr_sample are that frame's
+// (half-size) chroma planes. *card_rgb MUST be initialized to NULL or a valid 3 or 4 channel IplImage
+// the size of the card image (428x270, or 856x540 after dmz_transform_card_y_2x).
+// It is the caller's responsibility to free card_rgb.
+void dmz_card_color_image(dmz_context *dmz, ScannerState *state, IplImage *cb_sample, IplImage *cr_sample, IplImage **card_rgb);
+
 // Blurs card number digits on a result image.
 // The 'unblurDigits' argument defines how many digits not to blur to remain visible.
 // If 'unblurDigits' is negative, the function will not blur any numbers.
 void dmz_blur_card(IplImage* cardImageRGB, ScannerState* state, int unblurDigits);
 
+// As dmz_blur_card, with a choice of redaction. Overlapping digit rects are merged, or split where
+// they differ in height, so that each pixel is processed once, in constant time per pixel.
+void dmz_redact_card(IplImage* cardImage, ScannerState* state, int unblurDigits, dmz_redaction_options options);
+
 // FOR CYTHON USE ONLY
 #if CYTHON_DMZ
 void dmz_scharr3_dx_abs(IplImage *src, IplImage *dst);
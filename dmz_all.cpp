@@ -12,11 +12,15 @@
 #include "./cv/hough.cpp"
 #include "./cv/image_util.cpp"
 #include "./cv/morph.cpp"
+#include "./cv/redact.cpp"
 #include "./cv/sobel.cpp"
 #include "./cv/stats.cpp"
 #include "./cv/warp.cpp"
 #include "./dmz.cpp"
+#include "./dmz_frame_ring.cpp"
 #include "./dmz_olm.cpp"
+#include "./dmz_profile.cpp"
+#include "./dmz_recording.cpp"
 #include "./geometry.cpp"
 #include "./models/generated/modelc_01266c1b.cpp"
 #include "./models/generated/modelc_5c241121.cpp"
@@ -26,11 +30,13 @@
 #include "./mz_android.cpp"
 #include "./processor_support.cpp"
 #include "./scan/frame.cpp"
+#include "./scan/n_aggregate.cpp"
 #include "./scan/n_categorize.cpp"
 #include "./scan/n_hseg.cpp"
 #include "./scan/n_vseg.cpp"
 #include "./scan/scan.cpp"
 #include "./scan/scan_analytics.cpp"
+#include "./scan/scan_service.cpp"
 
   #if SCAN_EXPIRY
     #include "./models/expiry/modelc_bf4dd6c8.cpp"
@@ -0,0 +1,206 @@
+//
+//  dmz_frame_ring.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "dmz.h"
+#include "dmz_profile.h"
+#include "cv/convert.h"
+#include "opencv2/core/core_c.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Latest-frame-wins only ever needs three slots (a triple buffer): the one being written,
+// the one being scanned, and the most recently written one in between. Handing a slot over is
+// a single atomic exchange of the middle slot's index, so neither side ever waits for the other.
+#define kFrameRingSlots 3
+#define kFrameRingSlotMask 3
+#define kFrameRingFresh 4 // set in middle while it holds a frame that hasn't been taken
+
+typedef struct {
+  IplImage *y;
+  IplImage *cb;
+  IplImage *cr;
+  IplImage *cbcr;
+  bool interleaved; // chroma was written to cbcr, and is split into cb/cr when taken
+  FrameOrientation orientation;
+  uint32_t sequence;
+  uint64_t written_microseconds;
+} dmz_frame_ring_slot;
+
+struct dmz_frame_ring {
+  dmz_frame_ring_slot slots[kFrameRingSlots];
+  int back; // the writer's slot
+  volatile int middle; // slot index, plus kFrameRingFresh
+  int front; // the taker's slot
+
+  // Written only by the writer.
+  volatile uint32_t frames_written;
+  volatile uint32_t frames_overwritten;
+
+  // Touched only by the taker.
+  uint32_t frames_taken;
+  dmz_stage_profile queue_latency;
+
+  // Only for a taker that wants to wait; the writer takes the mutex only to signal one.
+  volatile bool taker_waiting;
+  pthread_mutex_t mutex;
+  pthread_cond_t frame_written;
+};
+
+dmz_frame_ring *dmz_frame_ring_create(uint16_t frame_width, uint16_t frame_height) {
+  dmz_frame_ring *ring = (dmz_frame_ring *)calloc(1, sizeof(dmz_frame_ring));
+  CvSize size = cvSize(frame_width, frame_height);
+  CvSize chroma_size = cvSize(frame_width / 2, frame_height / 2);
+  for(int i = 0; i < kFrameRingSlots; i++) {
+    dmz_frame_ring_slot *slot = &ring->slots[i];
+    slot->y = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    slot->cb = cvCreateImage(chroma_size, IPL_DEPTH_8U, 1);
+    slot->cr = cvCreateImage(chroma_size, IPL_DEPTH_8U, 1);
+    slot->cbcr = cvCreateImage(chroma_size, IPL_DEPTH_8U, 2);
+  }
+  ring->back = 0;
+  ring->middle = 1;
+  ring->front = 2;
+  pthread_mutex_init(&ring->mutex, NULL);
+  pthread_cond_init(&ring->frame_written, NULL);
+  return ring;
+}
+
+void dmz_frame_ring_destroy(dmz_frame_ring *ring) {
+  for(int i = 0; i < kFrameRingSlots; i++) {
+    dmz_frame_ring_slot *slot = &ring->slots[i];
+    cvReleaseImage(&slot->y);
+    cvReleaseImage(&slot->cb);
+    cvReleaseImage(&slot->cr);
+    cvReleaseImage(&slot->cbcr);
+  }
+  pthread_cond_destroy(&ring->frame_written);
+  pthread_mutex_destroy(&ring->mutex);
+  free(ring);
+}
+
+#pragma mark writer
+
+// The back slot was last scanned, which may have left rois behind.
+DMZ_INTERNAL dmz_frame_ring_slot *dmz_frame_ring_back_slot(dmz_frame_ring *ring) {
+  dmz_frame_ring_slot *slot = &ring->slots[ring->back];
+  cvResetImageROI(slot->y);
+  cvResetImageROI(slot->cb);
+  cvResetImageROI(slot->cr);
+  cvResetImageROI(slot->cbcr);
+  return slot;
+}
+
+DMZ_INTERNAL void dmz_frame_ring_publish(dmz_frame_ring *ring, FrameOrientation orientation, bool interleaved) {
+  dmz_frame_ring_slot *slot = &ring->slots[ring->back];
+  slot->interleaved = interleaved;
+  slot->orientation = orientation;
+  slot->sequence = ring->frames_written;
+  slot->written_microseconds = dmz_monotonic_microseconds();
+
+  __sync_synchronize(); // the slot is complete before the taker can see it
+  int previous = __sync_lock_test_and_set(&ring->middle, ring->back | kFrameRingFresh);
+  ring->back = previous & kFrameRingSlotMask;
+  if(previous & kFrameRingFresh) {
+    ring->frames_overwritten = ring->frames_overwritten + 1;
+  }
+  ring->frames_written = ring->frames_written + 1;
+
+  // A waiting taker holds the mutex from checking middle until it's inside pthread_cond_timedwait,
+  // so signaling under the mutex can't fall into that gap. Only a waiting taker costs the lock.
+  __sync_synchronize();
+  if(ring->taker_waiting) {
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_signal(&ring->frame_written);
+    pthread_mutex_unlock(&ring->mutex);
+  }
+}
+
+void dmz_frame_ring_write(dmz_frame_ring *ring, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample, FrameOrientation orientation) {
+  dmz_frame_ring_slot *slot = dmz_frame_ring_back_slot(ring);
+  cvCopy(y_sample, slot->y);
+  cvCopy(cb_sample, slot->cb);
+  cvCopy(cr_sample, slot->cr);
+  dmz_frame_ring_publish(ring, orientation, false);
+}
+
+void dmz_frame_ring_begin_write(dmz_frame_ring *ring, IplImage **y_sample, IplImage **cbcr_sample) {
+  dmz_frame_ring_slot *slot = dmz_frame_ring_back_slot(ring);
+  *y_sample = slot->y;
+  *cbcr_sample = slot->cbcr;
+}
+
+void dmz_frame_ring_commit_write(dmz_frame_ring *ring, FrameOrientation orientation) {
+  dmz_frame_ring_publish(ring, orientation, true);
+}
+
+#pragma mark taker
+
+DMZ_INTERNAL void dmz_frame_ring_wait(dmz_frame_ring *ring, uint32_t timeout_ms) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  long nanoseconds = now.tv_usec * 1000L + (long)(timeout_ms % 1000) * 1000000L;
+  struct timespec deadline;
+  deadline.tv_sec = now.tv_sec + timeout_ms / 1000 + nanoseconds / 1000000000L;
+  deadline.tv_nsec = nanoseconds % 1000000000L;
+
+  pthread_mutex_lock(&ring->mutex);
+  ring->taker_waiting = true;
+  __sync_synchronize(); // a frame written after this will signal; one written before is seen below
+  while(!(ring->middle & kFrameRingFresh)) {
+    if(pthread_cond_timedwait(&ring->frame_written, &ring->mutex, &deadline) != 0) {
+      break; // timed out
+    }
+  }
+  ring->taker_waiting = false;
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+bool dmz_frame_ring_take(dmz_frame_ring *ring, dmz_ring_frame *frame, uint32_t timeout_ms) {
+  if(!(ring->middle & kFrameRingFresh)) {
+    if(timeout_ms == 0) {
+      return false;
+    }
+    dmz_frame_ring_wait(ring, timeout_ms);
+    if(!(ring->middle & kFrameRingFresh)) {
+      return false;
+    }
+  }
+
+  // The writer only ever replaces a fresh middle with another fresh one, so it's still fresh here.
+  int previous = __sync_lock_test_and_set(&ring->middle, ring->front);
+  __sync_synchronize(); // see everything the writer put in the slot
+  ring->front = previous & kFrameRingSlotMask;
+
+  dmz_frame_ring_slot *slot = &ring->slots[ring->front];
+  if(slot->interleaved) {
+    llcv_split_u8(slot->cbcr, slot->cb, slot->cr);
+    slot->interleaved = false;
+  }
+  uint64_t queue_microseconds = dmz_monotonic_microseconds() - slot->written_microseconds;
+  dmz_stage_profile_record(&ring->queue_latency, queue_microseconds);
+  ring->frames_taken++;
+
+  frame->y = slot->y;
+  frame->cb = slot->cb;
+  frame->cr = slot->cr;
+  frame->orientation = slot->orientation;
+  frame->sequence = slot->sequence;
+  frame->queue_ms = queue_microseconds / 1000.0f;
+  return true;
+}
+
+void dmz_frame_ring_get_stats(dmz_frame_ring *ring, dmz_frame_ring_stats *stats) {
+  stats->frames_written = ring->frames_written;
+  stats->frames_overwritten = ring->frames_overwritten;
+  stats->frames_taken = ring->frames_taken;
+  dmz_stage_profile_timing(&ring->queue_latency, &stats->queue_latency);
+}
+
+#endif // COMPILE_DMZ
@@ -0,0 +1,127 @@
+//
+//  dmz_profile.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "dmz_profile.h"
+#include <string.h>
+
+#if __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+DMZ_INTERNAL uint64_t dmz_monotonic_microseconds(void) {
+#if __APPLE__
+  // clock_gettime only arrived in iOS 10
+  static mach_timebase_info_data_t timebase; // idempotent initialization, so no thread protection required
+  if(timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return (mach_absolute_time() * timebase.numer / timebase.denom) / 1000;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+// Values below 4us get a bucket each; above that, each power of two is split into 4 linear buckets.
+DMZ_INTERNAL uint8_t dmz_profile_bucket(uint32_t microseconds) {
+  if(microseconds < 4) {
+    return (uint8_t)microseconds;
+  }
+  uint8_t octave = (uint8_t)(31 - __builtin_clz(microseconds)); // >= 2
+  uint8_t sub_bucket = (uint8_t)((microseconds >> (octave - 2)) & 3);
+  return (uint8_t)(4 * (octave - 1) + sub_bucket); // < kDMZProfileBuckets, since octave <= 31
+}
+
+// Smallest value that lands in the bucket after this one, i.e. an upper bound for the bucket.
+// (The last bucket's is 2^32, so this is 64 bits.)
+DMZ_INTERNAL uint64_t dmz_profile_bucket_limit(uint8_t bucket) {
+  if(bucket < 4) {
+    return bucket + 1;
+  }
+  uint8_t octave = bucket / 4 + 1;
+  uint8_t sub_bucket = bucket % 4;
+  return (uint64_t)(4 + sub_bucket + 1) << (octave - 2);
+}
+
+DMZ_INTERNAL uint32_t dmz_stage_profile_record(dmz_stage_profile *stage_profile, uint64_t microseconds) {
+  uint32_t clamped = (uint32_t)MIN(microseconds, (uint64_t)UINT32_MAX);
+  if(stage_profile->count == 0 || clamped < stage_profile->min_microseconds) {
+    stage_profile->min_microseconds = clamped;
+  }
+  stage_profile->max_microseconds = MAX(stage_profile->max_microseconds, clamped);
+  stage_profile->count++;
+  stage_profile->total_microseconds += microseconds;
+  stage_profile->buckets[dmz_profile_bucket(clamped)]++;
+  return clamped;
+}
+
+DMZ_INTERNAL void dmz_stage_profile_merge(dmz_stage_profile *into, const dmz_stage_profile *from) {
+  if(from->count == 0) {
+    return;
+  }
+  if(into->count == 0 || from->min_microseconds < into->min_microseconds) {
+    into->min_microseconds = from->min_microseconds;
+  }
+  into->max_microseconds = MAX(into->max_microseconds, from->max_microseconds);
+  into->count += from->count;
+  into->total_microseconds += from->total_microseconds;
+  for(uint8_t bucket = 0; bucket < kDMZProfileBuckets; bucket++) {
+    into->buckets[bucket] += from->buckets[bucket];
+  }
+}
+
+DMZ_INTERNAL void dmz_profile_record(dmz_profile *profile, dmz_stage stage, uint64_t microseconds) {
+  profile->frame_microseconds[stage] += dmz_stage_profile_record(&profile->stages[stage], microseconds);
+}
+
+void dmz_profile_set_enabled(dmz_profile *profile, bool enabled) {
+  profile->enabled = enabled;
+}
+
+void dmz_profile_reset(dmz_profile *profile) {
+  memset(profile->stages, 0, sizeof(profile->stages));
+  memset(profile->frame_microseconds, 0, sizeof(profile->frame_microseconds));
+}
+
+DMZ_INTERNAL float dmz_profile_percentile_ms(const dmz_stage_profile *stage_profile, float percentile) {
+  uint32_t rank = (uint32_t)ceilf(percentile * stage_profile->count);
+  uint32_t seen = 0;
+  for(uint8_t bucket = 0; bucket < kDMZProfileBuckets; bucket++) {
+    seen += stage_profile->buckets[bucket];
+    if(seen >= rank) {
+      // never report beyond the largest value actually seen
+      return MIN(dmz_profile_bucket_limit(bucket), (uint64_t)stage_profile->max_microseconds) / 1000.0f;
+    }
+  }
+  return stage_profile->max_microseconds / 1000.0f;
+}
+
+DMZ_INTERNAL void dmz_stage_profile_timing(const dmz_stage_profile *stage_profile, dmz_stage_timing *timing) {
+  memset(timing, 0, sizeof(dmz_stage_timing));
+  timing->count = stage_profile->count;
+  if(stage_profile->count == 0) {
+    return;
+  }
+  timing->mean_ms = (float)((double)stage_profile->total_microseconds / stage_profile->count / 1000.0);
+  timing->min_ms = stage_profile->min_microseconds / 1000.0f;
+  timing->max_ms = stage_profile->max_microseconds / 1000.0f;
+  timing->p50_ms = dmz_profile_percentile_ms(stage_profile, 0.50f);
+  timing->p90_ms = dmz_profile_percentile_ms(stage_profile, 0.90f);
+  timing->p99_ms = dmz_profile_percentile_ms(stage_profile, 0.99f);
+}
+
+void dmz_profile_snapshot(const dmz_profile *profile, dmz_timing_snapshot *snapshot) {
+  for(uint8_t stage = 0; stage < DMZNumStages; stage++) {
+    dmz_stage_profile_timing(&profile->stages[stage], &snapshot->stages[stage]);
+  }
+}
+
+#endif // COMPILE_DMZ
@@ -0,0 +1,47 @@
+//
+//  dmz_profile.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef DMZ_PROFILE_H
+#define DMZ_PROFILE_H
+
+#include "dmz.h"
+#include "dmz_macros.h"
+#include <string.h>
+
+// Usage, around a stage:
+//   uint64_t start = dmz_profile_start(profile);
+//   ...
+//   dmz_profile_end(profile, DMZStageVSeg, start);
+// profile may be NULL. Neither reads the clock unless the profile is enabled.
+
+DMZ_INTERNAL uint64_t dmz_monotonic_microseconds(void);
+
+DMZ_INTERNAL inline uint64_t dmz_profile_start(const dmz_profile *profile) {
+  if(dmz_likely(profile == NULL || !profile->enabled)) {
+    return 0;
+  }
+  return dmz_monotonic_microseconds();
+}
+
+// Starts a new frame's worth of profile->frame_microseconds.
+DMZ_INTERNAL inline void dmz_profile_begin_frame(dmz_profile *profile) {
+  memset(profile->frame_microseconds, 0, sizeof(profile->frame_microseconds));
+}
+
+DMZ_INTERNAL void dmz_profile_record(dmz_profile *profile, dmz_stage stage, uint64_t microseconds);
+
+// The same histograms, for latencies other than pipeline stages. record returns the value as stored (clamped to 32 bits).
+DMZ_INTERNAL uint32_t dmz_stage_profile_record(dmz_stage_profile *stage_profile, uint64_t microseconds);
+DMZ_INTERNAL void dmz_stage_profile_merge(dmz_stage_profile *into, const dmz_stage_profile *from);
+DMZ_INTERNAL void dmz_stage_profile_timing(const dmz_stage_profile *stage_profile, dmz_stage_timing *timing);
+
+DMZ_INTERNAL inline void dmz_profile_end(dmz_profile *profile, dmz_stage stage, uint64_t start) {
+  if(dmz_likely(profile == NULL || !profile->enabled)) {
+    return;
+  }
+  dmz_profile_record(profile, stage, dmz_monotonic_microseconds() - start);
+}
+
+#endif
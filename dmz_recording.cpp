@@ -0,0 +1,422 @@
+//
+//  dmz_recording.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "dmz_recording.h"
+#include "dmz_profile.h"
+#include "opencv2/core/core_c.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#pragma mark writer
+
+// The caller copies each entry into one of these preallocated slots and moves on;
+// a writer thread drains them to disk. With 640x480 frames, 8 slots is ~3.5MB, and
+// a bit over a quarter of a second of camera frames' worth of slack for a stalled disk.
+#define kRecorderSlots 8
+#define kRecorderWaitMilliseconds 50
+
+typedef struct {
+  FILE *file;
+  uint16_t frame_width;
+  uint16_t frame_height;
+  uint64_t max_bytes;
+  uint64_t bytes_accepted; // caller's view: file header plus every record queued so far
+  uint32_t sequence;
+  uint32_t slot_capacity;
+  uint8_t *slots; // kRecorderSlots * slot_capacity
+  uint32_t slot_sizes[kRecorderSlots];
+
+  // Single producer (the caller), single consumer (the writer thread).
+  // head is only written by the caller, tail only by the writer.
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile bool stopping;
+  volatile bool write_failed;
+
+  dmz_recording_stats stats; // bytes_written is guarded by mutex; the rest belongs to the caller
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t thread;
+} dmz_recorder;
+
+DMZ_INTERNAL void dmz_recorder_drain(dmz_recorder *recorder) {
+  uint32_t head = recorder->head;
+  __sync_synchronize(); // see the caller's slot contents before using them
+  while(recorder->tail != head) {
+    uint32_t slot = recorder->tail % kRecorderSlots;
+    uint32_t size = recorder->slot_sizes[slot];
+    if(!recorder->write_failed) {
+      if(fwrite(recorder->slots + (size_t)slot * recorder->slot_capacity, 1, size, recorder->file) == size) {
+        pthread_mutex_lock(&recorder->mutex);
+        recorder->stats.bytes_written += size;
+        pthread_mutex_unlock(&recorder->mutex);
+      } else {
+        dmz_debug_log("recording write failed");
+        recorder->write_failed = true;
+      }
+    }
+    __sync_synchronize(); // done with the slot before handing it back
+    recorder->tail = recorder->tail + 1;
+  }
+}
+
+DMZ_INTERNAL void *dmz_recorder_run(void *arg) {
+  dmz_recorder *recorder = (dmz_recorder *)arg;
+  while(true) {
+    bool stopping = recorder->stopping;
+    __sync_synchronize(); // everything queued before stopping was set is now visible
+    dmz_recorder_drain(recorder);
+    if(stopping) {
+      break;
+    }
+
+    // The caller signals without taking the mutex, so a wakeup can be missed; hence the timeout.
+    pthread_mutex_lock(&recorder->mutex);
+    if(recorder->head == recorder->tail && !recorder->stopping) {
+      struct timeval now;
+      gettimeofday(&now, NULL);
+      long nanoseconds = now.tv_usec * 1000L + kRecorderWaitMilliseconds * 1000000L;
+      struct timespec deadline;
+      deadline.tv_sec = now.tv_sec + nanoseconds / 1000000000L;
+      deadline.tv_nsec = nanoseconds % 1000000000L;
+      pthread_cond_timedwait(&recorder->cond, &recorder->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+  }
+  fflush(recorder->file);
+  return NULL;
+}
+
+DMZ_INTERNAL void dmz_recorder_free(dmz_recorder *recorder) {
+  if(recorder->file != NULL) {
+    fclose(recorder->file);
+  }
+  free(recorder->slots);
+  free(recorder);
+}
+
+bool dmz_recording_start(dmz_context *dmz, const char *path, uint16_t frame_width, uint16_t frame_height, uint64_t max_bytes) {
+  dmz_recording_stop(dmz);
+
+  dmz_recorder *recorder = (dmz_recorder *)calloc(1, sizeof(dmz_recorder));
+  recorder->frame_width = frame_width;
+  recorder->frame_height = frame_height;
+  recorder->max_bytes = max_bytes;
+  recorder->slot_capacity = MAX(dmz_recording_frame_record_size(frame_width, frame_height), dmz_recording_scanner_input_record_size());
+  recorder->slots = (uint8_t *)malloc((size_t)kRecorderSlots * recorder->slot_capacity);
+  recorder->file = fopen(path, "wb");
+  if(recorder->slots == NULL || recorder->file == NULL) {
+    dmz_debug_log("could not start recording to %s", path);
+    dmz_recorder_free(recorder);
+    return false;
+  }
+
+  dmz_recording_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kDMZRecordingMagic, sizeof(header.magic));
+  header.version = kDMZRecordingVersion;
+  header.frame_width = frame_width;
+  header.frame_height = frame_height;
+  if(fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+    dmz_recorder_free(recorder);
+    return false;
+  }
+  recorder->bytes_accepted = sizeof(header);
+  recorder->stats.bytes_written = sizeof(header);
+
+  pthread_mutex_init(&recorder->mutex, NULL);
+  pthread_cond_init(&recorder->cond, NULL);
+  if(0 != pthread_create(&recorder->thread, NULL, dmz_recorder_run, recorder)) {
+    pthread_cond_destroy(&recorder->cond);
+    pthread_mutex_destroy(&recorder->mutex);
+    dmz_recorder_free(recorder);
+    return false;
+  }
+
+  dmz->recorder = recorder;
+  return true;
+}
+
+void dmz_recording_stop(dmz_context *dmz) {
+  dmz_recorder *recorder = (dmz_recorder *)dmz->recorder;
+  if(recorder == NULL) {
+    return;
+  }
+  __sync_synchronize();
+  recorder->stopping = true;
+  pthread_cond_signal(&recorder->cond);
+  pthread_join(recorder->thread, NULL);
+  pthread_cond_destroy(&recorder->cond);
+  pthread_mutex_destroy(&recorder->mutex);
+  dmz_recorder_free(recorder);
+  dmz->recorder = NULL;
+}
+
+void dmz_recording_get_stats(dmz_context *dmz, dmz_recording_stats *stats) {
+  dmz_recorder *recorder = (dmz_recorder *)dmz->recorder;
+  if(recorder == NULL) {
+    memset(stats, 0, sizeof(dmz_recording_stats));
+    return;
+  }
+  pthread_mutex_lock(&recorder->mutex);
+  *stats = recorder->stats;
+  pthread_mutex_unlock(&recorder->mutex);
+  stats->full = stats->full || recorder->write_failed;
+}
+
+// Returns a slot for a record of the given size, with its header filled in, or NULL (and counts a drop).
+DMZ_INTERNAL uint8_t *dmz_recorder_reserve(dmz_recorder *recorder, uint32_t size, dmz_recording_entry_type type, uint8_t orientation) {
+  uint32_t sequence = recorder->sequence++;
+  if(recorder->stats.full || recorder->write_failed || recorder->bytes_accepted + size > recorder->max_bytes) {
+    recorder->stats.full = true;
+    recorder->stats.entries_dropped++;
+    return NULL;
+  }
+  uint32_t tail = recorder->tail;
+  __sync_synchronize(); // the writer is done with slots before tail
+  if(recorder->head - tail >= kRecorderSlots) {
+    recorder->stats.entries_dropped++;
+    return NULL;
+  }
+
+  uint32_t slot = recorder->head % kRecorderSlots;
+  uint8_t *record = recorder->slots + (size_t)slot * recorder->slot_capacity;
+  recorder->slot_sizes[slot] = size;
+
+  dmz_recording_record_header *header = (dmz_recording_record_header *)record;
+  memset(header, 0, sizeof(dmz_recording_record_header));
+  header->size = size;
+  header->type = type;
+  header->orientation = orientation;
+  header->sequence = sequence;
+  header->timestamp_microseconds = dmz_monotonic_microseconds();
+  return record;
+}
+
+DMZ_INTERNAL void dmz_recorder_commit(dmz_recorder *recorder, uint8_t *record) {
+  uint32_t size = ((dmz_recording_record_header *)record)->size;
+  recorder->bytes_accepted += size;
+  recorder->stats.entries_recorded++;
+  __sync_synchronize(); // slot contents are visible before the writer can see the new head
+  recorder->head = recorder->head + 1;
+  pthread_cond_signal(&recorder->cond);
+}
+
+// Copies a width x height u8 plane (honoring any roi) into dest, rows packed. Returns the byte after the copy.
+DMZ_INTERNAL uint8_t *dmz_recorder_copy_plane(uint8_t *dest, IplImage *image, int width, int height) {
+  CvRect roi = cvGetImageROI(image);
+  const uint8_t *src = (const uint8_t *)image->imageData + roi.y * image->widthStep + roi.x;
+  for(int row = 0; row < height; row++) {
+    memcpy(dest, src, width);
+    dest += width;
+    src += image->widthStep;
+  }
+  return dest;
+}
+
+DMZ_INTERNAL bool dmz_recorder_plane_matches(IplImage *image, int width, int height) {
+  if(image == NULL || image->depth != IPL_DEPTH_8U || image->nChannels != 1) {
+    return false;
+  }
+  CvSize size = cvGetSize(image);
+  return size.width == width && size.height == height;
+}
+
+void dmz_record_frame(dmz_context *dmz, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample, FrameOrientation orientation) {
+  dmz_recorder *recorder = (dmz_recorder *)dmz->recorder;
+  if(recorder == NULL) {
+    return;
+  }
+  int width = recorder->frame_width;
+  int height = recorder->frame_height;
+  if(!dmz_recorder_plane_matches(y_sample, width, height) ||
+     !dmz_recorder_plane_matches(cb_sample, width / 2, height / 2) ||
+     !dmz_recorder_plane_matches(cr_sample, width / 2, height / 2)) {
+    dmz_debug_log("not recording frame: wrong size or format");
+    recorder->sequence++;
+    recorder->stats.entries_dropped++;
+    return;
+  }
+
+  uint8_t *record = dmz_recorder_reserve(recorder, dmz_recording_frame_record_size(width, height), DMZRecordingFrame, (uint8_t)orientation);
+  if(record == NULL) {
+    return;
+  }
+  uint8_t *payload = record + sizeof(dmz_recording_record_header);
+  payload = dmz_recorder_copy_plane(payload, y_sample, width, height);
+  payload = dmz_recorder_copy_plane(payload, cb_sample, width / 2, height / 2);
+  payload = dmz_recorder_copy_plane(payload, cr_sample, width / 2, height / 2);
+  memset(payload, 0, record + ((dmz_recording_record_header *)record)->size - payload);
+  dmz_recorder_commit(recorder, record);
+}
+
+void dmz_record_scanner_input(dmz_context *dmz, IplImage *card_y, const dmz_scanner_input *input) {
+  dmz_recorder *recorder = (dmz_recorder *)dmz->recorder;
+  if(recorder == NULL) {
+    return;
+  }
+  if(!dmz_recorder_plane_matches(card_y, kCreditCardTargetWidth, kCreditCardTargetHeight)) {
+    dmz_debug_log("not recording scanner input: wrong size or format");
+    recorder->sequence++;
+    recorder->stats.entries_dropped++;
+    return;
+  }
+
+  uint8_t *record = dmz_recorder_reserve(recorder, dmz_recording_scanner_input_record_size(), DMZRecordingScannerInput, 0);
+  if(record == NULL) {
+    return;
+  }
+  dmz_recording_scanner_input *recorded = (dmz_recording_scanner_input *)(record + sizeof(dmz_recording_record_header));
+  memset(recorded, 0, sizeof(dmz_recording_scanner_input));
+  recorded->focus_score = input->focus_score;
+  recorded->brightness_score = input->brightness_score;
+  recorded->shutter_speed = input->shutter_speed;
+  recorded->iso_speed = input->iso_speed;
+  recorded->scan_expiry = input->scan_expiry;
+  recorded->flipped = input->flipped;
+  recorded->torch_is_on = input->torch_is_on;
+  uint8_t *payload = dmz_recorder_copy_plane((uint8_t *)(recorded + 1), card_y, kCreditCardTargetWidth, kCreditCardTargetHeight);
+  memset(payload, 0, record + ((dmz_recording_record_header *)record)->size - payload);
+  dmz_recorder_commit(recorder, record);
+}
+
+void dmz_record_scanner_reset(dmz_context *dmz) {
+  dmz_recorder *recorder = (dmz_recorder *)dmz->recorder;
+  if(recorder == NULL) {
+    return;
+  }
+  uint8_t *record = dmz_recorder_reserve(recorder, sizeof(dmz_recording_record_header), DMZRecordingScannerReset, 0);
+  if(record != NULL) {
+    dmz_recorder_commit(recorder, record);
+  }
+}
+
+#pragma mark reader
+
+struct dmz_recording_reader {
+  uint8_t *base;
+  size_t length;
+  size_t offset;
+  uint16_t frame_width;
+  uint16_t frame_height;
+  // Headers only; their data points into the mapping.
+  IplImage y;
+  IplImage cb;
+  IplImage cr;
+  IplImage card_y;
+};
+
+dmz_recording_reader *dmz_recording_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(dmz_recording_file_header)) {
+    close(fd);
+    return NULL;
+  }
+  // Private and writable: the pipeline sets rois on, and sometimes writes to, the images it's given.
+  // Pages are only copied if that actually happens; the file itself is never modified.
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    return NULL;
+  }
+
+  const dmz_recording_file_header *header = (const dmz_recording_file_header *)base;
+  if(memcmp(header->magic, kDMZRecordingMagic, sizeof(header->magic)) != 0 || header->version != kDMZRecordingVersion) {
+    munmap(base, (size_t)st.st_size);
+    return NULL;
+  }
+
+  dmz_recording_reader *reader = (dmz_recording_reader *)calloc(1, sizeof(dmz_recording_reader));
+  reader->base = (uint8_t *)base;
+  reader->length = (size_t)st.st_size;
+  reader->offset = sizeof(dmz_recording_file_header);
+  reader->frame_width = header->frame_width;
+  reader->frame_height = header->frame_height;
+  return reader;
+}
+
+DMZ_INTERNAL IplImage *dmz_recording_plane(IplImage *header, uint8_t *data, int width, int height) {
+  cvInitImageHeader(header, cvSize(width, height), IPL_DEPTH_8U, 1);
+  cvSetData(header, data, width);
+  return header;
+}
+
+bool dmz_recording_next(dmz_recording_reader *reader, dmz_recording_entry *entry) {
+  while(reader->offset + sizeof(dmz_recording_record_header) <= reader->length) {
+    uint8_t *record = reader->base + reader->offset;
+    const dmz_recording_record_header *header = (const dmz_recording_record_header *)record;
+    if(header->size < sizeof(dmz_recording_record_header) || header->size % 8 != 0 || header->size > reader->length - reader->offset) {
+      return false; // truncated
+    }
+    reader->offset += header->size;
+
+    memset(entry, 0, sizeof(dmz_recording_entry));
+    entry->type = header->type;
+    entry->sequence = header->sequence;
+    entry->timestamp_microseconds = header->timestamp_microseconds;
+    uint8_t *payload = record + sizeof(dmz_recording_record_header);
+
+    switch(header->type) {
+      case DMZRecordingFrame: {
+        if(header->size != dmz_recording_frame_record_size(reader->frame_width, reader->frame_height)) {
+          return false;
+        }
+        int width = reader->frame_width;
+        int height = reader->frame_height;
+        entry->orientation = (FrameOrientation)header->orientation;
+        entry->y = dmz_recording_plane(&reader->y, payload, width, height);
+        payload += width * height;
+        entry->cb = dmz_recording_plane(&reader->cb, payload, width / 2, height / 2);
+        payload += (width / 2) * (height / 2);
+        entry->cr = dmz_recording_plane(&reader->cr, payload, width / 2, height / 2);
+        return true;
+      }
+      case DMZRecordingScannerInput: {
+        if(header->size != dmz_recording_scanner_input_record_size()) {
+          return false;
+        }
+        const dmz_recording_scanner_input *recorded = (const dmz_recording_scanner_input *)payload;
+        entry->scanner_input.focus_score = recorded->focus_score;
+        entry->scanner_input.brightness_score = recorded->brightness_score;
+        entry->scanner_input.shutter_speed = recorded->shutter_speed;
+        entry->scanner_input.iso_speed = recorded->iso_speed;
+        entry->scanner_input.scan_expiry = recorded->scan_expiry != 0;
+        entry->scanner_input.flipped = recorded->flipped != 0;
+        entry->scanner_input.torch_is_on = recorded->torch_is_on != 0;
+        entry->card_y = dmz_recording_plane(&reader->card_y, (uint8_t *)(recorded + 1), kCreditCardTargetWidth, kCreditCardTargetHeight);
+        return true;
+      }
+      case DMZRecordingScannerReset:
+        return true;
+      default:
+        break; // from a newer writer; skip it
+    }
+  }
+  return false;
+}
+
+void dmz_recording_close(dmz_recording_reader *reader) {
+  if(reader == NULL) {
+    return;
+  }
+  munmap(reader->base, reader->length);
+  free(reader);
+}
+
+#endif // COMPILE_DMZ
@@ -0,0 +1,70 @@
+//
+//  dmz_recording.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef DMZ_RECORDING_H
+#define DMZ_RECORDING_H
+
+#include "dmz.h"
+#include "dmz_constants.h"
+#include "dmz_macros.h"
+
+// On-disk layout of a recording. Everything is little-endian (we only record on ARM and x86),
+// and every record starts 8-byte aligned, so a reader can use the mapped file in place.
+//
+//   file header
+//   record header, payload, record header, payload, ...
+//
+// Records are only ever appended. A file cut short (crash, full disk) is read up to its last whole record.
+
+#define kDMZRecordingMagic "DMZREC01"
+#define kDMZRecordingVersion 1
+
+typedef struct {
+  char magic[8]; // kDMZRecordingMagic
+  uint32_t version;
+  uint16_t frame_width; // every frame record is this size, with half-size chroma
+  uint16_t frame_height;
+  uint64_t reserved;
+} dmz_recording_file_header;
+
+typedef struct {
+  uint32_t size; // of the whole record, header included; a multiple of 8
+  uint8_t type; // dmz_recording_entry_type
+  uint8_t orientation; // FrameOrientation, for DMZRecordingFrame
+  uint16_t reserved;
+  uint32_t sequence;
+  uint32_t reserved2;
+  uint64_t timestamp_microseconds;
+} dmz_recording_record_header;
+
+// DMZRecordingFrame payload: Y (frame_width x frame_height), then Cb, then Cr (each half size), rows packed.
+// DMZRecordingScannerInput payload: this, then the card's Y (kCreditCardTargetWidth x kCreditCardTargetHeight), rows packed.
+// DMZRecordingScannerReset: no payload.
+typedef struct {
+  float focus_score;
+  float brightness_score;
+  float shutter_speed;
+  uint16_t iso_speed;
+  uint8_t scan_expiry;
+  uint8_t flipped;
+  uint8_t torch_is_on;
+  uint8_t reserved[7];
+} dmz_recording_scanner_input;
+
+DMZ_INTERNAL inline uint32_t dmz_recording_align(uint32_t size) {
+  return (size + 7) & ~7u;
+}
+
+DMZ_INTERNAL inline uint32_t dmz_recording_frame_record_size(uint16_t frame_width, uint16_t frame_height) {
+  uint32_t y_size = (uint32_t)frame_width * frame_height;
+  uint32_t chroma_size = (uint32_t)(frame_width / 2) * (frame_height / 2);
+  return dmz_recording_align(sizeof(dmz_recording_record_header) + y_size + 2 * chroma_size);
+}
+
+DMZ_INTERNAL inline uint32_t dmz_recording_scanner_input_record_size(void) {
+  return dmz_recording_align(sizeof(dmz_recording_record_header) + sizeof(dmz_recording_scanner_input) + kCreditCardTargetWidth * kCreditCardTargetHeight);
+}
+
+#endif
@@ -30,6 +30,10 @@ def concat():
             if base_path.startswith("./.git/"):
                 continue
 
+            # standalone tools, which include dmz_all.cpp themselves
+            if base_path.startswith("./bench"):
+                continue
+
             is_impl = False
             for impl_extension in (".c", ".cpp"):
                 if filename.endswith(impl_extension):
@@ -68,3 +72,18 @@ def concat():
 
     with open("dmz_all.cpp", "w") as out:
         out.write("\n".join(include_lines))
+
+
+def bench(neon_2_sse=None):
+    """
+    Build the benchmarks, bench/replay and bench/kernels (Linux; needs OpenCV 2.4 and the Python headers).
+
+    Pass neon_2_sse=<directory containing NEON_2_SSE.h> to build the NEON kernels on x86 instead.
+    """
+    concat()
+    neon_flags = ""
+    if neon_2_sse:
+        neon_flags = "-DDMZ_NEON_2_SSE=1 -I{neon_2_sse} ".format(**locals())
+    for tool in ("replay", "kernels"):
+        local("g++ -std=gnu++98 -O3 -march=native -DCYTHON_DMZ=1 -DSCAN_EXPIRY=1 {neon_flags}-I. $(python-config --includes) "
+              "bench/{tool}.cpp -o bench/{tool} $(pkg-config --libs opencv) -lpthread".format(**locals()))
@@ -13454,9 +13454,12 @@ static uint8_t data_2ea7785b[704] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
   }
 #endif
 
-DMZ_INTERNAL ModelCOutput_bf4dd6c8 applyc_bf4dd6c8(const ModelCInput_bf4dd6c8& input, bool test_generated_models) {
+DMZ_INTERNAL ModelCOutput_bf4dd6c8 applyc_bf4dd6c8(const ModelCInputView_bf4dd6c8& input, bool test_generated_models) {
 
-  ModelCInput_bf4dd6c8 normalized_input = (input.array() - input.mean()).matrix();
+  // Copied out of the view before normalizing, so the mean and the subtraction run over
+  // packed, aligned storage, as they did when the input was a plain matrix.
+  ModelCInput_bf4dd6c8 normalized_input = input;
+  normalized_input.array() -= normalized_input.mean();
 
   // Apply convolutional layer(s)
   Eigen::Map<ModelCConvInput_bf4dd6c8_1> mapped_input((float *)normalized_input.data());
@@ -13549,7 +13552,7 @@ static uint8_t data_6992095e[40] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passc_bf4dd6c8() {
-  Eigen::Map<ModelCInput_bf4dd6c8, Eigen::Aligned> test_input((float *)data_7ed98413_bf4dd6c8);
+  ModelCInputView_bf4dd6c8 test_input((const float *)data_7ed98413_bf4dd6c8, Eigen::OuterStride<>(11));
   ModelCOutput_bf4dd6c8 computed_output = applyc_bf4dd6c8(test_input, true);
 
   if (computed_output.array().isZero(1e-3f)) {
@@ -15,7 +15,10 @@
 typedef Eigen::Matrix<float, 16, 11, Eigen::RowMajor> ModelCInput_bf4dd6c8;
 typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCOutput_bf4dd6c8;
 
-DMZ_INTERNAL ModelCOutput_bf4dd6c8 applyc_bf4dd6c8(const ModelCInput_bf4dd6c8& input, bool test_generated_models = false);
+// The input where it already lives, e.g. an image's pixels: rows may be any number of floats apart.
+typedef Eigen::Map<const ModelCInput_bf4dd6c8, Eigen::Unaligned, Eigen::OuterStride<> > ModelCInputView_bf4dd6c8;
+
+DMZ_INTERNAL ModelCOutput_bf4dd6c8 applyc_bf4dd6c8(const ModelCInputView_bf4dd6c8& input, bool test_generated_models = false);
 
 
 #if TEST_GENERATED_MODELS
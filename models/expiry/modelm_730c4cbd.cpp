@@ -2428,7 +2428,7 @@ static uint8_t data_01e1d602[8] EIGEN_ALIGN_TO_BOUNDARY(16) = { // logistic b
 typedef Eigen::Matrix<float, 2, 80, Eigen::RowMajor> ModelMLogisticW_730c4cbd;
 typedef Eigen::Matrix<float, 2, 1, Eigen::ColMajor> ModelMLogisticB_730c4cbd;
 
-DMZ_INTERNAL ModelMOutput_730c4cbd applym_730c4cbd(const ModelMInput_730c4cbd& input) {
+DMZ_INTERNAL ModelMOutput_730c4cbd applym_730c4cbd(const ModelMInputView_730c4cbd& input) {
 
 // Hidden layer 1 of 1
   Eigen::Map<ModelMHiddenW_730c4cbd_1, Eigen::Aligned> hidden_W_1((float *)data_17b52542);
@@ -2492,7 +2492,7 @@ static uint8_t data_b0825637[8] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passm_730c4cbd() {
-  Eigen::Map<ModelMInput_730c4cbd, Eigen::Aligned> test_input((float *)data_e7f5d21f);
+  ModelMInputView_730c4cbd test_input((const float *)data_e7f5d21f);
   ModelMOutput_730c4cbd computed_output = applym_730c4cbd(test_input);
   Eigen::Map<ModelMOutput_730c4cbd, Eigen::Aligned> known_good_output((float *)data_b0825637);
 
@@ -15,7 +15,10 @@
 typedef Eigen::Matrix<float, 176, 1, Eigen::ColMajor> ModelMInput_730c4cbd;
 typedef Eigen::Matrix<float, 2, 1, Eigen::ColMajor> ModelMOutput_730c4cbd;
 
-DMZ_INTERNAL ModelMOutput_730c4cbd applym_730c4cbd(const ModelMInput_730c4cbd& input);
+// The input where it already lives, e.g. an image's pixels.
+typedef Eigen::Map<const ModelMInput_730c4cbd> ModelMInputView_730c4cbd;
+
+DMZ_INTERNAL ModelMOutput_730c4cbd applym_730c4cbd(const ModelMInputView_730c4cbd& input);
 
 
 #if TEST_GENERATED_MODELS
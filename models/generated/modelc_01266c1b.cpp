@@ -1841,7 +1841,7 @@ typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCLogisticB_01266c1b;
 #endif
 
 
-DMZ_INTERNAL ModelCSingleConvolved_01266c1b convc_01266c1b(const ModelCInput_01266c1b& input, const ModelCSingleKernel_01266c1b& kernel) {
+DMZ_INTERNAL ModelCSingleConvolved_01266c1b convc_01266c1b(const ModelCInputView_01266c1b& input, const ModelCSingleKernel_01266c1b& kernel) {
   ModelCSingleConvolved_01266c1b output;
 
 #if USE_OPTIMIZED_3x3_CONVOLUTION
@@ -1890,7 +1890,7 @@ DMZ_INTERNAL ModelCSingleDownsampled_01266c1b downc_01266c1b(const ModelCSingleC
   return output;
 }
 
-DMZ_INTERNAL ModelCOutput_01266c1b applyc_01266c1b(const ModelCInput_01266c1b& input) {
+DMZ_INTERNAL ModelCOutput_01266c1b applyc_01266c1b(const ModelCInputView_01266c1b& input) {
   ModelCConvResult_01266c1b accumulated_convolutions;
 
   Eigen::Map<ModelCAllKernels_01266c1b, Eigen::Aligned> all_kernels((float *)data_4e401475);
@@ -2037,7 +2037,7 @@ static uint8_t data_8ead34f8[40] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passc_01266c1b() {
-  Eigen::Map<ModelCInput_01266c1b, Eigen::Aligned> test_input((float *)data_31c0cc47_01266c1b);
+  ModelCInputView_01266c1b test_input((const float *)data_31c0cc47_01266c1b, Eigen::OuterStride<>(19));
   ModelCOutput_01266c1b computed_output = applyc_01266c1b(test_input);
   Eigen::Map<ModelCOutput_01266c1b, Eigen::Aligned> known_good_output((float *)data_8ead34f8);
 
@@ -15,7 +15,10 @@
 typedef Eigen::Matrix<float, 27, 19, Eigen::RowMajor> ModelCInput_01266c1b;
 typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCOutput_01266c1b;
 
-DMZ_INTERNAL ModelCOutput_01266c1b applyc_01266c1b(const ModelCInput_01266c1b& input);
+// The input where it already lives, e.g. an image's pixels: rows may be any number of floats apart.
+typedef Eigen::Map<const ModelCInput_01266c1b, Eigen::Unaligned, Eigen::OuterStride<> > ModelCInputView_01266c1b;
+
+DMZ_INTERNAL ModelCOutput_01266c1b applyc_01266c1b(const ModelCInputView_01266c1b& input);
 
 
 #if TEST_GENERATED_MODELS
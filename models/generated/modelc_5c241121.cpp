@@ -1841,7 +1841,7 @@ typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCLogisticB_5c241121;
 #endif
 
 
-DMZ_INTERNAL ModelCSingleConvolved_5c241121 convc_5c241121(const ModelCInput_5c241121& input, const ModelCSingleKernel_5c241121& kernel) {
+DMZ_INTERNAL ModelCSingleConvolved_5c241121 convc_5c241121(const ModelCInputView_5c241121& input, const ModelCSingleKernel_5c241121& kernel) {
   ModelCSingleConvolved_5c241121 output;
 
 #if USE_OPTIMIZED_3x3_CONVOLUTION
@@ -1890,7 +1890,7 @@ DMZ_INTERNAL ModelCSingleDownsampled_5c241121 downc_5c241121(const ModelCSingleC
   return output;
 }
 
-DMZ_INTERNAL ModelCOutput_5c241121 applyc_5c241121(const ModelCInput_5c241121& input) {
+DMZ_INTERNAL ModelCOutput_5c241121 applyc_5c241121(const ModelCInputView_5c241121& input) {
   ModelCConvResult_5c241121 accumulated_convolutions;
 
   Eigen::Map<ModelCAllKernels_5c241121, Eigen::Aligned> all_kernels((float *)data_183da1fa);
@@ -2037,7 +2037,7 @@ static uint8_t data_c2bdeb12[40] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passc_5c241121() {
-  Eigen::Map<ModelCInput_5c241121, Eigen::Aligned> test_input((float *)data_31c0cc47_5c241121);
+  ModelCInputView_5c241121 test_input((const float *)data_31c0cc47_5c241121, Eigen::OuterStride<>(19));
   ModelCOutput_5c241121 computed_output = applyc_5c241121(test_input);
   Eigen::Map<ModelCOutput_5c241121, Eigen::Aligned> known_good_output((float *)data_c2bdeb12);
 
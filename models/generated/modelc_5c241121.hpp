@@ -15,7 +15,10 @@
 typedef Eigen::Matrix<float, 27, 19, Eigen::RowMajor> ModelCInput_5c241121;
 typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCOutput_5c241121;
 
-DMZ_INTERNAL ModelCOutput_5c241121 applyc_5c241121(const ModelCInput_5c241121& input);
+// The input where it already lives, e.g. an image's pixels: rows may be any number of floats apart.
+typedef Eigen::Map<const ModelCInput_5c241121, Eigen::Unaligned, Eigen::OuterStride<> > ModelCInputView_5c241121;
+
+DMZ_INTERNAL ModelCOutput_5c241121 applyc_5c241121(const ModelCInputView_5c241121& input);
 
 
 #if TEST_GENERATED_MODELS
@@ -1841,7 +1841,7 @@ typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCLogisticB_b00bf70c;
 #endif
 
 
-DMZ_INTERNAL ModelCSingleConvolved_b00bf70c convc_b00bf70c(const ModelCInput_b00bf70c& input, const ModelCSingleKernel_b00bf70c& kernel) {
+DMZ_INTERNAL ModelCSingleConvolved_b00bf70c convc_b00bf70c(const ModelCInputView_b00bf70c& input, const ModelCSingleKernel_b00bf70c& kernel) {
   ModelCSingleConvolved_b00bf70c output;
 
 #if USE_OPTIMIZED_3x3_CONVOLUTION
@@ -1890,7 +1890,7 @@ DMZ_INTERNAL ModelCSingleDownsampled_b00bf70c downc_b00bf70c(const ModelCSingleC
   return output;
 }
 
-DMZ_INTERNAL ModelCOutput_b00bf70c applyc_b00bf70c(const ModelCInput_b00bf70c& input) {
+DMZ_INTERNAL ModelCOutput_b00bf70c applyc_b00bf70c(const ModelCInputView_b00bf70c& input) {
   ModelCConvResult_b00bf70c accumulated_convolutions;
 
   Eigen::Map<ModelCAllKernels_b00bf70c, Eigen::Aligned> all_kernels((float *)data_0b9a8510);
@@ -2037,7 +2037,7 @@ static uint8_t data_7c53d215[40] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passc_b00bf70c() {
-  Eigen::Map<ModelCInput_b00bf70c, Eigen::Aligned> test_input((float *)data_31c0cc47_b00bf70c);
+  ModelCInputView_b00bf70c test_input((const float *)data_31c0cc47_b00bf70c, Eigen::OuterStride<>(19));
   ModelCOutput_b00bf70c computed_output = applyc_b00bf70c(test_input);
   Eigen::Map<ModelCOutput_b00bf70c, Eigen::Aligned> known_good_output((float *)data_7c53d215);
 
@@ -15,7 +15,10 @@
 typedef Eigen::Matrix<float, 27, 19, Eigen::RowMajor> ModelCInput_b00bf70c;
 typedef Eigen::Matrix<float, 10, 1, Eigen::ColMajor> ModelCOutput_b00bf70c;
 
-DMZ_INTERNAL ModelCOutput_b00bf70c applyc_b00bf70c(const ModelCInput_b00bf70c& input);
+// The input where it already lives, e.g. an image's pixels: rows may be any number of floats apart.
+typedef Eigen::Map<const ModelCInput_b00bf70c, Eigen::Unaligned, Eigen::OuterStride<> > ModelCInputView_b00bf70c;
+
+DMZ_INTERNAL ModelCOutput_b00bf70c applyc_b00bf70c(const ModelCInputView_b00bf70c& input);
 
 
 #if TEST_GENERATED_MODELS
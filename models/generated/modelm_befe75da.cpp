@@ -1767,7 +1767,9 @@ typedef Eigen::Matrix<float, 50, 1, Eigen::ColMajor> ModelMIntermediateResult_be
 typedef Eigen::Matrix<float, 3, 50, Eigen::RowMajor> ModelMLogisticW_befe75da;
 typedef Eigen::Matrix<float, 3, 1, Eigen::ColMajor> ModelMLogisticB_befe75da;
 
-DMZ_INTERNAL ModelMOutput_befe75da applym_befe75da(const ModelMInput_befe75da& input) {
+#if TEST_GENERATED_MODELS
+// The one-input form, kept to check applym_batch_befe75da against; the scanner only uses the batch.
+DMZ_INTERNAL ModelMOutput_befe75da applym_befe75da(const ModelMInputView_befe75da& input) {
   Eigen::Map<ModelMHiddenW_befe75da, Eigen::Aligned> hidden_W((float *)data_b3289e07);
   Eigen::Map<ModelMHiddenB_befe75da, Eigen::Aligned> hidden_b((float *)data_dd02e979);
 
@@ -1784,6 +1786,36 @@ DMZ_INTERNAL ModelMOutput_befe75da applym_befe75da(const ModelMInput_befe75da& i
 
   return output;
 }
+#endif // TEST_GENERATED_MODELS
+
+typedef Eigen::Matrix<float, 50, Eigen::Dynamic, Eigen::ColMajor, 50, kModelMMaxBatch_befe75da> ModelMBatchIntermediateResult_befe75da;
+
+DMZ_INTERNAL ModelMBatchOutput_befe75da applym_batch_befe75da(const ModelMBatchInputView_befe75da& inputs) {
+  assert(inputs.cols() <= kModelMMaxBatch_befe75da);
+  Eigen::Map<ModelMHiddenW_befe75da, Eigen::Aligned> hidden_W((float *)data_b3289e07);
+  Eigen::Map<ModelMHiddenB_befe75da, Eigen::Aligned> hidden_b((float *)data_dd02e979);
+
+  ModelMBatchIntermediateResult_befe75da intermediate_result = hidden_W * inputs;
+  for(int col = 0; col < intermediate_result.cols(); col++) {
+    intermediate_result.col(col) += hidden_b;
+  }
+  intermediate_result = intermediate_result.unaryExpr(std::ptr_fun(tanhf));
+
+  Eigen::Map<ModelMLogisticW_befe75da, Eigen::Aligned> logistic_W((float *)data_209a6565);
+  Eigen::Map<ModelMLogisticB_befe75da, Eigen::Aligned> logistic_b((float *)data_da0dff50);
+
+  ModelMBatchOutput_befe75da output = logistic_W * intermediate_result;
+  for(int col = 0; col < output.cols(); col++) {
+    output.col(col) += logistic_b;
+  }
+  output = output.unaryExpr(std::ptr_fun(expf));
+  for(int col = 0; col < output.cols(); col++) {
+    float sum = output.col(col).sum();
+    output.col(col) /= sum;
+  }
+
+  return output;
+}
 
 
 #if TEST_GENERATED_MODELS
@@ -1833,7 +1865,7 @@ static uint8_t data_b8937695[12] EIGEN_ALIGN_TO_BOUNDARY(16) = { // test output
 
 
 bool passm_befe75da() {
-  Eigen::Map<ModelMInput_befe75da, Eigen::Aligned> test_input((float *)data_93d4c7ac);
+  ModelMInputView_befe75da test_input((const float *)data_93d4c7ac);
   ModelMOutput_befe75da computed_output = applym_befe75da(test_input);
   Eigen::Map<ModelMOutput_befe75da, Eigen::Aligned> known_good_output((float *)data_b8937695);
 
@@ -1843,6 +1875,12 @@ bool passm_befe75da() {
     return false;
   }
 
+  ModelMBatchOutput_befe75da computed_batch_output = applym_batch_befe75da(ModelMBatchInputView_befe75da((const float *)data_93d4c7ac, 204, 1));
+  if(((computed_batch_output.array() - known_good_output.array()).abs() > 1e-5f).any()) {
+    std::cerr << "MLP model befe75da batch test failure:\nGot " << computed_batch_output << "\nExpected " << known_good_output << "\n";
+    return false;
+  }
+
   return true;
 }
 
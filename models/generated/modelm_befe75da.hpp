@@ -15,11 +15,21 @@
 typedef Eigen::Matrix<float, 204, 1, Eigen::ColMajor> ModelMInput_befe75da;
 typedef Eigen::Matrix<float, 3, 1, Eigen::ColMajor> ModelMOutput_befe75da;
 
-DMZ_INTERNAL ModelMOutput_befe75da applym_befe75da(const ModelMInput_befe75da& input);
+// The input where it already lives, e.g. an image's pixels.
+typedef Eigen::Map<const ModelMInput_befe75da> ModelMInputView_befe75da;
+
+// Up to kModelMMaxBatch_befe75da inputs at once, one per column, evaluated together.
+#define kModelMMaxBatch_befe75da 16
+typedef Eigen::Map<const Eigen::Matrix<float, 204, Eigen::Dynamic, Eigen::ColMajor> > ModelMBatchInputView_befe75da;
+typedef Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::ColMajor, 3, kModelMMaxBatch_befe75da> ModelMBatchOutput_befe75da;
+
+DMZ_INTERNAL ModelMBatchOutput_befe75da applym_batch_befe75da(const ModelMBatchInputView_befe75da& inputs);
 
 
 #if TEST_GENERATED_MODELS
 
+DMZ_INTERNAL ModelMOutput_befe75da applym_befe75da(const ModelMInputView_befe75da& input);
+
 bool passm_befe75da();
 
 #endif  // TEST_GENERATED_MODELS
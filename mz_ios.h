@@ -10,12 +10,13 @@
 #include "dmz_macros.h"
 
 // Skews input image from 4 dmz_points to the given dmz_rect.
-// Results are rendered to output IplImage, which should already be created.
+// Results are rendered to output IplImage, which should already be created, with unpadded rows
+// (llcv_unwarp_plane stages a padded output through an unpadded buffer).
 // from_points should have the following ordering: top-left, top-right, bottom-left, bottom-right
 void ios_gpu_unwarp(dmz_context *dmz, IplImage *input, const dmz_point from_points[4], IplImage *output);
 
 #if DMZ_DEBUG
-void ios_save_file(char *filename, IplImage *image);
+void ios_save_file(const char *filename, IplImage *image);
 #endif
 
 #endif
@@ -65,7 +65,7 @@ void ios_gpu_unwarp(dmz_context *dmz, IplImage *input, const dmz_point from_poin
 }
 
 #if DMZ_DEBUG
-void ios_save_file(char *filename, IplImage *image) {
+void ios_save_file(const char *filename, IplImage *image) {
   IplImage        *localImage = cvCreateImage(cvGetSize(image), image->depth, image->nChannels);
   cvConvertScale(image, localImage);
   
@@ -3,11 +3,21 @@
 //  See the file "LICENSE.md" for the full license governing this code.
 //
 
-// Contains NEON-related constants
+// Contains NEON-related constants, and pulls in the NEON intrinsics when they're available
 
 #ifndef DMZ_NEON_H
 #define DMZ_NEON_H
 
+#include "processor_support.h"
+
+#if DMZ_HAS_NEON_COMPILETIME
+  #if DMZ_NEON_2_SSE
+    #include "NEON_2_SSE.h"
+  #else
+    #include <arm_neon.h>
+  #endif
+#endif
+
 #define kQRegisterBits 128
 #define kQRegisterElements8 16 // == (kQRegisterBits / sizeof(uint8_t))
 #define kQRegisterElements16 8 // == (kQRegisterBits / sizeof(uint16_t))
@@ -73,10 +73,10 @@ AndroidProcessorSupport get_android_processor_support(void) {
               androidProcessor = AndroidProcessorHasVFP3_16;
           }
 
-      } else if(android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM64
-             || android_getCpuFamily() == ANDROID_CPU_FAMILY_X86_64) {
-          // arm64 bit is NEON by definition, but requires new asm to compile.
-          // See https://github.com/card-io/card.io-dmz/pull/20
+      } else if(android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM64) {
+          // arm64 is NEON by definition.
+          androidProcessor = AndroidProcessorHasNeon;
+      } else if(android_getCpuFamily() == ANDROID_CPU_FAMILY_X86_64) {
           androidProcessor = AndroidProcessorHasVFP3_16;
       }
       dmz_debug_log("androidProcessor: %i", androidProcessor);
@@ -101,7 +101,7 @@ int dmz_use_gles_warp(void) {
 	return glesWarpAllowed;
 }
 
-#elif DMZ_HAS_NEON_COMPILETIME // not ANDROID_DMZ (i.e. iOS)
+#elif IOS_DMZ && DMZ_HAS_NEON_COMPILETIME
 
 int dmz_has_neon_runtime(void) {return 1;}
 int dmz_use_vfp3_16(void) {return 0;}
@@ -109,7 +109,8 @@ int dmz_use_gles_warp(void) {return 1;}
 
 #else // not iOS, not Android. (i.e CYTHON)
 
-int dmz_has_neon_runtime(void) {return 0;}
+// NEON only when built for it: on arm64 Linux, or on x86 through DMZ_NEON_2_SSE.
+int dmz_has_neon_runtime(void) {return DMZ_HAS_NEON_COMPILETIME;}
 
 // technically we could use the vfpv3-d16 on any ARMv7 device,
 // but in practice the only non-NEON ARMv7 devices we will see are Android.
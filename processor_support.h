@@ -23,23 +23,27 @@
 //
 
 // Enable simple compiletime checks for NEON support
+//
+// The NEON kernels are written with <arm_neon.h> intrinsics that build for both armv7 and arm64.
+// NEON is part of the arm64 baseline, so arm64 builds need no extra -mfpu/-mfloat-abi flags.
+//
+// DMZ_NEON_2_SSE builds the NEON kernels on x86 instead, through an intrinsics translation
+// header (NEON_2_SSE.h, which must be on the include path), so they can be checked against
+// the C rows without a device. See bench/README.md.
 #if IOS_DMZ
-// ********************************* arm64 NOTE *********************************
-// Currently DMZ_HAS_NEON_COMPILETIME is disabled for the arm64 architecture.
-// To avoid compiler warnings, the `-mfloat-abi=softfp -mfpu=neon` compiler flags
-// have been removed from our arm64 builds for libCardIO (in Build Settings).
-// So if you enable DMZ_HAS_NEON_COMPILETIME for arm64 builds, then you will
-// also need to restore those compiler flags for arm64.
-// ********************************* arm64 NOTE *********************************
-    #ifdef _ARM_ARCH_7
+    #if defined(_ARM_ARCH_7) || defined(__arm64__) || defined(__aarch64__)
         #define DMZ_HAS_NEON_COMPILETIME 1
     #else
         #define DMZ_HAS_NEON_COMPILETIME 0
     #endif
 #elif CYTHON_DMZ
-    #define DMZ_HAS_NEON_COMPILETIME 0
+    #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define DMZ_HAS_NEON_COMPILETIME 1
+    #else
+        #define DMZ_HAS_NEON_COMPILETIME 0
+    #endif
 #elif ANDROID_DMZ
-    #if ANDROID_HAS_NEON
+    #if ANDROID_HAS_NEON || defined(__aarch64__)
         #define DMZ_HAS_NEON_COMPILETIME 1
     #else
         #define DMZ_HAS_NEON_COMPILETIME 0
@@ -51,7 +55,25 @@
     #error "Encountered unknown dmz client. Make sure the right *_DMZ preprocessor macro is set."
 #endif
 
-/* For Android ARMv7a architectures:
+#if DMZ_NEON_2_SSE
+    #undef DMZ_HAS_NEON_COMPILETIME
+    #define DMZ_HAS_NEON_COMPILETIME 1
+#endif
+
+// x86 SIMD is a compiletime-only decision: the build either targets the instruction set or it doesn't.
+// (SSE2 is baseline for x86_64; AVX2 requires building with -mavx2.)
+#if defined(__SSE2__)
+    #define DMZ_HAS_SSE2_COMPILETIME 1
+#else
+    #define DMZ_HAS_SSE2_COMPILETIME 0
+#endif
+#if defined(__AVX2__)
+    #define DMZ_HAS_AVX2_COMPILETIME 1
+#else
+    #define DMZ_HAS_AVX2_COMPILETIME 0
+#endif
+
+/* For Android ARMv7a architectures (arm64-v8a always has NEON):
  * gcc -mfpu=neon <=> DMZ_HAS_NEON_COMPILETME
  * else:
  * gcc -mfpu=vfpv3-d16 <=> limit to 16 VFP registers (normally 32)
@@ -7,6 +7,7 @@
 #if COMPILE_DMZ
 
 #include "expiry_categorize.h"
+#include "cv/eigen_view.h"
 #include "cv/image_util.h"
 #include "cv/morph.h"
 #include "cv/stats.h"
@@ -34,7 +35,8 @@ typedef Eigen::Matrix<float, 1, 10, Eigen::RowMajor> DigitProbabilities;
 
 #pragma mark - image preparation
 
-DMZ_INTERNAL void prepare_image_for_cat(IplImage *image, IplImage *as_float, CharacterRectListIterator rect) {
+// Leaves the character at rect in scratch->as_float; scratch's images must already be reserved, by categorize_expiry_digits.
+DMZ_INTERNAL void prepare_image_for_cat(IplImage *image, ExpiryScratch *scratch, CharacterRectListIterator rect) {
   // Input image: IPL_DEPTH_8U [0 - 255]
   // Data for models: IPL_DEPTH_32F [0.0 - 1.0]
   
@@ -43,27 +45,24 @@ DMZ_INTERNAL void prepare_image_for_cat(IplImage *image, IplImage *as_float, Cha
   // TODO: optimize this a lot!
   
   // Gradient
-  IplImage *filtered_image = cvCreateImage(cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_8U, 1);
+  IplImage *filtered_image = scratch->filtered;
   //llcv_morph_grad3_2d_cross_u8(image, filtered_image);
   IplConvKernel *kernel = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_CROSS, NULL);
   cvMorphologyEx(image, filtered_image, NULL, kernel, CV_MOP_GRADIENT, 1);
   cvReleaseStructuringElement(&kernel);
   
   // Equalize
-  llcv_equalize_hist(filtered_image, filtered_image);
+  llcv_equalize_hist_small(llcv_view_of_image(filtered_image), llcv_view_of_image(filtered_image));
   
   // Bilateral filter
   int aperture = 3;
   double space_sigma = (aperture / 2.0 - 1) * 0.3 + 0.8;
   double color_sigma = (aperture - 1) / 3.0;
-  IplImage *smoothed_image = cvCreateImage(cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_8U, 1);
+  IplImage *smoothed_image = scratch->smoothed;
   cvSmooth(filtered_image, smoothed_image, CV_BILATERAL, aperture, aperture, space_sigma, color_sigma);
   
   // Convert to float
-  cvConvertScale(smoothed_image, as_float, 1.0f / 255.0f, 0);
-  
-  cvReleaseImage(&smoothed_image);
-  cvReleaseImage(&filtered_image);
+  cvConvertScale(smoothed_image, scratch->as_float, 1.0f / 255.0f, 0);
   
   cvResetImageROI(image);
 
@@ -74,12 +73,11 @@ DMZ_INTERNAL void prepare_image_for_cat(IplImage *image, IplImage *as_float, Cha
 
 #pragma mark - categorize expiry digits via machine learning
 
-DMZ_INTERNAL inline DigitProbabilities *digit_probabilities(IplImage *as_float) {
 #define MAX_NUMBER_OF_MODELS 10
-  static DigitProbabilities probabilities[MAX_NUMBER_OF_MODELS];
-  
-  assert(as_float->width * sizeof(float) == as_float->widthStep);
-  Eigen::Map<DigitModelInput> conv_digit_model_input((float *)as_float->imageData);
+
+// Fills in one set of probabilities per model.
+DMZ_INTERNAL inline void digit_probabilities(IplImage *as_float, DigitProbabilities probabilities[MAX_NUMBER_OF_MODELS]) {
+  ModelCInputView_bf4dd6c8 conv_digit_model_input = llcv_eigen_matrix_view<DigitModelInput>(as_float);
 //  Eigen::Map<MLPModelInput> mlp_digit_model_input((float *)as_float->imageData);
   
 #if DEBUG_EXPIRY_CATEGORIZATION_PERFORMANCE
@@ -104,8 +102,6 @@ DMZ_INTERNAL inline DigitProbabilities *digit_probabilities(IplImage *as_float)
     dmz_debug_print("Relative time, model %d: %.2f\n", model_index, ((float)interval[model_index]) / ((float)slowest));
   }
 #endif
-  
-  return probabilities;
 }
 
 float nth_root(float value) {
@@ -146,8 +142,12 @@ DMZ_INTERNAL inline ExpiryGroupScores combine_model_results(ExpiryGroupScores pr
 #endif
 }
 
-DMZ_INTERNAL inline ExpiryGroupScores categorize_expiry_digits(IplImage *card_y, IplImage *as_float, GroupedRects group, char *expiries_string) {
+DMZ_INTERNAL inline ExpiryGroupScores categorize_expiry_digits(IplImage *card_y, ExpiryScratch *scratch, GroupedRects group, char *expiries_string) {
   ExpiryGroupScores probability_vector[NUMBER_OF_MODELS + 1]; // one for each model, plus one for the combined results
+  CvSize character_size = cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight);
+  expiry_scratch_reserve(&scratch->filtered, character_size, IPL_DEPTH_8U);
+  expiry_scratch_reserve(&scratch->smoothed, character_size, IPL_DEPTH_8U);
+  expiry_scratch_reserve(&scratch->as_float, character_size, IPL_DEPTH_32F);
   
   for (int character_index = 0; character_index < 5; character_index++) {
     if (character_index == 2) { // the slash character
@@ -156,8 +156,9 @@ DMZ_INTERNAL inline ExpiryGroupScores categorize_expiry_digits(IplImage *card_y,
     
     CharacterRectListIterator rect = group.character_rects.begin() + character_index;
     
-    prepare_image_for_cat(card_y, as_float, rect);
-    DigitProbabilities *probabilities = digit_probabilities(as_float);
+    prepare_image_for_cat(card_y, scratch, rect);
+    DigitProbabilities probabilities[MAX_NUMBER_OF_MODELS];
+    digit_probabilities(scratch->as_float, probabilities);
     
     for (int model_index = 0; model_index < NUMBER_OF_MODELS; model_index++) {
       for (int digit_index = 0; digit_index < 10; digit_index++) {
@@ -449,15 +450,17 @@ DMZ_INTERNAL void expiry_extract(IplImage *card_y,
                                  GroupedRectsList &expiry_groups,
                                  GroupedRectsList &new_groups,
                                  int *expiry_month,
-                                 int *expiry_year) {
+                                 int *expiry_year,
+                                 ExpiryScratch *scratch) {
   if (new_groups.empty()) {
     return;
   }
 
-  static IplImage *as_float = NULL;
-  if (as_float == NULL) {
-    as_float = cvCreateImage(cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_32F, 1);
+  ExpiryScratch call_scratch;
+  if (scratch == NULL) {
+    memset(&call_scratch, 0, sizeof(call_scratch));
   }
+  ExpiryScratch *images = scratch != NULL ? scratch : &call_scratch;
 
 #if DEBUG_EXPIRY_CATEGORIZATION_PERFORMANCE
   dmz_debug_timer_start(2);
@@ -467,11 +470,14 @@ DMZ_INTERNAL void expiry_extract(IplImage *card_y,
   
   for (GroupedRectsListIterator group = new_groups.begin(); group != new_groups.end(); ++group) {
     char expiries_string[8192];
-    group->scores = categorize_expiry_digits(card_y, as_float, *group, expiries_string);
+    group->scores = categorize_expiry_digits(card_y, images, *group, expiries_string);
 #if DEBUG_EXPIRY_CATEGORIZATION_RESULTS
     dmz_debug_print("\n%s\n", expiries_string);
 #endif
   }
+  if (scratch == NULL) {
+    expiry_scratch_release(&call_scratch);
+  }
 
   // Aggregate the newly found groups with those we've previously found:
   
@@ -506,14 +512,17 @@ DMZ_INTERNAL void expiry_extract_group(IplImage *card_y,
                                        GroupedRects &group,
                                        ExpiryGroupScores &old_scores,
                                        int *expiry_month,
-                                       int *expiry_year) {
-  static IplImage *as_float = NULL;
-  if (as_float == NULL) {
-    as_float = cvCreateImage(cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_32F, 1);
+                                       int *expiry_year,
+                                       ExpiryScratch *scratch) {
+  ExpiryScratch call_scratch;
+  if (scratch == NULL) {
+    memset(&call_scratch, 0, sizeof(call_scratch));
   }
-  
   char expiries_string[8192];
-  group.scores = categorize_expiry_digits(card_y, as_float, group, expiries_string);
+  group.scores = categorize_expiry_digits(card_y, scratch != NULL ? scratch : &call_scratch, group, expiries_string);
+  if (scratch == NULL) {
+    expiry_scratch_release(&call_scratch);
+  }
 
   group.scores = (old_scores * kExpiryDecayFactor) + (group.scores * (1 - kExpiryDecayFactor));
   
@@ -7,22 +7,26 @@
 #define DMZ_SCAN_EXPIRY_CATEGORIZE_H
 
 #include "expiry_types.h"
+#include "expiry_seg.h" // for ExpiryScratch
 
 #include "opencv2/core/core_c.h" // needed for IplImage
 #include "dmz_macros.h"
 
+// scratch may be NULL, in which case the working images are allocated for this call only.
 DMZ_INTERNAL void expiry_extract(IplImage *cardY,
                                  GroupedRectsList &expiry_groups,
                                  GroupedRectsList &new_groups,
                                  int *expiry_month,
-                                 int *expiry_year);
+                                 int *expiry_year,
+                                 ExpiryScratch *scratch);
 
 #if CYTHON_DMZ
 DMZ_INTERNAL void expiry_extract_group(IplImage *card_y,
                                        GroupedRects &group,
                                        ExpiryGroupScores &old_scores,
                                        int *expiry_month,
-                                       int *expiry_year);
+                                       int *expiry_year,
+                                       ExpiryScratch *scratch);
 #endif
   
 #endif
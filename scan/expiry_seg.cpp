@@ -8,20 +8,50 @@
 
 #include "expiry_seg.h"
 #include "dmz_debug.h"
+#include "cv/eigen_view.h"
+#include "cv/image_util.h"
 #include "opencv2/imgproc/imgproc_c.h"
 
 //#define DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE 1
 
 //#define DEBUG_EXPIRY_IMAGES 1
 #if DEBUG_EXPIRY_IMAGES
-static int image_session_count = 0;
-static int image_stripe_count = 0;
-static char image_filename_string[64];
+static int image_session_count = 0; // only ever updated atomically
 #endif
 
+// best_expiry_seg's working images (taken from an ExpiryScratch), plus its debug bookkeeping.
+typedef struct {
+  IplImage *character_image; // for optimize_character_rects
+  IplImage *as_float; // for is_slash
+#if DEBUG_EXPIRY_IMAGES
+  int image_session;
+  int image_stripe;
+  char image_filename_string[64];
+#endif
+} ExpirySegScratch;
+
 // slash categorizer
 #include "models/expiry/modelm_730c4cbd.hpp"
 
+#pragma mark - working images
+
+DMZ_INTERNAL void expiry_scratch_reserve(IplImage **image, CvSize size, int depth) {
+  if(*image != NULL && ((*image)->width < size.width || (*image)->height < size.height || (*image)->depth != depth)) {
+    cvReleaseImage(image);
+  }
+  if(*image == NULL) {
+    *image = cvCreateImage(size, depth, 1);
+  }
+}
+
+DMZ_INTERNAL void expiry_scratch_release(ExpiryScratch *scratch) {
+  cvReleaseImage(&scratch->sobel);
+  cvReleaseImage(&scratch->character_image);
+  cvReleaseImage(&scratch->as_float);
+  cvReleaseImage(&scratch->filtered);
+  cvReleaseImage(&scratch->smoothed);
+}
+
 #pragma mark - image preparation
 
 
@@ -30,19 +60,18 @@ DMZ_INTERNAL void prepare_image_for_seg(IplImage *image, IplImage *as_float, Cha
   // Input image: IPL_DEPTH_8U [0 - 255]
   // Data for models: IPL_DEPTH_32F [0.0 - 1.0]
   
-  cvSetImageROI(image, cvRect(rect->left, rect->top, kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight));
-  cvConvertScale(image, as_float, 1.0f / 255.0f, 0); // TODO: vectorize this as a llcv_* function
-  cvResetImageROI(image);
+  IplImage character;
+  llcv_image_header_for_view(llcv_view_rect(llcv_view_of_image(image), cvRect(rect->left, rect->top, kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight)),
+                             IPL_DEPTH_8U, &character);
+  cvConvertScale(&character, as_float, 1.0f / 255.0f, 0); // TODO: vectorize this as a llcv_* function
 }
 
 #pragma mark - slash detection via machine learning
 
-typedef Eigen::Matrix<float, 1, 176, Eigen::RowMajor> SlashModelInput;
 typedef Eigen::Matrix<float, 1, 2, Eigen::RowMajor> SlashProbabilities;
 
 DMZ_INTERNAL inline SlashProbabilities slash_probabilities(IplImage *as_float) {
-  assert(as_float->width * sizeof(float) == as_float->widthStep);
-  Eigen::Map<SlashModelInput> slash_model_input((float *)as_float->imageData);
+  ModelMInputView_730c4cbd slash_model_input = llcv_eigen_vector_view<ModelMInput_730c4cbd>(as_float);
   SlashProbabilities probabilities = applym_730c4cbd(slash_model_input);
   return probabilities;
 }
@@ -240,17 +269,15 @@ DMZ_INTERNAL void regrid_group(IplImage *sobel_image, GroupedRects &group) {
   strip_group_white_space(group);
 }
 
-DMZ_INTERNAL void optimize_character_rects(IplImage *sobel_image, GroupedRects &group) {
 #define kExpandedCharacterImageWidth 18
 #define kExpandedCharacterImageHeight 21
 #define kCharacterRectOutset 2
-  
-  static IplImage *character_image = NULL;
-  if (character_image == NULL) {
-    character_image = cvCreateImage(cvSize(kExpandedCharacterImageWidth * 2, kExpandedCharacterImageHeight * 2), IPL_DEPTH_16S, 1);
-  }
-  
+
+// character_image must be IPL_DEPTH_16S, at least (kExpandedCharacterImageWidth * 2) x (kExpandedCharacterImageHeight * 2).
+DMZ_INTERNAL void optimize_character_rects(IplImage *sobel_image, IplImage *character_image, GroupedRects &group) {
   CvSize  card_image_size = cvGetSize(sobel_image);
+  llcv_view sobel_view = llcv_view_of_image(sobel_image);
+  llcv_view character_view = llcv_view_of_image(character_image);
   int character_image_width = group.character_width + 2 * kCharacterRectOutset;
   int character_image_height = group.height + 2 * kCharacterRectOutset;
   
@@ -268,14 +295,19 @@ DMZ_INTERNAL void optimize_character_rects(IplImage *sobel_image, GroupedRects &
       continue;
     }
     
-    cvSetImageROI(sobel_image, cvRect(rect_left, rect_top, character_image_width, character_image_height));
-    cvSetImageROI(character_image, cvRect(0, 0, character_image_width, character_image_height));
-    cvCopy(sobel_image, character_image);
+    // character_image's header shares its pixels, so CV_IMAGE_ELEM below still reads what these wrote
+    IplImage sobel_character;
+    IplImage character;
+    llcv_image_header_for_view(llcv_view_rect(sobel_view, cvRect(rect_left, rect_top, character_image_width, character_image_height)),
+                               IPL_DEPTH_16S, &sobel_character);
+    llcv_image_header_for_view(llcv_view_rect(character_view, cvRect(0, 0, character_image_width, character_image_height)),
+                               IPL_DEPTH_16S, &character);
+    cvCopy(&sobel_character, &character);
 
     // normalize & threshold is time-consuming (though probably somewhat optimizable),
     // but does help to more consistently position the image
-    cvNormalize(character_image, character_image, 255, 0, CV_C);
-    cvThreshold(character_image, character_image, 100, 255, CV_THRESH_TOZERO);
+    cvNormalize(&character, &character, 255, 0, CV_C);
+    cvThreshold(&character, &character, 100, 255, CV_THRESH_TOZERO);
     
     int character_width = character_image_width;
     int character_height = character_image_height;
@@ -338,8 +370,6 @@ DMZ_INTERNAL void optimize_character_rects(IplImage *sobel_image, GroupedRects &
     group.top = highest_top;
     group.height = lowest_top + kTrimmedCharacterImageHeight - group.top;
   }
-  
-  cvResetImageROI(sobel_image);
 }
 
 #if DEBUG_EXPIRY_IMAGES
@@ -351,7 +381,7 @@ DMZ_INTERNAL void add_rects_to_image(IplImage *image, CharacterRectList &rect_li
 #endif
 
 #if DEBUG_EXPIRY_IMAGES
-DMZ_INTERNAL void save_image_groups(IplImage *image, GroupedRectsList &groups) {
+DMZ_INTERNAL void save_image_groups(IplImage *image, GroupedRectsList &groups, const char *filename) {
   if (!groups.size()) {
     return;
   }
@@ -378,12 +408,12 @@ DMZ_INTERNAL void save_image_groups(IplImage *image, GroupedRectsList &groups) {
                                     min_top - kSmallCharacterHeight,
                                     rects_image->width,
                                     MIN(max_top + 2 * kSmallCharacterHeight, image->height) - (min_top - kSmallCharacterHeight)));
-  ios_save_file(image_filename_string, rects_image);
+  ios_save_file(filename, rects_image);
   cvReleaseImage(&rects_image);
 }
 #endif
 
-DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *sobel_image, int stripe_base_row, long stripe_sum, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups) {
+DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *sobel_image, int stripe_base_row, long stripe_sum, ExpirySegScratch *scratch, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups) {
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
   dmz_debug_timer_start(1);
 #endif
@@ -518,10 +548,10 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
   }
   
   add_rects_to_image(rects_image, rects, kSmallCharacterWidth);
-  image_stripe_count++;
-  sprintf(image_filename_string, "%d-e-%d-char_rects.png", image_session_count, image_stripe_count);
+  scratch->image_stripe++;
+  sprintf(scratch->image_filename_string, "%d-e-%d-char_rects.png", scratch->image_session, scratch->image_stripe);
   cvSetImageROI(rects_image, cvRect(0, min_top - kSmallCharacterHeight, rects_image->width, kSmallCharacterHeight * 3));
-  ios_save_file(image_filename_string, rects_image);
+  ios_save_file(scratch->image_filename_string, rects_image);
   cvReleaseImage(&rects_image);
 #endif
   
@@ -554,8 +584,8 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
 #endif
   
 #if DEBUG_EXPIRY_IMAGES
-  sprintf(image_filename_string, "%d-f-%d-groups.png", image_session_count, image_stripe_count);
-  save_image_groups(card_y, local_groups);
+  sprintf(scratch->image_filename_string, "%d-f-%d-groups.png", scratch->image_session, scratch->image_stripe);
+  save_image_groups(card_y, local_groups, scratch->image_filename_string);
 #endif
 
   // Note: The two loops below use `kMinimumExpiryStripCharacters - 1` rather than `kMinimumExpiryStripCharacters`,
@@ -599,12 +629,12 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
 #endif
   
 #if DEBUG_EXPIRY_IMAGES
-  sprintf(image_filename_string, "%d-g-%d-regrid.png", image_session_count, image_stripe_count);
-  save_image_groups(card_y, local_groups);
+  sprintf(scratch->image_filename_string, "%d-g-%d-regrid.png", scratch->image_session, scratch->image_stripe);
+  save_image_groups(card_y, local_groups, scratch->image_filename_string);
 #endif
   
   for (int index = (int)local_groups.size() - 1; index >= 0; index--) {
-    optimize_character_rects(sobel_image, local_groups[index]);
+    optimize_character_rects(sobel_image, scratch->character_image, local_groups[index]);
     if (local_groups[index].character_rects.size() == 0) {
       local_groups.erase(local_groups.begin() + index);
       // dmz_debug_print("Erasing local_group %d, which is now empty.\n", index);
@@ -612,7 +642,7 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
   }
   
   for (int index = (int)super_groups.size() - 1; index >= 0; index--) {
-    optimize_character_rects(sobel_image, super_groups[index]);
+    optimize_character_rects(sobel_image, scratch->character_image, super_groups[index]);
     if (super_groups[index].character_rects.size() == 0) {
       super_groups.erase(super_groups.begin() + index);
     }
@@ -623,8 +653,8 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
 #endif
   
 #if DEBUG_EXPIRY_IMAGES
-  sprintf(image_filename_string, "%d-h-%d-optimize.png", image_session_count, image_stripe_count);
-  save_image_groups(card_y, local_groups);
+  sprintf(scratch->image_filename_string, "%d-h-%d-optimize.png", scratch->image_session, scratch->image_stripe);
+  save_image_groups(card_y, local_groups, scratch->image_filename_string);
 #endif
  
   new_groups.clear();
@@ -651,17 +681,12 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
   
   // Add local groups to the passed-in expiry_groups GroupedRectsList, iff they contain a slash in a reasonable position
   
-  static IplImage *as_float = NULL;
-  if (as_float == NULL) {
-    as_float = cvCreateImage(cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_32F, 1);
-  }
-  
   for (GroupedRectsListIterator group = local_groups.begin(); group != local_groups.end(); ++group) {
     if (group->character_rects.size() < 5) {
       continue;
     }
     for (size_t firstCharacterIndex = 0; firstCharacterIndex + 4 < group->character_rects.size(); firstCharacterIndex++) {
-      if (is_slash(sobel_image, as_float, &group->character_rects[firstCharacterIndex + 2])) {
+      if (is_slash(sobel_image, scratch->as_float, &group->character_rects[firstCharacterIndex + 2])) {
         GroupedRects grouped_5_characters;
         grouped_5_characters.top = group->character_rects[firstCharacterIndex].top;
         grouped_5_characters.left = group->character_rects[firstCharacterIndex].left;
@@ -691,8 +716,8 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
 #endif
   
 #if DEBUG_EXPIRY_IMAGES
-  sprintf(image_filename_string, "%d-i-%d-slash.png", image_session_count, image_stripe_count);
-  save_image_groups(card_y, expiry_groups);
+  sprintf(scratch->image_filename_string, "%d-i-%d-slash.png", scratch->image_session, scratch->image_stripe);
+  save_image_groups(card_y, expiry_groups, scratch->image_filename_string);
 #endif
   
   // Add supergroups to the passed-in name_groups GroupedRectsList
@@ -703,43 +728,60 @@ DMZ_INTERNAL void find_character_groups_for_stripe(IplImage *card_y, IplImage *s
 #endif
 }
 
-DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups) {
+DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups,
+                                  ExpiryScratch *expiry_scratch) {
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
   dmz_debug_timer_start();
 #endif
   
   CvSize card_image_size = cvGetSize(card_y);
-  
+
+  ExpiryScratch call_scratch;
+  if(expiry_scratch == NULL) {
+    memset(&call_scratch, 0, sizeof(call_scratch));
+  }
+  ExpiryScratch *images = expiry_scratch != NULL ? expiry_scratch : &call_scratch;
+  expiry_scratch_reserve(&images->sobel, card_image_size, IPL_DEPTH_16S);
+  expiry_scratch_reserve(&images->character_image, cvSize(kExpandedCharacterImageWidth * 2, kExpandedCharacterImageHeight * 2), IPL_DEPTH_16S);
+  expiry_scratch_reserve(&images->as_float, cvSize(kTrimmedCharacterImageWidth, kTrimmedCharacterImageHeight), IPL_DEPTH_32F);
+
   // Look for vertical line segments -> sobel_image:
   
-  IplImage *sobel_image = cvCreateImage(card_image_size, IPL_DEPTH_16S, 1);
+  IplImage sobel_header;
+  llcv_view sobel_view = llcv_view_rect(llcv_view_of_image(images->sobel), cvRect(0, 0, card_image_size.width, card_image_size.height));
+  llcv_image_header_for_view(sobel_view, IPL_DEPTH_16S, &sobel_header);
+  IplImage *sobel_image = &sobel_header;
   cvSetZero(sobel_image);
+
+  ExpirySegScratch scratch_images;
+  ExpirySegScratch *scratch = &scratch_images;
+  scratch->character_image = images->character_image;
+  scratch->as_float = images->as_float;
   
   CvRect below_numbers_rect = cvRect(0, starting_y_offset + kNumberHeight, card_image_size.width, card_image_size.height - (starting_y_offset + kNumberHeight));
-  cvSetImageROI(card_y, below_numbers_rect);
-  cvSetImageROI(sobel_image, below_numbers_rect);
+  IplImage card_y_below_numbers;
+  IplImage sobel_below_numbers;
+  llcv_image_header_for_view(llcv_view_rect(llcv_view_of_image(card_y), below_numbers_rect), IPL_DEPTH_8U, &card_y_below_numbers);
+  llcv_image_header_for_view(llcv_view_rect(sobel_view, below_numbers_rect), IPL_DEPTH_16S, &sobel_below_numbers);
   
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
   dmz_debug_timer_print("set up for Sobel");
 #endif
   
-  llcv_scharr3_dx_abs(card_y, sobel_image);
+  llcv_scharr3_dx_abs(&card_y_below_numbers, &sobel_below_numbers);
   
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
   dmz_debug_timer_print("do Sobel [Scharr]");
 #endif
   
 #if DEBUG_EXPIRY_IMAGES
-  image_session_count++;
-  sprintf(image_filename_string, "%d-a-original.png", image_session_count);
-  ios_save_file(image_filename_string, card_y);
-  sprintf(image_filename_string, "%d-b-sobel.png", image_session_count);
-  ios_save_file(image_filename_string, sobel_image);
+  scratch->image_session = __sync_add_and_fetch(&image_session_count, 1);
+  sprintf(scratch->image_filename_string, "%d-a-original.png", scratch->image_session);
+  ios_save_file(scratch->image_filename_string, &card_y_below_numbers);
+  sprintf(scratch->image_filename_string, "%d-b-sobel.png", scratch->image_session);
+  ios_save_file(scratch->image_filename_string, &sobel_below_numbers);
 #endif
   
-  cvResetImageROI(card_y);
-  cvResetImageROI(sobel_image);
-  
   // Calculate relative vertical-line-segment-ness for each scan line (i.e., cvSum of the [x-axis] Sobel image for that line):
   
   int   first_stripe_base_row = below_numbers_rect.y + 1;  // the "+ 1" represents the tolerance above and below each stripe
@@ -750,11 +792,13 @@ DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset,
   int   right_edge = (card_image_size.width * 2) / 3;  // beyond here lie logos
   
   for (int row = first_stripe_base_row - 1; row < card_image_size.height; row++) {
-    cvSetImageROI(sobel_image, cvRect(left_edge, row, right_edge - left_edge, 1));
-    line_sum[row] = (long)cvSum(sobel_image).val[0];
+    const int16_t *sobel_row = (const int16_t *)llcv_view_row(sobel_view, (uint16_t)row);
+    long sum = 0;
+    for (int col = left_edge; col < right_edge; col++) {
+      sum += sobel_row[col];
+    }
+    line_sum[row] = sum;
   }
-  
-  cvResetImageROI(sobel_image);
 
 #if DEBUG_EXPIRY_IMAGES
   long max_line_sum = 0;
@@ -779,8 +823,8 @@ DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset,
     cvSet(rows_image, cvScalar((line_sum[row] - min_line_sum) / scale_factor));
   }
   cvSetImageROI(rows_image, below_numbers_rect);
-  sprintf(image_filename_string, "%d-c-rows.png", image_session_count);
-  ios_save_file(image_filename_string, rows_image);
+  sprintf(scratch->image_filename_string, "%d-c-rows.png", scratch->image_session);
+  ios_save_file(scratch->image_filename_string, rows_image);
 #endif
   
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
@@ -880,17 +924,17 @@ DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset,
     indent += 20;
   }
   cvSetImageROI(rows_image, below_numbers_rect);
-  sprintf(image_filename_string, "%d-d-stripes.png", image_session_count);
-  ios_save_file(image_filename_string, rows_image);
+  sprintf(scratch->image_filename_string, "%d-d-stripes.png", scratch->image_session);
+  ios_save_file(scratch->image_filename_string, rows_image);
   cvReleaseImage(&rows_image);
   
-  image_stripe_count = 0;
+  scratch->image_stripe = 0;
 #endif
   
   // For each stripe, find the potential expiry groups and name groups:
   
   for (std::vector<StripeSum>::iterator probable_stripe = probable_stripes.begin(); probable_stripe != probable_stripes.end(); ++probable_stripe) {
-    find_character_groups_for_stripe(card_y, sobel_image, probable_stripe->base_row, probable_stripe->sum, expiry_groups, name_groups);
+    find_character_groups_for_stripe(card_y, sobel_image, probable_stripe->base_row, probable_stripe->sum, scratch, expiry_groups, name_groups);
   }
   
 #if DEBUG_EXPIRY_SEGMENTATION_PERFORMANCE
@@ -898,7 +942,9 @@ DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset,
   dmz_debug_print("Grand Total for Expiry segmentation: %.3f\n", ((float)dmz_debug_timer_stop()) / 1000.0);
 #endif
   
-  cvReleaseImage(&sobel_image);
+  if(expiry_scratch == NULL) {
+    expiry_scratch_release(&call_scratch);
+  }
 }
 
 #endif // COMPILE_DMZ
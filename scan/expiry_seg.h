@@ -9,6 +9,23 @@
 #include "expiry_types.h"
 #include "opencv2/imgproc/types_c.h"
 
-DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups);
+// Working images for best_expiry_seg and expiry_extract, so that a scanner doesn't allocate them every frame.
+// Each is allocated on first use and kept until expiry_scratch_release.
+typedef struct {
+  IplImage *sobel; // IPL_DEPTH_16S; only ever grows, and a smaller card uses its top-left corner
+  IplImage *character_image; // IPL_DEPTH_16S, for optimize_character_rects
+  IplImage *as_float; // IPL_DEPTH_32F, one character for the slash and digit models
+  IplImage *filtered; // IPL_DEPTH_8U, one character's gradient for the digit models
+  IplImage *smoothed; // IPL_DEPTH_8U, the same after the bilateral filter
+} ExpiryScratch;
+
+DMZ_INTERNAL void expiry_scratch_release(ExpiryScratch *scratch);
+
+// Leaves *image single channel, of depth, and at least size, reallocating it only to grow it.
+DMZ_INTERNAL void expiry_scratch_reserve(IplImage **image, CvSize size, int depth);
+
+// scratch may be NULL, in which case the working images are allocated for this call only.
+DMZ_INTERNAL void best_expiry_seg(IplImage *card_y, uint16_t starting_y_offset, GroupedRectsList &expiry_groups, GroupedRectsList &name_groups,
+                                  ExpiryScratch *scratch);
 
 #endif
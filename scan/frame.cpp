@@ -9,6 +9,8 @@
 #include "frame.h"
 #include "dmz_constants.h"
 #include "dmz_debug.h"
+#include "dmz_profile.h"
+#include "cv/convert.h"
 
 // These cutoff values derived through a very round of experimentation at my desk,
 // in one set of lighting conditions, with a handful of cards.
@@ -21,17 +23,23 @@
 #define kMaxNumberScoreDelta 3 // non-lax value: 1? 2?
 #define kFlipVSegYOffsetCutoff ((kCreditCardTargetHeight - kNumberHeight) / 2)
 
-DMZ_INTERNAL void scan_card_image(IplImage *y, bool collect_card_number, bool scan_expiry, FrameScanResult *result) {
+DMZ_INTERNAL void scan_card_image(IplImage *y, bool collect_card_number, bool scan_expiry, IplImage *expiry_y, NumberStripGradient *strip_grad,
+                                  ExpiryScratch *expiry_scratch, FrameScanResult *result, dmz_profile *profile) {
   assert(NULL == y->roi);
-  assert(y->width == 428);
-  assert(y->height == 270);
+  uint8_t scale = (uint8_t)(y->width / kCreditCardTargetWidth);
+  assert(scale == 1 || scale == 2);
+  assert(y->width == scale * kCreditCardTargetWidth);
+  assert(y->height == scale * kCreditCardTargetHeight);
   assert(y->depth == IPL_DEPTH_8U);
   assert(y->nChannels == 1);
 
   result->upside_down = false;
   result->usable = false;
+  result->hseg.n_offsets = 0; // until (unless) we get as far as the hseg
   
+  uint64_t start = dmz_profile_start(profile);
   result->vseg = best_n_vseg(y); // TODO - report this
+  dmz_profile_end(profile, DMZStageVSeg, start);
 
   // If the best vseg is in the top half of the card,
   // return early and indicate that the card is upside-down.
@@ -47,30 +55,45 @@ DMZ_INTERNAL void scan_card_image(IplImage *y, bool collect_card_number, bool sc
   }
 
   if (collect_card_number) {
-    cvSetImageROI(y, cvRect(0, result->vseg.y_offset, kCreditCardTargetWidth, kNumberHeight));
+    llcv_view y_strip = llcv_view_rect(llcv_view_of_image(y), cvRect(0, scale * result->vseg.y_offset,
+                                                                     scale * kCreditCardTargetWidth, scale * kNumberHeight));
     
-    result->hseg = best_n_hseg(y, result->vseg);
+    start = dmz_profile_start(profile);
+    result->hseg = best_n_hseg(y_strip, result->vseg, strip_grad);
+    dmz_profile_end(profile, DMZStageHSeg, start);
     // I've not found the hseg score to be a reliable indicator of quality at all
     // Unsurprising, since this is the hardest phase of the pipeline, and we're struggling
     // just to find anything at all!
     //
     //  if(!result->usable) {
-    //    cvResetImageROI(y);
     //    return result;
     //  }
     
-    result->scores = number_scores(y, result->hseg);
+    start = dmz_profile_start(profile);
+    result->scores = number_scores(y_strip, result->hseg, strip_grad);
+    dmz_profile_end(profile, DMZStageNumberCategorize, start);
     float number_score = result->hseg.n_offsets - result->scores.sum();
     result->usable = number_score < kMaxNumberScoreDelta;
     if (!result->usable) {
       dmz_debug_log("number_score %f unusable", number_score);
     }
-    cvResetImageROI(y);
   }
 
 #if SCAN_EXPIRY
-  if (scan_expiry && result->vseg.y_offset < kCreditCardTargetHeight - 2 * kSmallCharacterHeight) {
-    best_expiry_seg(y, result->vseg.y_offset, result->expiry_groups, result->name_groups);
+  if (scale == 1) {
+    expiry_y = y;
+  }
+  if (scan_expiry && expiry_y != NULL && result->vseg.y_offset < kCreditCardTargetHeight - 2 * kSmallCharacterHeight) {
+    start = dmz_profile_start(profile);
+    if (scale == 2) {
+      // best_expiry_seg and expiry_extract only look below the number
+      uint16_t first_row = result->vseg.y_offset + kNumberHeight;
+      llcv_area_down2_u8(llcv_view_rect(llcv_view_of_image(y), cvRect(0, 2 * first_row, y->width, y->height - 2 * first_row)),
+                         llcv_view_rect(llcv_view_of_image(expiry_y),
+                                        cvRect(0, first_row, kCreditCardTargetWidth, kCreditCardTargetHeight - first_row)));
+    }
+    best_expiry_seg(expiry_y, result->vseg.y_offset, result->expiry_groups, result->name_groups, expiry_scratch);
+    dmz_profile_end(profile, DMZStageExpirySeg, start);
   #if DMZ_DEBUG
     if (result->expiry_groups.empty()) {
       dmz_debug_log("Expiry segmentation failed.");
@@ -90,7 +113,7 @@ void cython_scan_card_image(IplImage *y, CythonFrameScanResult *result) {
   frameScanResult.torch_is_on = 0;
   frameScanResult.flipped = 0;
 
-  scan_card_image(y, true, true, &frameScanResult);
+  scan_card_image(y, true, true, NULL, NULL, NULL, &frameScanResult, NULL);
   
   result->usable = frameScanResult.usable;
   result->hseg = frameScanResult.hseg;
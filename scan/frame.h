@@ -10,6 +10,7 @@
 #include "n_categorize.h"
 #include "opencv2/core/core_c.h" // needed for IplImage
 #include "dmz_macros.h"
+#include "dmz.h" // for dmz_profile
 
 typedef struct {
   float                   focus_score;
@@ -30,8 +31,16 @@ typedef struct {
 
 // Scans a single card image, returns a summary of all info gathered along the way.
 // If usable is false, disregard all other info.
-// y must be 428x270, uint8_t, no roi, single channel greyscale.
-DMZ_INTERNAL void scan_card_image(IplImage *y, bool collect_card_number, bool scan_expiry, FrameScanResult *result);
+// y must be 428x270, uint8_t, no roi, single channel greyscale -- or the same at 856x540 (a 2x card),
+// in which case every position in result is still in 428x270 coordinates.
+// Expiry segmentation only works at 428x270: for a 2x card, the part of it below the number is
+// area-averaged into expiry_y (428x270, no roi), which is then what expiry rects refer to.
+// expiry_y is ignored for a 428x270 y, and expiry isn't scanned if it is needed but NULL.
+// strip_grad may be NULL; otherwise hseg and number categorization share the number strip's gradient through it.
+// expiry_scratch may be NULL; otherwise expiry segmentation keeps its working images there.
+// profile may be NULL; if enabled, vseg, hseg, number categorization and expiry segmentation are timed.
+DMZ_INTERNAL void scan_card_image(IplImage *y, bool collect_card_number, bool scan_expiry, IplImage *expiry_y, NumberStripGradient *strip_grad,
+                                  ExpiryScratch *expiry_scratch, FrameScanResult *result, dmz_profile *profile);
 
 #if CYTHON_DMZ
 typedef struct {
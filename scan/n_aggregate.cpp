@@ -0,0 +1,102 @@
+//
+//  n_aggregate.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "n_aggregate.h"
+
+DMZ_INTERNAL void number_aggregate_reset(NumberAggregate *aggregate) {
+  uint8_t window = aggregate->window;
+  float (*recent)[10][16] = aggregate->recent;
+  memset(aggregate, 0, sizeof(NumberAggregate));
+  aggregate->window = window;
+  aggregate->recent = recent; // only read once count says the window has been filled
+}
+
+DMZ_INTERNAL void number_aggregate_set_window(NumberAggregate *aggregate, uint8_t window) {
+  assert(window <= kNumberAggregateMaxWindow);
+  if(window != aggregate->window) {
+    free(aggregate->recent);
+    aggregate->recent = NULL;
+    if(window > 0) {
+      aggregate->recent = (float (*)[10][16])malloc(window * sizeof(*aggregate->recent));
+    }
+    aggregate->window = aggregate->recent == NULL ? 0 : window;
+  }
+  number_aggregate_reset(aggregate);
+}
+
+DMZ_INTERNAL void number_aggregate_release(NumberAggregate *aggregate) {
+  free(aggregate->recent);
+  aggregate->recent = NULL;
+  aggregate->window = 0;
+}
+
+// One pass over the scores, a digit (16 positions) at a time.
+DMZ_INTERNAL void number_aggregate_update_best(NumberAggregate *aggregate) {
+  for(uint8_t position = 0; position < 16; position++) {
+    aggregate->max_score[position] = aggregate->scores[0][position];
+    aggregate->best_digit[position] = 0;
+    aggregate->score_sum[position] = aggregate->scores[0][position];
+  }
+  for(uint8_t digit = 1; digit < 10; digit++) {
+    for(uint8_t position = 0; position < 16; position++) {
+      float score = aggregate->scores[digit][position];
+      aggregate->score_sum[position] += score;
+      if(score > aggregate->max_score[position]) {
+        aggregate->max_score[position] = score;
+        aggregate->best_digit[position] = digit;
+      }
+    }
+  }
+}
+
+DMZ_INTERNAL void number_aggregate_add(NumberAggregate *aggregate, const NumberScores &scores) {
+  float frame[10][16];
+  for(uint8_t position = 0; position < 16; position++) {
+    for(uint8_t digit = 0; digit < 10; digit++) {
+      frame[digit][position] = scores(position, digit);
+    }
+  }
+
+  if(aggregate->window == 0) {
+    for(uint8_t digit = 0; digit < 10; digit++) {
+      for(uint8_t position = 0; position < 16; position++) {
+        aggregate->scores[digit][position] = aggregate->scores[digit][position] * kNumberAggregateDecayFactor +
+                                             frame[digit][position] * (1 - kNumberAggregateDecayFactor);
+      }
+    }
+  } else {
+    uint8_t slot = aggregate->next_recent;
+    bool full = aggregate->count >= aggregate->window;
+    if(full && slot == 0) {
+      // Once per trip around the window, sum it afresh, so that rounding can't build up from frames leaving it
+      memcpy(aggregate->recent[slot], frame, sizeof(frame));
+      memset(aggregate->scores, 0, sizeof(aggregate->scores));
+      for(uint8_t recent_index = 0; recent_index < aggregate->window; recent_index++) {
+        for(uint8_t digit = 0; digit < 10; digit++) {
+          for(uint8_t position = 0; position < 16; position++) {
+            aggregate->scores[digit][position] += aggregate->recent[recent_index][digit][position];
+          }
+        }
+      }
+    } else {
+      for(uint8_t digit = 0; digit < 10; digit++) {
+        for(uint8_t position = 0; position < 16; position++) {
+          float leaving = full ? aggregate->recent[slot][digit][position] : 0.0f;
+          aggregate->scores[digit][position] += frame[digit][position] - leaving;
+        }
+      }
+      memcpy(aggregate->recent[slot], frame, sizeof(frame));
+    }
+    aggregate->next_recent = (uint8_t)((slot + 1) % aggregate->window);
+  }
+
+  aggregate->count++;
+  number_aggregate_update_best(aggregate);
+}
+
+#endif // COMPILE_DMZ
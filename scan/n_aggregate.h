@@ -0,0 +1,51 @@
+//
+//  n_aggregate.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef DMZ_SCAN_N_AGGREGATE_H
+#define DMZ_SCAN_N_AGGREGATE_H
+
+#include "n_categorize.h"
+#include "dmz_macros.h"
+
+#define kNumberAggregateDecayFactor 0.8f
+#define kNumberAggregateMaxWindow 16
+
+// Each frame's number scores, combined across frames (for one number length).
+// Stored by digit, then position (structure of arrays), so an add runs across all 16 positions at once,
+// and each position's best digit, best score and score sum are brought up to date as it goes:
+// reading them back is then O(positions), with nothing to scan.
+typedef struct {
+  float scores[10][16];      // scores[digit][position]
+  float max_score[16];
+  uint8_t best_digit[16];    // the first digit with max_score, as maxCoeff would pick
+  float score_sum[16];
+  uint16_t count;            // frames added since the last reset
+
+  // 0: exponential decay -- each add scales the scores down by kNumberAggregateDecayFactor first.
+  // Otherwise, scores is the sum of the last (up to) window frames' scores, each of which is kept in recent.
+  uint8_t window;
+  uint8_t next_recent;
+  float (*recent)[10][16]; // window frames, allocated by number_aggregate_set_window; NULL while window is 0
+} NumberAggregate;
+
+// Clears the scores; keeps window (and recent).
+DMZ_INTERNAL void number_aggregate_reset(NumberAggregate *aggregate);
+
+// window is 0 (exponential decay) or at most kNumberAggregateMaxWindow frames. Resets aggregate.
+// recent must be NULL or allocated by an earlier call; if it can't be allocated, window is 0.
+DMZ_INTERNAL void number_aggregate_set_window(NumberAggregate *aggregate, uint8_t window);
+
+// Frees recent (window drops to 0).
+DMZ_INTERNAL void number_aggregate_release(NumberAggregate *aggregate);
+
+DMZ_INTERNAL void number_aggregate_add(NumberAggregate *aggregate, const NumberScores &scores);
+
+// max_score / score_sum at position: how much of position's aggregated score its best digit has. 0 if nothing yet.
+DMZ_INTERNAL inline float number_aggregate_stability(const NumberAggregate *aggregate, uint8_t position) {
+  float sum = aggregate->score_sum[position];
+  return sum > 0 ? aggregate->max_score[position] / sum : 0.0f;
+}
+
+#endif
@@ -7,6 +7,7 @@
 #if COMPILE_DMZ
 
 #include "n_categorize.h"
+#include "cv/eigen_view.h"
 #include "cv/image_util.h"
 #include "cv/morph.h"
 #include "cv/stats.h"
@@ -23,27 +24,9 @@ typedef Eigen::Matrix<float, 27, 19, Eigen::RowMajor> NumberImage;
 typedef Eigen::Matrix<float, 1, 10, Eigen::RowMajor> SingleNumberScores;
 
 
-// TODO: Refactor me
-DMZ_INTERNAL inline NumberImage matrix_for_number_image(IplImage *number_image) {
-  CvSize image_size = cvGetSize(number_image);
-  
-  NumberImage m;
-  uint8_t *data_origin = (uint8_t *)llcv_get_data_origin(number_image); // use uint8_t so that the widthStep calculation is easier
-  
-  // TODO: Do this the not-stupid way (set up a Map with the right strides and just alias the memory)
-  for(int i = 0; i < image_size.height; i++){
-    float *row_origin = (float *)(data_origin + i * number_image->widthStep);
-    for(int j = 0; j < image_size.width; j++) {
-      m(i, j) = row_origin[j];
-    }
-  }
-  
-  return m;
-}
-
-
-DMZ_INTERNAL inline SingleNumberScores scores_for_number_image(IplImage *number_image) {
-  NumberImage image_matrix = matrix_for_number_image(number_image);
+DMZ_INTERNAL inline SingleNumberScores scores_for_number_image(llcv_view number_image) {
+  // All three models share one input layout, and read the image's pixels where they are.
+  ModelCInputView_5c241121 image_matrix = llcv_eigen_matrix_view<NumberImage>(number_image);
   
   // The values in result[0|1|2] are probabilities, but once we munge them together, they just become scores
   SingleNumberScores result0 = applyc_5c241121(image_matrix);
@@ -72,38 +55,64 @@ DMZ_INTERNAL inline SingleNumberScores scores_for_number_image(IplImage *number_
 }
 
 
-DMZ_INTERNAL NumberScores number_scores(IplImage *y_strip, NHorizontalSegmentation hseg) {
-  // y_strip might have been made into a strip by using a vertical ROI -- must preserve and use y_offset in that case
-  // though slightly complex, this is better than making an unneeded copy
-  CvSize y_strip_size = cvGetSize(y_strip);
-#pragma unused(y_strip_size) // work around broken compiler warnings
-  assert(y_strip_size.height == 27);
-  uint16_t y_offset = 0;
-  if(NULL != y_strip->roi) {
-    y_offset = (uint16_t)y_strip->roi->yOffset;
-    assert(y_strip->roi->width == 428);
-    assert(y_strip->roi->xOffset == 0);
+// Where hseg's offsets come from, before rounding: pattern_offset + pattern_index * number_width.
+// (The pattern index is recoverable because the rounding is far smaller than number_width.)
+DMZ_INTERNAL inline float unrounded_number_offset(NHorizontalSegmentation hseg, uint16_t offset) {
+  if(hseg.number_width <= 0.0f) {
+    return offset;
+  }
+  float pattern_index = roundf((offset - hseg.pattern_offset) / hseg.number_width);
+  return hseg.pattern_offset + pattern_index * hseg.number_width;
+}
+
+DMZ_INTERNAL NumberScores number_scores(llcv_view strip, NHorizontalSegmentation hseg, NumberStripGradient *strip_grad) {
+  // Each digit is a view into the strip -- no roi is set on anything, and nothing is copied to get at a digit
+  uint8_t scale = (uint8_t)(strip.height / 27);
+  assert(scale == 1 || scale == 2);
+  assert(strip.height == 27 * scale);
+  assert(strip.width == 428 * scale);
+
+  llcv_view strip_grad_1x;
+  llcv_view strip_down_1x;
+  if(strip_grad != NULL) {
+    strip_grad_1x = llcv_view_of_image(strip_grad->grad);
+    if(strip_grad->down != NULL) {
+      strip_down_1x = llcv_view_of_image(strip_grad->down);
+    }
   }
 
-  // TODO: Set up these temporary variables once during initialization, and reuse?
-  // Would be nicer yet to just have static allocation...
-  IplImage *number_image = cvCreateImage(cvSize(19, 27), y_strip->depth, 1);
-  IplImage *number_image_float = cvCreateImage(cvSize(19, 27), IPL_DEPTH_32F, 1);
-  
+  uint8_t number_pixels[27 * 19];
+  float number_floats[27 * 19];
+  uint8_t down2_scratch[3 * 19];
+  llcv_view number_image = llcv_view_of_data(number_pixels, 19, 27, 19, sizeof(uint8_t));
+  llcv_view number_image_float = llcv_view_of_data(number_floats, 19, 27, 19 * sizeof(float), sizeof(float));
+
   NumberScores scores = NumberScores::Zero();
   for(uint8_t offset_index = 0; offset_index < hseg.n_offsets; offset_index++) {
     uint16_t offset = hseg.offsets[offset_index];
-    cvSetImageROI(y_strip, cvRect(offset, y_offset, 19, 27));
-    llcv_morph_grad3_2d_cross_u8(y_strip, number_image);
-    llcv_equalize_hist(number_image, number_image);
-    cvConvertScale(number_image, number_image_float, 1.0f / 255.0f, 0.0f);
+    if(scale == 1) {
+      llcv_view digit = llcv_view_rect(strip, cvRect(offset, 0, 19, 27));
+      if(strip_grad != NULL) {
+        llcv_morph_grad3_2d_cross_window_u8(digit, llcv_view_rect(strip_grad_1x, cvRect(offset, 0, 19, 27)), number_image);
+      } else {
+        llcv_morph_grad3_2d_cross_u8(digit, number_image);
+      }
+    } else {
+      int offset_2x = MIN((int)lrintf(2.0f * unrounded_number_offset(hseg, offset)), 2 * (428 - 19));
+      if(strip_grad != NULL && offset_2x % 2 == 0) {
+        CvRect digit_rect_1x = cvRect(offset_2x / 2, 0, 19, 27);
+        llcv_morph_grad3_2d_cross_window_u8(llcv_view_rect(strip_down_1x, digit_rect_1x), llcv_view_rect(strip_grad_1x, digit_rect_1x),
+                                            number_image);
+      } else {
+        llcv_view digit = llcv_view_rect(strip, cvRect(offset_2x, 0, 2 * 19, 2 * 27));
+        llcv_area_down2_morph_grad3_2d_cross_u8(digit, number_image, down2_scratch);
+      }
+    }
+    llcv_equalize_hist_small_to_f32(number_image, number_image_float);
     SingleNumberScores single_number_scores = scores_for_number_image(number_image_float);
     scores.row(offset_index) = single_number_scores;
   }
-  
-  cvReleaseImage(&number_image_float);
-  cvReleaseImage(&number_image);
-  
+
   return scores;
 }
 
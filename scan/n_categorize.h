@@ -7,15 +7,20 @@
 #define DMZ_SCAN_N_CATEGORIZE_H
 
 #include "opencv2/core/core_c.h" // needed for IplImage
+#include "cv/image_util.h"
 #include "eigen.h"
 #include "n_hseg.h"
 #include "dmz_macros.h"
 
 typedef Eigen::Matrix<float, 16, 10, Eigen::RowMajor> NumberScores;  // (up to) 16 numbers, 10 possibilities each
 
-// May alter any roi that y_strip may have prior to returning. (The inbound roi will be respected,
-// it'll just be changed at the end.) If this is unwanted, pass in a copy of y_strip.
-DMZ_INTERNAL NumberScores number_scores(IplImage *y_strip, NHorizontalSegmentation hseg);
+// y_strip is a view of the 428x27 number strip; nothing it points into is modified.
+// It may also be the 856x54 strip of a 2x card. Each digit is then cropped at the nearest
+// half pixel to where hseg placed it, before being area-averaged down to the models' 19x27.
+// strip_grad may be NULL. Otherwise it must hold y_strip's gradient (as best_n_hseg leaves it), and
+// each digit's gradient is sliced out of it. (On a 2x card, only digits cropped at a whole 428x270
+// pixel line up with it; the rest are still computed on their own.)
+DMZ_INTERNAL NumberScores number_scores(llcv_view y_strip, NHorizontalSegmentation hseg, NumberStripGradient *strip_grad);
 
 
 #endif
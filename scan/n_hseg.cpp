@@ -8,6 +8,7 @@
 
 #include "n_hseg.h"
 #include "eigen.h"
+#include "cv/convert.h"
 #include "cv/image_util.h"
 #include "cv/morph.h"
 #include "opencv2/imgproc/imgproc_c.h"
@@ -34,68 +35,128 @@ typedef struct {
 #define SliceU16_MAX UINT16_MAX
 
 typedef Eigen::Matrix<float, 1, 428, Eigen::RowMajor> HorizontalStripPattern;
-typedef Eigen::Matrix<float, 1, 19, Eigen::RowMajor> NumberGradSumPattern;
 
-DMZ_INTERNAL NHorizontalSegmentation best_n_hseg_constrained(float *grad_sums, NVerticalSegmentation vseg, NHorizontalSegmentation best, SliceF32 width_slice, SliceU16 offset_slice) {
-  
-  HorizontalStripPattern pattern;
+// Specialized per number pattern (PatternMask bit i set: a digit at pattern_index i), so the digit placement unrolls.
+// Every offset's pattern is the same pattern shifted, so it's placed once per width, at offset 0, 428 floats into
+// shiftable_pattern (whose first 428 floats stay zero); the pattern at offset is then the 428 floats at 428 - offset.
+// Offsets whose last digit would run off the strip are never scored.
+template <uint8_t PatternLength, uint32_t PatternMask>
+DMZ_INTERNAL NHorizontalSegmentation best_n_hseg_constrained(float *grad_sums, NHorizontalSegmentation best, SliceF32 width_slice, SliceU16 offset_slice) {
   Eigen::Map<HorizontalStripPattern> grad_sums_pattern(grad_sums);
-  Eigen::Map<NumberGradSumPattern> number_grad_sum_pattern_array(number_grad_sum_pattern);
-  uint16_t temp_offsets[16];
-  
+  float shiftable_pattern[2 * 428];
+  memset(shiftable_pattern, 0, 428 * sizeof(float));
+  uint16_t centers[16]; // relative to the pattern offset
+
   for(float width = width_slice.min; width < width_slice.max; width += width_slice.step) {
-    float pattern_width = vseg.number_pattern_length * width;
+    float pattern_width = PatternLength * width;
     uint16_t pattern_offset_max = offset_slice.max;
     uint16_t maximum_pattern_offset_max = (uint16_t)(428 - lrintf(pattern_width));
     if(pattern_offset_max == SliceU16_MAX || pattern_offset_max > maximum_pattern_offset_max) {
       pattern_offset_max = maximum_pattern_offset_max;
     }
-    for(uint16_t offset = offset_slice.min; offset < pattern_offset_max; offset += offset_slice.step) {
-      pattern.setZero();
-      uint8_t offset_index = 0;
-      bool in_bounds = true;
-      for(uint8_t pattern_index = 0; pattern_index < vseg.number_pattern_length; pattern_index++) {
-        if(vseg.number_pattern[pattern_index]) {
-          uint16_t center_of_number = (uint16_t)(offset + lrintf(pattern_index * width));
-          if(center_of_number + 19 < 428) { // shouldn't need this check, just being defensive
-            pattern.segment<19>(center_of_number) = number_grad_sum_pattern_array;
-          } else {
-            in_bounds = false;
-          }
-          temp_offsets[offset_index] = center_of_number;
-          offset_index++;
-        }
+
+    uint8_t n_centers = 0;
+    for(uint8_t pattern_index = 0; pattern_index < PatternLength; pattern_index++) {
+      if(PatternMask & (1u << pattern_index)) {
+        centers[n_centers] = (uint16_t)lrintf(pattern_index * width);
+        n_centers++;
       }
-      
-      // Not a candidate if some of the numbers fall outside the card
-      if(in_bounds) {
-        float score = (grad_sums_pattern - pattern).cwiseAbs().sum();
-        // lower scores are better -- they're errors/L1 distances
-        if(score < best.score) {
-          memcpy(&best.offsets, &temp_offsets, sizeof(temp_offsets));
-          best.score = score;
-          best.number_width = width;
-          best.pattern_offset = offset;
+    }
+
+    int in_bounds_offset_max = pattern_offset_max;
+    if(n_centers > 0) {
+      in_bounds_offset_max = MIN(in_bounds_offset_max, 428 - 19 - centers[n_centers - 1]);
+    }
+    if(in_bounds_offset_max <= offset_slice.min) {
+      continue;
+    }
+
+    memset(shiftable_pattern + 428, 0, 428 * sizeof(float));
+    for(uint8_t center_index = 0; center_index < n_centers; center_index++) {
+      memcpy(shiftable_pattern + 428 + centers[center_index], number_grad_sum_pattern, sizeof(number_grad_sum_pattern));
+    }
+
+    for(uint16_t offset = offset_slice.min; offset < in_bounds_offset_max; offset += offset_slice.step) {
+      Eigen::Map<HorizontalStripPattern> pattern(shiftable_pattern + 428 - offset);
+      float score = (grad_sums_pattern - pattern).cwiseAbs().sum();
+      // lower scores are better -- they're errors/L1 distances
+      if(score < best.score) {
+        for(uint8_t center_index = 0; center_index < n_centers; center_index++) {
+          best.offsets[center_index] = offset + centers[center_index];
         }
+        best.score = score;
+        best.number_width = width;
+        best.pattern_offset = offset;
       }
     }
   }
-  
+
   return best;
 }
 
+typedef NHorizontalSegmentation (*NHorizontalSegmentationSearch)(float *grad_sums, NHorizontalSegmentation best, SliceF32 width_slice, SliceU16 offset_slice);
+
+DMZ_INTERNAL NHorizontalSegmentationSearch best_n_hseg_constrained_for_vseg(NVerticalSegmentation vseg) {
+  switch(vseg.pattern_type) {
+    case NumberPatternVisalike:
+      assert(vseg.number_pattern_length == 19);
+      return best_n_hseg_constrained<19, kNumberPatternVisalikeMask>;
+    case NumberPatternAmexlike:
+      assert(vseg.number_pattern_length == 17);
+      return best_n_hseg_constrained<17, kNumberPatternAmexlikeMask>;
+    default:
+      assert(vseg.number_pattern_length == 0);
+      return best_n_hseg_constrained<0, 0>;
+  }
+}
 
-DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSegmentation vseg) {
-  // Gradient
-  IplImage *grad = cvCreateImage(cvSize(428, 27), IPL_DEPTH_8U, 1);
-  llcv_morph_grad3_2d_cross_u8(y_strip, grad);
+
+DMZ_INTERNAL void number_strip_gradient_release(NumberStripGradient *strip_grad) {
+  llcv_release_aligned_image(&strip_grad->grad);
+  llcv_release_aligned_image(&strip_grad->down);
+}
+
+// number_scores needs the area-averaged strip as well (for its windows' borders), so it is kept, not fused away.
+DMZ_INTERNAL void number_strip_gradient_compute(llcv_view y_strip, NumberStripGradient *strip_grad) {
+  if(strip_grad->grad == NULL) {
+    strip_grad->grad = llcv_create_aligned_image(cvSize(428, 27), IPL_DEPTH_8U, 1);
+  }
+  if(y_strip.width == 428) {
+    llcv_morph_grad3_2d_cross_u8(y_strip, llcv_view_of_image(strip_grad->grad));
+  } else {
+    assert(y_strip.width == 2 * 428);
+    if(strip_grad->down == NULL) {
+      strip_grad->down = llcv_create_aligned_image(cvSize(428, 27), IPL_DEPTH_8U, 1);
+    }
+    llcv_area_down2_u8(y_strip, llcv_view_of_image(strip_grad->down));
+    llcv_morph_grad3_2d_cross_u8(llcv_view_of_image(strip_grad->down), llcv_view_of_image(strip_grad->grad));
+  }
+}
+
+DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(llcv_view y_strip, NVerticalSegmentation vseg, NumberStripGradient *strip_grad) {
+  // Gradient (of the 2x strip area-averaged back to 428x27, so number_grad_sum_pattern still applies)
+  IplImage *grad;
+  if(strip_grad != NULL) {
+    number_strip_gradient_compute(y_strip, strip_grad);
+    grad = strip_grad->grad;
+  } else {
+    grad = cvCreateImage(cvSize(428, 27), IPL_DEPTH_8U, 1);
+    if(y_strip.width == 428) {
+      llcv_morph_grad3_2d_cross_u8(y_strip, llcv_view_of_image(grad));
+    } else {
+      assert(y_strip.width == 2 * 428);
+      llcv_area_down2_morph_grad3_2d_cross_u8(y_strip, llcv_view_of_image(grad), NULL);
+    }
+  }
   
   // Reduce (sum), normalize
   IplImage *grad_sum = cvCreateImage(cvSize(428, 1), IPL_DEPTH_32F, 1); // could sum to IPL_DEPTH_16U and then convert to 32F for normalization, doing it this way for simplicity, will probably get changed during optimization
   cvReduce(grad, grad_sum, 0 /* reduce to single row */, CV_REDUCE_SUM);
   cvNormalize(grad_sum, grad_sum, 0.0f, 1.0f, CV_MINMAX, NULL);
 
-  cvReleaseImage(&grad);
+  if(strip_grad == NULL) {
+    cvReleaseImage(&grad);
+  }
   
   NHorizontalSegmentation best;
   best.n_offsets = vseg.number_length;
@@ -104,6 +165,7 @@ DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSeg
   memset(&best.offsets, 0, 16 * sizeof(uint16_t));
   
   float *grad_sum_data = (float *)llcv_get_data_origin(grad_sum);
+  NHorizontalSegmentationSearch constrained_search = best_n_hseg_constrained_for_vseg(vseg);
   SliceF32 width_slice;
   SliceU16 offset_slice;
   
@@ -113,7 +175,7 @@ DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSeg
   offset_slice.min = 0;
   offset_slice.max = SliceU16_MAX;
   offset_slice.step = 10;
-  best = best_n_hseg_constrained(grad_sum_data, vseg, best, width_slice, offset_slice);
+  best = constrained_search(grad_sum_data, best, width_slice, offset_slice);
 
   // In the following lines, there's some bounds checking on offset_slice.min.
   // It is needed because it prevents underflow due to using uints. (The uint/int issue
@@ -128,7 +190,7 @@ DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSeg
   offset_slice.min = best.pattern_offset < 10 ? 0 : best.pattern_offset - 10;
   offset_slice.max = best.pattern_offset + 10;
   offset_slice.step = 1;
-  best = best_n_hseg_constrained(grad_sum_data, vseg, best, width_slice, offset_slice);
+  best = constrained_search(grad_sum_data, best, width_slice, offset_slice);
   
   width_slice.min = best.number_width - 0.2f;
   width_slice.max = best.number_width + 0.2f;
@@ -136,7 +198,7 @@ DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSeg
   offset_slice.min = best.pattern_offset < 3 ? 0 : best.pattern_offset - 3;
   offset_slice.max = best.pattern_offset + 3;
   offset_slice.step = 1;
-  best = best_n_hseg_constrained(grad_sum_data, vseg, best, width_slice, offset_slice);
+  best = constrained_search(grad_sum_data, best, width_slice, offset_slice);
   
   width_slice.min = best.number_width - 0.1f;
   width_slice.max = best.number_width + 0.1f;
@@ -144,7 +206,7 @@ DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSeg
   offset_slice.min = best.pattern_offset < 3 ? 0 : best.pattern_offset - 3;
   offset_slice.max = best.pattern_offset + 3;
   offset_slice.step = 1;
-  best = best_n_hseg_constrained(grad_sum_data, vseg, best, width_slice, offset_slice);
+  best = constrained_search(grad_sum_data, best, width_slice, offset_slice);
 
   cvReleaseImage(&grad_sum);
 
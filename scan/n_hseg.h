@@ -8,6 +8,7 @@
 
 #include "n_vseg.h"
 #include "opencv2/core/core_c.h" // needed for IplImage
+#include "cv/image_util.h"
 #include "dmz_macros.h"
 
 typedef struct {
@@ -18,7 +19,20 @@ typedef struct {
   uint16_t pattern_offset;
 } NHorizontalSegmentation;
 
-DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(IplImage *y_strip, NVerticalSegmentation vseg);
+// The number strip's 3x3 cross gradient, at 428x27. best_n_hseg computes it, and number_scores
+// then slices its digit windows out of it instead of recomputing each one.
+// Both images are allocated on first use, and kept until number_strip_gradient_release.
+typedef struct {
+  IplImage *grad;
+  IplImage *down; // 2x cards only: the strip area-averaged to 428x27, which grad is the gradient of
+} NumberStripGradient;
+
+DMZ_INTERNAL void number_strip_gradient_release(NumberStripGradient *strip_grad);
+
+// y_strip is the number strip at vseg.y_offset: 428x27, or 856x54 from a 2x card.
+// Offsets and widths are in 428x270 coordinates either way.
+// strip_grad may be NULL; otherwise it is left holding y_strip's gradient, for number_scores.
+DMZ_INTERNAL NHorizontalSegmentation best_n_hseg(llcv_view y_strip, NVerticalSegmentation vseg, NumberStripGradient *strip_grad);
 
 
 #endif
@@ -9,20 +9,15 @@
 #include "n_vseg.h"
 #include "eigen.h"
 #include "dmz.h"
+#include "dmz_constants.h"
 
-#include "cv/morph.h"
 #include "cv/convert.h"
+#include "processor_support.h"
 
 #include "models/generated/modelm_befe75da.hpp"
 // TODO: gpu for matrix mult?
 
 
-enum {
-  NumberPatternUnknown = 0,
-  NumberPatternVisalike = 1,
-  NumberPatternAmexlike = 2,
-};
-
 static uint8_t const NumberLengthForNumberPatternType[3] = {0, 16, 15};
 static uint8_t const NumberPatternLengthForPatternType[3] = {0, 19, 17};
 static uint8_t const NumberPatternUnknownPattern[19]  = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -31,19 +26,49 @@ static uint8_t const NumberPatternAmexlikePattern[19] = {1, 1, 1, 1, 0, 1, 1, 1,
 static uint8_t const * NumberPatternForPatternType[3] = {NumberPatternUnknownPattern, NumberPatternVisalikePattern, NumberPatternAmexlikePattern};
 
 
-typedef Eigen::Matrix<float, 1, 204, Eigen::RowMajor> VSegModelInput;
-typedef Eigen::Matrix<float, 1, 3, Eigen::RowMajor> VSegProbabilities;
-
 #define kVertSegSumWindowSize 27
 
-DMZ_INTERNAL inline VSegProbabilities vseg_probabilities_for_hstrip(IplImage *y, IplImage *cropped_gradient, IplImage *downsampled_normed, IplImage *as_float) {
-  llcv_morph_grad3_1d_u8(y, cropped_gradient);
-  llcv_lineardown2_1d_u8(cropped_gradient, downsampled_normed);
-  llcv_norm_convert_1d_u8_to_f32(downsampled_normed, as_float);
-  
-  Eigen::Map<VSegModelInput> vseg_model_input((float *)as_float->imageData);
-  VSegProbabilities probabilities = applym_befe75da(vseg_model_input);
-  return probabilities;
+// The features of the strip at y_offset (in 428x270 coordinates), its columns 10 through 417.
+// NEON builds have always taken the strip's gradient along its row alone, as has every build for a 2x card,
+// whose two rows are area-averaged into a strip of their own first. Otherwise it was cvMorphologyEx's cross
+// over a one-row roi of the card, which also reads the rows above and below and the pixel just past each
+// end of the strip; that is kept, so no build scores differently than it used to.
+DMZ_INTERNAL void vseg_features_for_y_offset(llcv_view y, uint8_t scale, uint16_t y_offset, bool along_row, float *features) {
+  if(scale == 2) {
+    uint8_t strip_1x_pixels[408];
+    llcv_view strip_1x = llcv_view_of_data(strip_1x_pixels, 408, 1, 408, sizeof(uint8_t));
+    llcv_area_down2_u8(llcv_view_rect(y, cvRect(20, 2 * y_offset, 816, 2)), strip_1x);
+    llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32(strip_1x, features);
+  } else if(along_row) {
+    llcv_morph_grad3_lineardown2_norm_1d_u8_to_f32(llcv_view_rect(y, cvRect(10, y_offset, 408, 1)), features);
+  } else {
+    const uint8_t *north = llcv_view_row(y, y_offset == 0 ? y_offset : y_offset - 1);
+    const uint8_t *center = llcv_view_row(y, y_offset);
+    const uint8_t *south = llcv_view_row(y, y_offset + 1 < y.height ? y_offset + 1 : y_offset);
+    llcv_morph_grad3_cross_lineardown2_norm_u8_to_f32(north + 9, center + 9, south + 9, 408, features);
+  }
+}
+
+// Scores the strip at each of y_offsets, filling in those offsets' scores. Each strip's features are written
+// straight into a column of the model's batched input, and the model is applied to a whole batch of strips at once.
+DMZ_INTERNAL void vseg_scores_for_y_offsets(llcv_view y, uint8_t scale, const uint16_t *y_offsets, uint16_t n_offsets,
+                                            float *visalike_scores, float *amexlike_scores) {
+  float features[204 * kModelMMaxBatch_befe75da];
+  bool along_row = dmz_has_neon_runtime();
+
+  for(uint16_t batch_start = 0; batch_start < n_offsets; batch_start += kModelMMaxBatch_befe75da) {
+    uint16_t batch_size = (uint16_t)MIN(n_offsets - batch_start, kModelMMaxBatch_befe75da);
+    for(uint16_t batch_index = 0; batch_index < batch_size; batch_index++) {
+      vseg_features_for_y_offset(y, scale, y_offsets[batch_start + batch_index], along_row, features + 204 * batch_index);
+    }
+
+    ModelMBatchOutput_befe75da probabilities = applym_batch_befe75da(ModelMBatchInputView_befe75da(features, 204, batch_size));
+    for(uint16_t batch_index = 0; batch_index < batch_size; batch_index++) {
+      uint16_t y_offset = y_offsets[batch_start + batch_index];
+      visalike_scores[y_offset] = probabilities(1, batch_index);
+      amexlike_scores[y_offset] = probabilities(2, batch_index);
+    }
+  }
 }
 
 DMZ_INTERNAL inline void best_segmentation_for_vseg_scores(float *visalike_scores, float *amexlike_scores, NVerticalSegmentation *best) {
@@ -95,15 +120,17 @@ DMZ_INTERNAL NVerticalSegmentation best_n_vseg(IplImage *y) {
   assert(y->roi == NULL);
   CvSize y_size = cvGetSize(y);
 #pragma unused(y_size) // work around broken compiler warnings
-  assert(y_size.width == kCreditCardTargetWidth);
-  assert(y_size.height == kCreditCardTargetHeight);
+  uint8_t scale = (uint8_t)(y_size.width / kCreditCardTargetWidth);
+  assert(scale == 1 || scale == 2);
+  assert(y_size.width == scale * kCreditCardTargetWidth);
+  assert(y_size.height == scale * kCreditCardTargetHeight);
   assert(y->depth == IPL_DEPTH_8U);
   assert(y->nChannels == 1);
 
-  // Set up reusable memory for image calculations
-  IplImage *cropped_gradient = cvCreateImage(cvSize(408, 1), IPL_DEPTH_8U, 1);
-  IplImage *downsampled_normed = cvCreateImage(cvSize(204, 1), IPL_DEPTH_8U, 1);
-  IplImage *as_float = cvCreateImage(cvSize(204, 1), IPL_DEPTH_32F, 1);
+  // y itself is only ever looked at through views
+  llcv_view y_view = llcv_view_of_image(y);
+  uint16_t y_offsets[270];
+  uint16_t n_offsets;
 
   // Score buffers, to be filled in as needed
   float visalike_scores[270];
@@ -117,12 +144,11 @@ DMZ_INTERNAL NVerticalSegmentation best_n_vseg(IplImage *y) {
   uint8_t y_offset_step = 4;
 
   // Initially, calculate every fourth score, to narrow down the area in which we have to work
+  n_offsets = 0;
   for(uint16_t y_offset = min_y_offset; y_offset < max_y_offset; y_offset += y_offset_step) {
-    cvSetImageROI(y, cvRect(10, y_offset, 408, 1));
-    VSegProbabilities probabilities = vseg_probabilities_for_hstrip(y, cropped_gradient, downsampled_normed, as_float);
-    visalike_scores[y_offset] = probabilities(0, 1);
-    amexlike_scores[y_offset] = probabilities(0, 2);
+    y_offsets[n_offsets++] = y_offset;
   }
+  vseg_scores_for_y_offsets(y_view, scale, y_offsets, n_offsets, visalike_scores, amexlike_scores);
 
   NVerticalSegmentation best;
   best_segmentation_for_vseg_scores(visalike_scores, amexlike_scores, &best);
@@ -141,25 +167,18 @@ DMZ_INTERNAL NVerticalSegmentation best_n_vseg(IplImage *y) {
   max_y_offset = MIN(270, best.y_offset + kVertSegSumWindowSize + kFineTuningBuffer);
   y_offset_step = 1;
 
+  n_offsets = 0;
   for(uint16_t y_offset = min_y_offset; y_offset < max_y_offset; y_offset += y_offset_step) {
     // Don't recalculate anything -- we already calculated 1/4th of them!
     if(visalike_scores[y_offset] == 0 && amexlike_scores[y_offset] == 0) {
-      cvSetImageROI(y, cvRect(10, y_offset, 408, 1));
-      VSegProbabilities probabilities = vseg_probabilities_for_hstrip(y, cropped_gradient, downsampled_normed, as_float);
-      visalike_scores[y_offset] = probabilities(0, 1);
-      amexlike_scores[y_offset] = probabilities(0, 2);
+      y_offsets[n_offsets++] = y_offset;
     }
   }
+  vseg_scores_for_y_offsets(y_view, scale, y_offsets, n_offsets, visalike_scores, amexlike_scores);
 
   // TODO: Hint that resumming across all the possible values isn't really necessary...
   best_segmentation_for_vseg_scores(visalike_scores, amexlike_scores, &best);
 
-  cvReleaseImage(&cropped_gradient);
-  cvReleaseImage(&downsampled_normed);
-  cvReleaseImage(&as_float);
-
-  cvResetImageROI(y);
-
   best.number_pattern_length = NumberPatternLengthForPatternType[best.pattern_type];
   memcpy(&best.number_pattern, NumberPatternForPatternType[best.pattern_type], sizeof(best.number_pattern));
   best.number_length = NumberLengthForNumberPatternType[best.pattern_type];
@@ -11,6 +11,17 @@
 
 typedef uint8_t NumberPatternType;
 
+enum {
+  NumberPatternUnknown = 0,
+  NumberPatternVisalike = 1,
+  NumberPatternAmexlike = 2,
+};
+
+// Where each pattern's digits are, as bits (bit i set: a digit at pattern_index i), for code specialized per pattern.
+// Must match the patterns in n_vseg.cpp.
+#define kNumberPatternVisalikeMask 0x7bdef // 1111 1111 1111 1111, 19 long
+#define kNumberPatternAmexlikeMask 0x1f7ef // 1111 111111 11111, 17 long
+
 typedef struct {
   float score;
   uint16_t y_offset;
@@ -21,7 +32,8 @@ typedef struct {
 } NVerticalSegmentation;
 
 // Calculate the best number vertical segmentation for the card image y.
-// y must be 428x270, single channel, uint8_t, with no ROI set.
+// y must be 428x270 (or 856x540, a 2x card), single channel, uint8_t, with no ROI set.
+// y_offset is in 428x270 coordinates either way.
 DMZ_INTERNAL NVerticalSegmentation best_n_vseg(IplImage *y);
 
 
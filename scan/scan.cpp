@@ -9,22 +9,31 @@
 #include "scan.h"
 #include "expiry_categorize.h"
 #include "expiry_seg.h"
+#include "cv/image_util.h"
+#include "dmz_profile.h"
 
 #define SCAN_FOREVER 0  // useful for performance profiling
 #define EXTRA_TIME_FOR_EXPIRY_IN_MICROSECONDS 1000 // once the card number has been successfully identified, allow a bit more time to figure out the expiry
 
-#define kDecayFactor 0.8f
 #define kMinStability 0.7f
 
 void scanner_initialize(ScannerState *state) {
+  state->card_y = NULL; // allocated on first use by dmz_transform_card_y
+  state->expiry_y = NULL; // allocated on first use by a 2x card that needs expiry
+  state->number_strip_grad.grad = NULL; // allocated on first use by best_n_hseg
+  state->number_strip_grad.down = NULL;
+  memset(&state->expiry_scratch, 0, sizeof(state->expiry_scratch)); // each image allocated on first use by the expiry scan
+  memset(&state->profile, 0, sizeof(state->profile));
+  state->aggregated15.window = 0;
+  state->aggregated15.recent = NULL;
+  state->aggregated16.window = 0;
+  state->aggregated16.recent = NULL;
   scanner_reset(state);
 }
 
 void scanner_reset(ScannerState *state) {
-  state->count15 = 0;
-  state->count16 = 0;
-  state->aggregated15 = NumberScores::Zero();
-  state->aggregated16 = NumberScores::Zero();
+  number_aggregate_reset(&state->aggregated15);
+  number_aggregate_reset(&state->aggregated16);
   scan_analytics_init(&state->session_analytics);
   state->timeOfCardNumberCompletionInMilliseconds = 0;
   state->scan_expiry = false;
@@ -34,6 +43,11 @@ void scanner_reset(ScannerState *state) {
   state->name_groups.clear();
 }
 
+void scanner_set_number_window(ScannerState *state, uint8_t n_frames) {
+  number_aggregate_set_window(&state->aggregated15, n_frames);
+  number_aggregate_set_window(&state->aggregated16, n_frames);
+}
+
 void scanner_add_frame(ScannerState *state, IplImage *y, FrameScanResult *result) {
   scanner_add_frame_with_expiry(state, y, false, result);
 }
@@ -45,12 +59,20 @@ void scanner_add_frame_with_expiry(ScannerState *state, IplImage *y, bool scan_e
 
   // Don't bother with a bunch of assertions about y here,
   // since the frame reader will make them anyway.
-  scan_card_image(y, still_need_to_collect_card_number, still_need_to_scan_expiry, result);
+  IplImage *expiry_y = y;
+  if (y->width != kCreditCardTargetWidth) {
+    if (still_need_to_scan_expiry && state->expiry_y == NULL) {
+      state->expiry_y = llcv_create_aligned_image(cvSize(kCreditCardTargetWidth, kCreditCardTargetHeight), IPL_DEPTH_8U, 1);
+    }
+    expiry_y = state->expiry_y;
+  }
+
+  dmz_profile_begin_frame(&state->profile);
+  scan_card_image(y, still_need_to_collect_card_number, still_need_to_scan_expiry, expiry_y, &state->number_strip_grad, &state->expiry_scratch, result, &state->profile);
+  ScanFrameAnalytics *frame_analytics = scan_analytics_record_frame(&state->session_analytics, result, &state->profile);
   if (result->upside_down) {
     return;
   }
- 
-  scan_analytics_record_frame(&state->session_analytics, result);
 
   // TODO: Scene change detection?
   
@@ -61,7 +83,10 @@ void scanner_add_frame_with_expiry(ScannerState *state, IplImage *y, bool scan_e
 #if SCAN_EXPIRY
   if (still_need_to_scan_expiry) {
     state->scan_expiry = true;
-    expiry_extract(y, state->expiry_groups, result->expiry_groups, &state->expiry_month, &state->expiry_year);
+    uint64_t start = dmz_profile_start(&state->profile);
+    expiry_extract(expiry_y, state->expiry_groups, result->expiry_groups, &state->expiry_month, &state->expiry_year, &state->expiry_scratch);
+    dmz_profile_end(&state->profile, DMZStageExpiryCategorize, start);
+    frame_analytics->stage_microseconds[DMZStageExpiryCategorize] = state->profile.frame_microseconds[DMZStageExpiryCategorize];
     state->name_groups = result->name_groups;  // for now, for the debugging display
   }
 #endif
@@ -72,19 +97,57 @@ void scanner_add_frame_with_expiry(ScannerState *state, IplImage *y, bool scan_e
     state->mostRecentUsableVSeg = result->vseg;
     
     if(result->hseg.n_offsets == 15) {
-      state->aggregated15 *= kDecayFactor;
-      state->aggregated15 += result->scores * (1 - kDecayFactor);
-      state->count15++;
+      number_aggregate_add(&state->aggregated15, result->scores);
     } else if(result->hseg.n_offsets == 16) {
-      state->aggregated16 *= kDecayFactor;
-      state->aggregated16 += result->scores * (1 - kDecayFactor);
-      state->count16++;
+      number_aggregate_add(&state->aggregated16, result->scores);
     } else {
       assert(false);
     }
   }
 }
 
+bool scanner_replay_entry(ScannerState *state, const dmz_recording_entry *entry, FrameScanResult *result) {
+  if(entry->type == DMZRecordingScannerReset) {
+    scanner_reset(state);
+    return false;
+  }
+  if(entry->type != DMZRecordingScannerInput) {
+    return false;
+  }
+  const dmz_scanner_input *input = &entry->scanner_input;
+  result->focus_score = input->focus_score;
+  result->brightness_score = input->brightness_score;
+  result->flipped = input->flipped;
+  result->iso_speed = input->iso_speed;
+  result->shutter_speed = input->shutter_speed;
+  result->torch_is_on = input->torch_is_on;
+  scanner_add_frame_with_expiry(state, entry->card_y, input->scan_expiry, result);
+  return true;
+}
+
+float scanner_convergence(ScannerState *state) {
+  if (state->timeOfCardNumberCompletionInMilliseconds > 0) {
+    return 1.0f;
+  }
+  uint16_t count15 = state->aggregated15.count;
+  uint16_t count16 = state->aggregated16.count;
+  uint16_t max_count = MAX(count15, count16);
+  uint16_t min_count = MIN(count15, count16);
+  if (max_count == 0) {
+    return 0.0f;
+  }
+
+  // The same tests as scanner_result, as fractions of the way to passing
+  float lead_progress = MIN(1.0f, (max_count - min_count) / 3.0f);
+  const NumberAggregate *aggregated = count15 > count16 ? &state->aggregated15 : &state->aggregated16;
+  uint8_t n_numbers = count15 > count16 ? 15 : 16;
+  float stability_progress = 1.0f;
+  for (uint8_t i = 0; i < n_numbers; i++) {
+    stability_progress = MIN(stability_progress, number_aggregate_stability(aggregated, i) / kMinStability);
+  }
+  return MIN(lead_progress, stability_progress);
+}
+
 void scanner_result(ScannerState *state, ScannerResult *result) {
   result->complete = false; // until we change our minds otherwise...avoids having to set this at all the possible early exits
 
@@ -96,8 +159,10 @@ void scanner_result(ScannerState *state, ScannerResult *result) {
     *result = state->successfulCardNumberResult;
   }
   else {
-    uint16_t max_count = MAX(state->count15, state->count16);
-    uint16_t min_count = MIN(state->count15, state->count16);
+    uint16_t count15 = state->aggregated15.count;
+    uint16_t count16 = state->aggregated16.count;
+    uint16_t max_count = MAX(count15, count16);
+    uint16_t min_count = MIN(count15, count16);
 
     // We want a three frame lead at a bare minimum.
     // Also guarantees we have at least three frames, period. :)
@@ -115,13 +180,13 @@ void scanner_result(ScannerState *state, ScannerResult *result) {
 
     // TODO: Sanity check the scores distributions
     // TODO: Do something else sophisticated here -- look at confidences, distributions, stability, hysteresis, etc.
-    NumberScores aggregated;
-    if(state->count15 > state->count16) {
+    const NumberAggregate *aggregated;
+    if(count15 > count16) {
       result->n_numbers = 15;
-      aggregated = state->aggregated15;
+      aggregated = &state->aggregated15;
     } else {
       result->n_numbers = 16;
-      aggregated = state->aggregated16;
+      aggregated = &state->aggregated16;
     }
 
     // Calculate result predictions
@@ -130,12 +195,10 @@ void scanner_result(ScannerState *state, ScannerResult *result) {
 
     dmz_debug_print("Stability: ");
     for(uint8_t i = 0; i < result->n_numbers; i++) {
-      NumberScores::Index r, c;
-      float max_score = aggregated.row(i).maxCoeff(&r, &c);
-      float sum = aggregated.row(i).sum();
-      result->predictions(i, 0) = c;
-      number_as_u8s[i] = (uint8_t)c;
-      float stability = max_score / sum;
+      uint8_t best_digit = aggregated->best_digit[i];
+      result->predictions(i, 0) = best_digit;
+      number_as_u8s[i] = best_digit;
+      float stability = aggregated->max_score[i] / aggregated->score_sum[i];
       dmz_debug_print("%d ", (int) ceilf(stability * 100));
 
       // Bail early if low stability
@@ -194,7 +257,14 @@ void scanner_result(ScannerState *state, ScannerResult *result) {
 }
 
 void scanner_destroy(ScannerState *state) {
-  // currently a no-op
+  llcv_release_aligned_image(&state->card_y);
+  llcv_release_aligned_image(&state->expiry_y);
+  number_strip_gradient_release(&state->number_strip_grad);
+  number_aggregate_release(&state->aggregated15);
+  number_aggregate_release(&state->aggregated16);
+#if SCAN_EXPIRY
+  expiry_scratch_release(&state->expiry_scratch);
+#endif
 }
 
 
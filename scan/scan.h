@@ -7,6 +7,7 @@
 #define DMZ_SCAN_SCAN_H
 
 #include "frame.h"
+#include "n_aggregate.h"
 #include "dmz_macros.h"
 #include "scan_analytics.h"
 #include "expiry_seg.h"
@@ -31,10 +32,8 @@ typedef struct {
 } ScannerResult;
 
 typedef struct ScannerState {
-  uint16_t count15;
-  uint16_t count16;
-  NumberScores aggregated15;
-  NumberScores aggregated16;
+  NumberAggregate aggregated15; // frames whose hseg found 15 digits
+  NumberAggregate aggregated16;
   ScanSessionAnalytics session_analytics;
   ScannerResult successfulCardNumberResult;
   NHorizontalSegmentation mostRecentUsableHSeg;
@@ -45,18 +44,33 @@ typedef struct ScannerState {
   int expiry_year;
   GroupedRectsList expiry_groups;
   GroupedRectsList name_groups;
+  IplImage *card_y; // scanner-owned rectified Y plane, filled in by dmz_transform_card_y (or _2x)
+  IplImage *expiry_y; // 2x cards only: 428x270, the part below the number downsampled for expiry
+  NumberStripGradient number_strip_grad; // scanner-owned, shared by best_n_hseg and number_scores each frame
+  ExpiryScratch expiry_scratch; // scanner-owned working images for best_expiry_seg and expiry_extract
+  dmz_corner_points card_corner_points; // where card_y came from, for dmz_card_color_image
+  FrameOrientation card_orientation;
+  dmz_profile profile; // per-stage timing; survives scanner_reset. See dmz_profile_set_enabled.
 } ScannerState;
 
 // Initialize a scanner.
 void scanner_initialize(ScannerState *state);
 
-// Reset a scanner. Called by initialize.
+// Reset a scanner. Called by initialize. Keeps card_y, expiry_y, number_strip_grad and expiry_scratch, which live until scanner_destroy,
+// and the number window.
 void scanner_reset(ScannerState *state);
 
+// How each frame's digit scores are combined. 0 (the default): exponentially decaying, so recent frames count
+// for the most. Otherwise: summed over the last n_frames (at most kNumberAggregateMaxWindow) frames, equally.
+// Resets the number scores gathered so far. The window's frames (640 bytes each, per number length) are
+// allocated here, not in ScannerState, and freed by scanner_destroy.
+void scanner_set_number_window(ScannerState *state, uint8_t n_frames);
+
 // Provide the scanner with a single card image.
 //
 // Notes:
-// - y must be 428x270, uint8_t, no roi, single channel greyscale.
+// - y must be 428x270, uint8_t, no roi, single channel greyscale. It may instead be
+//   856x540 (see dmz_transform_card_y_2x); results are still in 428x270 coordinates.
 // - the FrameScanResult struct should be pre-populated with
 //   values for 'flipped' and 'focusScore'
 // - if the card appears to be upside down, result->upside_down
@@ -64,6 +78,16 @@ void scanner_reset(ScannerState *state);
 void scanner_add_frame(ScannerState *state, IplImage *y, FrameScanResult *result); // pre-expiry backward-compatible version
 void scanner_add_frame_with_expiry(ScannerState *state, IplImage *y, bool scan_expiry, FrameScanResult *result);
 
+// Feed a recorded entry (see dmz_recording_open) to the scanner, exactly as it was originally given.
+// DMZRecordingScannerInput entries are scanned into result; DMZRecordingScannerReset entries reset the scanner;
+// anything else is ignored. Returns whether result was filled in.
+bool scanner_replay_entry(ScannerState *state, const dmz_recording_entry *entry, FrameScanResult *result);
+
+// How close the scanner is to a complete number, from 0 to 1: the lesser of how far the 15 and 16 digit frame counts
+// are towards the lead scanner_result requires, and how far the least stable digit is towards kMinStability.
+// 1 once the number is complete.
+float scanner_convergence(ScannerState *state);
+
 // Ask the scanner for its number predictions.
 // If result.complete is false, the rest of the result must be ignored.
 void scanner_result(ScannerState *state, ScannerResult *result);
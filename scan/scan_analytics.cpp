@@ -6,6 +6,7 @@
 #include "scan_analytics.h"
 #include "mz.h"
 #include "dmz_debug.h"
+#include <string.h>
 #include <time.h>
 
 
@@ -13,9 +14,32 @@
 
 // Record relevant fields from FrameScanResult struct into
 // ScanFrameAnalytics struct.
-void scan_frame_analytics_record(ScanFrameAnalytics *f, FrameScanResult *frame) {
-  // Add lines of this form, to capture any relevant fields from `frame`:
-  // f->frame_values["foo"] = std::to_string(frame->foo);
+void scan_frame_analytics_record(ScanFrameAnalytics *f, FrameScanResult *frame, const dmz_profile *profile) {
+  memset(f, 0, sizeof(*f));
+  f->focus_score = frame->focus_score;
+  f->brightness_score = frame->brightness_score;
+  f->shutter_speed = frame->shutter_speed;
+  f->iso_speed = frame->iso_speed;
+  f->vseg_score = frame->vseg.score;
+  f->vseg_y_offset = frame->vseg.y_offset;
+
+  f->flags = (frame->usable ? ScanFrameFlagUsable : 0) |
+             (frame->upside_down ? ScanFrameFlagUpsideDown : 0) |
+             (frame->flipped ? ScanFrameFlagFlipped : 0) |
+             (frame->torch_is_on ? ScanFrameFlagTorchOn : 0);
+
+  // scan_card_image leaves n_offsets at 0 unless it got as far as the hseg
+  if (frame->hseg.n_offsets > 0) {
+    f->flags |= ScanFrameFlagNumberScanned;
+    f->hseg_score = frame->hseg.score;
+    f->hseg_number_width = frame->hseg.number_width;
+    f->hseg_n_offsets = frame->hseg.n_offsets;
+    f->number_score_delta = frame->hseg.n_offsets - frame->scores.sum();
+  }
+
+  if (profile != NULL) {
+    memcpy(f->stage_microseconds, profile->frame_microseconds, sizeof(f->stage_microseconds));
+  }
 }
 
 
@@ -31,24 +55,29 @@ void scan_analytics_init(ScanSessionAnalytics *session) {
 // Given a FrameScanResult frame, records to the session as a ScanFrameAnalytics
 // If the provided frame is NULL, returns NULL.
 // Returns pointer to the recorded ScanFrameAnalytics struct.
-ScanFrameAnalytics *scan_analytics_record_frame(ScanSessionAnalytics *session, FrameScanResult *frame) {
+ScanFrameAnalytics *scan_analytics_record_frame(ScanSessionAnalytics *session, FrameScanResult *frame, const dmz_profile *profile) {
 
   // Get pointer to current frame analytics struct
   int index = session->num_frames_scanned % kScanSessionNumFramesStored;
   ScanFrameAnalytics *f = &(session->frames_ring[index]);
 
-  // Once we start to overflow, move the frames_ring_start up one.
-  if (session->num_frames_scanned > kScanSessionNumFramesStored) {
-    session->frames_ring_start = (session->num_frames_scanned + 1) % kScanSessionNumFramesStored;
-  }
-  
   // Copy frame info into ScanFrameAnalytics struct and record its absolute session index
-  scan_frame_analytics_record(f, frame);
+  scan_frame_analytics_record(f, frame, profile);
   f->frame_index = session->num_frames_scanned;
 
   // Increment total number of frames scanned
   session->num_frames_scanned += 1;
+
+  // Once we start to overflow, the oldest frame is the one after the one just written.
+  if (session->num_frames_scanned > kScanSessionNumFramesStored) {
+    session->frames_ring_start = session->num_frames_scanned % kScanSessionNumFramesStored;
+  }
   
   // Return pointer to this ScanFrameAnalytics struct
   return f;
 }
+
+uint8_t scan_analytics_frames(const ScanSessionAnalytics *session, const ScanFrameAnalytics **frames) {
+  *frames = session->frames_ring;
+  return (uint8_t)MIN(session->num_frames_scanned, (uint32_t)kScanSessionNumFramesStored);
+}
@@ -9,7 +9,6 @@
 #include "dmz.h"
 #include "frame.h"
 #include <sys/time.h>
-#include <map>
 
 #define kScanSessionNumFramesStored 20
 
@@ -18,22 +17,51 @@
 #define kNumLastDigitChoices 4
 #define kNumTotalDigitChoices (kNumLastDigitChoices + kNumFirstDigitChoices)
 
-// Info about a single frame
+// Bump when the layout of ScanFrameAnalytics changes, so that exported records can be decoded.
+#define kScanFrameAnalyticsVersion 1
+
+typedef uint8_t ScanFrameFlags;
+enum {
+  ScanFrameFlagUsable = 1 << 0,
+  ScanFrameFlagUpsideDown = 1 << 1,
+  ScanFrameFlagFlipped = 1 << 2,
+  ScanFrameFlagTorchOn = 1 << 3,
+  ScanFrameFlagNumberScanned = 1 << 4, // hseg and number categorization ran; their fields are valid
+};
+
+// Info about a single frame. Fixed layout with no pointers, so the ring can be exported as raw bytes.
 typedef struct {
   uint32_t frame_index; // Index of this frame out of all scanned frames in this session
-  std::map<std::string, std::string> frame_values; // E.g., frame_values["foo_score"] == "43.1"
+  float focus_score;
+  float brightness_score;
+  float shutter_speed;
+  float vseg_score;
+  float hseg_score;
+  float hseg_number_width;
+  float number_score_delta; // hseg offsets minus the summed number scores; lower is more confident
+  uint32_t stage_microseconds[DMZNumStages]; // scan stages only, and only when ScannerState's profile is enabled
+  uint16_t vseg_y_offset;
+  uint16_t iso_speed;
+  uint8_t hseg_n_offsets;
+  ScanFrameFlags flags;
+  uint8_t reserved[2];
 } ScanFrameAnalytics;
 
 // Info about a scan session
 typedef struct {
   uint32_t num_frames_scanned;
-  uint8_t frames_ring_start;
+  uint8_t frames_ring_start; // index of the oldest frame in frames_ring
   ScanFrameAnalytics frames_ring[kScanSessionNumFramesStored];
 } ScanSessionAnalytics;
 
 // Reset a ScanSessionAnalytics, whether new or re-used
 void scan_analytics_init(ScanSessionAnalytics *session);
 
-ScanFrameAnalytics *scan_analytics_record_frame(ScanSessionAnalytics *session, FrameScanResult *frame);
+// Copies the frame's fields (and profile's frame_microseconds, if profile is not NULL) into the next ring slot.
+ScanFrameAnalytics *scan_analytics_record_frame(ScanSessionAnalytics *session, FrameScanResult *frame, const dmz_profile *profile);
+
+// Zero-copy export: sets *frames to the ring itself and returns how many slots are filled.
+// The oldest frame is at (*frames)[session->frames_ring_start]; later ones follow, wrapping around.
+uint8_t scan_analytics_frames(const ScanSessionAnalytics *session, const ScanFrameAnalytics **frames);
 
 #endif
@@ -0,0 +1,464 @@
+//
+//  scan_service.cpp
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#include "compile.h"
+#if COMPILE_DMZ
+
+#include "scan_service.h"
+
+#if CYTHON_DMZ
+
+#include "dmz_profile.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+
+// A worker scans this many frames of a session before putting it back on the end of its
+// queue, so that one long session can't hold up the others (or keep them from being stolen).
+#define kFramesPerTurn 4
+
+typedef struct {
+  uint64_t added_microseconds;
+  FrameOrientation orientation;
+  int width; // of the Y plane; chroma is half that each way
+  int height;
+  uint8_t *data; // Y, Cb, Cr, rows packed; allocated along with the frame
+} ScanServiceFrame;
+
+struct ScanServiceSession {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  ScanService *service;
+  pthread_mutex_t mutex; // guards frames, scheduled, closed and done
+  pthread_cond_t done_condition;
+  std::deque<ScanServiceFrame *> frames;
+  bool scheduled; // in a worker's queue, or being scanned; true whenever frames is non-empty
+  bool closed;
+  bool done;
+
+  // Only touched by whichever thread holds the session while it is scheduled (or finishes it).
+  uint64_t opened_microseconds;
+  dmz_context *dmz;
+  ScannerState state;
+  ScannerResult result;
+  bool have_result;
+};
+
+typedef struct {
+  ScanService *service;
+  int index;
+  pthread_t thread;
+  pthread_mutex_t mutex; // guards queue and the stats below
+  std::deque<ScanServiceSession *> queue; // the owner takes from the front, thieves from the back
+  uint64_t frames_scanned;
+  uint64_t frames_skipped;
+  uint64_t steals;
+  uint64_t last_scanned_microseconds;
+  dmz_stage_profile frame_latency;
+  dmz_stage_profile frame_scan;
+} ScanServiceWorker;
+
+struct ScanService {
+  ScanServiceConfig config;
+  int n_workers;
+  ScanServiceWorker *workers;
+  volatile int queued_sessions; // across all workers' queues; only updated atomically
+  volatile uint32_t next_worker; // round-robin target for newly scheduled sessions
+  volatile uint64_t first_frame_microseconds;
+
+  pthread_mutex_t mutex; // guards everything below
+  pthread_cond_t work_available;
+  bool stopping;
+  uint32_t sessions_completed;
+  dmz_stage_profile session_latency;
+};
+
+#pragma mark scheduling
+
+DMZ_INTERNAL void scan_service_enqueue(ScanServiceWorker *worker, ScanServiceSession *session) {
+  ScanService *service = worker->service;
+  pthread_mutex_lock(&worker->mutex);
+  worker->queue.push_back(session);
+  __sync_fetch_and_add(&service->queued_sessions, 1);
+  pthread_mutex_unlock(&worker->mutex);
+
+  // Taking the mutex here means a worker can't miss this between checking queued_sessions and waiting.
+  pthread_mutex_lock(&service->mutex);
+  pthread_cond_signal(&service->work_available);
+  pthread_mutex_unlock(&service->mutex);
+}
+
+DMZ_INTERNAL void scan_service_schedule(ScanService *service, ScanServiceSession *session) {
+  uint32_t worker_index = __sync_fetch_and_add(&service->next_worker, 1) % service->n_workers;
+  scan_service_enqueue(&service->workers[worker_index], session);
+}
+
+// Own queue first; failing that, steal the most recently queued session of another worker.
+DMZ_INTERNAL ScanServiceSession *scan_service_take(ScanServiceWorker *worker) {
+  ScanService *service = worker->service;
+  ScanServiceSession *session = NULL;
+
+  pthread_mutex_lock(&worker->mutex);
+  if(!worker->queue.empty()) {
+    session = worker->queue.front();
+    worker->queue.pop_front();
+    __sync_fetch_and_sub(&service->queued_sessions, 1);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+
+  for(int offset = 1; session == NULL && offset < service->n_workers && service->queued_sessions > 0; offset++) {
+    ScanServiceWorker *victim = &service->workers[(worker->index + offset) % service->n_workers];
+    pthread_mutex_lock(&victim->mutex);
+    if(!victim->queue.empty()) {
+      session = victim->queue.back();
+      victim->queue.pop_back();
+      __sync_fetch_and_sub(&service->queued_sessions, 1);
+    }
+    pthread_mutex_unlock(&victim->mutex);
+    if(session != NULL) {
+      pthread_mutex_lock(&worker->mutex);
+      worker->steals++;
+      pthread_mutex_unlock(&worker->mutex);
+    }
+  }
+  return session;
+}
+
+#pragma mark scanning
+
+DMZ_INTERNAL void scan_service_finish_session(ScanServiceSession *session) {
+  ScanService *service = session->service;
+  if(session->have_result) {
+    scanner_result(&session->state, &session->result); // pick up any expiry found since the number completed
+  }
+  scanner_destroy(&session->state);
+  dmz_context_destroy(session->dmz);
+  session->dmz = NULL;
+
+  pthread_mutex_lock(&service->mutex);
+  service->sessions_completed++;
+  dmz_stage_profile_record(&service->session_latency, dmz_monotonic_microseconds() - session->opened_microseconds);
+  pthread_mutex_unlock(&service->mutex);
+
+  pthread_mutex_lock(&session->mutex);
+  session->done = true;
+  pthread_cond_broadcast(&session->done_condition);
+  pthread_mutex_unlock(&session->mutex);
+}
+
+DMZ_INTERNAL IplImage *scan_service_plane(IplImage *header, uint8_t *data, int width, int height) {
+  cvInitImageHeader(header, cvSize(width, height), IPL_DEPTH_8U, 1);
+  cvSetData(header, data, width);
+  return header;
+}
+
+// Returns whether the frame was actually scanned (as opposed to skipped).
+DMZ_INTERNAL bool scan_service_scan_frame(ScanServiceSession *session, ScanServiceFrame *frame) {
+  const ScanServiceConfig *config = &session->service->config;
+  if(config->stop_at_result && session->have_result) {
+    return false;
+  }
+
+  int chroma_width = frame->width / 2;
+  int chroma_height = frame->height / 2;
+  IplImage y_header, cb_header, cr_header;
+  IplImage *y = scan_service_plane(&y_header, frame->data, frame->width, frame->height);
+  IplImage *cb = scan_service_plane(&cb_header, frame->data + frame->width * frame->height, chroma_width, chroma_height);
+  IplImage *cr = scan_service_plane(&cr_header, frame->data + frame->width * frame->height + chroma_width * chroma_height, chroma_width, chroma_height);
+
+  dmz_edges found_edges;
+  dmz_corner_points corner_points;
+  if(!dmz_detect_edges_with_pregate(session->dmz, y, cb, cr, frame->orientation, &found_edges, &corner_points, NULL)) {
+    return true;
+  }
+  IplImage *card_y = dmz_transform_card_y(session->dmz, &session->state, y, corner_points, frame->orientation);
+
+  FrameScanResult frame_result; // the rest is filled in by the scanner
+  frame_result.focus_score = dmz_focus_score(y, false);
+  frame_result.brightness_score = dmz_brightness_score(y, false);
+  frame_result.flipped = false;
+  frame_result.iso_speed = 0;
+  frame_result.shutter_speed = 0.0f;
+  frame_result.torch_is_on = false;
+  scanner_add_frame_with_expiry(&session->state, card_y, config->scan_expiry, &frame_result);
+
+  if(!session->have_result) {
+    scanner_result(&session->state, &session->result);
+    session->have_result = session->result.complete;
+  }
+  return true;
+}
+
+// Scans up to kFramesPerTurn of the session's frames, in order, then requeues it or lets it go.
+DMZ_INTERNAL void scan_service_run_session(ScanServiceWorker *worker, ScanServiceSession *session) {
+  for(int n_frames = 0; ; n_frames++) {
+    pthread_mutex_lock(&session->mutex);
+    if(session->frames.empty()) {
+      session->scheduled = false;
+      bool finish = session->closed;
+      pthread_mutex_unlock(&session->mutex);
+      if(finish) {
+        scan_service_finish_session(session);
+      }
+      return;
+    }
+    if(n_frames == kFramesPerTurn) {
+      pthread_mutex_unlock(&session->mutex);
+      scan_service_enqueue(worker, session); // still scheduled
+      return;
+    }
+    ScanServiceFrame *frame = session->frames.front();
+    session->frames.pop_front();
+    pthread_mutex_unlock(&session->mutex);
+
+    uint64_t start = dmz_monotonic_microseconds();
+    bool scanned = scan_service_scan_frame(session, frame);
+    uint64_t end = dmz_monotonic_microseconds();
+
+    pthread_mutex_lock(&worker->mutex);
+    if(scanned) {
+      worker->frames_scanned++;
+      dmz_stage_profile_record(&worker->frame_scan, end - start);
+      dmz_stage_profile_record(&worker->frame_latency, end - frame->added_microseconds);
+      worker->last_scanned_microseconds = MAX(worker->last_scanned_microseconds, end);
+    } else {
+      worker->frames_skipped++;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    free(frame);
+  }
+}
+
+DMZ_INTERNAL void *scan_service_worker_run(void *arg) {
+  ScanServiceWorker *worker = (ScanServiceWorker *)arg;
+  ScanService *service = worker->service;
+  while(true) {
+    ScanServiceSession *session = scan_service_take(worker);
+    if(session != NULL) {
+      scan_service_run_session(worker, session);
+      continue;
+    }
+
+    pthread_mutex_lock(&service->mutex);
+    while(service->queued_sessions == 0 && !service->stopping) {
+      pthread_cond_wait(&service->work_available, &service->mutex);
+    }
+    bool stop = service->stopping && service->queued_sessions == 0;
+    pthread_mutex_unlock(&service->mutex);
+    if(stop) {
+      return NULL;
+    }
+  }
+}
+
+#pragma mark service
+
+void scan_service_default_config(ScanServiceConfig *config) {
+  config->n_threads = 0;
+  config->scan_expiry = false;
+  config->pregate = false;
+  config->stop_at_result = true;
+  config->number_window = 0;
+}
+
+ScanService *scan_service_create(const ScanServiceConfig *config) {
+  ScanService *service = new ScanService;
+  service->config = *config;
+  service->n_workers = config->n_threads;
+  if(service->n_workers <= 0) {
+    service->n_workers = MAX(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  service->workers = new ScanServiceWorker[service->n_workers];
+  service->queued_sessions = 0;
+  service->next_worker = 0;
+  service->first_frame_microseconds = 0;
+  service->stopping = false;
+  service->sessions_completed = 0;
+  memset(&service->session_latency, 0, sizeof(dmz_stage_profile));
+  pthread_mutex_init(&service->mutex, NULL);
+  pthread_cond_init(&service->work_available, NULL);
+
+  int n_started = 0;
+  for(int i = 0; i < service->n_workers; i++) {
+    ScanServiceWorker *worker = &service->workers[i];
+    worker->service = service;
+    worker->index = i;
+    worker->frames_scanned = 0;
+    worker->frames_skipped = 0;
+    worker->steals = 0;
+    worker->last_scanned_microseconds = 0;
+    memset(&worker->frame_latency, 0, sizeof(dmz_stage_profile));
+    memset(&worker->frame_scan, 0, sizeof(dmz_stage_profile));
+    pthread_mutex_init(&worker->mutex, NULL);
+  }
+  for(int i = 0; i < service->n_workers; i++) {
+    if(0 == pthread_create(&service->workers[i].thread, NULL, scan_service_worker_run, &service->workers[i])) {
+      n_started++;
+    } else {
+      break;
+    }
+  }
+  if(n_started < service->n_workers) {
+    // Sessions are scheduled across every worker, so run with all of them or none.
+    dmz_debug_log("scan service started only %i of %i workers", n_started, service->n_workers);
+    service->n_workers = n_started;
+    scan_service_destroy(service);
+    return NULL;
+  }
+  return service;
+}
+
+void scan_service_destroy(ScanService *service) {
+  pthread_mutex_lock(&service->mutex);
+  service->stopping = true;
+  pthread_cond_broadcast(&service->work_available);
+  pthread_mutex_unlock(&service->mutex);
+
+  for(int i = 0; i < service->n_workers; i++) {
+    pthread_join(service->workers[i].thread, NULL);
+  }
+  for(int i = 0; i < service->n_workers; i++) {
+    pthread_mutex_destroy(&service->workers[i].mutex);
+  }
+  pthread_cond_destroy(&service->work_available);
+  pthread_mutex_destroy(&service->mutex);
+  delete [] service->workers;
+  delete service;
+}
+
+void scan_service_get_stats(ScanService *service, ScanServiceStats *stats) {
+  memset(stats, 0, sizeof(ScanServiceStats));
+  dmz_stage_profile frame_latency, frame_scan;
+  memset(&frame_latency, 0, sizeof(dmz_stage_profile));
+  memset(&frame_scan, 0, sizeof(dmz_stage_profile));
+  uint64_t last_scanned_microseconds = 0;
+
+  for(int i = 0; i < service->n_workers; i++) {
+    ScanServiceWorker *worker = &service->workers[i];
+    pthread_mutex_lock(&worker->mutex);
+    stats->frames_scanned += worker->frames_scanned;
+    stats->frames_skipped += worker->frames_skipped;
+    stats->steals += worker->steals;
+    dmz_stage_profile_merge(&frame_latency, &worker->frame_latency);
+    dmz_stage_profile_merge(&frame_scan, &worker->frame_scan);
+    last_scanned_microseconds = MAX(last_scanned_microseconds, worker->last_scanned_microseconds);
+    pthread_mutex_unlock(&worker->mutex);
+  }
+  dmz_stage_profile_timing(&frame_latency, &stats->frame_latency);
+  dmz_stage_profile_timing(&frame_scan, &stats->frame_scan);
+
+  pthread_mutex_lock(&service->mutex);
+  stats->sessions_completed = service->sessions_completed;
+  dmz_stage_profile_timing(&service->session_latency, &stats->session_latency);
+  pthread_mutex_unlock(&service->mutex);
+
+  uint64_t first_frame_microseconds = service->first_frame_microseconds;
+  if(first_frame_microseconds != 0 && last_scanned_microseconds > first_frame_microseconds) {
+    stats->elapsed_seconds = (last_scanned_microseconds - first_frame_microseconds) / 1000000.0f;
+    stats->frames_per_second = stats->frames_scanned / stats->elapsed_seconds;
+  }
+}
+
+#pragma mark sessions
+
+ScanServiceSession *scan_service_session_open(ScanService *service) {
+  ScanServiceSession *session = new ScanServiceSession;
+  session->service = service;
+  pthread_mutex_init(&session->mutex, NULL);
+  pthread_cond_init(&session->done_condition, NULL);
+  session->scheduled = false;
+  session->closed = false;
+  session->done = false;
+  session->opened_microseconds = dmz_monotonic_microseconds();
+  session->dmz = dmz_context_create();
+  session->dmz->pregate_config.enabled = service->config.pregate;
+  scanner_initialize(&session->state);
+  scanner_set_number_window(&session->state, service->config.number_window);
+  session->result.complete = false;
+  session->have_result = false;
+  return session;
+}
+
+DMZ_INTERNAL uint8_t *scan_service_copy_plane(uint8_t *dest, IplImage *image) {
+  CvRect roi = cvGetImageROI(image);
+  const uint8_t *src = (const uint8_t *)image->imageData + roi.y * image->widthStep + roi.x;
+  for(int row = 0; row < roi.height; row++) {
+    memcpy(dest, src, roi.width);
+    dest += roi.width;
+    src += image->widthStep;
+  }
+  return dest;
+}
+
+bool scan_service_session_add_frame(ScanServiceSession *session, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                                    FrameOrientation orientation) {
+  CvSize size = cvGetSize(y_sample);
+  CvSize chroma_size = cvGetSize(cb_sample);
+  assert(chroma_size.width == size.width / 2 && chroma_size.height == size.height / 2);
+  assert(cvGetSize(cr_sample).width == chroma_size.width && cvGetSize(cr_sample).height == chroma_size.height);
+
+  size_t y_bytes = (size_t)size.width * size.height;
+  size_t chroma_bytes = (size_t)chroma_size.width * chroma_size.height;
+  ScanServiceFrame *frame = (ScanServiceFrame *)malloc(sizeof(ScanServiceFrame) + y_bytes + 2 * chroma_bytes);
+  if(frame == NULL) {
+    return false;
+  }
+  frame->orientation = orientation;
+  frame->width = size.width;
+  frame->height = size.height;
+  frame->data = (uint8_t *)(frame + 1);
+  uint8_t *dest = scan_service_copy_plane(frame->data, y_sample);
+  dest = scan_service_copy_plane(dest, cb_sample);
+  scan_service_copy_plane(dest, cr_sample);
+  frame->added_microseconds = dmz_monotonic_microseconds();
+
+  ScanService *service = session->service;
+  __sync_bool_compare_and_swap(&service->first_frame_microseconds, 0, frame->added_microseconds);
+
+  pthread_mutex_lock(&session->mutex);
+  if(session->closed) {
+    pthread_mutex_unlock(&session->mutex);
+    free(frame);
+    return false;
+  }
+  session->frames.push_back(frame);
+  bool schedule = !session->scheduled;
+  session->scheduled = true;
+  pthread_mutex_unlock(&session->mutex);
+
+  if(schedule) {
+    scan_service_schedule(service, session);
+  }
+  return true;
+}
+
+void scan_service_session_close(ScanServiceSession *session) {
+  pthread_mutex_lock(&session->mutex);
+  session->closed = true;
+  bool finish = !session->scheduled; // otherwise the worker finishes it once the frames run out
+  pthread_mutex_unlock(&session->mutex);
+  if(finish) {
+    scan_service_finish_session(session);
+  }
+}
+
+void scan_service_session_wait(ScanServiceSession *session, ScannerResult *result) {
+  pthread_mutex_lock(&session->mutex);
+  while(!session->done) {
+    pthread_cond_wait(&session->done_condition, &session->mutex);
+  }
+  pthread_mutex_unlock(&session->mutex);
+
+  *result = session->result;
+  pthread_cond_destroy(&session->done_condition);
+  pthread_mutex_destroy(&session->mutex);
+  delete session;
+}
+
+#endif // CYTHON_DMZ
+
+#endif // COMPILE_DMZ
@@ -0,0 +1,76 @@
+//
+//  scan_service.h
+//  See the file "LICENSE.md" for the full license governing this code.
+//
+
+#ifndef DMZ_SCAN_SCAN_SERVICE_H
+#define DMZ_SCAN_SCAN_SERVICE_H
+
+#include "scan.h"
+
+#if CYTHON_DMZ
+
+// Server-side scanning of many independent sessions (e.g. uploaded card videos) at once.
+//
+// Each session gets its own dmz_context and ScannerState, and its frames are scanned strictly
+// in the order they were added, one at a time; different sessions run in parallel on a pool
+// of worker threads, which steal queued sessions from each other when they run out.
+//
+// Typical use, from one or more feeding threads:
+//   ScanService *service = scan_service_create(&config);
+//   ScanServiceSession *session = scan_service_session_open(service);
+//   scan_service_session_add_frame(session, y, cb, cr, orientation); // ...for each frame
+//   scan_service_session_close(session);
+//   scan_service_session_wait(session, &result); // also frees the session
+//   scan_service_destroy(service);
+
+typedef struct ScanService ScanService;
+typedef struct ScanServiceSession ScanServiceSession;
+
+typedef struct {
+  int n_threads; // 0 for one per online CPU
+  bool scan_expiry;
+  bool pregate; // see dmz_pregate_config
+  bool stop_at_result; // skip a session's remaining frames once it has a complete result
+  uint8_t number_window; // see scanner_set_number_window
+} ScanServiceConfig;
+
+typedef struct {
+  uint32_t sessions_completed;
+  uint64_t frames_scanned;
+  uint64_t frames_skipped; // stop_at_result only
+  uint64_t steals; // sessions a worker took from another worker's queue
+  float elapsed_seconds; // from the first frame added to the last frame scanned
+  float frames_per_second;
+  dmz_stage_timing frame_latency; // frame added -> frame scanned, queueing included
+  dmz_stage_timing frame_scan; // scanning alone
+  dmz_stage_timing session_latency; // session opened -> result available
+} ScanServiceStats;
+
+void scan_service_default_config(ScanServiceConfig *config);
+
+// Returns NULL if no worker thread could be started.
+ScanService *scan_service_create(const ScanServiceConfig *config);
+
+// Waits for every closed session to finish; sessions must all have been closed and waited for.
+void scan_service_destroy(ScanService *service);
+
+void scan_service_get_stats(ScanService *service, ScanServiceStats *stats);
+
+ScanServiceSession *scan_service_session_open(ScanService *service);
+
+// Copies the frame (u8 planes, chroma at half size) and queues it. Never waits for scanning.
+// Returns false if the session has already been closed, or the frame could not be copied.
+bool scan_service_session_add_frame(ScanServiceSession *session, IplImage *y_sample, IplImage *cb_sample, IplImage *cr_sample,
+                                    FrameOrientation orientation);
+
+// No more frames are coming.
+void scan_service_session_close(ScanServiceSession *session);
+
+// Blocks until every frame of a closed session has been scanned, fills in the scanner's result,
+// and frees the session. Call exactly once per session.
+void scan_service_session_wait(ScanServiceSession *session, ScannerResult *result);
+
+#endif
+
+#endif